@@ -9,11 +9,42 @@ extern "C" {
 #include <stdint.h>
 #include <stdlib.h>
 
-// You may define this before building
+// You may define this before building. It sizes the nesting stack embedded in
+// the contexts, which is used by the plain init functions and whenever NULL is
+// passed as `levels`. The inits taking `levels` use a caller supplied stack of
+// any depth instead, but the embedded one still takes its space in every
+// context. Define it to 0 to leave the embedded stacks out if only caller
+// supplied stacks are used, the contexts then just point to them and NULL
+// `levels` are rejected.
 #ifndef LIGHTWEIGHT_JSON_MAX_NESTING_SIZE
 #define LIGHTWEIGHT_JSON_MAX_NESTING_SIZE 10
 #endif
 
+// Set in a nesting level if the level is an array instead of an object
+#define LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT 0x80000000u
+
+// Maximum nesting depth accepted by `lightweight_json_validate`. It costs one
+// bit of stack per level.
+#ifndef LIGHTWEIGHT_JSON_VALIDATE_MAX_DEPTH
+#define LIGHTWEIGHT_JSON_VALIDATE_MAX_DEPTH 1024
+#endif
+
+// Maximum rule path length and maximum depth of the objects / arrays
+// `lightweight_json_writer_filter` descends into, subtrees no rule reaches are
+// copied as a whole. It costs 16 bytes of stack per level.
+#ifndef LIGHTWEIGHT_JSON_FILTER_MAX_DEPTH
+#define LIGHTWEIGHT_JSON_FILTER_MAX_DEPTH 32
+#endif
+// Rules per lightweight_json_writer_filter call
+#define LIGHTWEIGHT_JSON_FILTER_MAX_RULES 64
+
+// Fields per lightweight_json_batch_compile spec
+#define LIGHTWEIGHT_JSON_BATCH_MAX_FIELDS 64
+
+// Reader flag: validate the whole document once during init, the getters then
+// skip their per character checks
+#define LIGHTWEIGHT_JSON_READER_FLAG_VALIDATE (1u << 0)
+
 typedef enum {
   LIGHTWEIGHT_JSON_OBJECT,
   LIGHTWEIGHT_JSON_ARRAY,
@@ -21,6 +52,15 @@ typedef enum {
   LIGHTWEIGHT_JSON_NONE
 } lightweight_json_type_e;
 
+// Output format of a writer, see lightweight_json_writer_set_format
+typedef enum {
+  LIGHTWEIGHT_JSON_FORMAT_JSON,
+  // CBOR (RFC 8949)
+  LIGHTWEIGHT_JSON_FORMAT_CBOR,
+  // MessagePack
+  LIGHTWEIGHT_JSON_FORMAT_MSGPACK,
+} lightweight_json_format_e;
+
 typedef enum {
   LIGHTWEIGHT_JSON_ERR_NONE,
   LIGHTWEIGHT_JSON_ERR_INVALID_ARGS,
@@ -29,6 +69,9 @@ typedef enum {
   LIGHTWEIGHT_JSON_ERR_NOT_FOUND,
   LIGHTWEIGHT_JSON_ERR_INVALID_JSON,
   LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE,
+  LIGHTWEIGHT_JSON_ERR_NOT_SUPPORTED,
+  LIGHTWEIGHT_JSON_ERR_NO_MEM,
+  LIGHTWEIGHT_JSON_ERR_BUFFER_TOO_SMALL,
 } lightweight_json_err_t;
 
 /**
@@ -41,26 +84,424 @@ typedef enum {
  */
 typedef void (*flush_cb_t)(char *buffer, size_t amount, void *userdata);
 
+/**
+ * @brief Allocator of the dynamic writer mode, realloc() like
+ *
+ * @param[in] ptr The current buffer, NULL for the first allocation
+ * @param[in] old_size The size of `ptr`
+ * @param[in] new_size The requested size, 0 to free `ptr`
+ * @param[in] userdata The userdata passed when the context was initialized
+ * @return The new buffer or NULL on failure (`ptr` stays valid then)
+ */
+typedef void *(*lightweight_json_realloc_cb_t)(void *ptr, size_t old_size,
+                                               size_t new_size,
+                                               void *userdata);
+
+/**
+ * @brief One nesting level of the writer.
+ *        Bit 31 (`LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT`) marks an array, bits 0..30
+ * hold the amount of elements written into the object / array so far.
+ *        The binary formats use two entries per level, the second one holds
+ * the announced size or the position of the header to patch.
+ */
+typedef uint32_t lightweight_json_writer_level_t;
+
+/**
+ * @brief One nesting level of the reader.
+ *        The binary formats use two entries per level, the second one holds
+ * the amount of array elements left.
+ */
+typedef struct {
+  // Offset of the '{' / '[' in the buffer, bit 31
+  // (`LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT`) marks an array
+  uint32_t offset;
+  // Offset of the current array element, relative to the '['
+  uint32_t suboffset;
+} lightweight_json_reader_level_t;
+
+// Public calls, used by the instrumentation counters and the call hook
+typedef enum {
+  LIGHTWEIGHT_JSON_API_READER_KEY_EXISTS,
+  LIGHTWEIGHT_JSON_API_READER_GET_STRING,
+  LIGHTWEIGHT_JSON_API_READER_GET_UINT64,
+  LIGHTWEIGHT_JSON_API_READER_GET_INT64,
+  LIGHTWEIGHT_JSON_API_READER_GET_DOUBLE,
+  LIGHTWEIGHT_JSON_API_READER_GET_BOOL,
+  LIGHTWEIGHT_JSON_API_READER_ENTER,
+  LIGHTWEIGHT_JSON_API_READER_LEAVE,
+  LIGHTWEIGHT_JSON_API_READER_ARRAY_NEXT,
+  LIGHTWEIGHT_JSON_API_WRITER_BEGIN,
+  LIGHTWEIGHT_JSON_API_WRITER_END,
+  LIGHTWEIGHT_JSON_API_WRITER_ADD_STRING,
+  LIGHTWEIGHT_JSON_API_WRITER_ADD_DOUBLE,
+  LIGHTWEIGHT_JSON_API_WRITER_ADD_UINT64,
+  LIGHTWEIGHT_JSON_API_WRITER_ADD_INT64,
+  LIGHTWEIGHT_JSON_API_WRITER_ADD_BOOL,
+  LIGHTWEIGHT_JSON_API_WRITER_FLUSH,
+  // Everything not listed above
+  LIGHTWEIGHT_JSON_API_OTHER,
+  LIGHTWEIGHT_JSON_API_COUNT
+} lightweight_json_api_e;
+
+/**
+ * @brief Hook called when a public call is entered and when it returns, e.g.
+ * for timing. Only available when built with `LIGHTWEIGHT_JSON_ENABLE_STATS`.
+ *
+ * @param[in] api The call
+ * @param[in] enter true when the call is entered, false when it returns
+ * @param[in] userdata The userdata passed when the hook was set
+ */
+typedef void (*lightweight_json_call_hook_t)(lightweight_json_api_e api,
+                                             bool enter, void *userdata);
+
+typedef struct {
+  // Calls per public call
+  uint64_t calls[LIGHTWEIGHT_JSON_API_COUNT];
+  // Bytes of the document scanned per public call
+  uint64_t bytes_scanned[LIGHTWEIGHT_JSON_API_COUNT];
+  // Key lookups, every keyed call scans the current object for its key
+  uint64_t lookups;
+  // Nested objects / arrays stepped over while looking for a key or the next
+  // array element
+  uint64_t subtrees_skipped;
+  // Deepest nesting level entered
+  uint32_t max_depth;
+} lightweight_json_reader_stats_t;
+
+typedef struct {
+  // Calls per public call
+  uint64_t calls[LIGHTWEIGHT_JSON_API_COUNT];
+  // Bytes written, including the ones still waiting in the buffer
+  uint64_t bytes_written;
+  // Bytes passed to the flush callback
+  uint64_t bytes_flushed;
+  uint64_t flush_calls;
+  // bytes_flushed / flush_calls
+  uint64_t average_flush_size;
+  // Characters which had to be escaped
+  uint64_t escapes;
+} lightweight_json_writer_stats_t;
+
 typedef struct {
   char *buffer;
   size_t buffer_size;
   flush_cb_t flush_cb;
+  // Set in dynamic mode, the buffer grows instead of being flushed
+  lightweight_json_realloc_cb_t realloc_cb;
+  // Set in counting mode, nothing is written, `counted` sums up the output
+  // size instead
+  bool counting;
+  size_t counted;
+  // Sticky error of the dynamic mode, of the binary formats and of a broken
+  // transcode
+  lightweight_json_err_t error;
+  lightweight_json_format_e format;
   int offset;
   int nesting;
-  int objects_in_object[LIGHTWEIGHT_JSON_MAX_NESTING_SIZE];
-  lightweight_json_type_e object_type[LIGHTWEIGHT_JSON_MAX_NESTING_SIZE];
+  int max_nesting;
+  // Level the context started in and may not end, -1 or 0 for fragments
+  int base_nesting;
+  // Caller supplied nesting stack, NULL if `default_levels` is used
+  lightweight_json_writer_level_t *levels;
+#if LIGHTWEIGHT_JSON_MAX_NESTING_SIZE > 0
+  lightweight_json_writer_level_t
+      default_levels[LIGHTWEIGHT_JSON_MAX_NESTING_SIZE];
+#endif
   void *userdata;
+#ifdef LIGHTWEIGHT_JSON_ENABLE_STATS
+  lightweight_json_writer_stats_t stats;
+  lightweight_json_api_e current_api;
+  lightweight_json_call_hook_t call_hook;
+  void *call_hook_userdata;
+#endif
 } lightweight_json_writer_ctx_t;
 
+/**
+ * @brief A piece of output serialized separately, e.g. on another thread, and
+ * spliced into its parent writer afterwards
+ */
+typedef struct {
+  // The fragment's buffer, holds the serialized elements once finished
+  char *data;
+  size_t size;
+  // Elements written into the parent's object / array
+  uint32_t elements;
+  lightweight_json_type_e parent_type;
+  bool finished;
+  bool overflow;
+} lightweight_json_fragment_t;
+
+/**
+ * @brief Serialized form of one value, reused until the data it was
+ * serialized from changes
+ */
+typedef struct {
+  char *buffer;
+  size_t buffer_size;
+  // Length of the serialized value in `buffer`
+  size_t size;
+  // Version of the source data `buffer` holds, only meaningful if `valid`
+  uint64_t version;
+  bool valid;
+  // Nesting stack the value is serialized with, NULL for the embedded one
+  lightweight_json_writer_level_t *levels;
+  size_t max_nesting;
+} lightweight_json_cache_entry_t;
+
+typedef enum {
+  LIGHTWEIGHT_JSON_SLOT_STRING,
+  LIGHTWEIGHT_JSON_SLOT_DOUBLE,
+  LIGHTWEIGHT_JSON_SLOT_UINT64,
+  LIGHTWEIGHT_JSON_SLOT_INT64,
+  LIGHTWEIGHT_JSON_SLOT_BOOL,
+} lightweight_json_slot_type_e;
+
+/**
+ * @brief A placeholder in a template, filled in on every emission
+ */
+typedef struct {
+  // Offset into the skeleton the value gets inserted at
+  uint32_t offset;
+  lightweight_json_slot_type_e type;
+} lightweight_json_template_slot_t;
+
+/**
+ * @brief Value for a slot, the member matching the slot's type is used
+ */
+typedef union {
+  const char *string;
+  double f64;
+  uint64_t u64;
+  int64_t i64;
+  bool boolean;
+} lightweight_json_slot_value_t;
+
+/**
+ * @brief A message recorded once, consisting of a constant skeleton and the
+ * slots the changing values are inserted into
+ */
+typedef struct {
+  // The constant parts of the message, back to back
+  char *skeleton;
+  size_t skeleton_size;
+  lightweight_json_template_slot_t *slots;
+  size_t max_slots;
+  size_t slot_count;
+  // Used while recording
+  lightweight_json_fragment_t fragment;
+} lightweight_json_template_t;
+
+/**
+ * @brief Serializes the value of a cache entry
+ *        Has to write exactly one value without a key, e.g. begin(ctx, NULL,
+ * LIGHTWEIGHT_JSON_OBJECT), the members, end(ctx).
+ *
+ * @param[in] ctx The writer to serialize into
+ * @param[in] userdata The userdata passed to lightweight_json_writer_add_cached
+ */
+typedef lightweight_json_err_t (*lightweight_json_serialize_cb_t)(
+    lightweight_json_writer_ctx_t *ctx, void *userdata);
+
+typedef enum {
+  LIGHTWEIGHT_JSON_VALUE_NULL,
+  LIGHTWEIGHT_JSON_VALUE_BOOL,
+  LIGHTWEIGHT_JSON_VALUE_INT64,
+  LIGHTWEIGHT_JSON_VALUE_UINT64,
+  LIGHTWEIGHT_JSON_VALUE_DOUBLE,
+  LIGHTWEIGHT_JSON_VALUE_STRING,
+  LIGHTWEIGHT_JSON_VALUE_OBJECT,
+  LIGHTWEIGHT_JSON_VALUE_ARRAY,
+} lightweight_json_value_type_e;
+
+typedef enum {
+  // Keep the value. Once there is an include rule, only what is on the path
+  // of one is kept.
+  LIGHTWEIGHT_JSON_FILTER_INCLUDE,
+  // Drop the member
+  LIGHTWEIGHT_JSON_FILTER_EXCLUDE,
+  // Write `replacement` instead of the member's value
+  LIGHTWEIGHT_JSON_FILTER_REPLACE,
+} lightweight_json_filter_action_e;
+
+/**
+ * @brief A rule of lightweight_json_writer_filter
+ */
+typedef struct {
+  lightweight_json_filter_action_e action;
+  // Dot separated keys from the root, e.g. "user.password". "*" matches any
+  // key. Arrays don't add a segment, "items.token" is the token of every
+  // object in the items array. Keys are compared as they appear in the
+  // document, i.e. still escaped.
+  const char *path;
+  // Pre-serialized JSON value for LIGHTWEIGHT_JSON_FILTER_REPLACE, e.g.
+  // "\"***\"", written as it is
+  const char *replacement;
+} lightweight_json_filter_rule_t;
+
+/**
+ * @brief A value of any type, see lightweight_json_reader_get_value
+ */
+typedef struct {
+  lightweight_json_value_type_e type;
+  union {
+    bool boolean;
+    // Negative integers
+    int64_t i64;
+    // Non-negative integers
+    uint64_t u64;
+    // Numbers with a fraction / exponent and integers out of 64 bit range
+    double f64;
+    // Points into the reader's buffer, not null terminated and still escaped,
+    // see lightweight_json_unescape
+    struct {
+      const char *data;
+      size_t len;
+    } string;
+  } as;
+  // Offset of the value in the reader's buffer, behind any CBOR tags
+  size_t offset;
+} lightweight_json_value_t;
+
+/**
+ * @brief A value lightweight_json_batch_parse extracts from every message
+ */
+typedef struct {
+  // Member of the message's root object, compared as it appears in the
+  // document, i.e. still escaped
+  const char *key;
+  // LIGHTWEIGHT_JSON_VALUE_STRING, _UINT64, _INT64, _DOUBLE or _BOOL.
+  // Doubles accept any number, int64 any integer in range.
+  lightweight_json_value_type_e type;
+  // Where the value goes in the output struct, e.g. offsetof(msg_t, temp)
+  size_t offset;
+  // Strings: the size of the char array at `offset`, terminator included
+  size_t size;
+} lightweight_json_batch_field_t;
+
+/**
+ * @brief Fields compiled by lightweight_json_batch_compile
+ */
+typedef struct {
+  const lightweight_json_batch_field_t *fields;
+  size_t field_count;
+  uint16_t key_lengths[LIGHTWEIGHT_JSON_BATCH_MAX_FIELDS];
+  // Open addressing table from a key's length / first / last character to
+  // field index + 1
+  uint8_t slots[2 * LIGHTWEIGHT_JSON_BATCH_MAX_FIELDS];
+  // One bit per field
+  uint64_t all;
+} lightweight_json_batch_spec_t;
+
+typedef struct {
+  const char *data;
+  size_t size;
+} lightweight_json_batch_message_t;
+
+typedef struct {
+  // Bit i is set if field i was found and stored
+  uint64_t found;
+  // LIGHTWEIGHT_JSON_ERR_INVALID_JSON if the message is malformed, `found`
+  // holds what was stored before the error
+  lightweight_json_err_t err;
+} lightweight_json_batch_result_t;
+
+/**
+ * @brief Bracket match index entry: offsets of a '{' / '[' and of its closing
+ * '}' / ']'
+ */
+typedef struct {
+  uint32_t open;
+  uint32_t close;
+} lightweight_json_index_entry_t;
+
+/**
+ * @brief A validated, read-only document which any number of reader contexts
+ * (cursors) on any number of threads can share
+ */
 typedef struct {
   const char *buffer;
   size_t buffer_size;
+  // [Optional] one entry per object / array, sorted by `open`
+  lightweight_json_index_entry_t *index;
+  size_t index_size;
+} lightweight_json_document_t;
+
+/**
+ * @brief Element offsets of one array, see
+ * lightweight_json_reader_set_array_table
+ */
+typedef struct {
+  // [Optional] caller supplied storage, entry k is the `suboffset` of element
+  // k * stride
+  uint32_t *entries;
+  size_t capacity;
+  size_t size;
+  // Doubles whenever the entries run out, so any array fits
+  size_t stride;
+  // Offset + 1 of the '[' the table describes, 0 if it is not built yet
+  uint32_t owner;
+  // Elements of that array
+  uint32_t length;
+  // Nesting level of that array
   int nesting;
-  size_t current_offset[LIGHTWEIGHT_JSON_MAX_NESTING_SIZE];
-  size_t current_suboffset[LIGHTWEIGHT_JSON_MAX_NESTING_SIZE];
-  lightweight_json_type_e object_type[LIGHTWEIGHT_JSON_MAX_NESTING_SIZE];
+} lightweight_json_reader_array_table_t;
+
+typedef struct {
+  const char *buffer;
+  size_t buffer_size;
+  int nesting;
+  int max_nesting;
+  // Caller supplied nesting stack, NULL if `default_levels` is used
+  lightweight_json_reader_level_t *levels;
+#if LIGHTWEIGHT_JSON_MAX_NESTING_SIZE > 0
+  lightweight_json_reader_level_t
+      default_levels[LIGHTWEIGHT_JSON_MAX_NESTING_SIZE];
+#endif
+  // LIGHTWEIGHT_JSON_READER_FLAG_*
+  uint32_t flags;
+  // The shared document this context reads from, NULL if none
+  const lightweight_json_document_t *document;
+  lightweight_json_format_e format;
+  lightweight_json_reader_array_table_t array_table;
+#ifdef LIGHTWEIGHT_JSON_ENABLE_STATS
+  lightweight_json_reader_stats_t stats;
+  lightweight_json_api_e current_api;
+  lightweight_json_call_hook_t call_hook;
+  void *call_hook_userdata;
+#endif
 } lightweight_json_reader_ctx_t;
 
+/**
+ * @brief One piece of a document that is split across buffers, e.g. one
+ * iovec / mbuf of a received message
+ */
+typedef struct {
+  const char *data;
+  size_t size;
+} lightweight_json_segment_t;
+
+/**
+ * @brief Reader over a document split into segments, read in place without
+ * joining them into one buffer first
+ */
+typedef struct {
+  const lightweight_json_segment_t *segments;
+  size_t segment_count;
+  // Sum of the segment sizes, offsets below are offsets in the document
+  size_t size;
+  // Segment of the last access and the offset of its first byte
+  size_t segment;
+  size_t segment_start;
+  int nesting;
+  int max_nesting;
+  // Caller supplied nesting stack, NULL if `default_levels` is used
+  lightweight_json_reader_level_t *levels;
+#if LIGHTWEIGHT_JSON_MAX_NESTING_SIZE > 0
+  lightweight_json_reader_level_t
+      default_levels[LIGHTWEIGHT_JSON_MAX_NESTING_SIZE];
+#endif
+} lightweight_json_segment_reader_ctx_t;
+
 /**
  * @brief Initialize the given context
  *
@@ -76,17 +517,272 @@ lightweight_json_writer_init(char *buffer, size_t buffer_size,
                              flush_cb_t flush_cb, void *userdata,
                              lightweight_json_writer_ctx_t *ctx);
 
+/**
+ * @brief Initialize the given context with a caller supplied nesting stack
+ *        The stack has to outlive the context, the context itself may still
+ * be copied around freely.
+ *
+ * @param[in] buffer The char buffer to stream to, must be at least size 2
+ * @param[in] buffer_size The char buffer size, must be >= 2
+ * @param[in] flush_cb The flush callback to use
+ * @param[in] userdata [Optional] Userdata that gets passed to the flush
+callback
+ * @param[in] levels The nesting stack, one entry per nesting level. May be
+ * NULL to use the embedded stack
+ * @param[in] max_nesting The amount of entries in `levels`, must be >= 1 (and
+ * <= LIGHTWEIGHT_JSON_MAX_NESTING_SIZE without `levels`)
+ * @param[in] ctx The context to initialize
+ */
+lightweight_json_err_t lightweight_json_writer_init_with_stack(
+    char *buffer, size_t buffer_size, flush_cb_t flush_cb, void *userdata,
+    lightweight_json_writer_level_t *levels, size_t max_nesting,
+    lightweight_json_writer_ctx_t *ctx);
+
+/**
+ * @brief Initialize the given context in dynamic mode: the output is kept in
+ * memory in a buffer which grows geometrically, there is no flush callback.
+ * Fetch the result with lightweight_json_writer_take_buffer.
+ *
+ * @param[in] initial_size The initial buffer size, must be >= 2
+ * @param[in] realloc_cb [Optional] the allocator, NULL to use realloc / free
+ * @param[in] userdata [Optional] Userdata that gets passed to the allocator
+ * @param[in] levels [Optional] The nesting stack, see
+ * lightweight_json_writer_init_with_stack
+ * @param[in] max_nesting The amount of entries in `levels`
+ * @param[in] ctx The context to initialize
+ * @return LIGHTWEIGHT_JSON_ERR_NO_MEM if the initial allocation failed
+ */
+lightweight_json_err_t
+lightweight_json_writer_init_dynamic(size_t initial_size,
+                                     lightweight_json_realloc_cb_t realloc_cb,
+                                     void *userdata,
+                                     lightweight_json_writer_level_t *levels,
+                                     size_t max_nesting,
+                                     lightweight_json_writer_ctx_t *ctx);
+
+/**
+ * @brief Take the output of a dynamic mode context. The caller owns the buffer
+ * afterwards (free() it, or release it through your allocator), the context
+ * must not be used anymore.
+ *
+ * @param[in] ctx The context
+ * @param[in] shrink Shrink the buffer to the exact output size
+ * @param[out] out_buffer The null terminated output
+ * @param[out] out_len [Optional] The output length without the terminator
+ * @return LIGHTWEIGHT_JSON_ERR_NO_MEM if growing the buffer failed at some
+ * point, the buffer is freed then
+ */
+lightweight_json_err_t
+lightweight_json_writer_take_buffer(lightweight_json_writer_ctx_t *ctx,
+                                    bool shrink, char **out_buffer,
+                                    size_t *out_len);
+
+/**
+ * @brief Initialize the given context in counting mode: the same call
+ * sequence as for a real writer only computes the size of the output, without
+ * writing or flushing anything, e.g. for a Content-Length header or an exact
+ * allocation. Fetch it with lightweight_json_writer_get_counted_size.
+ *
+ * @param[in] levels [Optional] The nesting stack, NULL to use the embedded one
+ * @param[in] max_nesting The amount of entries in `levels`, must be >= 1 (and
+ * <= LIGHTWEIGHT_JSON_MAX_NESTING_SIZE without `levels`). Give it the same
+ * depth as the writer producing the real output.
+ * @param[in] ctx The context to initialize
+ */
+lightweight_json_err_t
+lightweight_json_writer_init_counting(lightweight_json_writer_level_t *levels,
+                                      size_t max_nesting,
+                                      lightweight_json_writer_ctx_t *ctx);
+
+/**
+ * @brief Get the size the output of a counting mode context has so far
+ *
+ * @param[in] ctx The context
+ * @param[out] out_size The size in bytes, what a real writer flushes in total
+ * @return the sticky error of a binary format, as lightweight_json_writer_flush
+ * does
+ */
+lightweight_json_err_t
+lightweight_json_writer_get_counted_size(lightweight_json_writer_ctx_t *ctx,
+                                         size_t *out_size);
+
+/**
+ * @brief Switch the output format of a freshly initialized context
+ *        The same begin / add / end calls then emit CBOR or MessagePack.
+ * Numbers are written in binary, doubles always as 64 bit floats. The binary
+ * formats use two stack entries per nesting level, so the maximum nesting is
+ * halved.
+ *        CBOR objects / arrays are written with an indefinite length.
+ * MessagePack has none, the element count in the header is patched when the
+ * object / array ends. That only works while the header is still in the buffer,
+ * either use a dynamic mode context, a buffer large enough for the whole
+ * object / array, or lightweight_json_writer_begin_sized.
+ *
+ * @param[in] ctx The context, nothing may have been written yet
+ * @param[in] format The format
+ */
+lightweight_json_err_t
+lightweight_json_writer_set_format(lightweight_json_writer_ctx_t *ctx,
+                                   lightweight_json_format_e format);
+
 /**
  * @brief Initialize the given reader context
  *
  * @param[in] buffer the string to parse
- * @param[in] buffer_size the buffer size
+ * @param[in] buffer_size the buffer size, must be < 2GiB
  * @param[in] ctx the context to initialize
  */
 lightweight_json_err_t
 lightweight_json_reader_init(const char *buffer, size_t buffer_size,
                              lightweight_json_reader_ctx_t *ctx);
 
+/**
+ * @brief Initialize the given reader context with a caller supplied nesting
+ * stack
+ *        The stack has to outlive the context, the context itself may still
+ * be copied around freely.
+ *
+ * @param[in] buffer the string to parse
+ * @param[in] buffer_size the buffer size, must be < 2GiB
+ * @param[in] levels the nesting stack, one entry per nesting level. May be
+ * NULL to use the embedded stack
+ * @param[in] max_nesting the amount of entries in `levels`, must be >= 1
+ * @param[in] ctx the context to initialize
+ */
+lightweight_json_err_t lightweight_json_reader_init_with_stack(
+    const char *buffer, size_t buffer_size,
+    lightweight_json_reader_level_t *levels, size_t max_nesting,
+    lightweight_json_reader_ctx_t *ctx);
+
+/**
+ * @brief Initialize the given reader context with flags
+ *        With `LIGHTWEIGHT_JSON_READER_FLAG_VALIDATE` the whole document is
+ * validated once up front and init fails if it isn't valid JSON. The getters
+ * then jump from value to value instead of checking every character. The
+ * buffer must not be modified while the context is in use.
+ *
+ * @param[in] buffer the string to parse
+ * @param[in] buffer_size the buffer size, must be < 2GiB
+ * @param[in] levels the nesting stack, NULL to use the embedded stack
+ * @param[in] max_nesting the amount of entries in `levels`, must be >= 1
+ * @param[in] flags LIGHTWEIGHT_JSON_READER_FLAG_* or 0
+ * @param[in] ctx the context to initialize
+ */
+lightweight_json_err_t lightweight_json_reader_init_ex(
+    const char *buffer, size_t buffer_size,
+    lightweight_json_reader_level_t *levels, size_t max_nesting,
+    uint32_t flags, lightweight_json_reader_ctx_t *ctx);
+
+/**
+ * @brief Minify `buffer` in place, then initialize the reader context on it
+ * like lightweight_json_reader_init_ex. Meant for pretty printed documents
+ * that are read many times, every later scan skips less whitespace.
+ *
+ * @param[in] buffer the string to parse, gets minified
+ * @param[in] buffer_size the buffer size, must be < 2GiB. The context's
+ * buffer_size is the minified size afterwards.
+ * @param[in] levels the nesting stack, NULL to use the embedded stack
+ * @param[in] max_nesting the amount of entries in `levels`, must be >= 1
+ * @param[in] flags LIGHTWEIGHT_JSON_READER_FLAG_* or 0
+ * @param[in] ctx the context to initialize
+ * @return LIGHTWEIGHT_JSON_ERR_INVALID_JSON if a string isn't terminated
+ */
+lightweight_json_err_t lightweight_json_reader_init_minify(
+    char *buffer, size_t buffer_size, lightweight_json_reader_level_t *levels,
+    size_t max_nesting, uint32_t flags, lightweight_json_reader_ctx_t *ctx);
+
+/**
+ * @brief Initialize the given reader context for a CBOR or MessagePack buffer
+ *        The getters, enter / leave and array_next work as for JSON. Strings
+ * are returned as they are (there are no escapes), binary strings are read as
+ * strings too. Integers aren't converted from floats, doubles are converted
+ * from any number. The binary formats use two stack entries per nesting
+ * level, so the maximum nesting is halved. Indefinite length strings, CBOR
+ * simple values other than false / true / null / undefined and MessagePack
+ * extension types are not supported.
+ *
+ * @param[in] buffer the encoded document, the root has to be a map or array
+ * @param[in] buffer_size the buffer size, must be < 2GiB
+ * @param[in] format the buffer's format, LIGHTWEIGHT_JSON_FORMAT_JSON works
+ * like lightweight_json_reader_init_with_stack
+ * @param[in] levels the nesting stack, NULL to use the embedded stack
+ * @param[in] max_nesting the amount of entries in `levels`, must be >= 2 for
+ * the binary formats
+ * @param[in] ctx the context to initialize
+ * @return LIGHTWEIGHT_JSON_ERR_INVALID_JSON if the root is malformed
+ */
+lightweight_json_err_t lightweight_json_reader_init_format(
+    const char *buffer, size_t buffer_size, lightweight_json_format_e format,
+    lightweight_json_reader_level_t *levels, size_t max_nesting,
+    lightweight_json_reader_ctx_t *ctx);
+
+/**
+ * @brief Validate a document once so it can be shared by several reader
+ * contexts, see lightweight_json_reader_init_document.
+ *        The document may be read from any number of threads at the same time,
+ * neither it nor the buffer may be modified afterwards.
+ *
+ * @param[in] buffer the JSON string, the root has to be an object or array
+ * @param[in] buffer_size the buffer size, must be < 2GiB
+ * @param[in] index [Optional] storage for the bracket match index, which lets
+ * readers skip nested objects / arrays without scanning them
+ * @param[in] index_capacity the amount of entries in `index`. One entry per
+ * object / array in the document is needed
+ * @param[out] doc the document to initialize
+ * @return LIGHTWEIGHT_JSON_ERR_BUFFER_TOO_SMALL if the index can't hold all
+ * objects / arrays
+ */
+lightweight_json_err_t
+lightweight_json_document_init(const char *buffer, size_t buffer_size,
+                               lightweight_json_index_entry_t *index,
+                               size_t index_capacity,
+                               lightweight_json_document_t *doc);
+
+/**
+ * @brief Initialize a reader context (cursor) on a shared document, without
+ * validating it again. The context only holds the position, copy it to save
+ * and restore a position (when using the embedded stack).
+ *
+ * @param[in] doc the document, has to outlive the context
+ * @param[in] levels the nesting stack, NULL to use the embedded stack
+ * @param[in] max_nesting the amount of entries in `levels`, must be >= 1
+ * @param[in] ctx the context to initialize
+ */
+lightweight_json_err_t lightweight_json_reader_init_document(
+    const lightweight_json_document_t *doc,
+    lightweight_json_reader_level_t *levels, size_t max_nesting,
+    lightweight_json_reader_ctx_t *ctx);
+
+/**
+ * @brief Check that the buffer holds exactly one valid JSON value (RFC 8259),
+ * optionally surrounded by whitespace. Strings must be valid UTF-8.
+ *
+ * @param[in] buffer the string to check
+ * @param[in] buffer_size the buffer size
+ * @return LIGHTWEIGHT_JSON_ERR_NONE if valid, LIGHTWEIGHT_JSON_ERR_INVALID_JSON
+ * if not, LIGHTWEIGHT_JSON_ERR_MAX_NESTING_REACHED if nested deeper than
+ * LIGHTWEIGHT_JSON_VALIDATE_MAX_DEPTH
+ */
+lightweight_json_err_t lightweight_json_validate(const char *buffer,
+                                                 size_t buffer_size);
+
+/**
+ * @brief Remove the whitespace between tokens, whitespace inside strings is
+ * kept. The document isn't validated otherwise.
+ *
+ * @param[in] buffer the JSON string
+ * @param[in] buffer_size the buffer size
+ * @param[out] out the output buffer, may be `buffer` itself to minify in place
+ * but must not overlap it otherwise
+ * @param[in] out_size the size of `out`, must be >= buffer_size
+ * @param[out] out_len the length of the minified document
+ * @return LIGHTWEIGHT_JSON_ERR_INVALID_JSON if a string isn't terminated
+ */
+lightweight_json_err_t lightweight_json_minify(const char *buffer,
+                                               size_t buffer_size, char *out,
+                                               size_t out_size,
+                                               size_t *out_len);
+
 /**
  * @brief Check if the given key exists in the current object the reader is in
  *
@@ -100,19 +796,59 @@ lightweight_json_reader_key_exists(lightweight_json_reader_ctx_t *ctx,
 /**
  * @brief Get a string from the value of key or from the current array position
  *        NOTE: The string gets written into the given buffer and will be null
- * terminated
+ * terminated. Escape sequences are decoded, \uXXXX (including surrogate
+ * pairs) to UTF-8. Unpaired surrogates become U+FFFD.
  *
  * @param[in] ctx the context
  * @param[in] key [Optional] the key to look for, leave NULL to use the current
  * array position instead
  * @param[in] buffer Buffer to write the value into
  * @param[in] buffer_len the buffer size
+ * @return LIGHTWEIGHT_JSON_ERR_BUFFER_TOO_SMALL if the decoded string and its
+ * terminator don't fit, `buffer` is left empty then
  */
 lightweight_json_err_t
 lightweight_json_reader_get_string(lightweight_json_reader_ctx_t *ctx,
                                    const char *key, char *buffer,
                                    size_t buffer_len);
 
+/**
+ * @brief Like lightweight_json_reader_get_string, additionally reports the
+ * decoded length
+ *
+ * @param[in] ctx the context
+ * @param[in] key [Optional] the key to look for, leave NULL to use the current
+ * array position instead
+ * @param[in] buffer Buffer to write the value into
+ * @param[in] buffer_len the buffer size
+ * @param[out] out_len [Optional] the decoded length without the terminator,
+ * also set on LIGHTWEIGHT_JSON_ERR_BUFFER_TOO_SMALL so the caller can retry
+ * with a buffer of at least `*out_len + 1` bytes
+ */
+lightweight_json_err_t lightweight_json_reader_get_string_len(
+    lightweight_json_reader_ctx_t *ctx, const char *key, char *buffer,
+    size_t buffer_len, size_t *out_len);
+
+/**
+ * @brief Decode a base64 string (standard alphabet, padding optional) from the
+ * value of key or from the current array position straight into `buffer`.
+ * The binary formats return byte strings as they are and decode text strings.
+ *
+ * @param[in] ctx the context
+ * @param[in] key [Optional] the key to look for, leave NULL to use the current
+ * array position instead
+ * @param[in] buffer Buffer to write the decoded bytes into, not terminated
+ * @param[in] buffer_len the buffer size
+ * @param[out] out_len the decoded length, also set on
+ * LIGHTWEIGHT_JSON_ERR_BUFFER_TOO_SMALL so the caller can retry
+ * @return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE if the value is not a string
+ * or not valid base64
+ */
+lightweight_json_err_t
+lightweight_json_reader_get_base64(lightweight_json_reader_ctx_t *ctx,
+                                   const char *key, uint8_t *buffer,
+                                   size_t buffer_len, size_t *out_len);
+
 /**
  * @brief Get a uint64 from the value of key or from the current array position
  *
@@ -161,6 +897,191 @@ lightweight_json_err_t
 lightweight_json_reader_get_bool(lightweight_json_reader_ctx_t *ctx,
                                  const char *key, bool *out_value);
 
+/**
+ * @brief Get the value of key or from the current array position, whatever its
+ * type, with a single lookup
+ *        Numbers are returned as uint64 if non-negative integers, int64 if
+ * negative integers and as double otherwise (or if they don't fit).
+ *
+ * @param[in] ctx the context
+ * @param[in] key [Optional] the key to look for, leave NULL to use the current
+ * array position instead
+ * @param[out] out_value The read value
+ */
+lightweight_json_err_t
+lightweight_json_reader_get_value(lightweight_json_reader_ctx_t *ctx,
+                                  const char *key,
+                                  lightweight_json_value_t *out_value);
+
+/**
+ * @brief lightweight_json_reader_get_value with a key of known length, which
+ * doesn't have to be null terminated
+ *
+ * @param[in] ctx the context
+ * @param[in] key [Optional] the key to look for, leave NULL to use the current
+ * array position instead
+ * @param[in] key_len The length of `key`
+ * @param[out] out_value The read value
+ */
+lightweight_json_err_t
+lightweight_json_reader_get_value_n(lightweight_json_reader_ctx_t *ctx,
+                                    const char *key, size_t key_len,
+                                    lightweight_json_value_t *out_value);
+
+/**
+ * @brief Get the type of the value of key or of the current array position
+ *
+ * @param[in] ctx the context
+ * @param[in] key [Optional] the key to look for, leave NULL to use the current
+ * array position instead
+ * @param[out] out_type The value's type
+ */
+lightweight_json_err_t
+lightweight_json_reader_get_type(lightweight_json_reader_ctx_t *ctx,
+                                 const char *key,
+                                 lightweight_json_value_type_e *out_type);
+
+/**
+ * @brief Enter an object / array returned by lightweight_json_reader_get_value
+ * without looking it up again. The reader must still be in the object / array
+ * the value was fetched from.
+ *
+ * @param[in] ctx the context
+ * @param[in] value the object / array value
+ */
+lightweight_json_err_t
+lightweight_json_reader_enter_value(lightweight_json_reader_ctx_t *ctx,
+                                    const lightweight_json_value_t *value);
+
+/**
+ * @brief Decode the escape sequences of a string, e.g. of a string value view.
+ * Works like lightweight_json_reader_get_string_len.
+ *
+ * @param[in] data the string content without quotes
+ * @param[in] len the length of `data`
+ * @param[in] buffer Buffer to write the decoded string into
+ * @param[in] buffer_len the buffer size
+ * @param[out] out_len [Optional] the decoded length without the terminator
+ */
+lightweight_json_err_t lightweight_json_unescape(const char *data, size_t len,
+                                                 char *buffer,
+                                                 size_t buffer_len,
+                                                 size_t *out_len);
+
+/**
+ * @brief Compile the fields to extract from many small messages
+ *
+ * @param[in] fields the fields, have to outlive the spec. At most
+ * LIGHTWEIGHT_JSON_BATCH_MAX_FIELDS, keys must be unique.
+ * @param[in] field_count the amount of fields
+ * @param[out] spec the spec to initialize
+ */
+lightweight_json_err_t
+lightweight_json_batch_compile(const lightweight_json_batch_field_t *fields,
+                               size_t field_count,
+                               lightweight_json_batch_spec_t *spec);
+
+/**
+ * @brief Extract the spec's fields from every message into an array of
+ * structs. Each message's root object is walked once, member by member, and
+ * stops as soon as every field was found, so the rest of the message isn't
+ * checked. Fields which are missing or of another type are left untouched,
+ * strings which don't fit their array are stored empty and not marked found.
+ * There is no per message setup, the messages ahead are prefetched.
+ *
+ * @param[in] spec the compiled fields
+ * @param[in] messages the messages, JSON objects
+ * @param[in] count the amount of messages
+ * @param[out] out the first struct, message i goes to `out` + i * `stride`
+ * @param[in] stride the size of a struct
+ * @param[out] results one result per message
+ */
+lightweight_json_err_t
+lightweight_json_batch_parse(const lightweight_json_batch_spec_t *spec,
+                             const lightweight_json_batch_message_t *messages,
+                             size_t count, void *out, size_t stride,
+                             lightweight_json_batch_result_t *results);
+
+/**
+ * @brief Initialize a reader over a document split into segments
+ *        Navigates like a reader initialized without validation, across
+ * segment boundaries. Nothing is copied, except for values which are split by
+ * a boundary: numbers, and escape sequences of strings, are joined when they
+ * are extracted. The segments have to outlive the context.
+ *
+ * @param[in] segments the document's pieces in order, empty ones are skipped
+ * @param[in] segment_count the amount of segments
+ * @param[in] levels [Optional] caller supplied nesting stack
+ * @param[in] max_nesting the amount of entries in `levels`, must be >= 1
+ * @param[in] ctx the context to initialize
+ *
+ * @return `LIGHTWEIGHT_JSON_ERR_INVALID_ARGS` if the document is >= 2GiB or
+ * has no root object / array
+ */
+lightweight_json_err_t lightweight_json_segment_reader_init(
+    const lightweight_json_segment_t *segments, size_t segment_count,
+    lightweight_json_reader_level_t *levels, size_t max_nesting,
+    lightweight_json_segment_reader_ctx_t *ctx);
+
+/**
+ * @brief See lightweight_json_reader_key_exists
+ */
+lightweight_json_err_t lightweight_json_segment_reader_key_exists(
+    lightweight_json_segment_reader_ctx_t *ctx, const char *key);
+
+/**
+ * @brief See lightweight_json_reader_get_string_len
+ */
+lightweight_json_err_t lightweight_json_segment_reader_get_string(
+    lightweight_json_segment_reader_ctx_t *ctx, const char *key, char *buffer,
+    size_t buffer_len, size_t *out_len);
+
+/**
+ * @brief See lightweight_json_reader_get_uint64
+ */
+lightweight_json_err_t lightweight_json_segment_reader_get_uint64(
+    lightweight_json_segment_reader_ctx_t *ctx, const char *key,
+    uint64_t *out_value);
+
+/**
+ * @brief See lightweight_json_reader_get_int64
+ */
+lightweight_json_err_t lightweight_json_segment_reader_get_int64(
+    lightweight_json_segment_reader_ctx_t *ctx, const char *key,
+    int64_t *out_value);
+
+/**
+ * @brief See lightweight_json_reader_get_double
+ */
+lightweight_json_err_t lightweight_json_segment_reader_get_double(
+    lightweight_json_segment_reader_ctx_t *ctx, const char *key,
+    double *out_value);
+
+/**
+ * @brief See lightweight_json_reader_get_bool
+ */
+lightweight_json_err_t lightweight_json_segment_reader_get_bool(
+    lightweight_json_segment_reader_ctx_t *ctx, const char *key,
+    bool *out_value);
+
+/**
+ * @brief See lightweight_json_reader_enter
+ */
+lightweight_json_err_t lightweight_json_segment_reader_enter(
+    lightweight_json_segment_reader_ctx_t *ctx, const char *key);
+
+/**
+ * @brief See lightweight_json_reader_leave
+ */
+lightweight_json_err_t lightweight_json_segment_reader_leave(
+    lightweight_json_segment_reader_ctx_t *ctx);
+
+/**
+ * @brief See lightweight_json_reader_array_next
+ */
+lightweight_json_err_t lightweight_json_segment_reader_array_next(
+    lightweight_json_segment_reader_ctx_t *ctx);
+
 /**
  * @brief Enter a child object / array by key or from the current array position
  *
@@ -188,6 +1109,51 @@ lightweight_json_reader_leave(lightweight_json_reader_ctx_t *ctx);
 lightweight_json_err_t
 lightweight_json_reader_array_next(lightweight_json_reader_ctx_t *ctx);
 
+/**
+ * @brief Give the context storage for the element offsets of
+ * lightweight_json_reader_array_length / _array_at. Call it after init.
+ *        The table is built on the first call for an array and kept while
+ * the reader is inside that array. Arrays nested in its elements go without
+ * one: array_at steps to the element from the first one, array_length counts
+ * the elements on every call. Another array replaces it. With `capacity`
+ * >= the array's length every element is one jump away, with less only every
+ * n-th element is stored and up to n - 1 elements are stepped over. Without a
+ * table the length is still cached, but array_at steps from the first
+ * element. 4 bytes per entry.
+ *
+ * @param[in] ctx the context, JSON only
+ * @param[in] entries [Optional] the storage, NULL to drop the table
+ * @param[in] capacity the amount of entries
+ */
+lightweight_json_err_t
+lightweight_json_reader_set_array_table(lightweight_json_reader_ctx_t *ctx,
+                                        uint32_t *entries, size_t capacity);
+
+/**
+ * @brief Get the amount of elements of the current array
+ *
+ * @param[in] ctx the context
+ * @param[out] out_length the amount of elements
+ * @return LIGHTWEIGHT_JSON_ERR_INVALID_STATE if not inside an array,
+ * LIGHTWEIGHT_JSON_ERR_NOT_SUPPORTED for the binary formats
+ */
+lightweight_json_err_t
+lightweight_json_reader_array_length(lightweight_json_reader_ctx_t *ctx,
+                                     size_t *out_length);
+
+/**
+ * @brief Move to element `index` of the current array, forwards or backwards.
+ * The getters with a NULL key and lightweight_json_reader_array_next continue
+ * from there.
+ *
+ * @param[in] ctx the context
+ * @param[in] index the element, starting at 0
+ * @return LIGHTWEIGHT_JSON_ERR_NOT_FOUND if `index` >= the array's length
+ */
+lightweight_json_err_t
+lightweight_json_reader_array_at(lightweight_json_reader_ctx_t *ctx,
+                                 size_t index);
+
 /**
  * @brief Begin a new object ('{') or array ('[')
  *
@@ -202,6 +1168,25 @@ lightweight_json_writer_begin(lightweight_json_writer_ctx_t *ctx,
                               const char *const key,
                               lightweight_json_type_e type);
 
+/**
+ * @brief Begin a new object or array of a known size
+ *        The binary formats write the size into the header instead of
+ * patching it / terminating the object or array, so this works with any buffer
+ * size. JSON output is the same as with lightweight_json_writer_begin.
+ *
+ * @param[in] ctx The context
+ * @param[in] key [Optional] The key to use
+ * @param[in] type The type to begin
+ * @param[in] size The amount of elements which will be added
+ * @return `LIGHTWEIGHT_JSON_ERR_NONE` on success. lightweight_json_writer_end
+ * of a binary format returns LIGHTWEIGHT_JSON_ERR_INVALID_STATE if a different
+ * amount was added.
+ */
+lightweight_json_err_t
+lightweight_json_writer_begin_sized(lightweight_json_writer_ctx_t *ctx,
+                                    const char *const key,
+                                    lightweight_json_type_e type, size_t size);
+
 /**
  * @brief End the current object or array
  *
@@ -273,6 +1258,32 @@ lightweight_json_err_t
 lightweight_json_writer_add_bool(lightweight_json_writer_ctx_t *ctx,
                                  const char *const key, bool value);
 
+/**
+ * @brief Add a null
+ *
+ * @param[in] ctx The context
+ * @param[in] key [Optional] key to use
+ * @return `LIGHTWEIGHT_JSON_ERR_NONE` on success
+ */
+lightweight_json_err_t
+lightweight_json_writer_add_null(lightweight_json_writer_ctx_t *ctx,
+                                 const char *const key);
+
+/**
+ * @brief Add binary data as a base64 string (standard alphabet, padded),
+ * encoded straight into the buffer. The binary formats write a byte string.
+ *
+ * @param[in] ctx The context
+ * @param[in] key [Optional] key to use
+ * @param[in] data The bytes to add, may be NULL if `len` is 0
+ * @param[in] len The amount of bytes
+ * @return `LIGHTWEIGHT_JSON_ERR_NONE` on success
+ */
+lightweight_json_err_t
+lightweight_json_writer_add_base64(lightweight_json_writer_ctx_t *ctx,
+                                   const char *const key, const uint8_t *data,
+                                   size_t len);
+
 /**
  * @brief Flush the buffer manually, used for when example your object is done
  * but the buffer didn't get filled up completely in the end.
@@ -284,6 +1295,332 @@ lightweight_json_writer_add_bool(lightweight_json_writer_ctx_t *ctx,
 lightweight_json_err_t
 lightweight_json_writer_flush(lightweight_json_writer_ctx_t *ctx);
 
+/**
+ * @brief Add pre-serialized JSON verbatim as one value
+ *        The JSON is not checked, it has to be exactly one valid value. For
+ * the binary formats it has to be one encoded value of the writer's format.
+ *
+ * @param[in] ctx The context
+ * @param[in] key The key, NULL when inside an array
+ * @param[in] json The serialized value
+ * @param[in] len The length of `json`
+ */
+lightweight_json_err_t
+lightweight_json_writer_add_raw(lightweight_json_writer_ctx_t *ctx,
+                                const char *const key, const char *json,
+                                size_t len);
+
+/**
+ * @brief Add a JSON document with members dropped, kept or replaced by path
+ * rules, as one value
+ *        Everything no rule reaches is copied byte for byte into the buffer,
+ * strings aren't unescaped and numbers aren't parsed, only the objects /
+ * arrays on the way to a rule are walked. The document has to be valid JSON,
+ * e.g. checked with lightweight_json_validate, copied parts are not checked
+ * again. An exclude rule wins over a replace rule, a replace rule over an
+ * include rule, with include rules a scalar document is left out. Only works
+ * for JSON output. If the input turns out to be broken after parts of it went
+ * out, the context drops back to its nesting level and the error sticks for
+ * flush.
+ *
+ * @param[in] ctx The context
+ * @param[in] key The key, NULL when inside an array or for the root
+ * @param[in] data The document
+ * @param[in] size The size of `data`
+ * @param[in] rules The rules, at most LIGHTWEIGHT_JSON_FILTER_MAX_RULES
+ * @param[in] rule_count The amount of rules, 0 copies the document
+ *
+ * @return `LIGHTWEIGHT_JSON_ERR_NONE` on success,
+ * `LIGHTWEIGHT_JSON_ERR_INVALID_JSON` if `data` is malformed,
+ * `LIGHTWEIGHT_JSON_ERR_NOT_SUPPORTED` for a binary format writer
+ */
+lightweight_json_err_t lightweight_json_writer_filter(
+    lightweight_json_writer_ctx_t *ctx, const char *const key,
+    const char *data, size_t size, const lightweight_json_filter_rule_t *rules,
+    size_t rule_count);
+
+/**
+ * @brief Add a value of any type, e.g. one returned by
+ * lightweight_json_reader_get_value
+ *        Strings are raw bytes and get escaped, doubles are written with full
+ * precision. An object / array only begins a level, close it with
+ * lightweight_json_writer_end.
+ *
+ * @param[in] ctx The context
+ * @param[in] key The key, NULL when inside an array or for the root
+ * @param[in] key_len The length of `key`, which doesn't have to be null
+ * terminated
+ * @param[in] value The value to add
+ */
+lightweight_json_err_t
+lightweight_json_writer_add_value(lightweight_json_writer_ctx_t *ctx,
+                                  const char *key, size_t key_len,
+                                  const lightweight_json_value_t *value);
+
+/**
+ * @brief Convert the document in `data` to the writer's format and add it as
+ * one value, in a single pass with no intermediate tree
+ *        Every item goes out as soon as it is read, so with a flush_cb the
+ * memory stays at the buffer and stack size no matter how large the document
+ * is. E.g. JSON to CBOR: a writer with LIGHTWEIGHT_JSON_FORMAT_CBOR and
+ * `format` JSON, CBOR to JSON: a plain writer and `format` CBOR. JSON input is
+ * validated on the way, binary input is bounds checked. Doubles are written
+ * with full precision, NaN / infinity become null in JSON. MessagePack output
+ * patches the counts, so it needs the document to stay in the buffer.
+ *        If the input turns out to be broken after parts of it went out, the
+ * context drops back to its nesting level and the error sticks for flush.
+ *
+ * @param[in] ctx The context
+ * @param[in] key The key, NULL when inside an array or for the root
+ * @param[in] data The document, the root may be any value unless it is also
+ * the writer's root
+ * @param[in] size The size of `data`
+ * @param[in] format The format of `data`
+ *
+ * @return `LIGHTWEIGHT_JSON_ERR_NONE` on success,
+ * `LIGHTWEIGHT_JSON_ERR_INVALID_JSON` if `data` is malformed,
+ * `LIGHTWEIGHT_JSON_ERR_NOT_SUPPORTED` for binary items JSON has no
+ * counterpart for (e.g. non string map keys)
+ */
+lightweight_json_err_t
+lightweight_json_writer_transcode(lightweight_json_writer_ctx_t *ctx,
+                                  const char *const key, const char *data,
+                                  size_t size,
+                                  lightweight_json_format_e format);
+
+/**
+ * @brief Initialize a cache entry, it starts out empty
+ *
+ * @param[in] buffer Storage for the serialized value
+ * @param[in] buffer_size The buffer size, has to be larger than the value
+ * @param[in] levels [Optional] The nesting stack the value is serialized with,
+ * NULL to use the one embedded into the serializing writer
+ * @param[in] max_nesting The amount of entries in `levels`, like for
+ * lightweight_json_fragment_init. The value itself takes the second level.
+ * @param[out] entry The entry to initialize
+ */
+lightweight_json_err_t
+lightweight_json_cache_init(char *buffer, size_t buffer_size,
+                            lightweight_json_writer_level_t *levels,
+                            size_t max_nesting,
+                            lightweight_json_cache_entry_t *entry);
+
+/**
+ * @brief Add a value through a cache entry
+ *        If the entry holds `version` its bytes are added with
+ * lightweight_json_writer_add_raw. Otherwise `serialize_cb` serializes the
+ * value into the entry first.
+ *
+ * @param[in] ctx The context
+ * @param[in] key The key, NULL when inside an array
+ * @param[in] entry The cache entry
+ * @param[in] version Version of the source data, change it whenever the data
+ * changes
+ * @param[in] serialize_cb Serializes the value on a cache miss
+ * @param[in] userdata [Optional] passed to `serialize_cb`
+ * @return LIGHTWEIGHT_JSON_ERR_BUFFER_TOO_SMALL if the value doesn't fit into
+ * the entry, nothing is added then
+ */
+lightweight_json_err_t lightweight_json_writer_add_cached(
+    lightweight_json_writer_ctx_t *ctx, const char *const key,
+    lightweight_json_cache_entry_t *entry, uint64_t version,
+    lightweight_json_serialize_cb_t serialize_cb, void *userdata);
+
+// --- Templates ---
+// A message whose shape doesn't change can be recorded once: begin, add the
+// constant fields and a slot for every changing field, end and finish. Each
+// emission then copies the constant spans and only formats the slot values.
+
+/**
+ * @brief Start recording a template
+ *        `ctx` is a writer recording into the skeleton, use it like any other
+ * writer and lightweight_json_template_add_slot for the changing fields. The
+ * template must not move until it is finished.
+ *
+ * @param[in] skeleton Storage for the constant parts, has to be larger than
+ * them
+ * @param[in] skeleton_size The skeleton size, must be >= 2
+ * @param[in] slots Storage for the slots
+ * @param[in] max_slots The amount of entries in `slots`
+ * @param[in] levels [Optional] The recording writer's nesting stack, NULL to
+ * use the embedded one
+ * @param[in] max_nesting The amount of entries in `levels`, must be >= 2. The
+ * first entry is taken by the level the message is recorded into.
+ * @param[out] tmpl The template to initialize
+ * @param[out] ctx The recording writer to initialize
+ */
+lightweight_json_err_t lightweight_json_template_init(
+    char *skeleton, size_t skeleton_size,
+    lightweight_json_template_slot_t *slots, size_t max_slots,
+    lightweight_json_writer_level_t *levels, size_t max_nesting,
+    lightweight_json_template_t *tmpl, lightweight_json_writer_ctx_t *ctx);
+
+/**
+ * @brief Record a slot, i.e. a field whose value is passed on emission
+ *
+ * @param[in] ctx The recording writer
+ * @param[in] key The key, NULL when inside an array
+ * @param[in] type The type of the values
+ * @param[in] tmpl The template being recorded
+ * @return LIGHTWEIGHT_JSON_ERR_BUFFER_TOO_SMALL if there are no slots left
+ */
+lightweight_json_err_t
+lightweight_json_template_add_slot(lightweight_json_writer_ctx_t *ctx,
+                                   const char *const key,
+                                   lightweight_json_slot_type_e type,
+                                   lightweight_json_template_t *tmpl);
+
+/**
+ * @brief Finish recording, exactly one value has to have been recorded
+ *
+ * @param[in] tmpl The template
+ * @param[in] ctx The recording writer
+ * @return LIGHTWEIGHT_JSON_ERR_BUFFER_TOO_SMALL if the skeleton overflowed
+ */
+lightweight_json_err_t
+lightweight_json_template_finish(lightweight_json_template_t *tmpl,
+                                 lightweight_json_writer_ctx_t *ctx);
+
+/**
+ * @brief Emit a template with the given slot values
+ *        With nothing begun the template is written as a document of its own,
+ * otherwise it is added as a value of the current object / array.
+ *
+ * @param[in] ctx The context
+ * @param[in] key The key, NULL when inside an array or at the top level
+ * @param[in] tmpl The finished template
+ * @param[in] values One value per slot, in recording order
+ * @return LIGHTWEIGHT_JSON_ERR_NOT_SUPPORTED for the binary formats, templates
+ * are recorded as JSON
+ */
+lightweight_json_err_t lightweight_json_writer_add_template(
+    lightweight_json_writer_ctx_t *ctx, const char *const key,
+    const lightweight_json_template_t *tmpl,
+    const lightweight_json_slot_value_t *values);
+
+// --- Fragments ---
+// Independent parts of an object / array can be serialized concurrently: create
+// one fragment writer per part from the parent writer, fill them on any
+// thread, then splice them into the parent in order. A fragment writer is used
+// like the parent at its current position (keys inside objects, none inside
+// arrays) and commas between the fragments are added by the splice.
+
+/**
+ * @brief Initialize a fragment writer continuing at the parent's current
+ * object / array
+ *        The parent is only read, so several fragments may be created from it.
+ * The fragment must not move until it got spliced.
+ *
+ * @param[in] parent The writer the fragment will be spliced into, must have
+ * begun an object / array
+ * @param[in] buffer The fragment's buffer, has to be larger than the whole
+ * fragment
+ * @param[in] buffer_size The buffer size, must be >= 2
+ * @param[in] levels [Optional] The fragment writer's nesting stack, NULL to use
+ * the embedded one. Its first level is the parent's current object / array.
+ * @param[in] max_nesting The amount of entries in `levels`, like for
+ * lightweight_json_writer_init_with_stack (the binary formats take two per
+ * level)
+ * @param[out] fragment The fragment to initialize
+ * @param[out] ctx The writer context to initialize, writes into the fragment
+ * @return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS if the stack can't hold the
+ * parent's level
+ */
+lightweight_json_err_t
+lightweight_json_fragment_init(const lightweight_json_writer_ctx_t *parent,
+                               char *buffer, size_t buffer_size,
+                               lightweight_json_writer_level_t *levels,
+                               size_t max_nesting,
+                               lightweight_json_fragment_t *fragment,
+                               lightweight_json_writer_ctx_t *ctx);
+
+/**
+ * @brief Finish writing a fragment, everything begun in it must be ended
+ *
+ * @param[in] fragment The fragment
+ * @param[in] ctx The fragment's writer context
+ * @return LIGHTWEIGHT_JSON_ERR_BUFFER_TOO_SMALL if the buffer overflowed
+ */
+lightweight_json_err_t
+lightweight_json_fragment_finish(lightweight_json_fragment_t *fragment,
+                                 lightweight_json_writer_ctx_t *ctx);
+
+/**
+ * @brief Copy a finished fragment into the writer's output
+ *
+ * @param[in] ctx The parent writer, at the same object / array as when the
+ * fragment was created
+ * @param[in] fragment The finished fragment
+ */
+lightweight_json_err_t
+lightweight_json_writer_splice(lightweight_json_writer_ctx_t *ctx,
+                               const lightweight_json_fragment_t *fragment);
+
+// --- Instrumentation ---
+// Only available when built with `LIGHTWEIGHT_JSON_ENABLE_STATS` defined (the
+// CMake option of the same name), otherwise these return
+// `LIGHTWEIGHT_JSON_ERR_NOT_SUPPORTED` and the contexts carry no counters.
+
+/**
+ * @brief Get the reader's counters
+ *
+ * @param[in] ctx the context
+ * @param[out] out_stats the counters
+ */
+lightweight_json_err_t
+lightweight_json_reader_get_stats(const lightweight_json_reader_ctx_t *ctx,
+                                  lightweight_json_reader_stats_t *out_stats);
+
+/**
+ * @brief Reset the reader's counters
+ *
+ * @param[in] ctx the context
+ */
+lightweight_json_err_t
+lightweight_json_reader_reset_stats(lightweight_json_reader_ctx_t *ctx);
+
+/**
+ * @brief Set the hook called around every public reader call
+ *
+ * @param[in] ctx the context
+ * @param[in] hook [Optional] the hook, NULL to remove it
+ * @param[in] userdata [Optional] userdata passed to the hook
+ */
+lightweight_json_err_t
+lightweight_json_reader_set_call_hook(lightweight_json_reader_ctx_t *ctx,
+                                      lightweight_json_call_hook_t hook,
+                                      void *userdata);
+
+/**
+ * @brief Get the writer's counters
+ *
+ * @param[in] ctx The context
+ * @param[out] out_stats The counters
+ */
+lightweight_json_err_t
+lightweight_json_writer_get_stats(const lightweight_json_writer_ctx_t *ctx,
+                                  lightweight_json_writer_stats_t *out_stats);
+
+/**
+ * @brief Reset the writer's counters
+ *
+ * @param[in] ctx The context
+ */
+lightweight_json_err_t
+lightweight_json_writer_reset_stats(lightweight_json_writer_ctx_t *ctx);
+
+/**
+ * @brief Set the hook called around every public writer call
+ *
+ * @param[in] ctx The context
+ * @param[in] hook [Optional] The hook, NULL to remove it
+ * @param[in] userdata [Optional] Userdata passed to the hook
+ */
+lightweight_json_err_t
+lightweight_json_writer_set_call_hook(lightweight_json_writer_ctx_t *ctx,
+                                      lightweight_json_call_hook_t hook,
+                                      void *userdata);
+
 // --- Helper defines ---
 // These expect the context to be a static value called "ctx" in the current
 // scope
@@ -0,0 +1,550 @@
+#ifndef LIGHTWEIGHT_JSON_HPP
+#define LIGHTWEIGHT_JSON_HPP
+
+// Header-only C++17 wrapper around the C API. Nothing is allocated or thrown
+// that the C API wouldn't allocate / report itself: errors come back as
+// result<T> / lightweight_json_err_t, keys carry their length so the library
+// never runs strlen on them. With C++20 coroutines, reader::items /
+// reader::elements iterate arrays lazily in a range-based for loop.
+
+#include "lightweight_json.h"
+
+#include <cstdlib>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#include <exception>
+#include <iterator>
+#define LIGHTWEIGHT_JSON_HAVE_COROUTINES
+#endif
+
+namespace lightweight_json {
+
+using err = lightweight_json_err_t;
+using value = lightweight_json_value_t;
+using format = lightweight_json_format_e;
+
+/**
+ * @brief A key and its length, computed at compile time for literals
+ */
+class key {
+public:
+  constexpr key(const char *data)
+      : data_(data), size_(std::char_traits<char>::length(data)) {}
+  constexpr key(std::string_view view)
+      : data_(view.data()), size_(view.size()) {}
+  key(const std::string &str) : data_(str.data()), size_(str.size()) {}
+
+  constexpr const char *data() const { return data_; }
+  constexpr size_t size() const { return size_; }
+
+private:
+  const char *data_;
+  size_t size_;
+};
+
+namespace literals {
+constexpr key operator""_key(const char *data, size_t size) {
+  return key(std::string_view(data, size));
+}
+} // namespace literals
+
+/**
+ * @brief A value or the error why there is none
+ */
+template <typename T> class result {
+public:
+  result(T value)
+      : value_(std::move(value)), error_(LIGHTWEIGHT_JSON_ERR_NONE) {}
+  result(err error) : value_(), error_(error) {}
+
+  explicit operator bool() const { return LIGHTWEIGHT_JSON_ERR_NONE == error_; }
+  err error() const { return error_; }
+  // Only meaningful if there's no error
+  const T &value() const { return value_; }
+  const T &operator*() const { return value_; }
+  const T *operator->() const { return &value_; }
+  T value_or(T fallback) const { return *this ? value_ : fallback; }
+
+private:
+  T value_;
+  err error_;
+};
+
+#ifdef LIGHTWEIGHT_JSON_HAVE_COROUTINES
+/**
+ * @brief Lazily produced sequence for a range-based for loop, see
+ * reader::items / reader::elements
+ *        Every element is produced when the loop asks for it and referenced,
+ * not copied, so memory stays constant however long the sequence is.
+ */
+template <typename T> class generator {
+public:
+  struct promise_type {
+    T *current = nullptr;
+
+    generator get_return_object() {
+      return generator(
+          std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    // The yielded object lives in the coroutine frame until it resumes
+    std::suspend_always yield_value(T &value) noexcept {
+      current = std::addressof(value);
+      return {};
+    }
+    std::suspend_always yield_value(T &&value) noexcept {
+      current = std::addressof(value);
+      return {};
+    }
+    void return_void() noexcept {}
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  class iterator {
+  public:
+    explicit iterator(std::coroutine_handle<promise_type> handle)
+        : handle_(handle) {}
+    T &operator*() const { return *handle_.promise().current; }
+    iterator &operator++() {
+      handle_.resume();
+      return *this;
+    }
+    bool operator!=(std::default_sentinel_t) const { return !handle_.done(); }
+
+  private:
+    std::coroutine_handle<promise_type> handle_;
+  };
+
+  generator(const generator &) = delete;
+  generator &operator=(const generator &) = delete;
+  generator(generator &&other) noexcept
+      : handle_(std::exchange(other.handle_, nullptr)) {}
+  generator &operator=(generator &&) = delete;
+  ~generator() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  // Can only be iterated once
+  iterator begin() {
+    handle_.resume();
+    return iterator(handle_);
+  }
+  std::default_sentinel_t end() { return {}; }
+
+private:
+  explicit generator(std::coroutine_handle<promise_type> handle)
+      : handle_(handle) {}
+
+  std::coroutine_handle<promise_type> handle_;
+};
+#endif
+
+/**
+ * @brief Reader of a JSON / CBOR / MessagePack document
+ *        The document (and `levels`, if given) has to outlive the reader.
+ * Getters take a key inside objects and no key for the current array element.
+ */
+class reader {
+public:
+  explicit reader(std::string_view doc,
+                  format fmt = LIGHTWEIGHT_JSON_FORMAT_JSON,
+                  uint32_t flags = 0,
+                  lightweight_json_reader_level_t *levels = nullptr,
+                  size_t max_nesting = LIGHTWEIGHT_JSON_MAX_NESTING_SIZE) {
+    init_error_ =
+        LIGHTWEIGHT_JSON_FORMAT_JSON == fmt
+            ? lightweight_json_reader_init_ex(doc.data(), doc.size(), levels,
+                                              max_nesting, flags, &ctx_)
+            : lightweight_json_reader_init_format(
+                  doc.data(), doc.size(), fmt, levels, max_nesting, &ctx_);
+  }
+  reader(const reader &) = delete;
+  reader &operator=(const reader &) = delete;
+  reader(reader &&) = default;
+  reader &operator=(reader &&) = default;
+
+  // Why the constructor failed, LIGHTWEIGHT_JSON_ERR_NONE if it didn't
+  err init_error() const { return init_error_; }
+
+  template <typename T> result<T> get(key k) {
+    return convert<T>(get_value(k.data(), k.size()));
+  }
+  template <typename T> result<T> get() {
+    return convert<T>(get_value(nullptr, 0));
+  }
+
+  bool contains(key k) {
+    return static_cast<bool>(get_value(k.data(), k.size()));
+  }
+
+  err enter(key k) { return enter_value(get_value(k.data(), k.size())); }
+  err enter() { return enter_value(get_value(nullptr, 0)); }
+  err leave() { return checked(lightweight_json_reader_leave(&ctx_)); }
+  // Step to the next array element
+  err next() { return checked(lightweight_json_reader_array_next(&ctx_)); }
+
+#ifdef LIGHTWEIGHT_JSON_HAVE_COROUTINES
+  /**
+   * @brief Enter the array `k` and yield its elements converted to T, one
+   * per loop iteration
+   *        The reader is back in the parent once the loop ends, also on an
+   * early break. An error (e.g. the wrong type) is yielded once and ends the
+   * sequence. The reader must not be used otherwise while iterating.
+   */
+  template <typename T> generator<result<T>> items(key k) {
+    // Entered right away, so `k` doesn't have to outlive the call
+    return walk_items<T>(enter(k));
+  }
+  // Same for the array at the current array position
+  template <typename T> generator<result<T>> items() {
+    return walk_items<T>(enter());
+  }
+
+  /**
+   * @brief Enter the array `k` and yield the reader itself positioned at each
+   * element, e.g. to enter an object element and read several keys
+   *        Whatever gets entered inside of the loop body has to be left again
+   * before the next iteration. Yields nothing if the array can't be entered.
+   */
+  generator<reader> elements(key k) { return walk_elements(enter(k)); }
+  generator<reader> elements() { return walk_elements(enter()); }
+#endif
+
+  lightweight_json_reader_ctx_t *c_ctx() { return &ctx_; }
+
+private:
+  err checked(err error) const {
+    return LIGHTWEIGHT_JSON_ERR_NONE != init_error_ ? init_error_ : error;
+  }
+
+#ifdef LIGHTWEIGHT_JSON_HAVE_COROUTINES
+  // Leaves the array when the sequence ends or gets destroyed early
+  struct leave_guard {
+    reader *r;
+    ~leave_guard() { r->leave(); }
+  };
+
+  template <typename T> generator<result<T>> walk_items(err entered) {
+    if (LIGHTWEIGHT_JSON_ERR_NONE != entered) {
+      co_yield result<T>(entered);
+      co_return;
+    }
+    const leave_guard guard{this};
+    for (;;) {
+      result<T> item = get<T>();
+      if (LIGHTWEIGHT_JSON_ERR_NOT_FOUND == item.error()) {
+        // Empty array
+        co_return;
+      }
+      const bool ok = static_cast<bool>(item);
+      co_yield item;
+      // array_next fails on the last element instead of reading it again
+      if (!ok || LIGHTWEIGHT_JSON_ERR_NONE != next()) {
+        co_return;
+      }
+    }
+  }
+
+  generator<reader> walk_elements(err entered) {
+    if (LIGHTWEIGHT_JSON_ERR_NONE != entered) {
+      co_return;
+    }
+    const leave_guard guard{this};
+    if (LIGHTWEIGHT_JSON_ERR_NOT_FOUND == get<value>().error()) {
+      co_return;
+    }
+    do {
+      co_yield *this;
+    } while (LIGHTWEIGHT_JSON_ERR_NONE == next());
+  }
+#endif
+
+  result<value> get_value(const char *k, size_t len) {
+    if (LIGHTWEIGHT_JSON_ERR_NONE != init_error_) {
+      return init_error_;
+    }
+    value out;
+    const err error =
+        lightweight_json_reader_get_value_n(&ctx_, k, len, &out);
+    if (LIGHTWEIGHT_JSON_ERR_NONE != error) {
+      return error;
+    }
+    return out;
+  }
+
+  err enter_value(const result<value> &v) {
+    return v ? lightweight_json_reader_enter_value(&ctx_, &*v) : v.error();
+  }
+
+  template <typename T> result<T> convert(const result<value> &v) const {
+    if (!v) {
+      return v.error();
+    }
+    if constexpr (std::is_same_v<T, value>) {
+      return *v;
+    } else if constexpr (std::is_same_v<T, bool>) {
+      if (LIGHTWEIGHT_JSON_VALUE_BOOL != v->type) {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
+      }
+      return v->as.boolean;
+    } else if constexpr (std::is_integral_v<T>) {
+      using limits = std::numeric_limits<T>;
+      if (LIGHTWEIGHT_JSON_VALUE_UINT64 == v->type) {
+        if (v->as.u64 > static_cast<uint64_t>(limits::max())) {
+          return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
+        }
+        return static_cast<T>(v->as.u64);
+      }
+      if (LIGHTWEIGHT_JSON_VALUE_INT64 == v->type) {
+        if (!limits::is_signed ||
+            v->as.i64 < static_cast<int64_t>(limits::min())) {
+          return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
+        }
+        return static_cast<T>(v->as.i64);
+      }
+      return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
+    } else if constexpr (std::is_floating_point_v<T>) {
+      switch (v->type) {
+      case LIGHTWEIGHT_JSON_VALUE_UINT64:
+        return static_cast<T>(v->as.u64);
+      case LIGHTWEIGHT_JSON_VALUE_INT64:
+        return static_cast<T>(v->as.i64);
+      case LIGHTWEIGHT_JSON_VALUE_DOUBLE:
+        return static_cast<T>(v->as.f64);
+      default:
+        return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
+      }
+    } else if constexpr (std::is_same_v<T, std::string_view>) {
+      // No copy, still escaped for JSON
+      if (LIGHTWEIGHT_JSON_VALUE_STRING != v->type) {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
+      }
+      return std::string_view(v->as.string.data, v->as.string.len);
+    } else if constexpr (std::is_same_v<T, std::string>) {
+      if (LIGHTWEIGHT_JSON_VALUE_STRING != v->type) {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
+      }
+      if (LIGHTWEIGHT_JSON_FORMAT_JSON != ctx_.format) {
+        return std::string(v->as.string.data, v->as.string.len);
+      }
+      // Unescaping never makes a string longer, +1 for the terminator
+      std::string out(v->as.string.len + 1, '\0');
+      size_t len = 0;
+      const err error = lightweight_json_unescape(
+          v->as.string.data, v->as.string.len, &out[0], out.size(), &len);
+      if (LIGHTWEIGHT_JSON_ERR_NONE != error) {
+        return error;
+      }
+      out.resize(len);
+      return out;
+    } else {
+      static_assert(!std::is_same_v<T, T>, "unsupported type for get<T>");
+    }
+  }
+
+  lightweight_json_reader_ctx_t ctx_;
+  err init_error_;
+};
+
+/**
+ * @brief Writer of JSON / CBOR / MessagePack
+ *        Either flushes a fixed buffer through a callback or collects the
+ * output in a growing buffer, see take.
+ */
+class writer {
+public:
+  struct free_deleter {
+    void operator()(char *buffer) const { std::free(buffer); }
+  };
+  // Output of a dynamic writer
+  struct buffer {
+    std::unique_ptr<char, free_deleter> data;
+    size_t size;
+    std::string_view view() const { return std::string_view(data.get(), size); }
+  };
+
+  /**
+   * `levels` (if given) has to outlive the writer, see
+   * lightweight_json_writer_init_with_stack.
+   */
+  writer(char *buf, size_t size, flush_cb_t flush_cb, void *userdata,
+         format fmt = LIGHTWEIGHT_JSON_FORMAT_JSON,
+         lightweight_json_writer_level_t *levels = nullptr,
+         size_t max_nesting = LIGHTWEIGHT_JSON_MAX_NESTING_SIZE) {
+    init_error_ = lightweight_json_writer_init_with_stack(
+        buf, size, flush_cb, userdata, levels, max_nesting, &ctx_);
+    set_format(fmt);
+  }
+  explicit writer(size_t initial_size = 256,
+                  format fmt = LIGHTWEIGHT_JSON_FORMAT_JSON,
+                  lightweight_json_writer_level_t *levels = nullptr,
+                  size_t max_nesting = LIGHTWEIGHT_JSON_MAX_NESTING_SIZE) {
+    init_error_ = lightweight_json_writer_init_dynamic(
+        initial_size, nullptr, nullptr, levels, max_nesting, &ctx_);
+    set_format(fmt);
+  }
+  writer(const writer &) = delete;
+  writer &operator=(const writer &) = delete;
+  writer(writer &&other) noexcept
+      : ctx_(other.ctx_), init_error_(other.init_error_) {
+    other.ctx_.buffer = nullptr;
+  }
+  writer &operator=(writer &&other) noexcept {
+    if (this != &other) {
+      release();
+      ctx_ = other.ctx_;
+      init_error_ = other.init_error_;
+      other.ctx_.buffer = nullptr;
+    }
+    return *this;
+  }
+  ~writer() { release(); }
+
+  err init_error() const { return init_error_; }
+
+  /**
+   * @brief Closes its object / array when it goes out of scope
+   */
+  class [[nodiscard]] scope {
+  public:
+    scope(writer &w, err error) : writer_(&w), error_(error) {}
+    scope(const scope &) = delete;
+    scope &operator=(const scope &) = delete;
+    scope(scope &&other) noexcept
+        : writer_(other.writer_), error_(other.error_) {
+      other.writer_ = nullptr;
+    }
+    scope &operator=(scope &&) = delete;
+    ~scope() {
+      if (nullptr != writer_ && LIGHTWEIGHT_JSON_ERR_NONE == error_) {
+        writer_->end();
+      }
+    }
+    // Why begin failed, the scope does nothing then
+    err error() const { return error_; }
+
+  private:
+    writer *writer_;
+    err error_;
+  };
+
+  scope object(key k) {
+    return begin(k.data(), k.size(), LIGHTWEIGHT_JSON_VALUE_OBJECT);
+  }
+  scope object() { return begin(nullptr, 0, LIGHTWEIGHT_JSON_VALUE_OBJECT); }
+  scope array(key k) {
+    return begin(k.data(), k.size(), LIGHTWEIGHT_JSON_VALUE_ARRAY);
+  }
+  scope array() { return begin(nullptr, 0, LIGHTWEIGHT_JSON_VALUE_ARRAY); }
+
+  template <typename T> err add(key k, const T &v) {
+    return add_value(k.data(), k.size(), make_value(v));
+  }
+  template <typename T> err add(const T &v) {
+    return add_value(nullptr, 0, make_value(v));
+  }
+  err add_null(key k) { return add_value(k.data(), k.size(), value{}); }
+  err add_null() { return add_value(nullptr, 0, value{}); }
+
+  err end() { return checked(lightweight_json_writer_end(&ctx_)); }
+  err flush() { return checked(lightweight_json_writer_flush(&ctx_)); }
+
+  /**
+   * @brief Take the output of a dynamic writer, the writer is done afterwards
+   */
+  result<buffer> take(bool shrink = true) {
+    if (LIGHTWEIGHT_JSON_ERR_NONE != init_error_) {
+      return init_error_;
+    }
+    char *data = nullptr;
+    size_t size = 0;
+    const err error =
+        lightweight_json_writer_take_buffer(&ctx_, shrink, &data, &size);
+    if (LIGHTWEIGHT_JSON_ERR_NONE != error) {
+      return error;
+    }
+    return buffer{std::unique_ptr<char, free_deleter>(data), size};
+  }
+
+  lightweight_json_writer_ctx_t *c_ctx() { return &ctx_; }
+
+private:
+  void set_format(format fmt) {
+    if (LIGHTWEIGHT_JSON_ERR_NONE == init_error_ &&
+        LIGHTWEIGHT_JSON_FORMAT_JSON != fmt) {
+      init_error_ = lightweight_json_writer_set_format(&ctx_, fmt);
+    }
+  }
+
+  // Free the buffer of a dynamic writer nobody took
+  void release() {
+    if (LIGHTWEIGHT_JSON_ERR_NONE == init_error_ && nullptr != ctx_.buffer &&
+        nullptr != ctx_.realloc_cb) {
+      ctx_.realloc_cb(ctx_.buffer, ctx_.buffer_size, 0, ctx_.userdata);
+      ctx_.buffer = nullptr;
+    }
+  }
+
+  err checked(err error) const {
+    return LIGHTWEIGHT_JSON_ERR_NONE != init_error_ ? init_error_ : error;
+  }
+
+  scope begin(const char *k, size_t len, lightweight_json_value_type_e type) {
+    value v{};
+    v.type = type;
+    return scope(*this, add_value(k, len, v));
+  }
+
+  err add_value(const char *k, size_t len, const value &v) {
+    return checked(lightweight_json_writer_add_value(&ctx_, k, len, &v));
+  }
+
+  template <typename T> static value make_value(const T &v) {
+    value out{};
+    if constexpr (std::is_same_v<T, value>) {
+      out = v;
+    } else if constexpr (std::is_same_v<T, bool>) {
+      out.type = LIGHTWEIGHT_JSON_VALUE_BOOL;
+      out.as.boolean = v;
+    } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+      if (v < 0) {
+        out.type = LIGHTWEIGHT_JSON_VALUE_INT64;
+        out.as.i64 = v;
+      } else {
+        out.type = LIGHTWEIGHT_JSON_VALUE_UINT64;
+        out.as.u64 = static_cast<uint64_t>(v);
+      }
+    } else if constexpr (std::is_integral_v<T>) {
+      out.type = LIGHTWEIGHT_JSON_VALUE_UINT64;
+      out.as.u64 = v;
+    } else if constexpr (std::is_floating_point_v<T>) {
+      out.type = LIGHTWEIGHT_JSON_VALUE_DOUBLE;
+      out.as.f64 = static_cast<double>(v);
+    } else if constexpr (std::is_convertible_v<const T &, std::string_view>) {
+      const std::string_view view(v);
+      out.type = LIGHTWEIGHT_JSON_VALUE_STRING;
+      out.as.string.data = view.data();
+      out.as.string.len = view.size();
+    } else {
+      static_assert(!std::is_same_v<T, T>, "unsupported type for add");
+    }
+    return out;
+  }
+
+  lightweight_json_writer_ctx_t ctx_;
+  err init_error_;
+};
+
+} // namespace lightweight_json
+
+#endif
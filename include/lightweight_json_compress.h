@@ -0,0 +1,98 @@
+#ifndef LIGHTWEIGHT_JSON_COMPRESS_H
+#define LIGHTWEIGHT_JSON_COMPRESS_H
+
+#include "lightweight_json.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdio.h>
+
+// Compression stage which sits between a writer and the final sink.
+// Initialize a compression context, then pass `lightweight_json_compress_cb`
+// as the writer's flush callback and the compression context as its userdata.
+// Every time the writer's buffer fills up it gets fed into the compressor, and
+// every time the compressor's output block fills up it gets passed on to the
+// final sink. The compression runs synchronously inside of the flush callback,
+// so the `lightweight_json_writer_add_*` call that fills the writer's buffer
+// also pays for deflating / zstd-compressing the whole buffer (and for the
+// sink). A larger writer buffer makes these stalls rarer but longer; to keep
+// them off the serialization path entirely, have the flush callback hand the
+// buffers to another thread which feeds them to `lightweight_json_compress_cb`.
+
+typedef enum {
+  // zlib format (RFC 1950), what HTTP calls "deflate"
+  LIGHTWEIGHT_JSON_COMPRESS_DEFLATE,
+  // gzip format (RFC 1952)
+  LIGHTWEIGHT_JSON_COMPRESS_GZIP,
+  // zstd frame (RFC 8878), only available when built with zstd
+  LIGHTWEIGHT_JSON_COMPRESS_ZSTD,
+} lightweight_json_compress_algo_e;
+
+typedef struct {
+  lightweight_json_compress_algo_e algo;
+  char *block;
+  size_t block_size;
+  flush_cb_t sink;
+  void *sink_userdata;
+  // First error that happened inside of the flush callback
+  lightweight_json_err_t err;
+  // zlib / zstd stream state
+  void *stream;
+} lightweight_json_compress_ctx_t;
+
+/**
+ * @brief Initialize a compression context
+ *
+ * @param[in] algo The algorithm to use
+ * @param[in] level The compression level, -1 uses the algorithm's default
+ * @param[in] block The output block buffer, full blocks are passed to `sink`
+ * @param[in] block_size The output block size, must be >= 64
+ * @param[in] sink The final sink receiving the compressed data
+ * @param[in] sink_userdata [Optional] Userdata that gets passed to the sink
+ * @param[in] ctx The context to initialize
+ *
+ * @return `LIGHTWEIGHT_JSON_ERR_NOT_SUPPORTED` if the algorithm wasn't built
+ * in, `LIGHTWEIGHT_JSON_ERR_NONE` on success
+ */
+lightweight_json_err_t
+lightweight_json_compress_init(lightweight_json_compress_algo_e algo,
+                               int level, char *block, size_t block_size,
+                               flush_cb_t sink, void *sink_userdata,
+                               lightweight_json_compress_ctx_t *ctx);
+
+/**
+ * @brief Flush callback feeding the writer's output into the compressor
+ *
+ * @param[in] buffer The writer's buffer
+ * @param[in] amount The amount of data in the buffer
+ * @param[in] userdata The `lightweight_json_compress_ctx_t`
+ */
+void lightweight_json_compress_cb(char *buffer, size_t amount, void *userdata);
+
+/**
+ * @brief Finish the compressed stream, pass the remaining data to the sink and
+ * release the stream state. Flush the writer before calling this.
+ *
+ * @param[in] ctx The context
+ *
+ * @return The first error that happened while compressing,
+ * `LIGHTWEIGHT_JSON_ERR_NONE` on success
+ */
+lightweight_json_err_t
+lightweight_json_compress_finish(lightweight_json_compress_ctx_t *ctx);
+
+/**
+ * @brief Sink writing everything into a `FILE *`
+ *
+ * @param[in] buffer The data to write
+ * @param[in] amount The amount of data
+ * @param[in] userdata The `FILE *` to write to
+ */
+void lightweight_json_file_sink(char *buffer, size_t amount, void *userdata);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,139 @@
+#ifndef LIGHTWEIGHT_JSON_NDJSON_H
+#define LIGHTWEIGHT_JSON_NDJSON_H
+
+#include "lightweight_json.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Record oriented NDJSON output shared by several threads. Every producer
+// thread serializes a record into its own buffer with a plain writer context,
+// then commits the whole record as one line into a bounded lock-free ring.
+// A single drain thread passes the lines on to the sink in commit order, so
+// lines never interleave and producers never take a lock. Needs GCC / Clang
+// atomics, the functions return `LIGHTWEIGHT_JSON_ERR_NOT_SUPPORTED`
+// otherwise.
+
+typedef enum {
+  // Drop the record and count it, producers never wait
+  LIGHTWEIGHT_JSON_NDJSON_DROP,
+  // Wait until the drain thread made room
+  LIGHTWEIGHT_JSON_NDJSON_BLOCK,
+} lightweight_json_ndjson_policy_e;
+
+/**
+ * @brief Called while a producer waits for room in the ring, e.g. to yield
+ * the thread. The producer spins if there is none.
+ */
+typedef void (*lightweight_json_wait_cb_t)(void);
+
+// Keeps the producer and the consumer position on separate cache lines
+#define LIGHTWEIGHT_JSON_NDJSON_CACHE_LINE 64
+
+typedef struct {
+  char *buffer;
+  size_t size;
+  lightweight_json_ndjson_policy_e policy;
+  lightweight_json_wait_cb_t wait_cb;
+  flush_cb_t sink;
+  void *sink_userdata;
+  // Only accessed atomically. Both positions grow forever, the offset in
+  // `buffer` is position & (size - 1).
+  char pad0[LIGHTWEIGHT_JSON_NDJSON_CACHE_LINE];
+  uint64_t write_pos;
+  // Records the DROP policy dropped
+  uint64_t dropped;
+  char pad1[LIGHTWEIGHT_JSON_NDJSON_CACHE_LINE - 2 * sizeof(uint64_t)];
+  uint64_t read_pos;
+  char pad2[LIGHTWEIGHT_JSON_NDJSON_CACHE_LINE - sizeof(uint64_t)];
+} lightweight_json_ndjson_ring_t;
+
+/**
+ * @brief A producer's record buffer, one per thread
+ *        Serialize a record with `writer` as usual, a root object / array
+ * begun and ended, then commit it.
+ */
+typedef struct {
+  lightweight_json_ndjson_ring_t *ring;
+  // The record didn't fit into the buffer
+  bool overflow;
+  lightweight_json_writer_ctx_t writer;
+} lightweight_json_ndjson_record_t;
+
+/**
+ * @brief Initialize a ring
+ *
+ * @param[in] buffer The ring's memory, 8 byte aligned
+ * @param[in] size The size of `buffer`, a power of two >= 64. A record takes
+ * its length + 1 (newline) rounded up to 8, plus 8 bytes.
+ * @param[in] policy What a producer does when the ring is full
+ * @param[in] wait_cb [Optional] Called while a producer waits with
+ * `LIGHTWEIGHT_JSON_NDJSON_BLOCK`
+ * @param[in] sink The sink receiving the lines, one call per line
+ * @param[in] sink_userdata [Optional] Userdata that gets passed to the sink
+ * @param[in] ring The ring to initialize
+ */
+lightweight_json_err_t lightweight_json_ndjson_ring_init(
+    char *buffer, size_t size, lightweight_json_ndjson_policy_e policy,
+    lightweight_json_wait_cb_t wait_cb, flush_cb_t sink, void *sink_userdata,
+    lightweight_json_ndjson_ring_t *ring);
+
+/**
+ * @brief Initialize a producer's record, the record's writer writes into
+ * `buffer`
+ *
+ * @param[in] ring The ring the records are committed to
+ * @param[in] buffer The record buffer, has to be larger than a whole record
+ * @param[in] buffer_size The size of `buffer`
+ * @param[in] levels [Optional] The nesting stack, see
+ * lightweight_json_writer_init_with_stack
+ * @param[in] max_nesting The amount of entries in `levels`
+ * @param[in] record The record to initialize
+ */
+lightweight_json_err_t
+lightweight_json_ndjson_record_init(lightweight_json_ndjson_ring_t *ring,
+                                    char *buffer, size_t buffer_size,
+                                    lightweight_json_writer_level_t *levels,
+                                    size_t max_nesting,
+                                    lightweight_json_ndjson_record_t *record);
+
+/**
+ * @brief Commit the serialized record as one line and reset the writer for
+ * the next record. Safe to call from any number of threads at once, each with
+ * its own record.
+ *
+ * @param[in] record The record, its root object / array has to be ended
+ *
+ * @return `LIGHTWEIGHT_JSON_ERR_BUFFER_TOO_SMALL` if the record didn't fit
+ * into its buffer or into the ring, `LIGHTWEIGHT_JSON_ERR_NO_MEM` if the ring
+ * was full and the record got dropped, `LIGHTWEIGHT_JSON_ERR_NONE` on success
+ */
+lightweight_json_err_t
+lightweight_json_ndjson_commit(lightweight_json_ndjson_record_t *record);
+
+/**
+ * @brief Pass every committed line to the sink and free their room. Only one
+ * thread may drain a ring.
+ *
+ * @param[in] ring The ring
+ * @param[out] out_records [Optional] The amount of lines passed to the sink
+ */
+lightweight_json_err_t
+lightweight_json_ndjson_drain(lightweight_json_ndjson_ring_t *ring,
+                              size_t *out_records);
+
+/**
+ * @brief Get the amount of records the DROP policy dropped so far
+ *
+ * @param[in] ring The ring
+ * @param[out] out_dropped The amount
+ */
+lightweight_json_err_t
+lightweight_json_ndjson_get_dropped(lightweight_json_ndjson_ring_t *ring,
+                                    uint64_t *out_dropped);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
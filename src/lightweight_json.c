@@ -1,14 +1,65 @@
 #include "lightweight_json.h"
+#include "lightweight_json_internal.h"
 #include <inttypes.h>
+#include <limits.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 
-lightweight_json_err_t
-lightweight_json_writer_init(char *buffer, size_t buffer_size,
-                             flush_cb_t flush_cb, void *userdata,
-                             lightweight_json_writer_ctx_t *ctx) {
-  if (NULL == buffer || buffer_size < 2 || NULL == flush_cb || NULL == ctx) {
+#if defined(__SSE2__) || defined(_M_X64) ||                                   \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LIGHTWEIGHT_JSON_SSE2
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#ifdef LIGHTWEIGHT_JSON_ENABLE_STATS
+// Run a public call through the call hook and account it to `_api`
+#define STATS_CALL(_ctx, _api, _call)                                          \
+  do {                                                                         \
+    if (NULL == (_ctx)) {                                                      \
+      return (_call);                                                          \
+    }                                                                          \
+    (_ctx)->stats.calls[_api]++;                                               \
+    (_ctx)->current_api = (_api);                                              \
+    if (NULL != (_ctx)->call_hook) {                                           \
+      (_ctx)->call_hook((_api), true, (_ctx)->call_hook_userdata);             \
+    }                                                                          \
+    const lightweight_json_err_t _err = (_call);                               \
+    if (NULL != (_ctx)->call_hook) {                                           \
+      (_ctx)->call_hook((_api), false, (_ctx)->call_hook_userdata);            \
+    }                                                                          \
+    (_ctx)->current_api = LIGHTWEIGHT_JSON_API_OTHER;                          \
+    return _err;                                                               \
+  } while (0)
+#define STATS_ADD(_ctx, _field, _amount) ((_ctx)->stats._field += (_amount))
+// Account scanned bytes to the public call currently running
+#define STATS_SCANNED(_ctx, _amount)                                           \
+  ((_ctx)->stats.bytes_scanned[(_ctx)->current_api] += (_amount))
+#define STATS_MAX(_ctx, _field, _value)                                        \
+  do {                                                                         \
+    if ((_ctx)->stats._field < (_value)) {                                     \
+      (_ctx)->stats._field = (_value);                                         \
+    }                                                                          \
+  } while (0)
+#else
+#define STATS_CALL(_ctx, _api, _call) return (_call)
+#define STATS_ADD(_ctx, _field, _amount) ((void)0)
+// Still uses `_amount`, so offsets only kept for it aren't unused
+#define STATS_SCANNED(_ctx, _amount) ((void)(_amount))
+#define STATS_MAX(_ctx, _field, _value) ((void)0)
+#endif
+
+lightweight_json_err_t lightweight_json_writer_init_with_stack(
+    char *buffer, size_t buffer_size, flush_cb_t flush_cb, void *userdata,
+    lightweight_json_writer_level_t *levels, size_t max_nesting,
+    lightweight_json_writer_ctx_t *ctx) {
+  if (NULL == buffer || buffer_size < 2 || NULL == flush_cb || NULL == ctx ||
+      0 == max_nesting || max_nesting > INT32_MAX ||
+      (NULL == levels && max_nesting > LIGHTWEIGHT_JSON_MAX_NESTING_SIZE)) {
     return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
   }
   lightweight_json_writer_ctx_t c = {
@@ -17,30 +68,393 @@ lightweight_json_writer_init(char *buffer, size_t buffer_size,
       .flush_cb = flush_cb,
       .offset = 0,
       .nesting = -1,
-      .objects_in_object = {0},
-      .object_type = {0},
+      .max_nesting = (int)max_nesting,
+      .base_nesting = -1,
+      .levels = levels,
       .userdata = userdata,
+#ifdef LIGHTWEIGHT_JSON_ENABLE_STATS
+      .current_api = LIGHTWEIGHT_JSON_API_OTHER,
+#endif
+  };
+  *ctx = c;
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+lightweight_json_err_t
+lightweight_json_writer_init(char *buffer, size_t buffer_size,
+                             flush_cb_t flush_cb, void *userdata,
+                             lightweight_json_writer_ctx_t *ctx) {
+  if (NULL == buffer || buffer_size < 2 || NULL == flush_cb || NULL == ctx) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  // NULL levels -> the stack embedded into the context is used
+  return lightweight_json_writer_init_with_stack(
+      buffer, buffer_size, flush_cb, userdata, NULL,
+      LIGHTWEIGHT_JSON_MAX_NESTING_SIZE, ctx);
+}
+
+static void *default_realloc(void *ptr, size_t old_size, size_t new_size,
+                             void *userdata) {
+  (void)old_size;
+  (void)userdata;
+  if (0 == new_size) {
+    free(ptr);
+    return NULL;
+  }
+  return realloc(ptr, new_size);
+}
+
+// Never called, dynamic mode contexts grow instead of flushing
+static void dynamic_flush_cb(char *buffer, size_t amount, void *userdata) {
+  (void)buffer;
+  (void)amount;
+  (void)userdata;
+}
+
+lightweight_json_err_t
+lightweight_json_writer_init_dynamic(size_t initial_size,
+                                     lightweight_json_realloc_cb_t realloc_cb,
+                                     void *userdata,
+                                     lightweight_json_writer_level_t *levels,
+                                     size_t max_nesting,
+                                     lightweight_json_writer_ctx_t *ctx) {
+  if (initial_size < 2 || initial_size > INT_MAX || NULL == ctx) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  if (NULL == realloc_cb) {
+    realloc_cb = default_realloc;
+  }
+  char *buffer = realloc_cb(NULL, 0, initial_size, userdata);
+  if (NULL == buffer) {
+    return LIGHTWEIGHT_JSON_ERR_NO_MEM;
+  }
+  const lightweight_json_err_t err = lightweight_json_writer_init_with_stack(
+      buffer, initial_size, dynamic_flush_cb, userdata, levels, max_nesting,
+      ctx);
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+    realloc_cb(buffer, initial_size, 0, userdata);
+    return err;
+  }
+  ctx->realloc_cb = realloc_cb;
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+lightweight_json_err_t
+lightweight_json_writer_take_buffer(lightweight_json_writer_ctx_t *ctx,
+                                    bool shrink, char **out_buffer,
+                                    size_t *out_len) {
+  if (NULL == ctx || NULL == out_buffer || NULL == ctx->realloc_cb ||
+      NULL == ctx->buffer) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  char *buffer = ctx->buffer;
+  const size_t size = ctx->buffer_size;
+  const size_t len = (size_t)ctx->offset;
+  ctx->buffer = NULL;
+  ctx->buffer_size = 0;
+  ctx->offset = 0;
+  if (LIGHTWEIGHT_JSON_ERR_NONE != ctx->error) {
+    ctx->realloc_cb(buffer, size, 0, ctx->userdata);
+    return ctx->error;
+  }
+
+  // The buffer grows as soon as it is full, so there's room for the terminator
+  buffer[len] = '\0';
+  if (shrink && len + 1 < size) {
+    char *shrunk = ctx->realloc_cb(buffer, size, len + 1, ctx->userdata);
+    if (NULL != shrunk) {
+      buffer = shrunk;
+    }
+  }
+  *out_buffer = buffer;
+  if (NULL != out_len) {
+    *out_len = len;
+  }
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+lightweight_json_err_t
+lightweight_json_writer_init_counting(lightweight_json_writer_level_t *levels,
+                                      size_t max_nesting,
+                                      lightweight_json_writer_ctx_t *ctx) {
+  if (NULL == ctx || 0 == max_nesting || max_nesting > INT32_MAX ||
+      (NULL == levels && max_nesting > LIGHTWEIGHT_JSON_MAX_NESTING_SIZE)) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  // No buffer at all, every write is counted before it would touch it
+  lightweight_json_writer_ctx_t c = {
+      .counting = true,
+      .nesting = -1,
+      .max_nesting = (int)max_nesting,
+      .base_nesting = -1,
+      .levels = levels,
+#ifdef LIGHTWEIGHT_JSON_ENABLE_STATS
+      .current_api = LIGHTWEIGHT_JSON_API_OTHER,
+#endif
   };
   *ctx = c;
   return LIGHTWEIGHT_JSON_ERR_NONE;
 }
 
+lightweight_json_err_t
+lightweight_json_writer_get_counted_size(lightweight_json_writer_ctx_t *ctx,
+                                         size_t *out_size) {
+  if (NULL == ctx || NULL == out_size || !ctx->counting) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  *out_size = ctx->counted;
+  return ctx->error;
+}
+
+// Stack entries per nesting level
+static inline int level_stride(lightweight_json_format_e format) {
+  return LIGHTWEIGHT_JSON_FORMAT_JSON == format ? 1 : 2;
+}
+
+static inline lightweight_json_writer_level_t *
+writer_level(lightweight_json_writer_ctx_t *ctx) {
+  return LIGHTWEIGHT_JSON_LEVELS(ctx) +
+         ctx->nesting * level_stride(ctx->format);
+}
+
+lightweight_json_writer_level_t *
+lightweight_json_writer_level(lightweight_json_writer_ctx_t *ctx) {
+  return writer_level(ctx);
+}
+
+static inline uint32_t writer_level_count(lightweight_json_writer_ctx_t *ctx) {
+  return *writer_level(ctx) & ~LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT;
+}
+
+static inline lightweight_json_type_e
+writer_level_type(lightweight_json_writer_ctx_t *ctx) {
+  return (*writer_level(ctx) & LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT)
+             ? LIGHTWEIGHT_JSON_ARRAY
+             : LIGHTWEIGHT_JSON_OBJECT;
+}
+
+// Count a finished element in the current object / array
+static void count_element(lightweight_json_writer_ctx_t *ctx) {
+  if (ctx->nesting < 0) {
+    return;
+  }
+  lightweight_json_writer_level_t *level = writer_level(ctx);
+  // Saturate instead of overflowing into the type bit, add_comma only cares
+  // whether there already are elements
+  if ((*level & ~LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT) !=
+      ~LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT) {
+    (*level)++;
+  }
+}
+
+// Double the buffer of a dynamic mode context. On failure the output so far is
+// dropped and the error sticks, take_buffer reports it.
+static void grow_buffer(lightweight_json_writer_ctx_t *ctx) {
+  const size_t new_size = ctx->buffer_size * 2;
+  char *buffer = NULL;
+  if (LIGHTWEIGHT_JSON_ERR_NONE == ctx->error && new_size <= INT_MAX) {
+    buffer = ctx->realloc_cb(ctx->buffer, ctx->buffer_size, new_size,
+                             ctx->userdata);
+  }
+  if (NULL == buffer) {
+    ctx->error = LIGHTWEIGHT_JSON_ERR_NO_MEM;
+    ctx->offset = 0;
+    return;
+  }
+  ctx->buffer = buffer;
+  ctx->buffer_size = new_size;
+}
+
 static void check_buffer(lightweight_json_writer_ctx_t *ctx, bool force) {
+  if (ctx->counting) {
+    return;
+  }
+  if (NULL != ctx->realloc_cb) {
+    if (ctx->offset == ctx->buffer_size) {
+      grow_buffer(ctx);
+    }
+    return;
+  }
   if (ctx->offset == ctx->buffer_size || force) {
+    if (LIGHTWEIGHT_JSON_FORMAT_MSGPACK == ctx->format) {
+      lightweight_json_binary_flushing(ctx);
+    }
+    STATS_ADD(ctx, flush_calls, 1);
+    STATS_ADD(ctx, bytes_flushed, ctx->offset);
     ctx->flush_cb(ctx->buffer, ctx->offset, ctx->userdata);
     ctx->offset = 0;
   }
 }
 
+// Copy `len` bytes into the buffer, flushing whenever it fills up
+static void write_bytes(lightweight_json_writer_ctx_t *ctx, const char *data,
+                        size_t len) {
+  if (len < ctx->buffer_size - (size_t)ctx->offset) {
+    // Fits without filling the buffer up, nothing to flush
+    memcpy(&ctx->buffer[ctx->offset], data, len);
+    ctx->offset += (int)len;
+    return;
+  }
+  if (ctx->counting) {
+    ctx->counted += len;
+    return;
+  }
+  while (len > 0) {
+    const size_t space = ctx->buffer_size - (size_t)ctx->offset;
+    const size_t chunk = len < space ? len : space;
+    memcpy(&ctx->buffer[ctx->offset], data, chunk);
+    ctx->offset += (int)chunk;
+    data += chunk;
+    len -= chunk;
+    check_buffer(ctx, false);
+  }
+}
+
+void lightweight_json_write_bytes(lightweight_json_writer_ctx_t *ctx,
+                                  const char *data, size_t len) {
+  write_bytes(ctx, data, len);
+}
+
+static const char digit_pairs[201] =
+    "00010203040506070809101112131415161718192021222324"
+    "25262728293031323334353637383940414243444546474849"
+    "50515253545556575859606162636465666768697071727374"
+    "75767778798081828384858687888990919293949596979899";
+
+// Longest formatted int64 / uint64
+#define INTEGER_CHARS 20
+
+// Digits of `value`
+static size_t uint64_length(uint64_t value) {
+  size_t len = 1;
+  for (uint64_t limit = 10; value >= limit; limit *= 10) {
+    len++;
+    if (len == INTEGER_CHARS) {
+      // 10^20 doesn't fit
+      break;
+    }
+  }
+  return len;
+}
+
+// Format `value` so it ends right before `end`, two digits per step. Returns
+// the first character.
+static char *format_uint64(uint64_t value, char *end) {
+  while (value >= 100) {
+    const size_t pair = (size_t)(value % 100) * 2;
+    value /= 100;
+    *--end = digit_pairs[pair + 1];
+    *--end = digit_pairs[pair];
+  }
+  if (value >= 10) {
+    *--end = digit_pairs[value * 2 + 1];
+    *--end = digit_pairs[value * 2];
+  } else {
+    *--end = (char)('0' + value);
+  }
+  return end;
+}
+
+static char *format_int64(int64_t value, char *end) {
+  if (value >= 0) {
+    return format_uint64((uint64_t)value, end);
+  }
+  // Negate in unsigned arithmetic, INT64_MIN has no positive counterpart
+  char *begin = format_uint64((uint64_t)0 - (uint64_t)value, end);
+  *--begin = '-';
+  return begin;
+}
+
+static void write_uint64(lightweight_json_writer_ctx_t *ctx, uint64_t value) {
+  if (ctx->counting) {
+    ctx->counted += uint64_length(value);
+    return;
+  }
+  char temp[INTEGER_CHARS];
+  const char *begin = format_uint64(value, temp + sizeof(temp));
+  write_bytes(ctx, begin, (size_t)(temp + sizeof(temp) - begin));
+}
+
+static void write_int64(lightweight_json_writer_ctx_t *ctx, int64_t value) {
+  if (ctx->counting) {
+    ctx->counted += value < 0 ? 1 + uint64_length((uint64_t)0 - (uint64_t)value)
+                              : uint64_length((uint64_t)value);
+    return;
+  }
+  char temp[INTEGER_CHARS];
+  const char *begin = format_int64(value, temp + sizeof(temp));
+  write_bytes(ctx, begin, (size_t)(temp + sizeof(temp) - begin));
+}
+
+// Length of the "%.8lf" output of `value` if it can be told from the integer
+// part, 0 otherwise. The fraction rounds up into the integer part from
+// .999999995 on, values too close to that are left to snprintf.
+static size_t double_length(double value) {
+  const double magnitude = fabs(value);
+  if (!(magnitude < 1e15)) {
+    // Large, infinite or NaN
+    return 0;
+  }
+  uint64_t integer = (uint64_t)magnitude;
+  const double fraction = magnitude - (double)integer;
+  if (fabs(fraction - 0.999999995) < 1e-12) {
+    return 0;
+  }
+  if (fraction > 0.999999995) {
+    integer++;
+  }
+  // Negative zero and values rounding to zero keep their sign
+  return (signbit(value) ? 1 : 0) + uint64_length(integer) + 9;
+}
+
+static void write_double(lightweight_json_writer_ctx_t *ctx, double value) {
+  if (ctx->counting) {
+    const size_t len = double_length(value);
+    if (0 != len) {
+      ctx->counted += len;
+      return;
+    }
+  }
+  char temp[64];
+  const int len = snprintf(temp, sizeof(temp), "%.8lf", value);
+  write_bytes(ctx, temp, len < (int)sizeof(temp) ? (size_t)len
+                                                  : sizeof(temp) - 1);
+}
+
+static void write_bool(lightweight_json_writer_ctx_t *ctx, bool value) {
+  if (value) {
+    write_bytes(ctx, "true", 4);
+  } else {
+    write_bytes(ctx, "false", 5);
+  }
+}
+
+// Append one character, the caller checks the buffer afterwards
+static inline void put_char(lightweight_json_writer_ctx_t *ctx, char c) {
+  if (ctx->counting) {
+    ctx->counted++;
+  } else {
+    ctx->buffer[ctx->offset++] = c;
+  }
+}
+
 static void add_comma(lightweight_json_writer_ctx_t *ctx) {
-  if (ctx->objects_in_object[ctx->nesting] > 0) {
+  if (ctx->nesting >= 0 && LIGHTWEIGHT_JSON_FORMAT_JSON == ctx->format &&
+      writer_level_count(ctx) > 0) {
+    if (ctx->counting) {
+      ctx->counted++;
+      return;
+    }
     ctx->buffer[ctx->offset++] = ',';
     check_buffer(ctx, false);
   }
 }
 
 static void add_key(lightweight_json_writer_ctx_t *ctx, const char *const key) {
-  if (NULL != key) {
+  if (NULL != key && ctx->counting) {
+    // Quotes and colon
+    ctx->counted += strlen(key) + 3;
+  } else if (NULL != key) {
     ctx->buffer[ctx->offset++] = '\"';
     check_buffer(ctx, false);
     for (int i = 0; i < strlen(key); i++) {
@@ -56,10 +470,19 @@ static void add_key(lightweight_json_writer_ctx_t *ctx, const char *const key) {
 
 static void add_str(lightweight_json_writer_ctx_t *ctx,
                     const char *const value) {
+  if (ctx->counting) {
+    size_t len = 0;
+    for (const char *c = value; *c != '\0'; c++) {
+      len += (*c == '\"' || *c == '\\' || *c == '\n' || *c == '\r') ? 2 : 1;
+    }
+    ctx->counted += len;
+    return;
+  }
   int i = 0;
   while (value[i] != '\0') {
     if (value[i] == '\"' || value[i] == '\\' || value[i] == '\n' ||
         value[i] == '\r') {
+      STATS_ADD(ctx, escapes, 1);
       ctx->buffer[ctx->offset++] = '\\';
       check_buffer(ctx, false);
     }
@@ -69,64 +492,125 @@ static void add_str(lightweight_json_writer_ctx_t *ctx,
   }
 }
 
+static lightweight_json_err_t
+writer_set_format(lightweight_json_writer_ctx_t *ctx,
+                  lightweight_json_format_e format) {
+  if (NULL == ctx ||
+      (uint8_t)format > (uint8_t)LIGHTWEIGHT_JSON_FORMAT_MSGPACK) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  if (format == ctx->format) {
+    return LIGHTWEIGHT_JSON_ERR_NONE;
+  }
+  if (-1 != ctx->nesting || 0 != ctx->offset || 0 != ctx->counted ||
+      LIGHTWEIGHT_JSON_FORMAT_JSON != ctx->format) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_STATE;
+  }
+  if (ctx->max_nesting < 2) {
+    // Not even one binary level fits
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  ctx->format = format;
+  ctx->max_nesting /= 2;
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
 lightweight_json_err_t
-lightweight_json_writer_begin(lightweight_json_writer_ctx_t *ctx,
-                              const char *const key,
-                              lightweight_json_type_e type) {
-  if (NULL == ctx || (uint8_t)LIGHTWEIGHT_JSON_NONE <= (uint8_t)type) {
+lightweight_json_writer_set_format(lightweight_json_writer_ctx_t *ctx,
+                                   lightweight_json_format_e format) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_OTHER, writer_set_format(ctx, format));
+}
+
+static lightweight_json_err_t
+writer_begin(lightweight_json_writer_ctx_t *ctx, const char *const key,
+             lightweight_json_type_e type, bool sized, size_t size) {
+  if (NULL == ctx || (uint8_t)LIGHTWEIGHT_JSON_NONE <= (uint8_t)type ||
+      size > ~LIGHTWEIGHT_JSON_LEVEL_SIZED_BIT) {
     return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
   }
-  if (ctx->nesting == LIGHTWEIGHT_JSON_MAX_NESTING_SIZE - 1) {
+  if (ctx->nesting == ctx->max_nesting - 1) {
     return LIGHTWEIGHT_JSON_ERR_MAX_NESTING_REACHED;
   }
+  if (LIGHTWEIGHT_JSON_FORMAT_JSON != ctx->format) {
+    lightweight_json_binary_begin(ctx, key, type, sized, (uint32_t)size);
+    return LIGHTWEIGHT_JSON_ERR_NONE;
+  }
 
   add_comma(ctx);
   add_key(ctx, key);
 
   switch (type) {
   case LIGHTWEIGHT_JSON_OBJECT:
-    ctx->buffer[ctx->offset++] = '{';
+    put_char(ctx, '{');
     break;
   case LIGHTWEIGHT_JSON_ARRAY:
-    ctx->buffer[ctx->offset++] = '[';
+    put_char(ctx, '[');
     break;
   default:
     return LIGHTWEIGHT_JSON_ERR_INVALID_STATE;
   }
   ctx->nesting++;
-  ctx->objects_in_object[ctx->nesting] = 0;
-  ctx->object_type[ctx->nesting] = type;
+  *writer_level(ctx) =
+      LIGHTWEIGHT_JSON_ARRAY == type ? LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT : 0;
   check_buffer(ctx, false);
   return LIGHTWEIGHT_JSON_ERR_NONE;
 }
 
 lightweight_json_err_t
-lightweight_json_writer_end(lightweight_json_writer_ctx_t *ctx) {
+lightweight_json_writer_begin(lightweight_json_writer_ctx_t *ctx,
+                              const char *const key,
+                              lightweight_json_type_e type) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_WRITER_BEGIN,
+             writer_begin(ctx, key, type, false, 0));
+}
+
+lightweight_json_err_t
+lightweight_json_writer_begin_sized(lightweight_json_writer_ctx_t *ctx,
+                                    const char *const key,
+                                    lightweight_json_type_e type, size_t size) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_WRITER_BEGIN,
+             writer_begin(ctx, key, type, true, size));
+}
+
+static lightweight_json_err_t writer_end(lightweight_json_writer_ctx_t *ctx) {
   if (NULL == ctx) {
     return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
   }
-  switch (ctx->object_type[ctx->nesting]) {
+  if (ctx->nesting <= ctx->base_nesting) {
+    // Nothing to end
+    return LIGHTWEIGHT_JSON_ERR_INVALID_STATE;
+  }
+  if (LIGHTWEIGHT_JSON_FORMAT_JSON != ctx->format) {
+    const lightweight_json_err_t err = lightweight_json_binary_end(ctx);
+    count_element(ctx);
+    return err;
+  }
+  switch (writer_level_type(ctx)) {
   case LIGHTWEIGHT_JSON_OBJECT:
-    ctx->buffer[ctx->offset++] = '}';
+    put_char(ctx, '}');
     break;
   case LIGHTWEIGHT_JSON_ARRAY:
-    ctx->buffer[ctx->offset++] = ']';
+    put_char(ctx, ']');
     break;
   default:
     // Shouldn't be possible unless the ctx is broken
     return LIGHTWEIGHT_JSON_ERR_INVALID_STATE;
   }
   ctx->nesting--;
-  ctx->objects_in_object[ctx->nesting]++;
+  count_element(ctx);
 
   check_buffer(ctx, false);
   return LIGHTWEIGHT_JSON_ERR_NONE;
 }
 
 lightweight_json_err_t
-lightweight_json_writer_add_string(lightweight_json_writer_ctx_t *ctx,
-                                   const char *const key,
-                                   const char *const value) {
+lightweight_json_writer_end(lightweight_json_writer_ctx_t *ctx) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_WRITER_END, writer_end(ctx));
+}
+
+static lightweight_json_err_t
+writer_add_string(lightweight_json_writer_ctx_t *ctx, const char *const key,
+                  const char *const value) {
   if (NULL == ctx || NULL == value) {
     return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
   }
@@ -134,23 +618,66 @@ lightweight_json_writer_add_string(lightweight_json_writer_ctx_t *ctx,
     // The user didn't begin at least a "main" object
     return LIGHTWEIGHT_JSON_ERR_INVALID_STATE;
   }
+  if (LIGHTWEIGHT_JSON_FORMAT_JSON != ctx->format) {
+    lightweight_json_binary_key(ctx, key);
+    lightweight_json_binary_string(ctx, value, strlen(value));
+    count_element(ctx);
+    return LIGHTWEIGHT_JSON_ERR_NONE;
+  }
   add_comma(ctx);
   add_key(ctx, key);
 
-  ctx->buffer[ctx->offset++] = '\"';
+  put_char(ctx, '\"');
   check_buffer(ctx, false);
   add_str(ctx, value);
-  ctx->buffer[ctx->offset++] = '\"';
+  put_char(ctx, '\"');
   check_buffer(ctx, false);
 
-  ctx->objects_in_object[ctx->nesting]++;
+  count_element(ctx);
+
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+lightweight_json_err_t
+lightweight_json_writer_add_string(lightweight_json_writer_ctx_t *ctx,
+                                   const char *const key,
+                                   const char *const value) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_WRITER_ADD_STRING,
+             writer_add_string(ctx, key, value));
+}
 
+static lightweight_json_err_t
+writer_add_double(lightweight_json_writer_ctx_t *ctx, const char *const key,
+                  double value) {
+  if (NULL == ctx) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  if (ctx->nesting < 0) {
+    // The user didn't begin at least a "main" object
+    return LIGHTWEIGHT_JSON_ERR_INVALID_STATE;
+  }
+  if (LIGHTWEIGHT_JSON_FORMAT_JSON != ctx->format) {
+    lightweight_json_binary_key(ctx, key);
+    lightweight_json_binary_double(ctx, value);
+  } else {
+    add_comma(ctx);
+    add_key(ctx, key);
+    write_double(ctx, value);
+  }
+  count_element(ctx);
   return LIGHTWEIGHT_JSON_ERR_NONE;
 }
 
 lightweight_json_err_t
 lightweight_json_writer_add_double(lightweight_json_writer_ctx_t *ctx,
                                    const char *const key, double value) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_WRITER_ADD_DOUBLE,
+             writer_add_double(ctx, key, value));
+}
+
+static lightweight_json_err_t
+writer_add_int64(lightweight_json_writer_ctx_t *ctx, const char *const key,
+                 int64_t value) {
   if (NULL == ctx) {
     return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
   }
@@ -158,18 +685,28 @@ lightweight_json_writer_add_double(lightweight_json_writer_ctx_t *ctx,
     // The user didn't begin at least a "main" object
     return LIGHTWEIGHT_JSON_ERR_INVALID_STATE;
   }
-  char temp[64] = {0};
-  snprintf(temp, sizeof(temp), "%.8lf", value);
-  add_comma(ctx);
-  add_key(ctx, key);
-  add_str(ctx, temp);
-  ctx->objects_in_object[ctx->nesting]++;
+  if (LIGHTWEIGHT_JSON_FORMAT_JSON != ctx->format) {
+    lightweight_json_binary_key(ctx, key);
+    lightweight_json_binary_int64(ctx, value);
+  } else {
+    add_comma(ctx);
+    add_key(ctx, key);
+    write_int64(ctx, value);
+  }
+  count_element(ctx);
   return LIGHTWEIGHT_JSON_ERR_NONE;
 }
 
 lightweight_json_err_t
 lightweight_json_writer_add_int64(lightweight_json_writer_ctx_t *ctx,
                                   const char *const key, int64_t value) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_WRITER_ADD_INT64,
+             writer_add_int64(ctx, key, value));
+}
+
+static lightweight_json_err_t
+writer_add_uint64(lightweight_json_writer_ctx_t *ctx, const char *const key,
+                  uint64_t value) {
   if (NULL == ctx) {
     return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
   }
@@ -177,18 +714,28 @@ lightweight_json_writer_add_int64(lightweight_json_writer_ctx_t *ctx,
     // The user didn't begin at least a "main" object
     return LIGHTWEIGHT_JSON_ERR_INVALID_STATE;
   }
-  char temp[64] = {0};
-  snprintf(temp, sizeof(temp), "%" PRId64, value);
-  add_comma(ctx);
-  add_key(ctx, key);
-  add_str(ctx, temp);
-  ctx->objects_in_object[ctx->nesting]++;
+  if (LIGHTWEIGHT_JSON_FORMAT_JSON != ctx->format) {
+    lightweight_json_binary_key(ctx, key);
+    lightweight_json_binary_uint64(ctx, value);
+  } else {
+    add_comma(ctx);
+    add_key(ctx, key);
+    write_uint64(ctx, value);
+  }
+  count_element(ctx);
   return LIGHTWEIGHT_JSON_ERR_NONE;
 }
 
 lightweight_json_err_t
 lightweight_json_writer_add_uint64(lightweight_json_writer_ctx_t *ctx,
                                    const char *const key, uint64_t value) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_WRITER_ADD_UINT64,
+             writer_add_uint64(ctx, key, value));
+}
+
+static lightweight_json_err_t
+writer_add_bool(lightweight_json_writer_ctx_t *ctx, const char *const key,
+                bool value) {
   if (NULL == ctx) {
     return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
   }
@@ -196,18 +743,27 @@ lightweight_json_writer_add_uint64(lightweight_json_writer_ctx_t *ctx,
     // The user didn't begin at least a "main" object
     return LIGHTWEIGHT_JSON_ERR_INVALID_STATE;
   }
-  char temp[64] = {0};
-  snprintf(temp, sizeof(temp), "%" PRIu64, value);
-  add_comma(ctx);
-  add_key(ctx, key);
-  add_str(ctx, temp);
-  ctx->objects_in_object[ctx->nesting]++;
+  if (LIGHTWEIGHT_JSON_FORMAT_JSON != ctx->format) {
+    lightweight_json_binary_key(ctx, key);
+    lightweight_json_binary_bool(ctx, value);
+  } else {
+    add_comma(ctx);
+    add_key(ctx, key);
+    write_bool(ctx, value);
+  }
+  count_element(ctx);
   return LIGHTWEIGHT_JSON_ERR_NONE;
 }
 
 lightweight_json_err_t
 lightweight_json_writer_add_bool(lightweight_json_writer_ctx_t *ctx,
                                  const char *const key, bool value) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_WRITER_ADD_BOOL,
+             writer_add_bool(ctx, key, value));
+}
+
+static lightweight_json_err_t
+writer_add_null(lightweight_json_writer_ctx_t *ctx, const char *const key) {
   if (NULL == ctx) {
     return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
   }
@@ -215,504 +771,4446 @@ lightweight_json_writer_add_bool(lightweight_json_writer_ctx_t *ctx,
     // The user didn't begin at least a "main" object
     return LIGHTWEIGHT_JSON_ERR_INVALID_STATE;
   }
-  char temp[64] = {0};
-  snprintf(temp, sizeof(temp), "%s", value ? "true" : "false");
-  add_comma(ctx);
-  add_key(ctx, key);
-  add_str(ctx, temp);
-  ctx->objects_in_object[ctx->nesting]++;
+  if (LIGHTWEIGHT_JSON_FORMAT_JSON != ctx->format) {
+    lightweight_json_binary_key(ctx, key);
+    lightweight_json_binary_null(ctx);
+  } else {
+    add_comma(ctx);
+    add_key(ctx, key);
+    write_bytes(ctx, "null", 4);
+  }
+  count_element(ctx);
   return LIGHTWEIGHT_JSON_ERR_NONE;
 }
 
 lightweight_json_err_t
-lightweight_json_writer_flush(lightweight_json_writer_ctx_t *ctx) {
+lightweight_json_writer_add_null(lightweight_json_writer_ctx_t *ctx,
+                                 const char *const key) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_OTHER, writer_add_null(ctx, key));
+}
+
+static lightweight_json_err_t writer_flush(lightweight_json_writer_ctx_t *ctx) {
   if (NULL == ctx) {
     return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
   }
 
   check_buffer(ctx, true);
-  return LIGHTWEIGHT_JSON_ERR_NONE;
+  return ctx->error;
 }
 
 lightweight_json_err_t
-lightweight_json_reader_init(const char *buffer, size_t buffer_size,
-                             lightweight_json_reader_ctx_t *ctx) {
-  if (NULL == buffer || 0 == buffer_size || NULL == ctx) {
-    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+lightweight_json_writer_flush(lightweight_json_writer_ctx_t *ctx) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_WRITER_FLUSH, writer_flush(ctx));
+}
+
+// --- Fragments ---
+
+// The fragment writer's buffer is the fragment itself, so a flush before
+// finishing means it overflowed. The final flush just records the size.
+static void fragment_flush_cb(char *buffer, size_t amount, void *userdata) {
+  (void)buffer;
+  lightweight_json_fragment_t *fragment = userdata;
+  if (!fragment->finished) {
+    fragment->overflow = true;
+  } else {
+    fragment->size = amount;
   }
-  memset(ctx, 0, sizeof(lightweight_json_reader_ctx_t));
-  ctx->buffer = buffer;
-  ctx->buffer_size = buffer_size;
-  memset(ctx->current_offset, 0, sizeof(ctx->current_offset));
-  ctx->nesting = 0;
-  memset(ctx->object_type, LIGHTWEIGHT_JSON_NONE, sizeof(ctx->object_type));
+}
 
-  // Find first object offset
-  bool found = false;
-  for (size_t i = 0; i < buffer_size; i++) {
-    if (buffer[i] == '{') {
-      ctx->object_type[ctx->nesting] = LIGHTWEIGHT_JSON_OBJECT;
-      ctx->current_offset[ctx->nesting] = i;
-      found = true;
-      break;
-    } else if (buffer[i] == '[') {
-      ctx->object_type[ctx->nesting] = LIGHTWEIGHT_JSON_ARRAY;
-      ctx->current_offset[ctx->nesting] = i;
-      found = true;
-      break;
-    }
+// Initialize a fragment writer in `format` continuing in an object / array of
+// `type`, with `max_nesting` entries of `levels` (NULL for the embedded stack)
+// as its stack. The object / array it continues in takes the first level.
+static lightweight_json_err_t
+fragment_init(lightweight_json_format_e format, lightweight_json_type_e type,
+              lightweight_json_writer_level_t *levels, size_t max_nesting,
+              char *buffer, size_t buffer_size,
+              lightweight_json_fragment_t *fragment,
+              lightweight_json_writer_ctx_t *ctx) {
+  lightweight_json_err_t err = lightweight_json_writer_init_with_stack(
+      buffer, buffer_size, fragment_flush_cb, fragment, levels, max_nesting,
+      ctx);
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+    return err;
   }
-  if (!found) {
-    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  err = writer_set_format(ctx, format);
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+    return err;
+  }
+
+  fragment->data = buffer;
+  fragment->size = 0;
+  fragment->elements = 0;
+  fragment->parent_type = type;
+  fragment->finished = false;
+  fragment->overflow = false;
+
+  // Seed the level of the parent, without any elements so the first one
+  // isn't preceded by a comma
+  ctx->nesting = 0;
+  ctx->base_nesting = 0;
+  lightweight_json_writer_level_t *level = writer_level(ctx);
+  level[0] =
+      LIGHTWEIGHT_JSON_ARRAY == type ? LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT : 0;
+  if (LIGHTWEIGHT_JSON_FORMAT_JSON != format) {
+    // Never ended, nothing to patch
+    level[1] = LIGHTWEIGHT_JSON_LEVEL_SIZED_BIT;
   }
   return LIGHTWEIGHT_JSON_ERR_NONE;
 }
 
-static size_t find_key(lightweight_json_reader_ctx_t *ctx, const char *key) {
-  if (NULL == ctx || NULL == key) {
-    return 0;
+lightweight_json_err_t
+lightweight_json_fragment_init(const lightweight_json_writer_ctx_t *parent,
+                               char *buffer, size_t buffer_size,
+                               lightweight_json_writer_level_t *levels,
+                               size_t max_nesting,
+                               lightweight_json_fragment_t *fragment,
+                               lightweight_json_writer_ctx_t *ctx) {
+  if (NULL == parent || NULL == fragment || parent->nesting < 0) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
   }
+  const lightweight_json_writer_level_t *parent_levels =
+      LIGHTWEIGHT_JSON_LEVELS(parent);
+  const lightweight_json_type_e type =
+      (parent_levels[parent->nesting * level_stride(parent->format)] &
+       LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT)
+          ? LIGHTWEIGHT_JSON_ARRAY
+          : LIGHTWEIGHT_JSON_OBJECT;
+  return fragment_init(parent->format, type, levels, max_nesting, buffer,
+                       buffer_size, fragment, ctx);
+}
 
-  size_t offset = ctx->current_offset[ctx->nesting] + 1;
-  int nesting = 0;
-  bool in_string = false;
-  bool is_val = false;
-  size_t cur_string_offset = 0;
-  size_t cur_string_end = 0;
-  for (; offset < ctx->buffer_size; offset++) {
-    const char c = ctx->buffer[offset];
+lightweight_json_err_t
+lightweight_json_fragment_finish(lightweight_json_fragment_t *fragment,
+                                 lightweight_json_writer_ctx_t *ctx) {
+  if (NULL == fragment || NULL == ctx || ctx->userdata != fragment) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  if (ctx->nesting != ctx->base_nesting) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_STATE;
+  }
+  fragment->elements = writer_level_count(ctx);
+  fragment->finished = true;
+  check_buffer(ctx, true);
+  return fragment->overflow ? LIGHTWEIGHT_JSON_ERR_BUFFER_TOO_SMALL
+                            : LIGHTWEIGHT_JSON_ERR_NONE;
+}
 
-    switch (c) {
-    case '\"':
-      if (nesting == 0 && !is_val) {
-        if (!in_string) {
-          cur_string_offset = offset + 1;
+static lightweight_json_err_t
+writer_splice(lightweight_json_writer_ctx_t *ctx,
+              const lightweight_json_fragment_t *fragment) {
+  if (NULL == ctx || NULL == fragment) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  if (!fragment->finished || fragment->overflow || ctx->nesting < 0 ||
+      writer_level_type(ctx) != fragment->parent_type) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_STATE;
+  }
+  if (0 == fragment->elements) {
+    return LIGHTWEIGHT_JSON_ERR_NONE;
+  }
+
+  // No-op for the binary formats
+  add_comma(ctx);
+  write_bytes(ctx, fragment->data, fragment->size);
+  lightweight_json_writer_level_t *level = writer_level(ctx);
+  uint64_t count = (uint64_t)(*level & ~LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT) +
+                   fragment->elements;
+  if (count > ~LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT) {
+    count = ~LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT;
+  }
+  *level = (*level & LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT) | (uint32_t)count;
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+lightweight_json_err_t
+lightweight_json_writer_splice(lightweight_json_writer_ctx_t *ctx,
+                               const lightweight_json_fragment_t *fragment) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_OTHER, writer_splice(ctx, fragment));
+}
+
+static lightweight_json_err_t
+writer_add_raw(lightweight_json_writer_ctx_t *ctx, const char *const key,
+               const char *json, size_t len) {
+  if (NULL == ctx || NULL == json || 0 == len) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  if (ctx->nesting < 0) {
+    // The user didn't begin at least a "main" object
+    return LIGHTWEIGHT_JSON_ERR_INVALID_STATE;
+  }
+  if (LIGHTWEIGHT_JSON_FORMAT_JSON != ctx->format) {
+    lightweight_json_binary_key(ctx, key);
+  } else {
+    add_comma(ctx);
+    add_key(ctx, key);
+  }
+  write_bytes(ctx, json, len);
+  count_element(ctx);
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+lightweight_json_err_t
+lightweight_json_writer_add_raw(lightweight_json_writer_ctx_t *ctx,
+                                const char *const key, const char *json,
+                                size_t len) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_OTHER,
+             writer_add_raw(ctx, key, json, len));
+}
+
+// --- Cache ---
+
+lightweight_json_err_t
+lightweight_json_cache_init(char *buffer, size_t buffer_size,
+                            lightweight_json_writer_level_t *levels,
+                            size_t max_nesting,
+                            lightweight_json_cache_entry_t *entry) {
+  if (NULL == buffer || buffer_size < 2 || NULL == entry ||
+      0 == max_nesting || max_nesting > INT32_MAX ||
+      (NULL == levels && max_nesting > LIGHTWEIGHT_JSON_MAX_NESTING_SIZE)) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  entry->buffer = buffer;
+  entry->buffer_size = buffer_size;
+  entry->size = 0;
+  entry->version = 0;
+  entry->valid = false;
+  entry->levels = levels;
+  entry->max_nesting = max_nesting;
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+// Serialize the entry's value through a fragment writer
+static lightweight_json_err_t
+cache_fill(const lightweight_json_writer_ctx_t *ctx,
+           lightweight_json_cache_entry_t *entry,
+           lightweight_json_serialize_cb_t serialize_cb, void *userdata) {
+  lightweight_json_fragment_t fragment;
+  lightweight_json_writer_ctx_t writer;
+  entry->valid = false;
+  // Inside an array, so the value is written without a key
+  lightweight_json_err_t err =
+      fragment_init(ctx->format, LIGHTWEIGHT_JSON_ARRAY, entry->levels,
+                    entry->max_nesting, entry->buffer, entry->buffer_size,
+                    &fragment, &writer);
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+    return err;
+  }
+  err = serialize_cb(&writer, userdata);
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+    return err;
+  }
+  err = lightweight_json_fragment_finish(&fragment, &writer);
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+    return err;
+  }
+  if (1 != fragment.elements) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_STATE;
+  }
+  entry->size = fragment.size;
+  entry->valid = true;
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+static lightweight_json_err_t
+writer_add_cached(lightweight_json_writer_ctx_t *ctx, const char *const key,
+                  lightweight_json_cache_entry_t *entry, uint64_t version,
+                  lightweight_json_serialize_cb_t serialize_cb,
+                  void *userdata) {
+  if (NULL == ctx || NULL == entry || NULL == serialize_cb) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  if (ctx->nesting < 0) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_STATE;
+  }
+  if (!entry->valid || entry->version != version) {
+    const lightweight_json_err_t err =
+        cache_fill(ctx, entry, serialize_cb, userdata);
+    if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+      return err;
+    }
+    entry->version = version;
+  }
+  return writer_add_raw(ctx, key, entry->buffer, entry->size);
+}
+
+lightweight_json_err_t lightweight_json_writer_add_cached(
+    lightweight_json_writer_ctx_t *ctx, const char *const key,
+    lightweight_json_cache_entry_t *entry, uint64_t version,
+    lightweight_json_serialize_cb_t serialize_cb, void *userdata) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_OTHER,
+             writer_add_cached(ctx, key, entry, version, serialize_cb,
+                               userdata));
+}
+
+// --- Templates ---
+
+lightweight_json_err_t lightweight_json_template_init(
+    char *skeleton, size_t skeleton_size,
+    lightweight_json_template_slot_t *slots, size_t max_slots,
+    lightweight_json_writer_level_t *levels, size_t max_nesting,
+    lightweight_json_template_t *tmpl, lightweight_json_writer_ctx_t *ctx) {
+  if (NULL == tmpl || (NULL == slots && 0 != max_slots) || max_nesting < 2) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  tmpl->skeleton = skeleton;
+  tmpl->skeleton_size = 0;
+  tmpl->slots = slots;
+  tmpl->max_slots = max_slots;
+  tmpl->slot_count = 0;
+  // Recorded like a cache entry: one value without a key
+  return fragment_init(LIGHTWEIGHT_JSON_FORMAT_JSON, LIGHTWEIGHT_JSON_ARRAY,
+                       levels, max_nesting, skeleton, skeleton_size,
+                       &tmpl->fragment, ctx);
+}
+
+lightweight_json_err_t
+lightweight_json_template_add_slot(lightweight_json_writer_ctx_t *ctx,
+                                   const char *const key,
+                                   lightweight_json_slot_type_e type,
+                                   lightweight_json_template_t *tmpl) {
+  if (NULL == ctx || NULL == tmpl || ctx->userdata != &tmpl->fragment ||
+      (uint8_t)type > (uint8_t)LIGHTWEIGHT_JSON_SLOT_BOOL) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  if (ctx->nesting <= ctx->base_nesting) {
+    // Slots have to be inside the recorded object / array
+    return LIGHTWEIGHT_JSON_ERR_INVALID_STATE;
+  }
+  if (tmpl->slot_count == tmpl->max_slots) {
+    return LIGHTWEIGHT_JSON_ERR_BUFFER_TOO_SMALL;
+  }
+  add_comma(ctx);
+  add_key(ctx, key);
+  lightweight_json_template_slot_t *slot = &tmpl->slots[tmpl->slot_count++];
+  slot->offset = (uint32_t)ctx->offset;
+  slot->type = type;
+  count_element(ctx);
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+lightweight_json_err_t
+lightweight_json_template_finish(lightweight_json_template_t *tmpl,
+                                 lightweight_json_writer_ctx_t *ctx) {
+  if (NULL == tmpl) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  const lightweight_json_err_t err =
+      lightweight_json_fragment_finish(&tmpl->fragment, ctx);
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+    return err;
+  }
+  if (1 != tmpl->fragment.elements) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_STATE;
+  }
+  tmpl->skeleton_size = tmpl->fragment.size;
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+static void write_slot(lightweight_json_writer_ctx_t *ctx,
+                       lightweight_json_slot_type_e type,
+                       const lightweight_json_slot_value_t *value) {
+  switch (type) {
+  case LIGHTWEIGHT_JSON_SLOT_STRING:
+    write_bytes(ctx, "\"", 1);
+    add_str(ctx, NULL != value->string ? value->string : "");
+    write_bytes(ctx, "\"", 1);
+    break;
+  case LIGHTWEIGHT_JSON_SLOT_DOUBLE:
+    write_double(ctx, value->f64);
+    break;
+  case LIGHTWEIGHT_JSON_SLOT_UINT64:
+    write_uint64(ctx, value->u64);
+    break;
+  case LIGHTWEIGHT_JSON_SLOT_INT64:
+    write_int64(ctx, value->i64);
+    break;
+  case LIGHTWEIGHT_JSON_SLOT_BOOL:
+    write_bool(ctx, value->boolean);
+    break;
+  default:
+    break;
+  }
+}
+
+static lightweight_json_err_t
+writer_add_template(lightweight_json_writer_ctx_t *ctx, const char *const key,
+                    const lightweight_json_template_t *tmpl,
+                    const lightweight_json_slot_value_t *values) {
+  if (NULL == ctx || NULL == tmpl || (NULL == values && tmpl->slot_count > 0)) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  if (0 == tmpl->skeleton_size) {
+    // Not finished
+    return LIGHTWEIGHT_JSON_ERR_INVALID_STATE;
+  }
+  if (LIGHTWEIGHT_JSON_FORMAT_JSON != ctx->format) {
+    // The skeleton is JSON
+    return LIGHTWEIGHT_JSON_ERR_NOT_SUPPORTED;
+  }
+  add_comma(ctx);
+  if (ctx->nesting >= 0) {
+    add_key(ctx, key);
+  }
+
+  size_t offset = 0;
+  for (size_t i = 0; i < tmpl->slot_count; i++) {
+    const lightweight_json_template_slot_t *slot = &tmpl->slots[i];
+    write_bytes(ctx, &tmpl->skeleton[offset], slot->offset - offset);
+    write_slot(ctx, slot->type, &values[i]);
+    offset = slot->offset;
+  }
+  write_bytes(ctx, &tmpl->skeleton[offset], tmpl->skeleton_size - offset);
+  count_element(ctx);
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+lightweight_json_err_t lightweight_json_writer_add_template(
+    lightweight_json_writer_ctx_t *ctx, const char *const key,
+    const lightweight_json_template_t *tmpl,
+    const lightweight_json_slot_value_t *values) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_OTHER,
+             writer_add_template(ctx, key, tmpl, values));
+}
+
+// --- Scanning helpers ---
+// Used by the validator and by the reader once a document has been validated.
+// They find the next interesting byte 16 bytes at a time with SSE2, or 8 bytes
+// at a time with plain 64-bit arithmetic everywhere else.
+
+#define SWAR_ONES 0x0101010101010101ull
+#define SWAR_HIGHS 0x8080808080808080ull
+
+static inline uint64_t swar_has_zero(uint64_t word) {
+  return (word - SWAR_ONES) & ~word & SWAR_HIGHS;
+}
+
+static inline uint64_t swar_has_byte(uint64_t word, char c) {
+  return swar_has_zero(word ^ (SWAR_ONES * (uint8_t)c));
+}
+
+static inline unsigned count_trailing_zeros(uint32_t value) {
+#ifdef _MSC_VER
+  unsigned long index = 0;
+  _BitScanForward(&index, value);
+  return (unsigned)index;
+#else
+  return (unsigned)__builtin_ctz(value);
+#endif
+}
+
+static inline unsigned count_trailing_zeros64(uint64_t value) {
+#ifdef _MSC_VER
+  unsigned long index = 0;
+  _BitScanForward64(&index, value);
+  return (unsigned)index;
+#else
+  return (unsigned)__builtin_ctzll(value);
+#endif
+}
+
+static inline bool is_whitespace(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static inline bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+static inline size_t skip_whitespace(const char *buffer, size_t size,
+                                     size_t offset) {
+  while (offset < size && is_whitespace(buffer[offset])) {
+    offset++;
+  }
+  return offset;
+}
+
+// Offset of the first '"' or '\\' at or after `offset`, `size` if there is none
+static size_t find_quote_or_backslash(const char *buffer, size_t size,
+                                      size_t offset) {
+#ifdef LIGHTWEIGHT_JSON_SSE2
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  for (; offset + 16 <= size; offset += 16) {
+    const __m128i chunk = _mm_loadu_si128((const __m128i *)&buffer[offset]);
+    const uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_or_si128(
+        _mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)));
+    if (0 != mask) {
+      return offset + count_trailing_zeros(mask);
+    }
+  }
+#else
+  for (; offset + 8 <= size; offset += 8) {
+    uint64_t word;
+    memcpy(&word, &buffer[offset], sizeof(word));
+    if (swar_has_byte(word, '"') || swar_has_byte(word, '\\')) {
+      break;
+    }
+  }
+#endif
+  for (; offset < size; offset++) {
+    if (buffer[offset] == '"' || buffer[offset] == '\\') {
+      return offset;
+    }
+  }
+  return size;
+}
+
+// Offset of the first '"', '\\', control character or non ASCII byte at or
+// after `offset`, `size` if there is none
+static size_t find_string_special(const char *buffer, size_t size,
+                                  size_t offset) {
+#ifdef LIGHTWEIGHT_JSON_SSE2
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i space = _mm_set1_epi8(0x20);
+  for (; offset + 16 <= size; offset += 16) {
+    const __m128i chunk = _mm_loadu_si128((const __m128i *)&buffer[offset]);
+    // Signed compare, catches both < 0x20 and >= 0x80
+    const __m128i special = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                     _mm_cmpeq_epi8(chunk, backslash)),
+        _mm_cmplt_epi8(chunk, space));
+    const uint32_t mask = (uint32_t)_mm_movemask_epi8(special);
+    if (0 != mask) {
+      return offset + count_trailing_zeros(mask);
+    }
+  }
+#else
+  for (; offset + 8 <= size; offset += 8) {
+    uint64_t word;
+    memcpy(&word, &buffer[offset], sizeof(word));
+    // May report false positives for bytes < 0x20, the bytewise loop below
+    // sorts those out
+    if (swar_has_byte(word, '"') || swar_has_byte(word, '\\') ||
+        (((word - SWAR_ONES * 0x20) | word) & SWAR_HIGHS)) {
+      size_t i = offset;
+      for (; i < offset + 8; i++) {
+        const unsigned char c = (unsigned char)buffer[i];
+        if (c == '"' || c == '\\' || c < 0x20 || c >= 0x80) {
+          return i;
+        }
+      }
+    }
+  }
+#endif
+  for (; offset < size; offset++) {
+    const unsigned char c = (unsigned char)buffer[offset];
+    if (c == '"' || c == '\\' || c < 0x20 || c >= 0x80) {
+      return offset;
+    }
+  }
+  return size;
+}
+
+// Offset of the closing quote of the string whose content starts at `offset`
+static size_t scan_string(const char *buffer, size_t size, size_t offset) {
+  for (;;) {
+    offset = find_quote_or_backslash(buffer, size, offset);
+    if (offset >= size || buffer[offset] == '"') {
+      return offset;
+    }
+    // Skip the escaped character
+    offset += 2;
+  }
+}
+
+// --- Validation ---
+
+// Length of the UTF-8 sequence at `p`, 0 if it is invalid, overlong or encodes
+// a surrogate
+static size_t utf8_sequence_length(const unsigned char *p, size_t remaining) {
+  const unsigned char c = p[0];
+  if (c < 0x80) {
+    return 1;
+  }
+  if (c < 0xC2) {
+    // Continuation byte or overlong 2 byte sequence
+    return 0;
+  }
+  if (c < 0xE0) {
+    return remaining >= 2 && (p[1] & 0xC0) == 0x80 ? 2 : 0;
+  }
+  if (c < 0xF0) {
+    if (remaining < 3 || (p[1] & 0xC0) != 0x80 || (p[2] & 0xC0) != 0x80 ||
+        (c == 0xE0 && p[1] < 0xA0) || (c == 0xED && p[1] >= 0xA0)) {
+      return 0;
+    }
+    return 3;
+  }
+  if (c < 0xF5) {
+    if (remaining < 4 || (p[1] & 0xC0) != 0x80 || (p[2] & 0xC0) != 0x80 ||
+        (p[3] & 0xC0) != 0x80 || (c == 0xF0 && p[1] < 0x90) ||
+        (c == 0xF4 && p[1] >= 0x90)) {
+      return 0;
+    }
+    return 4;
+  }
+  return 0;
+}
+
+static inline bool is_hex_digit(char c) {
+  return is_digit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+// `offset` points behind the opening quote and is moved behind the closing one
+static bool validate_string(const char *buffer, size_t size, size_t *offset) {
+  size_t i = *offset;
+  for (;;) {
+    i = find_string_special(buffer, size, i);
+    if (i >= size) {
+      return false;
+    }
+    const unsigned char c = (unsigned char)buffer[i];
+    if (c == '"') {
+      *offset = i + 1;
+      return true;
+    }
+    if (c == '\\') {
+      if (i + 1 >= size) {
+        return false;
+      }
+      switch (buffer[i + 1]) {
+      case '"':
+      case '\\':
+      case '/':
+      case 'b':
+      case 'f':
+      case 'n':
+      case 'r':
+      case 't':
+        i += 2;
+        break;
+      case 'u':
+        if (i + 6 > size || !is_hex_digit(buffer[i + 2]) ||
+            !is_hex_digit(buffer[i + 3]) || !is_hex_digit(buffer[i + 4]) ||
+            !is_hex_digit(buffer[i + 5])) {
+          return false;
+        }
+        i += 6;
+        break;
+      default:
+        return false;
+      }
+    } else if (c < 0x20) {
+      return false;
+    } else {
+      const size_t length =
+          utf8_sequence_length((const unsigned char *)&buffer[i], size - i);
+      if (0 == length) {
+        return false;
+      }
+      i += length;
+    }
+  }
+}
+
+static bool validate_number(const char *buffer, size_t size, size_t *offset) {
+  size_t i = *offset;
+  if (i < size && buffer[i] == '-') {
+    i++;
+  }
+  if (i >= size) {
+    return false;
+  }
+  if (buffer[i] == '0') {
+    i++;
+  } else if (is_digit(buffer[i])) {
+    while (i < size && is_digit(buffer[i])) {
+      i++;
+    }
+  } else {
+    return false;
+  }
+  if (i < size && buffer[i] == '.') {
+    i++;
+    if (i >= size || !is_digit(buffer[i])) {
+      return false;
+    }
+    while (i < size && is_digit(buffer[i])) {
+      i++;
+    }
+  }
+  if (i < size && (buffer[i] == 'e' || buffer[i] == 'E')) {
+    i++;
+    if (i < size && (buffer[i] == '+' || buffer[i] == '-')) {
+      i++;
+    }
+    if (i >= size || !is_digit(buffer[i])) {
+      return false;
+    }
+    while (i < size && is_digit(buffer[i])) {
+      i++;
+    }
+  }
+  *offset = i;
+  return true;
+}
+
+static bool validate_literal(const char *buffer, size_t size, size_t *offset,
+                             const char *literal, size_t length) {
+  if (size - *offset < length ||
+      0 != memcmp(&buffer[*offset], literal, length)) {
+    return false;
+  }
+  *offset += length;
+  return true;
+}
+
+lightweight_json_err_t lightweight_json_validate(const char *buffer,
+                                                 size_t buffer_size) {
+  if (NULL == buffer) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+
+  // One bit per level, set for arrays
+  uint8_t is_array[(LIGHTWEIGHT_JSON_VALIDATE_MAX_DEPTH + 7) / 8];
+  int depth = 0;
+  enum { EXPECT_VALUE, EXPECT_KEY, AFTER_VALUE } state = EXPECT_VALUE;
+  size_t i = skip_whitespace(buffer, buffer_size, 0);
+
+  for (;;) {
+    switch (state) {
+    case EXPECT_VALUE:
+      if (i >= buffer_size) {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+      }
+      switch (buffer[i]) {
+      case '{':
+      case '[':
+        if (depth == LIGHTWEIGHT_JSON_VALIDATE_MAX_DEPTH) {
+          return LIGHTWEIGHT_JSON_ERR_MAX_NESTING_REACHED;
+        }
+        if (buffer[i] == '[') {
+          is_array[depth / 8] |= (uint8_t)(1u << (depth % 8));
+          state = EXPECT_VALUE;
         } else {
-          cur_string_end = offset - 1;
-          const char *found_key = &ctx->buffer[cur_string_offset];
-          char temp[64] = {0};
-          memcpy(temp, found_key, cur_string_end - cur_string_offset + 1);
+          is_array[depth / 8] &= (uint8_t) ~(1u << (depth % 8));
+          state = EXPECT_KEY;
+        }
+        depth++;
+        i = skip_whitespace(buffer, buffer_size, i + 1);
+        if (i < buffer_size &&
+            buffer[i] == (EXPECT_VALUE == state ? ']' : '}')) {
+          // Empty object / array
+          depth--;
+          i++;
+          state = AFTER_VALUE;
+        }
+        continue;
+      case '"':
+        i++;
+        if (!validate_string(buffer, buffer_size, &i)) {
+          return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+        }
+        break;
+      case 't':
+        if (!validate_literal(buffer, buffer_size, &i, "true", 4)) {
+          return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+        }
+        break;
+      case 'f':
+        if (!validate_literal(buffer, buffer_size, &i, "false", 5)) {
+          return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+        }
+        break;
+      case 'n':
+        if (!validate_literal(buffer, buffer_size, &i, "null", 4)) {
+          return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+        }
+        break;
+      default:
+        if (!validate_number(buffer, buffer_size, &i)) {
+          return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+        }
+        break;
+      }
+      state = AFTER_VALUE;
+      break;
+    case EXPECT_KEY:
+      if (i >= buffer_size || buffer[i] != '"') {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+      }
+      i++;
+      if (!validate_string(buffer, buffer_size, &i)) {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+      }
+      i = skip_whitespace(buffer, buffer_size, i);
+      if (i >= buffer_size || buffer[i] != ':') {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+      }
+      i = skip_whitespace(buffer, buffer_size, i + 1);
+      state = EXPECT_VALUE;
+      break;
+    case AFTER_VALUE:
+      i = skip_whitespace(buffer, buffer_size, i);
+      if (0 == depth) {
+        // Only whitespace may follow the root value
+        return i == buffer_size ? LIGHTWEIGHT_JSON_ERR_NONE
+                                : LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+      }
+      if (i >= buffer_size) {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+      }
+      const bool in_array =
+          is_array[(depth - 1) / 8] & (1u << ((depth - 1) % 8));
+      if (buffer[i] == ',') {
+        i = skip_whitespace(buffer, buffer_size, i + 1);
+        state = in_array ? EXPECT_VALUE : EXPECT_KEY;
+      } else if (buffer[i] == (in_array ? ']' : '}')) {
+        depth--;
+        i++;
+      } else {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+      }
+      break;
+    }
+  }
+}
+
+// --- Minifying ---
+
+// Copy the rest of a string, from the content at `*offset` up to and
+// including the closing quote. False if there is none.
+static bool minify_string(const char *buffer, size_t size, size_t *offset,
+                          char *out, size_t *out_offset) {
+  const size_t end = scan_string(buffer, size, *offset);
+  if (end >= size) {
+    return false;
+  }
+  // May overlap when minifying in place
+  memmove(&out[*out_offset], &buffer[*offset], end + 1 - *offset);
+  *out_offset += end + 1 - *offset;
+  *offset = end + 1;
+  return true;
+}
+
+#ifdef LIGHTWEIGHT_JSON_SSE2
+// Bit i is the parity of the bits 0..i, i.e. set from an opening quote up to
+// the byte before the closing one
+static inline uint32_t prefix_xor16(uint32_t mask) {
+  mask ^= mask << 1;
+  mask ^= mask << 2;
+  mask ^= mask << 4;
+  mask ^= mask << 8;
+  return mask & 0xFFFF;
+}
+#endif
+
+lightweight_json_err_t lightweight_json_minify(const char *buffer,
+                                               size_t buffer_size, char *out,
+                                               size_t out_size,
+                                               size_t *out_len) {
+  if (NULL == buffer || NULL == out || NULL == out_len ||
+      out_size < buffer_size) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+
+  // The output never runs ahead of the input, so in place every byte is read
+  // before it gets overwritten
+  size_t o = 0;
+  size_t i = 0;
+#ifdef LIGHTWEIGHT_JSON_SSE2
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i cr = _mm_set1_epi8('\r');
+  const __m128i lf = _mm_set1_epi8('\n');
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  bool in_string = false;
+  // The second half is only read by the 16 byte stores below
+  char bytes[32] = {0};
+  while (i + 16 <= buffer_size) {
+    const __m128i chunk = _mm_loadu_si128((const __m128i *)&buffer[i]);
+    const uint32_t ws = (uint32_t)_mm_movemask_epi8(
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, space),
+                                  _mm_cmpeq_epi8(chunk, tab)),
+                     _mm_or_si128(_mm_cmpeq_epi8(chunk, cr),
+                                  _mm_cmpeq_epi8(chunk, lf))));
+    const uint32_t quotes =
+        (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, quote));
+    const uint32_t backslashes =
+        (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, backslash));
+    // Up to the first backslash, the quote after it might be escaped
+    const unsigned n =
+        0 == backslashes ? 16 : count_trailing_zeros(backslashes);
+    const uint32_t valid = (1u << n) - 1;
+    const uint32_t inside =
+        prefix_xor16(quotes & valid) ^ (in_string ? 0xFFFF : 0);
+    const uint32_t keep = (~ws | inside) & valid;
+    if (0xFFFF == keep) {
+      _mm_storeu_si128((__m128i *)&out[o], chunk);
+      o += 16;
+    } else if (0 != keep) {
+      _mm_storeu_si128((__m128i *)bytes, chunk);
+      if (out == buffer ? o + 16 <= i : o + 32 <= out_size) {
+        // Copy run by run with 16 byte stores. What they write past the run
+        // is either already consumed input or overwritten by the next run.
+        uint32_t runs = keep;
+        while (0 != runs) {
+          const unsigned start = count_trailing_zeros(runs);
+          const unsigned len = count_trailing_zeros(~(runs >> start));
+          _mm_storeu_si128((__m128i *)&out[o],
+                           _mm_loadu_si128((const __m128i *)&bytes[start]));
+          o += len;
+          runs &= ~(((1u << len) - 1) << start);
+        }
+      } else {
+        for (unsigned k = 0; k < n; k++) {
+          out[o] = bytes[k];
+          o += (keep >> k) & 1;
+        }
+      }
+    }
+    if (0 != n) {
+      in_string = (inside >> (n - 1)) & 1;
+    }
+    i += n;
+    if (16 != n) {
+      if (in_string) {
+        // The escape sequence's first two bytes
+        if (i + 1 >= buffer_size) {
+          return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+        }
+        out[o] = buffer[i];
+        out[o + 1] = buffer[i + 1];
+        o += 2;
+        i += 2;
+      } else {
+        out[o++] = buffer[i++];
+      }
+    }
+  }
+  if (in_string && !minify_string(buffer, buffer_size, &i, out, &o)) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+  }
+#endif
+  while (i < buffer_size) {
+    const char c = buffer[i++];
+    if (c == '"') {
+      out[o++] = c;
+      if (!minify_string(buffer, buffer_size, &i, out, &o)) {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+      }
+      continue;
+    }
+    out[o] = c;
+    o += !is_whitespace(c);
+  }
+  *out_len = o;
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+static inline lightweight_json_reader_level_t *
+reader_level(lightweight_json_reader_ctx_t *ctx) {
+  return LIGHTWEIGHT_JSON_LEVELS(ctx) + ctx->nesting;
+}
+
+// Offset of the '{' / '[' of the current object / array
+static inline size_t reader_level_offset(lightweight_json_reader_ctx_t *ctx) {
+  return reader_level(ctx)->offset & ~LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT;
+}
+
+static inline lightweight_json_type_e
+reader_level_type(lightweight_json_reader_ctx_t *ctx) {
+  return (reader_level(ctx)->offset & LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT)
+             ? LIGHTWEIGHT_JSON_ARRAY
+             : LIGHTWEIGHT_JSON_OBJECT;
+}
+
+// Offset right after the '[' or the ',' of the current array element
+static inline size_t reader_value_offset(lightweight_json_reader_ctx_t *ctx) {
+  lightweight_json_reader_level_t *level = reader_level(ctx);
+  return (level->offset & ~LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT) +
+         level->suboffset + 1;
+}
+
+static bool reader_stack_valid(lightweight_json_reader_level_t *levels,
+                               size_t max_nesting) {
+  if (0 == max_nesting || max_nesting > INT32_MAX) {
+    return false;
+  }
+  return NULL != levels || max_nesting <= LIGHTWEIGHT_JSON_MAX_NESTING_SIZE;
+}
+
+static void reader_reset(lightweight_json_reader_ctx_t *ctx, const char *buffer,
+                         size_t buffer_size,
+                         lightweight_json_reader_level_t *levels,
+                         size_t max_nesting) {
+  ctx->buffer = buffer;
+  ctx->buffer_size = buffer_size;
+  ctx->nesting = 0;
+  ctx->max_nesting = (int)max_nesting;
+  ctx->levels = levels;
+  ctx->flags = 0;
+  ctx->document = NULL;
+  ctx->format = LIGHTWEIGHT_JSON_FORMAT_JSON;
+  memset(&ctx->array_table, 0, sizeof(ctx->array_table));
+#ifdef LIGHTWEIGHT_JSON_ENABLE_STATS
+  memset(&ctx->stats, 0, sizeof(ctx->stats));
+  ctx->current_api = LIGHTWEIGHT_JSON_API_OTHER;
+  ctx->call_hook = NULL;
+  ctx->call_hook_userdata = NULL;
+#endif
+}
+
+// Validate the document and return the offset of its root object / array
+static lightweight_json_err_t validate_root(const char *buffer,
+                                            size_t buffer_size,
+                                            size_t *out_root) {
+  const lightweight_json_err_t err =
+      lightweight_json_validate(buffer, buffer_size);
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+    return err;
+  }
+  // The root has to be an object or array
+  const size_t root = skip_whitespace(buffer, buffer_size, 0);
+  if (buffer[root] != '{' && buffer[root] != '[') {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+  }
+  *out_root = root;
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+// Enter the first object / array at or after `first`
+static lightweight_json_err_t
+reader_enter_root(lightweight_json_reader_ctx_t *ctx, size_t first) {
+  const char *buffer = ctx->buffer;
+  const size_t buffer_size = ctx->buffer_size;
+  bool found = false;
+  for (size_t i = first; i < buffer_size; i++) {
+    if (buffer[i] == '{' || buffer[i] == '[') {
+      lightweight_json_reader_level_t *level = reader_level(ctx);
+      level->offset = (uint32_t)i;
+      if (buffer[i] == '[') {
+        level->offset |= LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT;
+      }
+      level->suboffset = 0;
+      found = true;
+      break;
+    }
+  }
+  if (!found) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+lightweight_json_err_t lightweight_json_reader_init_ex(
+    const char *buffer, size_t buffer_size,
+    lightweight_json_reader_level_t *levels, size_t max_nesting,
+    uint32_t flags, lightweight_json_reader_ctx_t *ctx) {
+  if (NULL == buffer || 0 == buffer_size || NULL == ctx ||
+      !reader_stack_valid(levels, max_nesting)) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  if (buffer_size > ~LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT) {
+    // Offsets are stored in 31 bits
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  reader_reset(ctx, buffer, buffer_size, levels, max_nesting);
+
+  size_t first = 0;
+  if (flags & LIGHTWEIGHT_JSON_READER_FLAG_VALIDATE) {
+    const lightweight_json_err_t err =
+        validate_root(buffer, buffer_size, &first);
+    if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+      return err;
+    }
+    ctx->flags |= LIGHTWEIGHT_JSON_READER_FLAG_VALIDATE;
+  }
+  return reader_enter_root(ctx, first);
+}
+
+lightweight_json_err_t lightweight_json_reader_init_minify(
+    char *buffer, size_t buffer_size, lightweight_json_reader_level_t *levels,
+    size_t max_nesting, uint32_t flags, lightweight_json_reader_ctx_t *ctx) {
+  if (NULL == buffer || 0 == buffer_size || NULL == ctx) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  size_t size = 0;
+  const lightweight_json_err_t err =
+      lightweight_json_minify(buffer, buffer_size, buffer, buffer_size, &size);
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+    return err;
+  }
+  return lightweight_json_reader_init_ex(buffer, size, levels, max_nesting,
+                                         flags, ctx);
+}
+
+// Fill the bracket match index of a validated document. While an entry is
+// still open, its `close` links to the enclosing open entry (+1, 0 for none).
+static lightweight_json_err_t
+build_index(const char *buffer, size_t buffer_size,
+            lightweight_json_index_entry_t *index, size_t capacity,
+            size_t *out_size) {
+  size_t count = 0;
+  size_t open = 0;
+  for (size_t offset = 0; offset < buffer_size; offset++) {
+    switch (buffer[offset]) {
+    case '"':
+      offset = scan_string(buffer, buffer_size, offset + 1);
+      break;
+    case '{':
+    case '[':
+      if (count == capacity) {
+        return LIGHTWEIGHT_JSON_ERR_BUFFER_TOO_SMALL;
+      }
+      index[count].open = (uint32_t)offset;
+      index[count].close = (uint32_t)open;
+      open = ++count;
+      break;
+    case '}':
+    case ']': {
+      lightweight_json_index_entry_t *entry = &index[open - 1];
+      open = entry->close;
+      entry->close = (uint32_t)offset;
+      break;
+    }
+    default:
+      break;
+    }
+  }
+  *out_size = count;
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+lightweight_json_err_t
+lightweight_json_document_init(const char *buffer, size_t buffer_size,
+                               lightweight_json_index_entry_t *index,
+                               size_t index_capacity,
+                               lightweight_json_document_t *doc) {
+  if (NULL == buffer || 0 == buffer_size || NULL == doc ||
+      (NULL == index && 0 != index_capacity)) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  if (buffer_size > ~LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+
+  size_t root = 0;
+  lightweight_json_err_t err = validate_root(buffer, buffer_size, &root);
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+    return err;
+  }
+  doc->buffer = buffer;
+  doc->buffer_size = buffer_size;
+  doc->index = NULL;
+  doc->index_size = 0;
+  if (NULL != index) {
+    size_t index_size = 0;
+    err = build_index(buffer, buffer_size, index, index_capacity, &index_size);
+    if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+      return err;
+    }
+    doc->index = index;
+    doc->index_size = index_size;
+  }
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+lightweight_json_err_t lightweight_json_reader_init_document(
+    const lightweight_json_document_t *doc,
+    lightweight_json_reader_level_t *levels, size_t max_nesting,
+    lightweight_json_reader_ctx_t *ctx) {
+  if (NULL == doc || NULL == doc->buffer || NULL == ctx ||
+      !reader_stack_valid(levels, max_nesting)) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  reader_reset(ctx, doc->buffer, doc->buffer_size, levels, max_nesting);
+  ctx->flags = LIGHTWEIGHT_JSON_READER_FLAG_VALIDATE;
+  ctx->document = doc;
+  return reader_enter_root(
+      ctx, skip_whitespace(doc->buffer, doc->buffer_size, 0));
+}
+
+lightweight_json_err_t lightweight_json_reader_init_with_stack(
+    const char *buffer, size_t buffer_size,
+    lightweight_json_reader_level_t *levels, size_t max_nesting,
+    lightweight_json_reader_ctx_t *ctx) {
+  return lightweight_json_reader_init_ex(buffer, buffer_size, levels,
+                                         max_nesting, 0, ctx);
+}
+
+lightweight_json_err_t lightweight_json_reader_init_format(
+    const char *buffer, size_t buffer_size, lightweight_json_format_e format,
+    lightweight_json_reader_level_t *levels, size_t max_nesting,
+    lightweight_json_reader_ctx_t *ctx) {
+  if (LIGHTWEIGHT_JSON_FORMAT_JSON == format) {
+    return lightweight_json_reader_init_ex(buffer, buffer_size, levels,
+                                           max_nesting, 0, ctx);
+  }
+  if (NULL == buffer || 0 == buffer_size || NULL == ctx ||
+      (uint8_t)format > (uint8_t)LIGHTWEIGHT_JSON_FORMAT_MSGPACK ||
+      !reader_stack_valid(levels, max_nesting) || max_nesting < 2 ||
+      buffer_size > ~LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  // Two stack entries per level
+  reader_reset(ctx, buffer, buffer_size, levels, max_nesting / 2);
+  ctx->format = format;
+  return lightweight_json_binary_reader_init(ctx);
+}
+
+lightweight_json_err_t
+lightweight_json_reader_init(const char *buffer, size_t buffer_size,
+                             lightweight_json_reader_ctx_t *ctx) {
+  // NULL levels -> the stack embedded into the context is used
+  return lightweight_json_reader_init_ex(
+      buffer, buffer_size, NULL, LIGHTWEIGHT_JSON_MAX_NESTING_SIZE, 0, ctx);
+}
+
+// Whether the document passed validation, the reader can skip its checks then
+static inline bool reader_validated(lightweight_json_reader_ctx_t *ctx) {
+  return ctx->flags & LIGHTWEIGHT_JSON_READER_FLAG_VALIDATE;
+}
+
+// Offset of the '}' / ']' matching the '{' / '[' at `open`
+static size_t index_find_close(const lightweight_json_document_t *doc,
+                               size_t open) {
+  size_t low = 0;
+  size_t high = doc->index_size;
+  while (low < high) {
+    const size_t mid = low + (high - low) / 2;
+    if (doc->index[mid].open < open) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  // The index covers every object / array of the document
+  return doc->index[low].close;
+}
+
+// Offset right behind the value at `offset`. Only strings and brackets are
+// looked at, so the value has to be valid.
+static size_t skip_json_value(const char *buffer, size_t size, size_t offset) {
+  switch (buffer[offset]) {
+  case '"':
+    return scan_string(buffer, size, offset + 1) + 1;
+  case '{':
+  case '[': {
+    int nesting = 0;
+    for (; offset < size; offset++) {
+      switch (buffer[offset]) {
+      case '"':
+        offset = scan_string(buffer, size, offset + 1);
+        break;
+      case '{':
+      case '[':
+        nesting++;
+        break;
+      case '}':
+      case ']':
+        if (0 == --nesting) {
+          return offset + 1;
+        }
+        break;
+      default:
+        break;
+      }
+    }
+    return size;
+  }
+  default:
+    // Number or literal
+    while (offset < size && buffer[offset] != ',' && buffer[offset] != '}' &&
+           buffer[offset] != ']' && !is_whitespace(buffer[offset])) {
+      offset++;
+    }
+    return offset;
+  }
+}
+
+// Offset right behind the value at `offset` of a validated document
+static size_t skip_value(lightweight_json_reader_ctx_t *ctx, size_t offset) {
+  const char *buffer = ctx->buffer;
+  if (buffer[offset] == '{' || buffer[offset] == '[') {
+    STATS_ADD(ctx, subtrees_skipped, 1);
+    if (NULL != ctx->document && NULL != ctx->document->index) {
+      return index_find_close(ctx->document, offset) + 1;
+    }
+  }
+  return skip_json_value(buffer, ctx->buffer_size, offset);
+}
+
+// find_key for validated documents: hops from member to member instead of
+// looking at every character
+static size_t find_key_validated(lightweight_json_reader_ctx_t *ctx,
+                                 const char *key, size_t key_len) {
+  if (LIGHTWEIGHT_JSON_OBJECT != reader_level_type(ctx)) {
+    return 0;
+  }
+  const char *buffer = ctx->buffer;
+  const size_t size = ctx->buffer_size;
+  const size_t start = reader_level_offset(ctx) + 1;
+
+  size_t offset = skip_whitespace(buffer, size, start);
+  while (offset < size && buffer[offset] == '"') {
+    const size_t key_begin = offset + 1;
+    const size_t key_end = scan_string(buffer, size, key_begin);
+    // Skip the colon
+    offset = skip_whitespace(buffer, size, key_end + 1) + 1;
+    offset = skip_whitespace(buffer, size, offset);
+    if (key_end - key_begin == key_len &&
+        0 == memcmp(&buffer[key_begin], key, key_len)) {
+      STATS_SCANNED(ctx, offset - start);
+      return offset;
+    }
+    offset = skip_whitespace(buffer, size, skip_value(ctx, offset));
+    if (offset >= size || buffer[offset] != ',') {
+      break;
+    }
+    offset = skip_whitespace(buffer, size, offset + 1);
+  }
+  STATS_SCANNED(ctx, offset - start);
+  return 0;
+}
+
+// Offset behind `key` in the current object, 0 if it doesn't exist. For
+// validated documents this is the value's first character, otherwise
+// whitespace and the colon may still follow.
+static size_t find_key(lightweight_json_reader_ctx_t *ctx, const char *key,
+                       size_t key_len) {
+  if (NULL == ctx || NULL == key) {
+    return 0;
+  }
+
+  STATS_ADD(ctx, lookups, 1);
+  if (reader_validated(ctx)) {
+    return find_key_validated(ctx, key, key_len);
+  }
+  const size_t start = reader_level_offset(ctx) + 1;
+  size_t offset = start;
+  int nesting = 0;
+  bool in_string = false;
+  bool is_val = false;
+  size_t cur_string_offset = 0;
+  for (; offset < ctx->buffer_size; offset++) {
+    const char c = ctx->buffer[offset];
+
+    switch (c) {
+    case '\"':
+      if (nesting == 0 && !is_val) {
+        if (!in_string) {
+          cur_string_offset = offset + 1;
+        } else {
+          if (offset - cur_string_offset == key_len &&
+              0 == memcmp(&ctx->buffer[cur_string_offset], key, key_len)) {
+            STATS_SCANNED(ctx, offset - start);
+            return offset + 1;
+          }
+        }
+      }
+      in_string = !in_string;
+      break;
+    case ':':
+      if (!in_string && nesting == 0) {
+        is_val = true;
+      }
+      break;
+    case ',':
+      if (!in_string && nesting == 0) {
+        is_val = false;
+      }
+      break;
+    case '[':
+    case '{':
+      if (!in_string) {
+        if (0 == nesting) {
+          STATS_ADD(ctx, subtrees_skipped, 1);
+        }
+        nesting++;
+      }
+      break;
+    case ']':
+    case '}':
+      if (!in_string) {
+        nesting--;
+        if (nesting < 0) {
+          // End of current object
+          STATS_SCANNED(ctx, offset - start);
+          return 0;
+        }
+      }
+      break;
+    case '\\':
+      if (in_string) {
+        // Skip escape sequence
+        offset++;
+      }
+      break;
+    default:
+
+      break;
+    }
+  }
+
+  STATS_SCANNED(ctx, offset - start);
+  return 0;
+}
+
+// Offset of the value of `key` in the current object, or of the current array
+// element if `key` is NULL. For validated documents it points at the value's
+// first character.
+static lightweight_json_err_t locate_value_n(lightweight_json_reader_ctx_t *ctx,
+                                             const char *key, size_t key_len,
+                                             size_t *out_offset) {
+  size_t offset = reader_value_offset(ctx);
+  if (NULL != key) {
+    offset = find_key(ctx, key, key_len);
+    if (0 == offset) {
+      return LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
+    }
+    if (!reader_validated(ctx)) {
+      // Skip the colon
+      offset = skip_whitespace(ctx->buffer, ctx->buffer_size, offset);
+      if (offset < ctx->buffer_size && ctx->buffer[offset] == ':') {
+        offset++;
+      }
+    }
+  } else if (reader_validated(ctx)) {
+    offset = skip_whitespace(ctx->buffer, ctx->buffer_size, offset);
+  }
+  *out_offset = offset;
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+static inline lightweight_json_err_t
+locate_value(lightweight_json_reader_ctx_t *ctx, const char *key,
+             size_t *out_offset) {
+  return locate_value_n(ctx, key, NULL != key ? strlen(key) : 0, out_offset);
+}
+
+// Error for a validated value that doesn't have the requested type
+static inline lightweight_json_err_t
+type_mismatch(lightweight_json_reader_ctx_t *ctx, size_t offset) {
+  // An empty array / the end of the array has no value at all
+  return ctx->buffer[offset] == ']' ? LIGHTWEIGHT_JSON_ERR_NOT_FOUND
+                                    : LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
+}
+
+static lightweight_json_err_t
+reader_key_exists(lightweight_json_reader_ctx_t *ctx, const char *key) {
+  if (NULL == ctx || NULL == key) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  if (LIGHTWEIGHT_JSON_FORMAT_JSON != ctx->format) {
+    return lightweight_json_binary_key_exists(ctx, key);
+  }
+
+  size_t offset = find_key(ctx, key, strlen(key));
+  if (0 == offset) {
+    return LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
+  }
+
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+lightweight_json_err_t
+lightweight_json_reader_key_exists(lightweight_json_reader_ctx_t *ctx,
+                                   const char *key) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_READER_KEY_EXISTS,
+             reader_key_exists(ctx, key));
+}
+
+// Output of the unescaper, counts on once the buffer is full
+typedef struct {
+  char *buffer;
+  size_t capacity;
+  size_t length;
+} unescape_out_t;
+
+static inline void unescape_emit(unescape_out_t *out, const char *data,
+                                 size_t len) {
+  if (out->length + len <= out->capacity) {
+    memcpy(&out->buffer[out->length], data, len);
+  }
+  out->length += len;
+}
+
+static inline int hex_value(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+// Parse the 4 hex digits at `p`, -1 if they aren't
+static int32_t parse_hex4(const char *p) {
+  int32_t value = 0;
+  for (int i = 0; i < 4; i++) {
+    const int digit = hex_value(p[i]);
+    if (digit < 0) {
+      return -1;
+    }
+    value = (value << 4) | digit;
+  }
+  return value;
+}
+
+static size_t utf8_encode(uint32_t cp, char *out) {
+  if (cp < 0x80) {
+    out[0] = (char)cp;
+    return 1;
+  }
+  if (cp < 0x800) {
+    out[0] = (char)(0xC0 | (cp >> 6));
+    out[1] = (char)(0x80 | (cp & 0x3F));
+    return 2;
+  }
+  if (cp < 0x10000) {
+    out[0] = (char)(0xE0 | (cp >> 12));
+    out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[2] = (char)(0x80 | (cp & 0x3F));
+    return 3;
+  }
+  out[0] = (char)(0xF0 | (cp >> 18));
+  out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+  out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+  out[3] = (char)(0x80 | (cp & 0x3F));
+  return 4;
+}
+
+// Decode the escape sequence at `src[*offset]` (the character after the
+// backslash), unpaired surrogates become U+FFFD
+static bool unescape_sequence(const char *src, size_t len, size_t *offset,
+                              unescape_out_t *out) {
+  const char c = src[*offset];
+  char decoded = 0;
+  switch (c) {
+  case '"':
+  case '\\':
+  case '/':
+    decoded = c;
+    break;
+  case 'b':
+    decoded = '\b';
+    break;
+  case 'f':
+    decoded = '\f';
+    break;
+  case 'n':
+    decoded = '\n';
+    break;
+  case 'r':
+    decoded = '\r';
+    break;
+  case 't':
+    decoded = '\t';
+    break;
+  case 'u': {
+    if (len - *offset < 5) {
+      return false;
+    }
+    int32_t cp = parse_hex4(&src[*offset + 1]);
+    if (cp < 0) {
+      return false;
+    }
+    *offset += 5;
+    if (cp >= 0xD800 && cp <= 0xDBFF && len - *offset >= 6 &&
+        src[*offset] == '\\' && src[*offset + 1] == 'u') {
+      const int32_t low = parse_hex4(&src[*offset + 2]);
+      if (low >= 0xDC00 && low <= 0xDFFF) {
+        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+        *offset += 6;
+      }
+    }
+    if (cp >= 0xD800 && cp <= 0xDFFF) {
+      cp = 0xFFFD;
+    }
+    char utf8[4];
+    unescape_emit(out, utf8, utf8_encode((uint32_t)cp, utf8));
+    return true;
+  }
+  default:
+    return false;
+  }
+  *offset += 1;
+  unescape_emit(out, &decoded, 1);
+  return true;
+}
+
+// Decode the string content `src` (without quotes) into `out`. Runs without a
+// backslash are found with find_quote_or_backslash and copied in bulk.
+static bool unescape_into(const char *src, size_t len, unescape_out_t *out) {
+  size_t offset = 0;
+  while (offset < len) {
+    // The content has no unescaped quotes, so this stops at backslashes only
+    const size_t escape = find_quote_or_backslash(src, len, offset);
+    unescape_emit(out, &src[offset], escape - offset);
+    if (escape >= len) {
+      break;
+    }
+    offset = escape + 1;
+    if (offset >= len || !unescape_sequence(src, len, &offset, out)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Terminate the decoded string, or empty the buffer if decoding failed (`ok`
+// false) or the string didn't fit
+static lightweight_json_err_t unescape_finish(unescape_out_t *out, bool ok,
+                                              size_t *out_len) {
+  if (!ok) {
+    out->buffer[0] = '\0';
+    return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+  }
+
+  if (NULL != out_len) {
+    *out_len = out->length;
+  }
+  if (out->length > out->capacity) {
+    out->buffer[0] = '\0';
+    return LIGHTWEIGHT_JSON_ERR_BUFFER_TOO_SMALL;
+  }
+  out->buffer[out->length] = '\0';
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+static lightweight_json_err_t unescape_string(const char *src, size_t len,
+                                              char *buffer, size_t buffer_len,
+                                              size_t *out_len) {
+  unescape_out_t out = {buffer, buffer_len - 1, 0};
+  return unescape_finish(&out, unescape_into(src, len, &out), out_len);
+}
+
+static lightweight_json_err_t
+reader_get_string(lightweight_json_reader_ctx_t *ctx, const char *key,
+                  char *buffer, size_t buffer_len, size_t *out_len) {
+  if (NULL == ctx || NULL == buffer || 0 == buffer_len) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+
+  buffer[0] = '\0';
+  if (LIGHTWEIGHT_JSON_FORMAT_JSON != ctx->format) {
+    return lightweight_json_binary_get_string(ctx, key, buffer, buffer_len,
+                                              out_len);
+  }
+
+  size_t offset = 0;
+  const lightweight_json_err_t err = locate_value(ctx, key, &offset);
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+    return err;
+  }
+  if (reader_validated(ctx)) {
+    if (ctx->buffer[offset] != '"') {
+      return type_mismatch(ctx, offset);
+    }
+    const size_t end = scan_string(ctx->buffer, ctx->buffer_size, offset + 1);
+    STATS_SCANNED(ctx, end - offset + 1);
+    return unescape_string(&ctx->buffer[offset + 1], end - offset - 1, buffer,
+                           buffer_len, out_len);
+  }
+
+  const size_t value_offset = offset;
+  bool in_string = false;
+  size_t string_begin = 0;
+  for (; offset < ctx->buffer_size; offset++) {
+    const char c = ctx->buffer[offset];
+
+    switch (c) {
+    case '\"':
+      if (!in_string) {
+        in_string = true;
+        string_begin = offset;
+      } else {
+        STATS_SCANNED(ctx, offset - value_offset + 1);
+        return unescape_string(&ctx->buffer[string_begin + 1],
+                               offset - string_begin - 1, buffer, buffer_len,
+                               out_len);
+      }
+      break;
+    case '\\':
+      // Skip escape
+      offset++;
+      break;
+    default:
+      if (!in_string && c != ' ' && c != '\r' && c != '\n' && c != '\t' &&
+          c != ':') {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
+      }
+      break;
+    }
+  }
+
+  return LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
+}
+
+lightweight_json_err_t
+lightweight_json_reader_get_string(lightweight_json_reader_ctx_t *ctx,
+                                   const char *key, char *buffer,
+                                   size_t buffer_len) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_READER_GET_STRING,
+             reader_get_string(ctx, key, buffer, buffer_len, NULL));
+}
+
+lightweight_json_err_t lightweight_json_reader_get_string_len(
+    lightweight_json_reader_ctx_t *ctx, const char *key, char *buffer,
+    size_t buffer_len, size_t *out_len) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_READER_GET_STRING,
+             reader_get_string(ctx, key, buffer, buffer_len, out_len));
+}
+
+typedef enum {
+  NUMERICAL_TYPE_UINT64,
+  NUMERICAL_TYPE_INT64,
+  NUMERICAL_TYPE_DOUBLE,
+} numerical_type_t;
+
+static inline size_t min_size(size_t a, size_t b) { return a < b ? a : b; }
+
+// Convert a number lexeme the slow way
+static lightweight_json_err_t convert_number(const char *number, size_t len,
+                                             void *out_value,
+                                             numerical_type_t numerical_type) {
+  char temp[64] = {0};
+  memcpy(temp, number, min_size(len, sizeof(temp) - 1));
+
+  switch (numerical_type) {
+  case NUMERICAL_TYPE_UINT64:
+    *(uint64_t *)out_value = strtoull(temp, NULL, 0);
+    break;
+  case NUMERICAL_TYPE_INT64:
+    *(int64_t *)out_value = strtoll(temp, NULL, 0);
+    break;
+  case NUMERICAL_TYPE_DOUBLE:
+    *(double *)out_value = strtod(temp, NULL);
+    break;
+  default:
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+// Parse the number at `offset` of a validated document. Integers of up to 18
+// digits, which can't overflow, are converted directly.
+static lightweight_json_err_t
+parse_number_validated(lightweight_json_reader_ctx_t *ctx, size_t offset,
+                       void *out_value, numerical_type_t numerical_type) {
+  const char *number = &ctx->buffer[offset];
+  const size_t remaining = ctx->buffer_size - offset;
+  if (number[0] != '-' && !is_digit(number[0])) {
+    return type_mismatch(ctx, offset);
+  }
+
+  const bool negative = number[0] == '-';
+  size_t len = negative ? 1 : 0;
+  uint64_t value = 0;
+  while (len < remaining && is_digit(number[len])) {
+    value = value * 10 + (uint64_t)(number[len] - '0');
+    len++;
+  }
+  const size_t digits = len - (negative ? 1 : 0);
+  const bool integer =
+      len >= remaining || (number[len] != '.' && number[len] != 'e' &&
+                           number[len] != 'E');
+  if (!integer) {
+    while (len < remaining && (is_digit(number[len]) || number[len] == '.' ||
+                               number[len] == 'e' || number[len] == 'E' ||
+                               number[len] == '+' || number[len] == '-')) {
+      len++;
+    }
+  }
+  STATS_SCANNED(ctx, len);
+
+  if (integer && digits <= 18) {
+    switch (numerical_type) {
+    case NUMERICAL_TYPE_UINT64:
+      if (!negative) {
+        *(uint64_t *)out_value = value;
+        return LIGHTWEIGHT_JSON_ERR_NONE;
+      }
+      break;
+    case NUMERICAL_TYPE_INT64:
+      *(int64_t *)out_value = negative ? -(int64_t)value : (int64_t)value;
+      return LIGHTWEIGHT_JSON_ERR_NONE;
+    case NUMERICAL_TYPE_DOUBLE:
+      *(double *)out_value = negative ? -(double)value : (double)value;
+      return LIGHTWEIGHT_JSON_ERR_NONE;
+    default:
+      return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+    }
+  }
+  return convert_number(number, len, out_value, numerical_type);
+}
+
+static lightweight_json_err_t get_numerical(lightweight_json_reader_ctx_t *ctx,
+                                            const char *key, void *out_value,
+                                            numerical_type_t numerical_type) {
+  if (NULL == ctx || NULL == out_value) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  if (LIGHTWEIGHT_JSON_FORMAT_JSON != ctx->format) {
+    static const lightweight_json_value_type_e value_types[] = {
+        [NUMERICAL_TYPE_UINT64] = LIGHTWEIGHT_JSON_VALUE_UINT64,
+        [NUMERICAL_TYPE_INT64] = LIGHTWEIGHT_JSON_VALUE_INT64,
+        [NUMERICAL_TYPE_DOUBLE] = LIGHTWEIGHT_JSON_VALUE_DOUBLE,
+    };
+    return lightweight_json_binary_get_number(
+        ctx, key, value_types[numerical_type], out_value);
+  }
+
+  size_t offset = 0;
+  const lightweight_json_err_t err = locate_value(ctx, key, &offset);
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+    return err;
+  }
+  if (reader_validated(ctx)) {
+    return parse_number_validated(ctx, offset, out_value, numerical_type);
+  }
+
+  const size_t value_offset = offset;
+  bool in_num = false;
+  size_t num_begin = 0;
+  size_t num_end = 0;
+  int decimal_count = 0;
+  int exponent_count = 0;
+  for (; offset < ctx->buffer_size; offset++) {
+    const char c = ctx->buffer[offset];
+
+    switch (c) {
+    case '0':
+    case '1':
+    case '2':
+    case '3':
+    case '4':
+    case '5':
+    case '6':
+    case '7':
+    case '8':
+    case '9':
+      if (!in_num) {
+        in_num = true;
+        num_begin = offset;
+      }
+      break;
+    case '-':
+      if (!in_num) {
+        in_num = true;
+        num_begin = offset;
+      } else if (ctx->buffer[offset - 1] != 'e' &&
+                 ctx->buffer[offset - 1] != 'E') {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+      }
+      break;
+    case '+':
+      if (!in_num || (ctx->buffer[offset - 1] != 'e' &&
+                      ctx->buffer[offset - 1] != 'E')) {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+      }
+      break;
+    case 'e':
+    case 'E':
+      if (in_num && exponent_count == 0) {
+        exponent_count++;
+      } else if (!in_num) {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
+      } else {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+      }
+      break;
+    case '.':
+      if (in_num && decimal_count == 0 && exponent_count == 0) {
+        decimal_count++;
+      } else {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+      }
+      break;
+    case ',':
+    case ']':
+    case '}':
+      if (!in_num) {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+      }
+      in_num = false;
+      num_end = offset;
+
+      STATS_SCANNED(ctx, offset - value_offset + 1);
+      return convert_number(&ctx->buffer[num_begin], num_end - num_begin,
+                            out_value, numerical_type);
+      break;
+    default:
+      if (c != ' ' && c != '\r' && c != '\n' && c != '\t' && c != ':') {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
+      }
+      break;
+    }
+  }
+
+  return LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
+}
+
+lightweight_json_err_t
+lightweight_json_reader_get_uint64(lightweight_json_reader_ctx_t *ctx,
+                                   const char *key, uint64_t *out_value) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_READER_GET_UINT64,
+             get_numerical(ctx, key, (void *)out_value, NUMERICAL_TYPE_UINT64));
+}
+
+lightweight_json_err_t
+lightweight_json_reader_get_double(lightweight_json_reader_ctx_t *ctx,
+                                   const char *key, double *out_value) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_READER_GET_DOUBLE,
+             get_numerical(ctx, key, (void *)out_value, NUMERICAL_TYPE_DOUBLE));
+}
+
+lightweight_json_err_t
+lightweight_json_reader_get_int64(lightweight_json_reader_ctx_t *ctx,
+                                  const char *key, int64_t *out_value) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_READER_GET_INT64,
+             get_numerical(ctx, key, (void *)out_value, NUMERICAL_TYPE_INT64));
+}
+
+// Push the container starting at `offset` onto the nesting stack
+static lightweight_json_err_t push_level(lightweight_json_reader_ctx_t *ctx,
+                                         size_t offset) {
+  if (ctx->nesting == ctx->max_nesting - 1) {
+    return LIGHTWEIGHT_JSON_ERR_MAX_NESTING_REACHED;
+  }
+  ctx->nesting++;
+  lightweight_json_reader_level_t *level = reader_level(ctx);
+  level->offset = (uint32_t)offset;
+  if (ctx->buffer[offset] == '[') {
+    level->offset |= LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT;
+  }
+  level->suboffset = 0;
+  STATS_MAX(ctx, max_depth, (uint32_t)ctx->nesting);
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+static lightweight_json_err_t
+reader_enter(lightweight_json_reader_ctx_t *ctx, const char *key) {
+  if (NULL == ctx) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  if (LIGHTWEIGHT_JSON_FORMAT_JSON != ctx->format) {
+    return lightweight_json_binary_enter(ctx, key);
+  }
+
+  size_t offset = 0;
+  const lightweight_json_err_t err = locate_value(ctx, key, &offset);
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+    return err;
+  }
+  if (reader_validated(ctx)) {
+    if (ctx->buffer[offset] != '{' && ctx->buffer[offset] != '[') {
+      return type_mismatch(ctx, offset);
+    }
+    return push_level(ctx, offset);
+  }
+
+  bool in_string = false;
+  for (; offset < ctx->buffer_size; offset++) {
+    const char c = ctx->buffer[offset];
+
+    switch (c) {
+    case '\"':
+      in_string = !in_string;
+      break;
+    case '\\':
+      // Skip escape
+      offset++;
+      break;
+    case '}':
+    case ']':
+    case ',':
+      if (!in_string) {
+        return LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
+      }
+      break;
+    case '[':
+    case '{':
+      if (!in_string) {
+        return push_level(ctx, offset);
+      }
+      break;
+    default:
+      if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
+      }
+      break;
+    }
+  }
+  return LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
+}
+
+lightweight_json_err_t
+lightweight_json_reader_enter(lightweight_json_reader_ctx_t *ctx,
+                              const char *key) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_READER_ENTER, reader_enter(ctx, key));
+}
+
+static lightweight_json_err_t reader_leave(lightweight_json_reader_ctx_t *ctx) {
+  if (NULL == ctx) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+
+  if (ctx->nesting > 0) {
+    ctx->nesting--;
+  }
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+lightweight_json_err_t
+lightweight_json_reader_leave(lightweight_json_reader_ctx_t *ctx) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_READER_LEAVE, reader_leave(ctx));
+}
+
+static lightweight_json_err_t
+reader_array_next(lightweight_json_reader_ctx_t *ctx) {
+  if (NULL == ctx) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  if (LIGHTWEIGHT_JSON_FORMAT_JSON != ctx->format) {
+    return lightweight_json_binary_array_next(ctx);
+  }
+
+  if (LIGHTWEIGHT_JSON_ARRAY != reader_level_type(ctx)) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_STATE;
+  }
+
+  const size_t start = reader_value_offset(ctx);
+  if (reader_validated(ctx)) {
+    const char *buffer = ctx->buffer;
+    size_t offset = skip_whitespace(buffer, ctx->buffer_size, start);
+    if (buffer[offset] == ']') {
+      return LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
+    }
+    offset = skip_whitespace(buffer, ctx->buffer_size, skip_value(ctx, offset));
+    STATS_SCANNED(ctx, offset - start + 1);
+    if (buffer[offset] != ',') {
+      return LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
+    }
+    reader_level(ctx)->suboffset =
+        (uint32_t)(offset - reader_level_offset(ctx));
+    return LIGHTWEIGHT_JSON_ERR_NONE;
+  }
+
+  size_t offset = start;
+  bool in_string = false;
+  int nesting = 0;
+  for (; offset < ctx->buffer_size; offset++) {
+    const char c = ctx->buffer[offset];
+    switch (c) {
+    case ',':
+      if (!in_string && nesting == 0) {
+        reader_level(ctx)->suboffset =
+            (uint32_t)(offset - reader_level_offset(ctx));
+        STATS_SCANNED(ctx, offset - start + 1);
+        return LIGHTWEIGHT_JSON_ERR_NONE;
+      }
+      break;
+    case '\"':
+      in_string = !in_string;
+      break;
+    case '\\':
+      offset++;
+      break;
+    case '{':
+    case '[':
+      if (!in_string) {
+        if (0 == nesting) {
+          STATS_ADD(ctx, subtrees_skipped, 1);
+        }
+        nesting++;
+      }
+      break;
+    case ']':
+    case '}':
+      if (!in_string && nesting > 0) {
+        nesting--;
+      } else if (!in_string) {
+        STATS_SCANNED(ctx, offset - start + 1);
+        return LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
+      }
+      break;
+    default:
+
+      break;
+    }
+  }
+
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+lightweight_json_err_t
+lightweight_json_reader_array_next(lightweight_json_reader_ctx_t *ctx) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_READER_ARRAY_NEXT,
+             reader_array_next(ctx));
+}
+
+lightweight_json_err_t
+lightweight_json_reader_set_array_table(lightweight_json_reader_ctx_t *ctx,
+                                        uint32_t *entries, size_t capacity) {
+  if (NULL == ctx || (NULL == entries && 0 != capacity) ||
+      (NULL != entries && 0 == capacity)) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  memset(&ctx->array_table, 0, sizeof(ctx->array_table));
+  ctx->array_table.entries = entries;
+  ctx->array_table.capacity = capacity;
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+// Record element `index` at the current position, halving the table first
+// if it is full
+static void array_table_add(lightweight_json_reader_array_table_t *table,
+                            size_t index, uint32_t suboffset) {
+  if (0 != index % table->stride) {
+    return;
+  }
+  if (table->size == table->capacity) {
+    // Keep every other entry
+    for (size_t i = 0; 2 * i < table->size; i++) {
+      table->entries[i] = table->entries[2 * i];
+    }
+    table->size = (table->size + 1) / 2;
+    table->stride *= 2;
+    if (0 != index % table->stride) {
+      return;
+    }
+  }
+  table->entries[table->size++] = suboffset;
+}
+
+// Walk the current array once, counting its elements and filling `table`
+static lightweight_json_err_t
+array_table_build(lightweight_json_reader_ctx_t *ctx,
+                  lightweight_json_reader_array_table_t *table) {
+  lightweight_json_reader_level_t *level = reader_level(ctx);
+  const uint32_t saved = level->suboffset;
+  table->owner = 0;
+  table->size = 0;
+  table->stride = 1;
+
+  level->suboffset = 0;
+  const size_t first =
+      skip_whitespace(ctx->buffer, ctx->buffer_size, reader_value_offset(ctx));
+  size_t length = 0;
+  lightweight_json_err_t err = LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
+  if (first < ctx->buffer_size && ctx->buffer[first] != ']') {
+    do {
+      if (NULL != table->entries) {
+        array_table_add(table, length, level->suboffset);
+      }
+      length++;
+      const uint32_t previous = level->suboffset;
+      err = reader_array_next(ctx);
+      if (LIGHTWEIGHT_JSON_ERR_NONE == err && level->suboffset == previous) {
+        // Ran off the end of the buffer
+        err = LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+      }
+    } while (LIGHTWEIGHT_JSON_ERR_NONE == err);
+  }
+  level->suboffset = saved;
+  if (LIGHTWEIGHT_JSON_ERR_NOT_FOUND != err) {
+    return err;
+  }
+  table->owner = (uint32_t)reader_level_offset(ctx) + 1;
+  table->length = (uint32_t)length;
+  table->nesting = ctx->nesting;
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+// The table of the current array, built on first use. NULL while the
+// context's table belongs to an array further up the stack, which keeps it.
+static lightweight_json_err_t
+array_table_get(lightweight_json_reader_ctx_t *ctx,
+                const lightweight_json_reader_array_table_t **out_table) {
+  if (LIGHTWEIGHT_JSON_FORMAT_JSON != ctx->format) {
+    return LIGHTWEIGHT_JSON_ERR_NOT_SUPPORTED;
+  }
+  if (LIGHTWEIGHT_JSON_ARRAY != reader_level_type(ctx)) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_STATE;
+  }
+  lightweight_json_reader_array_table_t *table = &ctx->array_table;
+  if (0 != table->owner && table->nesting <= ctx->nesting) {
+    const lightweight_json_reader_level_t *owner =
+        LIGHTWEIGHT_JSON_LEVELS(ctx) + table->nesting;
+    if ((owner->offset & ~LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT) + 1 ==
+        table->owner) {
+      *out_table = table->nesting == ctx->nesting ? table : NULL;
+      return LIGHTWEIGHT_JSON_ERR_NONE;
+    }
+  }
+  *out_table = table;
+  return array_table_build(ctx, table);
+}
+
+static lightweight_json_err_t
+reader_array_length(lightweight_json_reader_ctx_t *ctx, size_t *out_length) {
+  if (NULL == ctx || NULL == out_length) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  const lightweight_json_reader_array_table_t *table = NULL;
+  lightweight_json_err_t err = array_table_get(ctx, &table);
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+    return err;
+  }
+  if (NULL == table) {
+    // Count only, the context's table stays with its array
+    lightweight_json_reader_array_table_t scratch;
+    memset(&scratch, 0, sizeof(scratch));
+    err = array_table_build(ctx, &scratch);
+    if (LIGHTWEIGHT_JSON_ERR_NONE == err) {
+      *out_length = scratch.length;
+    }
+    return err;
+  }
+  *out_length = table->length;
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+lightweight_json_err_t
+lightweight_json_reader_array_length(lightweight_json_reader_ctx_t *ctx,
+                                     size_t *out_length) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_OTHER,
+             reader_array_length(ctx, out_length));
+}
+
+// Step from the first element to element `index` of an array without a
+// table, the position is kept if the array is shorter
+static lightweight_json_err_t array_step_to(lightweight_json_reader_ctx_t *ctx,
+                                            size_t index) {
+  lightweight_json_reader_level_t *level = reader_level(ctx);
+  const uint32_t saved = level->suboffset;
+  level->suboffset = 0;
+  const size_t first =
+      skip_whitespace(ctx->buffer, ctx->buffer_size, reader_value_offset(ctx));
+  lightweight_json_err_t err = LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
+  if (first < ctx->buffer_size && ctx->buffer[first] != ']') {
+    err = LIGHTWEIGHT_JSON_ERR_NONE;
+    for (; index > 0 && LIGHTWEIGHT_JSON_ERR_NONE == err; index--) {
+      const uint32_t previous = level->suboffset;
+      err = reader_array_next(ctx);
+      if (LIGHTWEIGHT_JSON_ERR_NONE == err && level->suboffset == previous) {
+        // Ran off the end of the buffer
+        err = LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+      }
+    }
+  }
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+    level->suboffset = saved;
+  }
+  return err;
+}
+
+static lightweight_json_err_t
+reader_array_at(lightweight_json_reader_ctx_t *ctx, size_t index) {
+  if (NULL == ctx) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  const lightweight_json_reader_array_table_t *table = NULL;
+  lightweight_json_err_t err = array_table_get(ctx, &table);
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+    return err;
+  }
+  if (NULL == table) {
+    return array_step_to(ctx, index);
+  }
+  if (index >= table->length) {
+    return LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
+  }
+  // Closest recorded element at or before `index`, then step
+  size_t steps = index;
+  reader_level(ctx)->suboffset = 0;
+  if (0 != table->size) {
+    reader_level(ctx)->suboffset = table->entries[index / table->stride];
+    steps = index % table->stride;
+  }
+  for (; steps > 0; steps--) {
+    err = reader_array_next(ctx);
+    if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+      return err;
+    }
+  }
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+lightweight_json_err_t
+lightweight_json_reader_array_at(lightweight_json_reader_ctx_t *ctx,
+                                 size_t index) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_OTHER, reader_array_at(ctx, index));
+}
+
+static lightweight_json_err_t
+reader_get_bool(lightweight_json_reader_ctx_t *ctx, const char *key,
+                bool *out_value) {
+  if (NULL == ctx || NULL == out_value) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  if (LIGHTWEIGHT_JSON_FORMAT_JSON != ctx->format) {
+    return lightweight_json_binary_get_bool(ctx, key, out_value);
+  }
+
+  size_t offset = 0;
+  const lightweight_json_err_t err = locate_value(ctx, key, &offset);
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+    return err;
+  }
+  if (reader_validated(ctx)) {
+    if (ctx->buffer[offset] == 't') {
+      *out_value = true;
+    } else if (ctx->buffer[offset] == 'f') {
+      *out_value = false;
+    } else {
+      return type_mismatch(ctx, offset);
+    }
+    return LIGHTWEIGHT_JSON_ERR_NONE;
+  }
+
+  char temp[16] = {0};
+  bool found = false;
+  for (; offset < ctx->buffer_size && !found; offset++) {
+    const char c = ctx->buffer[offset];
+
+    switch (c) {
+    case 't':
+      // Copy "true"
+      memcpy(temp, &ctx->buffer[offset],
+             min_size(4, ctx->buffer_size - offset));
+      found = true;
+      break;
+    case 'f':
+      // Copy "false"
+      memcpy(temp, &ctx->buffer[offset],
+             min_size(5, ctx->buffer_size - offset));
+      found = true;
+      break;
+    default:
+      if (c != ' ' && c != '\r' && c != '\n' && c != '\t' && c != ':') {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
+      }
+      break;
+    }
+  }
+
+  if (0 == strcmp(temp, "true")) {
+    *out_value = true;
+  } else if (0 == strcmp(temp, "false")) {
+    *out_value = false;
+  } else {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
+  }
+
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+lightweight_json_err_t
+lightweight_json_reader_get_bool(lightweight_json_reader_ctx_t *ctx,
+                                 const char *key, bool *out_value) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_READER_GET_BOOL,
+             reader_get_bool(ctx, key, out_value));
+}
+
+// Classify and convert the number at `offset`
+static lightweight_json_err_t
+parse_number_value(const char *buffer, size_t size, size_t offset,
+                   lightweight_json_value_t *out) {
+  const char *number = &buffer[offset];
+  const size_t remaining = size - offset;
+  const bool negative = number[0] == '-';
+  size_t len = negative ? 1 : 0;
+  uint64_t magnitude = 0;
+  bool fits = true;
+  for (; len < remaining && is_digit(number[len]); len++) {
+    const uint64_t digit = (uint64_t)(number[len] - '0');
+    if (magnitude > (UINT64_MAX - digit) / 10) {
+      fits = false;
+    }
+    magnitude = magnitude * 10 + digit;
+  }
+  if (len == (negative ? 1u : 0u)) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+  }
+
+  bool integer = true;
+  for (; len < remaining; len++) {
+    const char c = number[len];
+    if (c == '.' || c == 'e' || c == 'E') {
+      integer = false;
+    } else if (!is_digit(c) && c != '+' && c != '-') {
+      break;
+    }
+  }
+
+  if (integer && fits && !negative) {
+    out->type = LIGHTWEIGHT_JSON_VALUE_UINT64;
+    out->as.u64 = magnitude;
+    return LIGHTWEIGHT_JSON_ERR_NONE;
+  }
+  if (integer && fits && magnitude <= (uint64_t)INT64_MAX + 1) {
+    out->type = LIGHTWEIGHT_JSON_VALUE_INT64;
+    // Negate in unsigned arithmetic, INT64_MIN has no positive counterpart
+    out->as.i64 = (int64_t)((uint64_t)0 - magnitude);
+    return LIGHTWEIGHT_JSON_ERR_NONE;
+  }
+  out->type = LIGHTWEIGHT_JSON_VALUE_DOUBLE;
+  return convert_number(number, len, &out->as.f64, NUMERICAL_TYPE_DOUBLE);
+}
+
+static bool match_literal(const char *buffer, size_t size, size_t offset,
+                          const char *literal, size_t length) {
+  return size - offset >= length &&
+         0 == memcmp(&buffer[offset], literal, length);
+}
+
+static lightweight_json_err_t
+reader_get_value(lightweight_json_reader_ctx_t *ctx, const char *key,
+                 size_t key_len, lightweight_json_value_t *out_value) {
+  if (NULL == ctx || NULL == out_value) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  if (LIGHTWEIGHT_JSON_FORMAT_JSON != ctx->format) {
+    return lightweight_json_binary_get_value(ctx, key, key_len, out_value);
+  }
+
+  size_t offset = 0;
+  const lightweight_json_err_t err =
+      locate_value_n(ctx, key, key_len, &offset);
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+    return err;
+  }
+  const char *buffer = ctx->buffer;
+  const size_t size = ctx->buffer_size;
+  offset = skip_whitespace(buffer, size, offset);
+  if (offset >= size) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+  }
+  out_value->offset = offset;
+
+  switch (buffer[offset]) {
+  case '"': {
+    const size_t end = scan_string(buffer, size, offset + 1);
+    if (end >= size) {
+      return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+    }
+    STATS_SCANNED(ctx, end - offset + 1);
+    out_value->type = LIGHTWEIGHT_JSON_VALUE_STRING;
+    out_value->as.string.data = &buffer[offset + 1];
+    out_value->as.string.len = end - offset - 1;
+    return LIGHTWEIGHT_JSON_ERR_NONE;
+  }
+  case '{':
+    out_value->type = LIGHTWEIGHT_JSON_VALUE_OBJECT;
+    return LIGHTWEIGHT_JSON_ERR_NONE;
+  case '[':
+    out_value->type = LIGHTWEIGHT_JSON_VALUE_ARRAY;
+    return LIGHTWEIGHT_JSON_ERR_NONE;
+  case 't':
+  case 'f':
+    out_value->type = LIGHTWEIGHT_JSON_VALUE_BOOL;
+    out_value->as.boolean = buffer[offset] == 't';
+    return match_literal(buffer, size, offset,
+                         out_value->as.boolean ? "true" : "false",
+                         out_value->as.boolean ? 4 : 5)
+               ? LIGHTWEIGHT_JSON_ERR_NONE
+               : LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+  case 'n':
+    out_value->type = LIGHTWEIGHT_JSON_VALUE_NULL;
+    return match_literal(buffer, size, offset, "null", 4)
+               ? LIGHTWEIGHT_JSON_ERR_NONE
+               : LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+  case ']':
+    // An empty array / the end of the array has no value at all
+    return LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
+  default:
+    return parse_number_value(buffer, size, offset, out_value);
+  }
+}
+
+lightweight_json_err_t
+lightweight_json_reader_get_value(lightweight_json_reader_ctx_t *ctx,
+                                  const char *key,
+                                  lightweight_json_value_t *out_value) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_OTHER,
+             reader_get_value(ctx, key, NULL != key ? strlen(key) : 0,
+                              out_value));
+}
+
+lightweight_json_err_t
+lightweight_json_reader_get_value_n(lightweight_json_reader_ctx_t *ctx,
+                                    const char *key, size_t key_len,
+                                    lightweight_json_value_t *out_value) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_OTHER,
+             reader_get_value(ctx, key, key_len, out_value));
+}
+
+lightweight_json_err_t
+lightweight_json_reader_get_type(lightweight_json_reader_ctx_t *ctx,
+                                 const char *key,
+                                 lightweight_json_value_type_e *out_type) {
+  if (NULL == out_type) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  lightweight_json_value_t value;
+  const lightweight_json_err_t err =
+      lightweight_json_reader_get_value(ctx, key, &value);
+  if (LIGHTWEIGHT_JSON_ERR_NONE == err) {
+    *out_type = value.type;
+  }
+  return err;
+}
+
+lightweight_json_err_t
+lightweight_json_reader_enter_value(lightweight_json_reader_ctx_t *ctx,
+                                    const lightweight_json_value_t *value) {
+  if (NULL == ctx || NULL == value || value->offset >= ctx->buffer_size) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  if (LIGHTWEIGHT_JSON_VALUE_OBJECT != value->type &&
+      LIGHTWEIGHT_JSON_VALUE_ARRAY != value->type) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
+  }
+  if (LIGHTWEIGHT_JSON_FORMAT_JSON != ctx->format) {
+    STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_READER_ENTER,
+               lightweight_json_binary_enter_value(ctx, value));
+  }
+  if (ctx->buffer[value->offset] != '{' && ctx->buffer[value->offset] != '[') {
+    // Not fetched from this reader's buffer
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_READER_ENTER,
+             push_level(ctx, value->offset));
+}
+
+lightweight_json_err_t lightweight_json_unescape(const char *data, size_t len,
+                                                 char *buffer,
+                                                 size_t buffer_len,
+                                                 size_t *out_len) {
+  if (NULL == data || NULL == buffer || 0 == buffer_len) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  return unescape_string(data, len, buffer, buffer_len, out_len);
+}
+
+// --- Base64 ---
+
+static const char base64_alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Encode `groups` groups of 3 bytes into 4 characters each
+static void base64_encode_groups(const uint8_t *in, size_t groups,
+                                 char *out) {
+  size_t g = 0;
+#ifdef LIGHTWEIGHT_JSON_SSE2
+  // 4 groups per step, the 16 byte load needs 4 bytes more than those 12
+  const __m128i upper_end = _mm_set1_epi8(25);
+  const __m128i lower_end = _mm_set1_epi8(51);
+  const __m128i plus = _mm_set1_epi8(62);
+  const __m128i slash = _mm_set1_epi8(63);
+  for (; g + 6 <= groups; g += 4) {
+    const __m128i bytes = _mm_loadu_si128((const __m128i *)&in[3 * g]);
+    // One group per 32 bit lane: b0 | b1 << 8 | b2 << 16
+    const __m128i lanes = _mm_unpacklo_epi64(
+        _mm_unpacklo_epi32(bytes, _mm_srli_si128(bytes, 3)),
+        _mm_unpacklo_epi32(_mm_srli_si128(bytes, 6),
+                           _mm_srli_si128(bytes, 9)));
+    // The four 6 bit values, one per byte in output order
+    const __m128i values = _mm_or_si128(
+        _mm_or_si128(
+            _mm_or_si128(
+                _mm_and_si128(_mm_srli_epi32(lanes, 2), _mm_set1_epi32(0x3F)),
+                _mm_and_si128(_mm_slli_epi32(lanes, 12),
+                              _mm_set1_epi32(0x3000))),
+            _mm_or_si128(
+                _mm_and_si128(_mm_srli_epi32(lanes, 4),
+                              _mm_set1_epi32(0x0F00)),
+                _mm_and_si128(_mm_slli_epi32(lanes, 10),
+                              _mm_set1_epi32(0x3C0000)))),
+        _mm_or_si128(_mm_and_si128(_mm_srli_epi32(lanes, 6),
+                                   _mm_set1_epi32(0x030000)),
+                     _mm_and_si128(_mm_slli_epi32(lanes, 8),
+                                   _mm_set1_epi32(0x3F000000))));
+    // 'A' + value, moved on to the next range past 'Z', 'z', '9' and '+'
+    __m128i offset = _mm_set1_epi8('A');
+    offset = _mm_add_epi8(
+        offset, _mm_and_si128(_mm_cmpgt_epi8(values, upper_end),
+                              _mm_set1_epi8('a' - 'A' - 26)));
+    offset = _mm_add_epi8(
+        offset, _mm_and_si128(_mm_cmpgt_epi8(values, lower_end),
+                              _mm_set1_epi8('0' - 'a' - 26)));
+    offset = _mm_add_epi8(offset, _mm_and_si128(_mm_cmpeq_epi8(values, plus),
+                                                _mm_set1_epi8('+' - '0' - 10)));
+    offset = _mm_add_epi8(offset, _mm_and_si128(_mm_cmpeq_epi8(values, slash),
+                                                _mm_set1_epi8('/' - '0' - 11)));
+    _mm_storeu_si128((__m128i *)&out[4 * g], _mm_add_epi8(values, offset));
+  }
+#endif
+  for (; g < groups; g++) {
+    const uint8_t *group = &in[3 * g];
+    const uint32_t bits = (uint32_t)group[0] << 16 |
+                          (uint32_t)group[1] << 8 | group[2];
+    out[4 * g] = base64_alphabet[bits >> 18];
+    out[4 * g + 1] = base64_alphabet[(bits >> 12) & 0x3F];
+    out[4 * g + 2] = base64_alphabet[(bits >> 6) & 0x3F];
+    out[4 * g + 3] = base64_alphabet[bits & 0x3F];
+  }
+}
+
+static lightweight_json_err_t
+writer_add_base64(lightweight_json_writer_ctx_t *ctx, const char *const key,
+                  const uint8_t *data, size_t len) {
+  if (NULL == ctx || (NULL == data && 0 != len)) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  if (ctx->nesting < 0) {
+    // The user didn't begin at least a "main" object
+    return LIGHTWEIGHT_JSON_ERR_INVALID_STATE;
+  }
+  if (LIGHTWEIGHT_JSON_FORMAT_JSON != ctx->format) {
+    lightweight_json_binary_key(ctx, key);
+    lightweight_json_binary_bytes(ctx, data, len);
+    count_element(ctx);
+    return LIGHTWEIGHT_JSON_ERR_NONE;
+  }
+  add_comma(ctx);
+  add_key(ctx, key);
+  if (ctx->counting) {
+    // Quotes, every started group of 3 bytes takes 4 characters
+    ctx->counted += 2 + (len + 2) / 3 * 4;
+    count_element(ctx);
+    return LIGHTWEIGHT_JSON_ERR_NONE;
+  }
+  ctx->buffer[ctx->offset++] = '\"';
+  check_buffer(ctx, false);
+
+  size_t offset = 0;
+  char chars[4];
+  while (len - offset >= 3) {
+    // As many groups as fit into the rest of the buffer
+    size_t groups = (ctx->buffer_size - (size_t)ctx->offset) / 4;
+    if (groups > (len - offset) / 3) {
+      groups = (len - offset) / 3;
+    }
+    if (0 == groups) {
+      base64_encode_groups(&data[offset], 1, chars);
+      write_bytes(ctx, chars, 4);
+      offset += 3;
+      continue;
+    }
+    base64_encode_groups(&data[offset], groups, &ctx->buffer[ctx->offset]);
+    ctx->offset += (int)(4 * groups);
+    offset += 3 * groups;
+    check_buffer(ctx, false);
+  }
+  if (offset < len) {
+    // 1 or 2 bytes left, padded
+    const uint8_t tail[3] = {data[offset],
+                             offset + 1 < len ? data[offset + 1] : 0, 0};
+    base64_encode_groups(tail, 1, chars);
+    chars[3] = '=';
+    if (offset + 1 == len) {
+      chars[2] = '=';
+    }
+    write_bytes(ctx, chars, 4);
+  }
+  ctx->buffer[ctx->offset++] = '\"';
+  check_buffer(ctx, false);
+
+  count_element(ctx);
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+lightweight_json_err_t
+lightweight_json_writer_add_base64(lightweight_json_writer_ctx_t *ctx,
+                                   const char *const key, const uint8_t *data,
+                                   size_t len) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_OTHER,
+             writer_add_base64(ctx, key, data, len));
+}
+
+// 6 bit value of a base64 character, -1 if it isn't one
+static inline int base64_value(char c) {
+  if (c >= 'A' && c <= 'Z') {
+    return c - 'A';
+  }
+  if (c >= 'a' && c <= 'z') {
+    return c - 'a' + 26;
+  }
+  if (c >= '0' && c <= '9') {
+    return c - '0' + 52;
+  }
+  if (c == '+') {
+    return 62;
+  }
+  return c == '/' ? 63 : -1;
+}
+
+static inline void base64_emit(uint8_t *out, size_t capacity, size_t *length,
+                               uint32_t byte) {
+  if (*length < capacity) {
+    out[*length] = (uint8_t)byte;
+  }
+  (*length)++;
+}
+
+// Decode the base64 string content `src` into `out`, nothing is written past
+// `capacity`. JSON's "\/" escape is accepted, it is the only one base64 text
+// can contain.
+static lightweight_json_err_t base64_decode(const char *src, size_t len,
+                                            uint8_t *out, size_t capacity,
+                                            size_t *out_len) {
+  size_t i = 0;
+  size_t o = 0;
+  // Pending 6 bit values
+  uint32_t bits = 0;
+  unsigned count = 0;
+#ifdef LIGHTWEIGHT_JSON_SSE2
+  uint32_t lanes[4];
+#endif
+  for (;;) {
+#ifdef LIGHTWEIGHT_JSON_SSE2
+    // 16 characters into 12 bytes per step, until one that is not plain
+    // base64 (padding, an escape, an error). The lane stores write a 13th
+    // byte.
+    while (0 == count && i + 16 <= len && o + 13 <= capacity) {
+      const __m128i chars = _mm_loadu_si128((const __m128i *)&src[i]);
+      const __m128i upper =
+          _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('A' - 1)),
+                        _mm_cmplt_epi8(chars, _mm_set1_epi8('Z' + 1)));
+      const __m128i lower =
+          _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('a' - 1)),
+                        _mm_cmplt_epi8(chars, _mm_set1_epi8('z' + 1)));
+      const __m128i digit =
+          _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('0' - 1)),
+                        _mm_cmplt_epi8(chars, _mm_set1_epi8('9' + 1)));
+      const __m128i plus = _mm_cmpeq_epi8(chars, _mm_set1_epi8('+'));
+      const __m128i slash = _mm_cmpeq_epi8(chars, _mm_set1_epi8('/'));
+      const __m128i valid = _mm_or_si128(
+          _mm_or_si128(upper, lower),
+          _mm_or_si128(digit, _mm_or_si128(plus, slash)));
+      if (0xFFFF != _mm_movemask_epi8(valid)) {
+        break;
+      }
+      const __m128i offset = _mm_or_si128(
+          _mm_or_si128(_mm_and_si128(upper, _mm_set1_epi8(-'A')),
+                       _mm_and_si128(lower, _mm_set1_epi8(26 - 'a'))),
+          _mm_or_si128(_mm_and_si128(digit, _mm_set1_epi8(52 - '0')),
+                       _mm_or_si128(_mm_and_si128(plus, _mm_set1_epi8(62 - '+')),
+                                    _mm_and_si128(slash,
+                                                  _mm_set1_epi8(63 - '/')))));
+      const __m128i values = _mm_add_epi8(chars, offset);
+      // v0 | v1 << 8 | v2 << 16 | v3 << 24 -> the 3 bytes in output order
+      const __m128i bytes = _mm_or_si128(
+          _mm_or_si128(
+              _mm_or_si128(
+                  _mm_and_si128(_mm_slli_epi32(values, 2),
+                                _mm_set1_epi32(0xFC)),
+                  _mm_and_si128(_mm_srli_epi32(values, 12),
+                                _mm_set1_epi32(0x03))),
+              _mm_or_si128(
+                  _mm_and_si128(_mm_slli_epi32(values, 4),
+                                _mm_set1_epi32(0xF000)),
+                  _mm_and_si128(_mm_srli_epi32(values, 10),
+                                _mm_set1_epi32(0x0F00)))),
+          _mm_or_si128(_mm_and_si128(_mm_slli_epi32(values, 6),
+                                     _mm_set1_epi32(0xC00000)),
+                       _mm_and_si128(_mm_srli_epi32(values, 8),
+                                     _mm_set1_epi32(0x3F0000))));
+      _mm_storeu_si128((__m128i *)lanes, bytes);
+      for (int k = 0; k < 4; k++) {
+        memcpy(&out[o + 3 * k], &lanes[k], 4);
+      }
+      i += 16;
+      o += 12;
+    }
+#endif
+    if (i >= len || src[i] == '=') {
+      break;
+    }
+    char c = src[i++];
+    if (c == '\\' && i < len && src[i] == '/') {
+      c = src[i++];
+    }
+    const int value = base64_value(c);
+    if (value < 0) {
+      return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
+    }
+    bits = bits << 6 | (uint32_t)value;
+    if (4 == ++count) {
+      base64_emit(out, capacity, &o, bits >> 16);
+      base64_emit(out, capacity, &o, (bits >> 8) & 0xFF);
+      base64_emit(out, capacity, &o, bits & 0xFF);
+      bits = 0;
+      count = 0;
+    }
+  }
+
+  // Padding completes the last group, if there is any
+  const size_t padding = len - i;
+  for (; i < len; i++) {
+    if (src[i] != '=') {
+      return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
+    }
+  }
+  if (1 == count || (0 != padding && (0 == count || count + padding != 4))) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
+  }
+  if (2 == count) {
+    base64_emit(out, capacity, &o, bits >> 4);
+  } else if (3 == count) {
+    base64_emit(out, capacity, &o, bits >> 10);
+    base64_emit(out, capacity, &o, (bits >> 2) & 0xFF);
+  }
+  *out_len = o;
+  return o > capacity ? LIGHTWEIGHT_JSON_ERR_BUFFER_TOO_SMALL
+                      : LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+static lightweight_json_err_t
+reader_get_base64(lightweight_json_reader_ctx_t *ctx, const char *key,
+                  uint8_t *buffer, size_t buffer_len, size_t *out_len) {
+  if (NULL == ctx || (NULL == buffer && 0 != buffer_len) || NULL == out_len) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  lightweight_json_value_t value;
+  const lightweight_json_err_t err =
+      reader_get_value(ctx, key, NULL != key ? strlen(key) : 0, &value);
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+    return err;
+  }
+  if (LIGHTWEIGHT_JSON_VALUE_STRING != value.type) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
+  }
+  if (LIGHTWEIGHT_JSON_FORMAT_JSON != ctx->format &&
+      lightweight_json_binary_is_bytes(ctx, &value)) {
+    *out_len = value.as.string.len;
+    if (value.as.string.len > buffer_len) {
+      return LIGHTWEIGHT_JSON_ERR_BUFFER_TOO_SMALL;
+    }
+    memcpy(buffer, value.as.string.data, value.as.string.len);
+    return LIGHTWEIGHT_JSON_ERR_NONE;
+  }
+  return base64_decode(value.as.string.data, value.as.string.len, buffer,
+                       buffer_len, out_len);
+}
+
+lightweight_json_err_t
+lightweight_json_reader_get_base64(lightweight_json_reader_ctx_t *ctx,
+                                   const char *key, uint8_t *buffer,
+                                   size_t buffer_len, size_t *out_len) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_OTHER,
+             reader_get_base64(ctx, key, buffer, buffer_len, out_len));
+}
+
+// --- Batch parsing ---
+
+#if defined(__GNUC__) || defined(__clang__)
+#define BATCH_PREFETCH(_address) __builtin_prefetch(_address)
+#elif defined(LIGHTWEIGHT_JSON_SSE2)
+#define BATCH_PREFETCH(_address)                                               \
+  _mm_prefetch((const char *)(_address), _MM_HINT_T0)
+#else
+#define BATCH_PREFETCH(_address) ((void)(_address))
+#endif
+// Messages prefetched ahead of the one being parsed
+#define BATCH_PREFETCH_AHEAD 4
+#define BATCH_SLOT_MASK (2 * LIGHTWEIGHT_JSON_BATCH_MAX_FIELDS - 1)
+
+static inline size_t batch_hash(const char *key, size_t len) {
+  const size_t first = 0 != len ? (unsigned char)key[0] : 0;
+  const size_t last = 0 != len ? (unsigned char)key[len - 1] : 0;
+  return (len * 7 + first * 31 + last) & BATCH_SLOT_MASK;
+}
+
+lightweight_json_err_t
+lightweight_json_batch_compile(const lightweight_json_batch_field_t *fields,
+                               size_t field_count,
+                               lightweight_json_batch_spec_t *spec) {
+  if (NULL == fields || NULL == spec || 0 == field_count ||
+      field_count > LIGHTWEIGHT_JSON_BATCH_MAX_FIELDS) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  memset(spec, 0, sizeof(*spec));
+  for (size_t i = 0; i < field_count; i++) {
+    const lightweight_json_batch_field_t *field = &fields[i];
+    if (NULL == field->key) {
+      return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+    }
+    switch (field->type) {
+    case LIGHTWEIGHT_JSON_VALUE_STRING:
+      if (0 == field->size) {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+      }
+      break;
+    case LIGHTWEIGHT_JSON_VALUE_UINT64:
+    case LIGHTWEIGHT_JSON_VALUE_INT64:
+    case LIGHTWEIGHT_JSON_VALUE_DOUBLE:
+    case LIGHTWEIGHT_JSON_VALUE_BOOL:
+      break;
+    default:
+      return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+    }
+    const size_t len = strlen(field->key);
+    if (len > UINT16_MAX) {
+      return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+    }
+    size_t slot = batch_hash(field->key, len);
+    for (; 0 != spec->slots[slot]; slot = (slot + 1) & BATCH_SLOT_MASK) {
+      const size_t other = spec->slots[slot] - 1u;
+      if (spec->key_lengths[other] == len &&
+          0 == memcmp(fields[other].key, field->key, len)) {
+        // Duplicate key
+        return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+      }
+    }
+    spec->slots[slot] = (uint8_t)(i + 1);
+    spec->key_lengths[i] = (uint16_t)len;
+  }
+  spec->fields = fields;
+  spec->field_count = field_count;
+  spec->all = LIGHTWEIGHT_JSON_BATCH_MAX_FIELDS == field_count
+                  ? UINT64_MAX
+                  : (1ull << field_count) - 1;
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+// Index of the field extracting `key`, -1 if there is none
+static int batch_lookup(const lightweight_json_batch_spec_t *spec,
+                        const char *key, size_t len) {
+  for (size_t slot = batch_hash(key, len); 0 != spec->slots[slot];
+       slot = (slot + 1) & BATCH_SLOT_MASK) {
+    const size_t field = spec->slots[slot] - 1u;
+    if (spec->key_lengths[field] == len &&
+        0 == memcmp(spec->fields[field].key, key, len)) {
+      return (int)field;
+    }
+  }
+  return -1;
+}
+
+// Convert the value from `offset` to `end` and store it into `out`, false if
+// it doesn't fit the field
+static bool batch_store(const lightweight_json_batch_field_t *field,
+                        const char *buffer, size_t size, size_t offset,
+                        size_t end, char *out) {
+  const char c = buffer[offset];
+  out += field->offset;
+  if (LIGHTWEIGHT_JSON_VALUE_STRING == field->type) {
+    return c == '"' && LIGHTWEIGHT_JSON_ERR_NONE ==
+                           unescape_string(&buffer[offset + 1],
+                                           end - offset - 2, out, field->size,
+                                           NULL);
+  }
+  if (LIGHTWEIGHT_JSON_VALUE_BOOL == field->type) {
+    bool value = false;
+    if (c == 't' && match_literal(buffer, size, offset, "true", 4)) {
+      value = true;
+    } else if (!(c == 'f' && match_literal(buffer, size, offset, "false", 5))) {
+      return false;
+    }
+    memcpy(out, &value, sizeof(value));
+    return true;
+  }
+
+  lightweight_json_value_t value;
+  if ((c != '-' && !is_digit(c)) ||
+      LIGHTWEIGHT_JSON_ERR_NONE !=
+          parse_number_value(buffer, size, offset, &value)) {
+    return false;
+  }
+  switch (field->type) {
+  case LIGHTWEIGHT_JSON_VALUE_UINT64:
+    if (LIGHTWEIGHT_JSON_VALUE_UINT64 != value.type) {
+      return false;
+    }
+    memcpy(out, &value.as.u64, sizeof(uint64_t));
+    return true;
+  case LIGHTWEIGHT_JSON_VALUE_INT64:
+    if (LIGHTWEIGHT_JSON_VALUE_UINT64 == value.type &&
+        value.as.u64 <= INT64_MAX) {
+      value.as.i64 = (int64_t)value.as.u64;
+    } else if (LIGHTWEIGHT_JSON_VALUE_INT64 != value.type) {
+      return false;
+    }
+    memcpy(out, &value.as.i64, sizeof(int64_t));
+    return true;
+  default: {
+    double number = value.as.f64;
+    if (LIGHTWEIGHT_JSON_VALUE_UINT64 == value.type) {
+      number = (double)value.as.u64;
+    } else if (LIGHTWEIGHT_JSON_VALUE_INT64 == value.type) {
+      number = (double)value.as.i64;
+    }
+    memcpy(out, &number, sizeof(number));
+    return true;
+  }
+  }
+}
+
+// Walk the root object's members once, storing the ones the spec extracts
+static lightweight_json_err_t
+batch_message(const lightweight_json_batch_spec_t *spec, const char *buffer,
+              size_t size, char *out, uint64_t *found) {
+  size_t offset = skip_whitespace(buffer, size, 0);
+  if (offset >= size || buffer[offset] != '{') {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+  }
+  offset = skip_whitespace(buffer, size, offset + 1);
+  if (offset < size && buffer[offset] == '}') {
+    return LIGHTWEIGHT_JSON_ERR_NONE;
+  }
+  while (offset < size && buffer[offset] == '"') {
+    const size_t key_end = scan_string(buffer, size, offset + 1);
+    if (key_end >= size) {
+      break;
+    }
+    const char *key = &buffer[offset + 1];
+    const size_t key_len = key_end - offset - 1;
+    offset = skip_whitespace(buffer, size, key_end + 1);
+    if (offset >= size || buffer[offset] != ':') {
+      break;
+    }
+    offset = skip_whitespace(buffer, size, offset + 1);
+    if (offset >= size) {
+      break;
+    }
+    const size_t end = skip_json_value(buffer, size, offset);
+    if (end > size) {
+      // Unterminated string
+      break;
+    }
+    const int field = batch_lookup(spec, key, key_len);
+    if (field >= 0 && 0 == (*found & (1ull << field)) &&
+        batch_store(&spec->fields[field], buffer, size, offset, end, out)) {
+      *found |= 1ull << field;
+      if (*found == spec->all) {
+        return LIGHTWEIGHT_JSON_ERR_NONE;
+      }
+    }
+    offset = skip_whitespace(buffer, size, end);
+    if (offset < size && buffer[offset] == '}') {
+      return LIGHTWEIGHT_JSON_ERR_NONE;
+    }
+    if (offset >= size || buffer[offset] != ',') {
+      break;
+    }
+    offset = skip_whitespace(buffer, size, offset + 1);
+  }
+  return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+}
+
+lightweight_json_err_t
+lightweight_json_batch_parse(const lightweight_json_batch_spec_t *spec,
+                             const lightweight_json_batch_message_t *messages,
+                             size_t count, void *out, size_t stride,
+                             lightweight_json_batch_result_t *results) {
+  if (NULL == spec || NULL == spec->fields ||
+      (0 != count && (NULL == messages || NULL == out || NULL == results))) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  for (size_t i = 0; i < count; i++) {
+    if (i + BATCH_PREFETCH_AHEAD < count) {
+      BATCH_PREFETCH(messages[i + BATCH_PREFETCH_AHEAD].data);
+    }
+    results[i].found = 0;
+    results[i].err =
+        NULL == messages[i].data
+            ? LIGHTWEIGHT_JSON_ERR_INVALID_ARGS
+            : batch_message(spec, messages[i].data, messages[i].size,
+                            (char *)out + i * stride, &results[i].found);
+  }
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+// --- Segmented reader ---
+
+// Point `segment` at the segment holding `offset`, false if `offset` is past
+// the end. Moves from the segment of the last access, which is usually close.
+static bool segment_seek(lightweight_json_segment_reader_ctx_t *ctx,
+                         size_t offset) {
+  while (offset < ctx->segment_start) {
+    ctx->segment--;
+    ctx->segment_start -= ctx->segments[ctx->segment].size;
+  }
+  while (offset - ctx->segment_start >= ctx->segments[ctx->segment].size) {
+    if (ctx->segment + 1 >= ctx->segment_count) {
+      return false;
+    }
+    ctx->segment_start += ctx->segments[ctx->segment].size;
+    ctx->segment++;
+  }
+  return true;
+}
+
+// Character at `offset`, -1 past the end
+static inline int segment_char(lightweight_json_segment_reader_ctx_t *ctx,
+                               size_t offset) {
+  if (!segment_seek(ctx, offset)) {
+    return -1;
+  }
+  return (unsigned char)
+      ctx->segments[ctx->segment].data[offset - ctx->segment_start];
+}
+
+static size_t
+segment_skip_whitespace(lightweight_json_segment_reader_ctx_t *ctx,
+                        size_t offset) {
+  int c = segment_char(ctx, offset);
+  while (c >= 0 && is_whitespace((char)c)) {
+    c = segment_char(ctx, ++offset);
+  }
+  return offset;
+}
+
+// Offset of the closing quote of the string whose content starts at `offset`,
+// `size` if it is unterminated. Searches one segment at a time, an escape at
+// the end of a segment skips the first character of the next one.
+static size_t segment_string_end(lightweight_json_segment_reader_ctx_t *ctx,
+                                 size_t offset) {
+  while (segment_seek(ctx, offset)) {
+    const lightweight_json_segment_t *segment = &ctx->segments[ctx->segment];
+    const size_t found = find_quote_or_backslash(
+        segment->data, segment->size, offset - ctx->segment_start);
+    offset = ctx->segment_start + found;
+    if (found < segment->size) {
+      if (segment->data[found] == '"') {
+        return offset;
+      }
+      // Skip the escaped character
+      offset += 2;
+    }
+  }
+  return ctx->size;
+}
+
+// Copy `len` bytes from `offset` on, the caller checked they exist
+static void segment_copy(lightweight_json_segment_reader_ctx_t *ctx,
+                         size_t offset, char *out, size_t len) {
+  while (0 != len && segment_seek(ctx, offset)) {
+    const lightweight_json_segment_t *segment = &ctx->segments[ctx->segment];
+    const size_t local = offset - ctx->segment_start;
+    const size_t amount = min_size(len, segment->size - local);
+    memcpy(out, &segment->data[local], amount);
+    out += amount;
+    offset += amount;
+    len -= amount;
+  }
+}
+
+// Whether the `len` bytes at `offset` are `str`
+static bool segment_equals(lightweight_json_segment_reader_ctx_t *ctx,
+                           size_t offset, const char *str, size_t len) {
+  if (offset > ctx->size || ctx->size - offset < len) {
+    return false;
+  }
+  while (0 != len && segment_seek(ctx, offset)) {
+    const lightweight_json_segment_t *segment = &ctx->segments[ctx->segment];
+    const size_t local = offset - ctx->segment_start;
+    const size_t amount = min_size(len, segment->size - local);
+    if (0 != memcmp(&segment->data[local], str, amount)) {
+      return false;
+    }
+    str += amount;
+    offset += amount;
+    len -= amount;
+  }
+  return true;
+}
+
+// Offset right behind the value at `offset`
+static size_t segment_skip_value(lightweight_json_segment_reader_ctx_t *ctx,
+                                 size_t offset) {
+  int c = segment_char(ctx, offset);
+  if (c == '"') {
+    return segment_string_end(ctx, offset + 1) + 1;
+  }
+  if (c == '{' || c == '[') {
+    int nesting = 0;
+    for (; (c = segment_char(ctx, offset)) >= 0; offset++) {
+      switch (c) {
+      case '"':
+        offset = segment_string_end(ctx, offset + 1);
+        break;
+      case '{':
+      case '[':
+        nesting++;
+        break;
+      case '}':
+      case ']':
+        if (0 == --nesting) {
+          return offset + 1;
+        }
+        break;
+      default:
+        break;
+      }
+    }
+    return ctx->size;
+  }
+  // Number or literal
+  while (c >= 0 && c != ',' && c != '}' && c != ']' &&
+         !is_whitespace((char)c)) {
+    c = segment_char(ctx, ++offset);
+  }
+  return offset;
+}
+
+// Decode the string content from `offset` to `end`. Runs are copied straight
+// out of the segments, only escape sequences split by a boundary are joined.
+static lightweight_json_err_t
+segment_unescape(lightweight_json_segment_reader_ctx_t *ctx, size_t offset,
+                 size_t end, char *buffer, size_t buffer_len,
+                 size_t *out_len) {
+  unescape_out_t out = {buffer, buffer_len - 1, 0};
+  bool ok = true;
+  while (ok && offset < end && segment_seek(ctx, offset)) {
+    const lightweight_json_segment_t *segment = &ctx->segments[ctx->segment];
+    const size_t start = ctx->segment_start;
+    const size_t stop = min_size(segment->size, end - start);
+    const size_t local = offset - start;
+    // The content has no unescaped quotes, so this stops at backslashes only
+    size_t escape = find_quote_or_backslash(segment->data, stop, local);
+    unescape_emit(&out, &segment->data[local], escape - local);
+    offset = start + escape;
+    if (escape >= stop) {
+      continue;
+    }
+    // The longest sequence is a surrogate pair, \uXXXX\uXXXX
+    if (stop - escape >= 12 || start + stop == end) {
+      escape++;
+      ok = escape < stop &&
+           unescape_sequence(segment->data, stop, &escape, &out);
+      offset = start + escape;
+    } else {
+      char sequence[12];
+      const size_t len = min_size(sizeof(sequence), end - offset);
+      size_t consumed = 1;
+      segment_copy(ctx, offset, sequence, len);
+      ok = len > 1 && unescape_sequence(sequence, len, &consumed, &out);
+      offset += consumed;
+    }
+  }
+  return unescape_finish(&out, ok, out_len);
+}
+
+static inline lightweight_json_reader_level_t *
+segment_level(lightweight_json_segment_reader_ctx_t *ctx) {
+  return LIGHTWEIGHT_JSON_LEVELS(ctx) + ctx->nesting;
+}
+
+static inline size_t
+segment_level_offset(lightweight_json_segment_reader_ctx_t *ctx) {
+  return segment_level(ctx)->offset & ~LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT;
+}
+
+// Push the container starting at `offset` onto the nesting stack
+static lightweight_json_err_t
+segment_push_level(lightweight_json_segment_reader_ctx_t *ctx, size_t offset,
+                   bool is_array) {
+  if (ctx->nesting == ctx->max_nesting - 1) {
+    return LIGHTWEIGHT_JSON_ERR_MAX_NESTING_REACHED;
+  }
+  ctx->nesting++;
+  lightweight_json_reader_level_t *level = segment_level(ctx);
+  level->offset = (uint32_t)offset;
+  if (is_array) {
+    level->offset |= LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT;
+  }
+  level->suboffset = 0;
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+lightweight_json_err_t lightweight_json_segment_reader_init(
+    const lightweight_json_segment_t *segments, size_t segment_count,
+    lightweight_json_reader_level_t *levels, size_t max_nesting,
+    lightweight_json_segment_reader_ctx_t *ctx) {
+  if (NULL == segments || 0 == segment_count || NULL == ctx ||
+      !reader_stack_valid(levels, max_nesting)) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  size_t size = 0;
+  for (size_t i = 0; i < segment_count; i++) {
+    if (NULL == segments[i].data && 0 != segments[i].size) {
+      return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+    }
+    size += segments[i].size;
+    if (size > ~LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT) {
+      // Offsets are stored in 31 bits
+      return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+    }
+  }
+  ctx->segments = segments;
+  ctx->segment_count = segment_count;
+  ctx->size = size;
+  ctx->segment = 0;
+  ctx->segment_start = 0;
+  ctx->levels = levels;
+  ctx->max_nesting = (int)max_nesting;
+  // The root is pushed onto level 0
+  ctx->nesting = -1;
+
+  // Enter the first object / array
+  int c = 0;
+  size_t offset = 0;
+  for (; (c = segment_char(ctx, offset)) >= 0; offset++) {
+    if (c == '{' || c == '[') {
+      return segment_push_level(ctx, offset, c == '[');
+    }
+  }
+  ctx->nesting = 0;
+  return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+}
 
-          if (0 == strcmp(temp, key)) {
-            return cur_string_offset - 1;
-          }
+// Offset right behind the closing quote of `key` in the current object, 0 if
+// it isn't there. Scans within a segment until the next string.
+static size_t segment_find_key(lightweight_json_segment_reader_ctx_t *ctx,
+                               const char *key, size_t key_len) {
+  size_t offset = segment_level_offset(ctx) + 1;
+  int nesting = 0;
+  bool is_val = false;
+  while (segment_seek(ctx, offset)) {
+    const lightweight_json_segment_t *segment = &ctx->segments[ctx->segment];
+    size_t i = offset - ctx->segment_start;
+    for (; i < segment->size && segment->data[i] != '"'; i++) {
+      switch (segment->data[i]) {
+      case ':':
+        if (0 == nesting) {
+          is_val = true;
         }
-      }
-      in_string = !in_string;
-      break;
-    case ':':
-      if (nesting == 0) {
-        is_val = true;
-      }
-      break;
-    case ',':
-      if (!in_string && nesting == 0) {
-        is_val = false;
-      }
-      break;
-    case '[':
-    case '{':
-      if (!in_string) {
+        break;
+      case ',':
+        if (0 == nesting) {
+          is_val = false;
+        }
+        break;
+      case '[':
+      case '{':
         nesting++;
-      }
-      break;
-    case ']':
-    case '}':
-      if (!in_string) {
-        nesting--;
-        if (nesting < 0) {
+        break;
+      case ']':
+      case '}':
+        if (--nesting < 0) {
           // End of current object
           return 0;
         }
+        break;
+      default:
+        break;
       }
-      break;
-    case '\\':
-      if (in_string) {
-        // Skip escape sequence
-        offset++;
-      }
-      break;
-    default:
+    }
+    offset = ctx->segment_start + i;
+    if (i >= segment->size) {
+      continue;
+    }
 
-      break;
+    const size_t begin = offset + 1;
+    offset = segment_string_end(ctx, begin);
+    if (offset >= ctx->size) {
+      return 0;
     }
+    if (0 == nesting && !is_val && offset - begin == key_len &&
+        segment_equals(ctx, begin, key, key_len)) {
+      return offset + 1;
+    }
+    offset++;
   }
-
   return 0;
 }
 
-lightweight_json_err_t
-lightweight_json_reader_key_exists(lightweight_json_reader_ctx_t *ctx,
-                                   const char *key) {
-  if (NULL == key || NULL == key) {
+// Offset of the first character of the value of `key` in the current object,
+// or of the current array element if `key` is NULL
+static lightweight_json_err_t
+segment_locate(lightweight_json_segment_reader_ctx_t *ctx, const char *key,
+               size_t *out_offset) {
+  size_t offset = 0;
+  if (NULL != key) {
+    offset = segment_find_key(ctx, key, strlen(key));
+    if (0 == offset) {
+      return LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
+    }
+    // Skip the colon
+    offset = segment_skip_whitespace(ctx, offset);
+    if (segment_char(ctx, offset) == ':') {
+      offset++;
+    }
+  } else {
+    offset = segment_level_offset(ctx) + segment_level(ctx)->suboffset + 1;
+  }
+  *out_offset = segment_skip_whitespace(ctx, offset);
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+lightweight_json_err_t lightweight_json_segment_reader_key_exists(
+    lightweight_json_segment_reader_ctx_t *ctx, const char *key) {
+  if (NULL == ctx || NULL == key) {
     return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
   }
+  return 0 == segment_find_key(ctx, key, strlen(key))
+             ? LIGHTWEIGHT_JSON_ERR_NOT_FOUND
+             : LIGHTWEIGHT_JSON_ERR_NONE;
+}
 
-  size_t offset = find_key(ctx, key);
-  if (0 == offset) {
+lightweight_json_err_t lightweight_json_segment_reader_get_string(
+    lightweight_json_segment_reader_ctx_t *ctx, const char *key, char *buffer,
+    size_t buffer_len, size_t *out_len) {
+  if (NULL == ctx || NULL == buffer || 0 == buffer_len) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+
+  buffer[0] = '\0';
+  size_t offset = 0;
+  const lightweight_json_err_t err = segment_locate(ctx, key, &offset);
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+    return err;
+  }
+  const int c = segment_char(ctx, offset);
+  if (c != '"') {
+    return c < 0 ? LIGHTWEIGHT_JSON_ERR_NOT_FOUND
+                 : LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
+  }
+  const size_t end = segment_string_end(ctx, offset + 1);
+  if (end >= ctx->size) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+  }
+  return segment_unescape(ctx, offset + 1, end, buffer, buffer_len, out_len);
+}
+
+static lightweight_json_err_t
+segment_get_numerical(lightweight_json_segment_reader_ctx_t *ctx,
+                      const char *key, void *out_value,
+                      numerical_type_t numerical_type) {
+  if (NULL == ctx || NULL == out_value) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+
+  size_t offset = 0;
+  const lightweight_json_err_t err = segment_locate(ctx, key, &offset);
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+    return err;
+  }
+  int c = segment_char(ctx, offset);
+  if (c < 0) {
     return LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
   }
+  if (c == ',' || c == ']' || c == '}' || c == '+' || c == '.') {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+  }
+  if (c != '-' && !is_digit((char)c)) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
+  }
 
+  // Joined here if a boundary splits it, convert_number keeps 63 characters
+  char number[64];
+  size_t len = 0;
+  for (; c >= 0 && (is_digit((char)c) || c == '-' || c == '+' || c == '.' ||
+                    c == 'e' || c == 'E');
+       c = segment_char(ctx, ++offset)) {
+    if (len < sizeof(number) - 1) {
+      number[len++] = (char)c;
+    }
+  }
+  if (c >= 0 && c != ',' && c != '}' && c != ']' && !is_whitespace((char)c)) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+  }
+  return convert_number(number, len, out_value, numerical_type);
+}
+
+lightweight_json_err_t lightweight_json_segment_reader_get_uint64(
+    lightweight_json_segment_reader_ctx_t *ctx, const char *key,
+    uint64_t *out_value) {
+  return segment_get_numerical(ctx, key, (void *)out_value,
+                               NUMERICAL_TYPE_UINT64);
+}
+
+lightweight_json_err_t lightweight_json_segment_reader_get_int64(
+    lightweight_json_segment_reader_ctx_t *ctx, const char *key,
+    int64_t *out_value) {
+  return segment_get_numerical(ctx, key, (void *)out_value,
+                               NUMERICAL_TYPE_INT64);
+}
+
+lightweight_json_err_t lightweight_json_segment_reader_get_double(
+    lightweight_json_segment_reader_ctx_t *ctx, const char *key,
+    double *out_value) {
+  return segment_get_numerical(ctx, key, (void *)out_value,
+                               NUMERICAL_TYPE_DOUBLE);
+}
+
+lightweight_json_err_t lightweight_json_segment_reader_get_bool(
+    lightweight_json_segment_reader_ctx_t *ctx, const char *key,
+    bool *out_value) {
+  if (NULL == ctx || NULL == out_value) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+
+  size_t offset = 0;
+  const lightweight_json_err_t err = segment_locate(ctx, key, &offset);
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+    return err;
+  }
+  const int c = segment_char(ctx, offset);
+  if (c == 't' && segment_equals(ctx, offset, "true", 4)) {
+    *out_value = true;
+  } else if (c == 'f' && segment_equals(ctx, offset, "false", 5)) {
+    *out_value = false;
+  } else {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
+  }
   return LIGHTWEIGHT_JSON_ERR_NONE;
 }
 
-lightweight_json_err_t
-lightweight_json_reader_get_string(lightweight_json_reader_ctx_t *ctx,
-                                   const char *key, char *buffer,
-                                   size_t buffer_len) {
-  if (NULL == ctx || NULL == buffer || 0 == buffer_len) {
+lightweight_json_err_t lightweight_json_segment_reader_enter(
+    lightweight_json_segment_reader_ctx_t *ctx, const char *key) {
+  if (NULL == ctx) {
     return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
   }
 
-  // reset output buffer just in case
-  memset(buffer, 0, buffer_len);
+  size_t offset = 0;
+  const lightweight_json_err_t err = segment_locate(ctx, key, &offset);
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+    return err;
+  }
+  const int c = segment_char(ctx, offset);
+  if (c < 0 || c == '}' || c == ']' || c == ',') {
+    return LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
+  }
+  if (c != '{' && c != '[') {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
+  }
+  return segment_push_level(ctx, offset, c == '[');
+}
+
+lightweight_json_err_t lightweight_json_segment_reader_leave(
+    lightweight_json_segment_reader_ctx_t *ctx) {
+  if (NULL == ctx) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
 
-  size_t offset = ctx->current_offset[ctx->nesting] +
-                  ctx->current_suboffset[ctx->nesting] + 1;
+  if (ctx->nesting > 0) {
+    ctx->nesting--;
+  }
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
 
-  if (NULL != key) {
-    offset = find_key(ctx, key);
-    if (0 == offset) {
-      return LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
-    }
+lightweight_json_err_t lightweight_json_segment_reader_array_next(
+    lightweight_json_segment_reader_ctx_t *ctx) {
+  if (NULL == ctx) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  lightweight_json_reader_level_t *level = segment_level(ctx);
+  if (0 == (level->offset & LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT)) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_STATE;
+  }
 
-    // Skip key and the two "s and colon
-    offset += strlen(key) + 3;
+  const size_t start = segment_level_offset(ctx);
+  size_t offset = segment_skip_whitespace(ctx, start + level->suboffset + 1);
+  const int c = segment_char(ctx, offset);
+  if (c < 0 || c == ']') {
+    return LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
   }
+  offset = segment_skip_whitespace(ctx, segment_skip_value(ctx, offset));
+  if (segment_char(ctx, offset) != ',') {
+    return LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
+  }
+  level->suboffset = (uint32_t)(offset - start);
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
 
-  bool in_string = false;
-  size_t string_begin = 0;
-  size_t string_end = 0;
-  for (; offset < ctx->buffer_size; offset++) {
-    const char c = ctx->buffer[offset];
+// --- Transcoding ---
 
-    switch (c) {
-    case '\"':
-      if (!in_string) {
-        in_string = true;
-        string_begin = offset;
-      } else {
-        string_end = offset;
-        in_string = false;
-        const size_t len = string_end - string_begin - 1;
-        memcpy(buffer, &ctx->buffer[string_begin + 1],
-               string_end - string_begin - 1);
-        buffer[len] = '\0';
-        return LIGHTWEIGHT_JSON_ERR_NONE;
-      }
+static const char hex_digits[] = "0123456789abcdef";
+
+// Write the raw bytes `src` as JSON string content
+static void write_escaped(lightweight_json_writer_ctx_t *ctx, const char *src,
+                          size_t len) {
+  size_t offset = 0;
+  while (offset < len) {
+    size_t special = find_string_special(src, len, offset);
+    // Non ASCII bytes go out as they are
+    while (special < len && (unsigned char)src[special] >= 0x80) {
+      special = find_string_special(src, len, special + 1);
+    }
+    write_bytes(ctx, &src[offset], special - offset);
+    if (special >= len) {
       break;
+    }
+    const char c = src[special];
+    char escape[6] = {'\\', c};
+    size_t escape_len = 2;
+    switch (c) {
+    case '"':
     case '\\':
-      // Skip escape
-      offset++;
+      break;
+    case '\b':
+      escape[1] = 'b';
+      break;
+    case '\f':
+      escape[1] = 'f';
+      break;
+    case '\n':
+      escape[1] = 'n';
+      break;
+    case '\r':
+      escape[1] = 'r';
+      break;
+    case '\t':
+      escape[1] = 't';
       break;
     default:
-      if (!in_string && c != ' ' && c != '\r' && c != '\n' && c != '\t' &&
-          c != ':') {
-        return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
-      }
+      memcpy(&escape[1], "u00", 3);
+      escape[4] = hex_digits[(c >> 4) & 0xF];
+      escape[5] = hex_digits[c & 0xF];
+      escape_len = 6;
       break;
     }
+    STATS_ADD(ctx, escapes, 1);
+    write_bytes(ctx, escape, escape_len);
+    offset = special + 1;
   }
+}
 
-  return LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
+// Write the validated JSON string content `src` unescaped
+static void write_unescaped(lightweight_json_writer_ctx_t *ctx,
+                            const char *src, size_t len) {
+  size_t offset = 0;
+  while (offset < len) {
+    const size_t escape = find_quote_or_backslash(src, len, offset);
+    write_bytes(ctx, &src[offset], escape - offset);
+    if (escape >= len) {
+      break;
+    }
+    char decoded[4];
+    unescape_out_t out = {decoded, sizeof(decoded), 0};
+    offset = escape + 1;
+    unescape_sequence(src, len, &offset, &out);
+    write_bytes(ctx, decoded, out.length);
+  }
 }
 
-typedef enum {
-  NUMERICAL_TYPE_UINT64,
-  NUMERICAL_TYPE_INT64,
-  NUMERICAL_TYPE_DOUBLE,
-} numerical_type_t;
+// Powers of ten a double holds exactly
+static const double exact_pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4,
+                                     1e5, 1e6, 1e7, 1e8};
 
-static lightweight_json_err_t get_numerical(lightweight_json_reader_ctx_t *ctx,
-                                            const char *key, void *out_value,
-                                            numerical_type_t numerical_type) {
-  if (NULL == ctx || NULL == out_value) {
-    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+// Fast path for doubles with up to 8 decimals: the smallest `k` for which
+// m / 10^k rounds to `value` gives the digits, both sides of the comparison
+// are correctly rounded so a reader gets `value` back. Returns the first
+// character of the digits ending right before `end`, NULL if there is no
+// such `k`.
+static char *format_decimal(double value, char *end) {
+  const double magnitude = fabs(value);
+  for (size_t k = 0; k < sizeof(exact_pow10) / sizeof(exact_pow10[0]); k++) {
+    const double scaled = magnitude * exact_pow10[k];
+    if (scaled >= 9007199254740992.0) {
+      // 2^53, m wouldn't be exact anymore
+      return NULL;
+    }
+    const uint64_t m = (uint64_t)(scaled + 0.5);
+    if ((double)m / exact_pow10[k] != magnitude) {
+      continue;
+    }
+    char *begin = format_uint64(m, end - (0 == k ? 2 : 0));
+    if (0 == k) {
+      end[-2] = '.';
+      end[-1] = '0';
+    } else {
+      // At least one digit in front of the point
+      while ((size_t)(end - begin) <= k) {
+        *--begin = '0';
+      }
+      // Shift the integer part left to make room for the point
+      char *point = end - k - 1;
+      memmove(begin - 1, begin, (size_t)(point + 1 - begin));
+      begin--;
+      *point = '.';
+    }
+    if (signbit(value)) {
+      *--begin = '-';
+    }
+    return begin;
   }
+  return NULL;
+}
 
-  size_t offset = ctx->current_offset[ctx->nesting] +
-                  ctx->current_suboffset[ctx->nesting] + 1;
-  if (NULL != key) {
-    offset = find_key(ctx, key);
-    if (0 == offset) {
-      return LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
+// Doubles must survive the round trip: format_decimal or the shorter of
+// %.15g / %.17g which reads back the same, and a ".0" so it stays a double.
+// JSON has no NaN / infinity, those become null.
+static void write_double_exact(lightweight_json_writer_ctx_t *ctx,
+                               double value) {
+  if (!isfinite(value)) {
+    write_bytes(ctx, "null", 4);
+    return;
+  }
+  char temp[32];
+  const char *begin = format_decimal(value, temp + sizeof(temp));
+  if (NULL != begin) {
+    write_bytes(ctx, begin, (size_t)(temp + sizeof(temp) - begin));
+    return;
+  }
+  int len = snprintf(temp, sizeof(temp), "%.15g", value);
+  if (strtod(temp, NULL) != value) {
+    len = snprintf(temp, sizeof(temp), "%.17g", value);
+  }
+  if (NULL == memchr(temp, '.', (size_t)len) &&
+      NULL == memchr(temp, 'e', (size_t)len)) {
+    temp[len++] = '.';
+    temp[len++] = '0';
+  }
+  write_bytes(ctx, temp, (size_t)len);
+}
+
+static void transcode_string(lightweight_json_writer_ctx_t *ctx,
+                             const char *data, size_t len, bool escaped) {
+  if (LIGHTWEIGHT_JSON_FORMAT_JSON == ctx->format) {
+    write_bytes(ctx, "\"", 1);
+    if (escaped) {
+      write_bytes(ctx, data, len);
+    } else {
+      write_escaped(ctx, data, len);
     }
+    write_bytes(ctx, "\"", 1);
+  } else if (!escaped || find_quote_or_backslash(data, len, 0) == len) {
+    lightweight_json_binary_string(ctx, data, len);
+  } else {
+    // The header needs the unescaped length, count it first
+    char unused;
+    unescape_out_t out = {&unused, 0, 0};
+    unescape_into(data, len, &out);
+    lightweight_json_binary_string_head(ctx, out.length);
+    write_unescaped(ctx, data, len);
+  }
+}
 
-    // Skip key and the two "s and colon
-    offset += strlen(key) + 3;
+lightweight_json_err_t lightweight_json_transcode_item(
+    lightweight_json_writer_ctx_t *ctx, const char *key, size_t key_len,
+    bool key_escaped, const lightweight_json_value_t *value, bool escaped) {
+  const bool json = LIGHTWEIGHT_JSON_FORMAT_JSON == ctx->format;
+  const bool container = LIGHTWEIGHT_JSON_VALUE_OBJECT == value->type ||
+                         LIGHTWEIGHT_JSON_VALUE_ARRAY == value->type;
+  if (container) {
+    if (ctx->nesting == ctx->max_nesting - 1) {
+      return LIGHTWEIGHT_JSON_ERR_MAX_NESTING_REACHED;
+    }
+  } else if (ctx->nesting < 0) {
+    // Only an object / array can be the root
+    return LIGHTWEIGHT_JSON_ERR_INVALID_STATE;
   }
 
-  bool in_num = false;
-  size_t num_begin = 0;
-  size_t num_end = 0;
-  int decimal_count = 0;
-  for (; offset < ctx->buffer_size; offset++) {
-    const char c = ctx->buffer[offset];
+  if (json) {
+    add_comma(ctx);
+  }
+  if (NULL != key && ctx->nesting >= 0) {
+    transcode_string(ctx, key, key_len, key_escaped);
+    if (json) {
+      write_bytes(ctx, ":", 1);
+    }
+  }
 
-    switch (c) {
-    case '0':
-    case '1':
-    case '2':
-    case '3':
-    case '4':
-    case '5':
-    case '6':
-    case '7':
-    case '8':
-    case '9':
-      if (!in_num) {
-        in_num = true;
-        num_begin = offset;
+  switch (value->type) {
+  case LIGHTWEIGHT_JSON_VALUE_NULL:
+    if (json) {
+      write_bytes(ctx, "null", 4);
+    } else {
+      lightweight_json_binary_null(ctx);
+    }
+    break;
+  case LIGHTWEIGHT_JSON_VALUE_BOOL:
+    if (json) {
+      write_bool(ctx, value->as.boolean);
+    } else {
+      lightweight_json_binary_bool(ctx, value->as.boolean);
+    }
+    break;
+  case LIGHTWEIGHT_JSON_VALUE_INT64:
+    if (json) {
+      write_int64(ctx, value->as.i64);
+    } else {
+      lightweight_json_binary_int64(ctx, value->as.i64);
+    }
+    break;
+  case LIGHTWEIGHT_JSON_VALUE_UINT64:
+    if (json) {
+      write_uint64(ctx, value->as.u64);
+    } else {
+      lightweight_json_binary_uint64(ctx, value->as.u64);
+    }
+    break;
+  case LIGHTWEIGHT_JSON_VALUE_DOUBLE:
+    if (json) {
+      write_double_exact(ctx, value->as.f64);
+    } else {
+      lightweight_json_binary_double(ctx, value->as.f64);
+    }
+    break;
+  case LIGHTWEIGHT_JSON_VALUE_STRING:
+    transcode_string(ctx, value->as.string.data, value->as.string.len,
+                     escaped);
+    break;
+  case LIGHTWEIGHT_JSON_VALUE_OBJECT:
+  case LIGHTWEIGHT_JSON_VALUE_ARRAY: {
+    const bool array = LIGHTWEIGHT_JSON_VALUE_ARRAY == value->type;
+    if (!json) {
+      lightweight_json_binary_begin(
+          ctx, NULL, array ? LIGHTWEIGHT_JSON_ARRAY : LIGHTWEIGHT_JSON_OBJECT,
+          false, 0);
+      return LIGHTWEIGHT_JSON_ERR_NONE;
+    }
+    write_bytes(ctx, array ? "[" : "{", 1);
+    ctx->nesting++;
+    *writer_level(ctx) = array ? LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT : 0;
+    // Counted in the parent once it ends
+    return LIGHTWEIGHT_JSON_ERR_NONE;
+  }
+  }
+  count_element(ctx);
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+lightweight_json_err_t
+lightweight_json_transcode_end(lightweight_json_writer_ctx_t *ctx) {
+  return writer_end(ctx);
+}
+
+// Walk the JSON document in `data`, validating it on the way like
+// lightweight_json_validate. The writer's stack tracks the open objects /
+// arrays.
+static lightweight_json_err_t
+transcode_json(lightweight_json_writer_ctx_t *ctx, const char *const key,
+               const char *data, size_t size, bool *out_started) {
+  const int nesting = ctx->nesting;
+  enum { EXPECT_VALUE, EXPECT_KEY, AFTER_VALUE } state = EXPECT_VALUE;
+  const char *item_key = key;
+  size_t key_len = NULL != key ? strlen(key) : 0;
+  bool key_escaped = false;
+  size_t i = skip_whitespace(data, size, 0);
+
+  for (;;) {
+    switch (state) {
+    case EXPECT_VALUE: {
+      if (i >= size) {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
       }
-      break;
-    case '-':
-      if (!in_num) {
-        in_num = true;
-        num_begin = offset;
-      } else {
+      lightweight_json_value_t value;
+      size_t end = i + 1;
+      bool valid = true;
+      switch (data[i]) {
+      case '{':
+        value.type = LIGHTWEIGHT_JSON_VALUE_OBJECT;
+        break;
+      case '[':
+        value.type = LIGHTWEIGHT_JSON_VALUE_ARRAY;
+        break;
+      case '"':
+        valid = validate_string(data, size, &end);
+        value.type = LIGHTWEIGHT_JSON_VALUE_STRING;
+        value.as.string.data = &data[i + 1];
+        value.as.string.len = end - i - 2;
+        break;
+      case 't':
+      case 'f':
+        end = i;
+        value.type = LIGHTWEIGHT_JSON_VALUE_BOOL;
+        value.as.boolean = data[i] == 't';
+        valid = value.as.boolean
+                    ? validate_literal(data, size, &end, "true", 4)
+                    : validate_literal(data, size, &end, "false", 5);
+        break;
+      case 'n':
+        end = i;
+        value.type = LIGHTWEIGHT_JSON_VALUE_NULL;
+        valid = validate_literal(data, size, &end, "null", 4);
+        break;
+      default:
+        end = i;
+        valid = validate_number(data, size, &end) &&
+                LIGHTWEIGHT_JSON_ERR_NONE ==
+                    parse_number_value(data, size, i, &value);
+        break;
+      }
+      if (!valid) {
         return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
       }
+      const lightweight_json_err_t err = lightweight_json_transcode_item(
+          ctx, item_key, key_len, key_escaped, &value, true);
+      if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+        return err;
+      }
+      *out_started = true;
+      i = skip_whitespace(data, size, end);
+      state = AFTER_VALUE;
+      if (LIGHTWEIGHT_JSON_VALUE_ARRAY == value.type) {
+        item_key = NULL;
+        state = EXPECT_VALUE;
+      } else if (LIGHTWEIGHT_JSON_VALUE_OBJECT == value.type) {
+        state = EXPECT_KEY;
+      }
+      if (EXPECT_VALUE == state || EXPECT_KEY == state) {
+        if (i < size && data[i] == (EXPECT_VALUE == state ? ']' : '}')) {
+          // Empty object / array
+          const lightweight_json_err_t end_err = writer_end(ctx);
+          if (LIGHTWEIGHT_JSON_ERR_NONE != end_err) {
+            return end_err;
+          }
+          i++;
+          state = AFTER_VALUE;
+        }
+      }
       break;
-    case '.':
-      if (in_num && decimal_count == 0) {
-        decimal_count++;
-      } else {
+    }
+    case EXPECT_KEY: {
+      if (i >= size || data[i] != '"') {
         return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
       }
-      break;
-    case ',':
-    case ']':
-    case '}':
-      if (!in_num) {
+      size_t end = i + 1;
+      if (!validate_string(data, size, &end)) {
         return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
       }
-      in_num = false;
-      num_end = offset;
-
-      char temp[64] = {0};
-      memcpy(temp, &ctx->buffer[num_begin], num_end - num_begin);
-
-      switch (numerical_type) {
-      case NUMERICAL_TYPE_UINT64:
-        *(uint64_t *)out_value = strtoull(temp, NULL, 0);
-        break;
-      case NUMERICAL_TYPE_INT64:
-        *(int64_t *)out_value = strtoll(temp, NULL, 0);
-        break;
-      case NUMERICAL_TYPE_DOUBLE:
-        *(double *)out_value = strtod(temp, NULL);
-        break;
-      default:
-        return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+      item_key = &data[i + 1];
+      key_len = end - i - 2;
+      key_escaped = true;
+      i = skip_whitespace(data, size, end);
+      if (i >= size || data[i] != ':') {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
       }
-      return LIGHTWEIGHT_JSON_ERR_NONE;
+      i = skip_whitespace(data, size, i + 1);
+      state = EXPECT_VALUE;
       break;
-    default:
-      if (c != ' ' && c != '\r' && c != '\n' && c != '\t' && c != ':') {
-        return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
+    }
+    case AFTER_VALUE:
+      i = skip_whitespace(data, size, i);
+      if (ctx->nesting == nesting) {
+        // Only whitespace may follow the root value
+        return i == size ? LIGHTWEIGHT_JSON_ERR_NONE
+                         : LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+      }
+      if (i >= size) {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+      }
+      const bool in_array = LIGHTWEIGHT_JSON_ARRAY == writer_level_type(ctx);
+      if (data[i] == ',') {
+        i = skip_whitespace(data, size, i + 1);
+        item_key = NULL;
+        state = in_array ? EXPECT_VALUE : EXPECT_KEY;
+      } else if (data[i] == (in_array ? ']' : '}')) {
+        const lightweight_json_err_t err = writer_end(ctx);
+        if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+          return err;
+        }
+        i++;
+      } else {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
       }
       break;
     }
   }
-
-  return LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
 }
 
-lightweight_json_err_t
-lightweight_json_reader_get_uint64(lightweight_json_reader_ctx_t *ctx,
-                                   const char *key, uint64_t *out_value) {
-  return get_numerical(ctx, key, (void *)out_value, NUMERICAL_TYPE_UINT64);
+static lightweight_json_err_t
+writer_add_value(lightweight_json_writer_ctx_t *ctx, const char *key,
+                 size_t key_len, const lightweight_json_value_t *value) {
+  if (NULL == ctx || NULL == value ||
+      (uint8_t)value->type > (uint8_t)LIGHTWEIGHT_JSON_VALUE_ARRAY) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  return lightweight_json_transcode_item(ctx, key, key_len, false, value,
+                                         false);
 }
 
 lightweight_json_err_t
-lightweight_json_reader_get_double(lightweight_json_reader_ctx_t *ctx,
-                                   const char *key, double *out_value) {
-  return get_numerical(ctx, key, (void *)out_value, NUMERICAL_TYPE_DOUBLE);
+lightweight_json_writer_add_value(lightweight_json_writer_ctx_t *ctx,
+                                  const char *key, size_t key_len,
+                                  const lightweight_json_value_t *value) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_OTHER,
+             writer_add_value(ctx, key, key_len, value));
 }
 
-lightweight_json_err_t
-lightweight_json_reader_get_int64(lightweight_json_reader_ctx_t *ctx,
-                                  const char *key, int64_t *out_value) {
-  return get_numerical(ctx, key, (void *)out_value, NUMERICAL_TYPE_INT64);
+// Called once a transcode / filter returns
+static lightweight_json_err_t
+writer_broke_off(lightweight_json_writer_ctx_t *ctx, int nesting,
+                 lightweight_json_err_t err, bool started) {
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err && started) {
+    // The output broke off in the middle of the document. Drop back to where
+    // it started so the context stays usable, the error sticks for flush.
+    ctx->nesting = nesting;
+    if (LIGHTWEIGHT_JSON_ERR_NONE == ctx->error) {
+      ctx->error = err;
+    }
+  }
+  return err;
 }
 
-lightweight_json_err_t
-lightweight_json_reader_enter(lightweight_json_reader_ctx_t *ctx,
-                              const char *key) {
-  if (NULL == ctx) {
+static lightweight_json_err_t
+writer_transcode(lightweight_json_writer_ctx_t *ctx, const char *const key,
+                 const char *data, size_t size,
+                 lightweight_json_format_e format) {
+  if (NULL == ctx || NULL == data || 0 == size ||
+      (uint8_t)format > (uint8_t)LIGHTWEIGHT_JSON_FORMAT_MSGPACK) {
     return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
   }
+  const int nesting = ctx->nesting;
+  bool started = false;
+  const lightweight_json_err_t err =
+      LIGHTWEIGHT_JSON_FORMAT_JSON == format
+          ? transcode_json(ctx, key, data, size, &started)
+          : lightweight_json_binary_transcode(ctx, key, data, size, format,
+                                              &started);
+  return writer_broke_off(ctx, nesting, err, started);
+}
 
-  size_t offset = ctx->current_offset[ctx->nesting] +
-                  ctx->current_suboffset[ctx->nesting] + 1;
-  if (key) {
-    offset = find_key(ctx, key);
-    if (0 == offset) {
-      return LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
-    }
+lightweight_json_err_t
+lightweight_json_writer_transcode(lightweight_json_writer_ctx_t *ctx,
+                                  const char *const key, const char *data,
+                                  size_t size,
+                                  lightweight_json_format_e format) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_OTHER,
+             writer_transcode(ctx, key, data, size, format));
+}
 
-    // Skip key, the two "s and the colon
-    offset += strlen(key) + 3;
-  }
+// --- Filtering ---
 
-  bool in_string = false;
-  for (; offset < ctx->buffer_size; offset++) {
-    const char c = ctx->buffer[offset];
+// Where the walk is relative to the rule paths
+typedef struct {
+  // Rules whose first `depth` path segments matched
+  uint64_t alive;
+  uint8_t depth;
+  // Inside of a subtree an include rule matched (or there are none)
+  bool included;
+  bool array;
+  bool first;
+} filter_level_t;
 
-    switch (c) {
-    case '\"':
-      in_string = !in_string;
-      break;
-    case '\\':
-      // Skip escape
-      offset++;
-      break;
-    case '}':
-    case ']':
-    case ',':
-      if (!in_string) {
-        return LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
-      }
-      break;
-    case '[':
-    case '{':
-      if (!in_string) {
-        ctx->nesting++;
-        ctx->current_offset[ctx->nesting] = offset;
-        if (c == '[') {
-          ctx->object_type[ctx->nesting] = LIGHTWEIGHT_JSON_ARRAY;
-        } else {
-          ctx->object_type[ctx->nesting] = LIGHTWEIGHT_JSON_OBJECT;
+typedef struct {
+  const lightweight_json_filter_rule_t *rules;
+  // Rule bits by action
+  uint64_t includes;
+  uint64_t excludes;
+  uint64_t replaces;
+  // Rules whose path has exactly `depth + 1` segments, per depth
+  uint64_t terminal[LIGHTWEIGHT_JSON_FILTER_MAX_DEPTH];
+  // Offset of every path segment + one past the end of the path
+  uint8_t segments[LIGHTWEIGHT_JSON_FILTER_MAX_RULES]
+                  [LIGHTWEIGHT_JSON_FILTER_MAX_DEPTH + 1];
+} filter_rules_t;
+
+typedef enum {
+  FILTER_SKIP,
+  // Copied as it is
+  FILTER_COPY,
+  FILTER_REPLACE,
+  // Walked, rules still apply below it
+  FILTER_DESCEND,
+} filter_action_t;
+
+// Parse the rules, false if one is invalid
+static bool filter_compile(const lightweight_json_filter_rule_t *rules,
+                           size_t rule_count, filter_rules_t *out) {
+  out->rules = rules;
+  out->includes = 0;
+  out->excludes = 0;
+  out->replaces = 0;
+  memset(out->terminal, 0, sizeof(out->terminal));
+  for (size_t r = 0; r < rule_count; r++) {
+    const lightweight_json_filter_rule_t *rule = &rules[r];
+    if (NULL == rule->path || '\0' == rule->path[0] ||
+        (LIGHTWEIGHT_JSON_FILTER_REPLACE == rule->action &&
+         (NULL == rule->replacement || '\0' == rule->replacement[0]))) {
+      return false;
+    }
+    const size_t len = strlen(rule->path);
+    if (len >= UINT8_MAX) {
+      return false;
+    }
+    size_t segments = 0;
+    out->segments[r][0] = 0;
+    for (size_t c = 0; c <= len; c++) {
+      if (c == len || rule->path[c] == '.') {
+        if (++segments > LIGHTWEIGHT_JSON_FILTER_MAX_DEPTH) {
+          return false;
         }
-        ctx->current_suboffset[ctx->nesting] = 0;
-        return LIGHTWEIGHT_JSON_ERR_NONE;
+        // One past the dot, so the segment ends 1 before the next start
+        out->segments[r][segments] = (uint8_t)(c + 1);
       }
+    }
+    const uint64_t bit = 1ull << r;
+    out->terminal[segments - 1] |= bit;
+    switch (rule->action) {
+    case LIGHTWEIGHT_JSON_FILTER_INCLUDE:
+      out->includes |= bit;
       break;
-    default:
-      if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
-        return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
-      }
+    case LIGHTWEIGHT_JSON_FILTER_EXCLUDE:
+      out->excludes |= bit;
+      break;
+    case LIGHTWEIGHT_JSON_FILTER_REPLACE:
+      out->replaces |= bit;
       break;
+    default:
+      return false;
     }
   }
-  return LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
+  return true;
 }
-lightweight_json_err_t
-lightweight_json_reader_leave(lightweight_json_reader_ctx_t *ctx) {
-  if (NULL == ctx) {
-    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+
+// What to do with a value whose parent left it in state `child`
+static filter_action_t filter_decide(const filter_rules_t *rules, char first,
+                                     const filter_level_t *child, bool root) {
+  if ((first == '{' || first == '[') && (0 != child->alive || root)) {
+    // Unless nothing below it can be included
+    return child->included || 0 != (child->alive & rules->includes)
+               ? FILTER_DESCEND
+               : FILTER_SKIP;
   }
+  return child->included ? FILTER_COPY : FILTER_SKIP;
+}
 
-  if (ctx->nesting > 0) {
-    ctx->nesting--;
+// Match the key of a member of the object `level` against the rules
+static filter_action_t filter_member(const filter_rules_t *rules,
+                                     const filter_level_t *level,
+                                     const char *key, size_t key_len,
+                                     char first, filter_level_t *out_child,
+                                     const char **out_replacement) {
+  const uint8_t depth = level->depth;
+  uint64_t matched = 0;
+  for (uint64_t alive = level->alive; 0 != alive; alive &= alive - 1) {
+    const unsigned rule = count_trailing_zeros64(alive);
+    const uint8_t *segments = rules->segments[rule];
+    const char *segment = &rules->rules[rule].path[segments[depth]];
+    const size_t segment_len = segments[depth + 1] - segments[depth] - 1u;
+    if ((segment_len == key_len && 0 == memcmp(segment, key, key_len)) ||
+        (1 == segment_len && '*' == segment[0])) {
+      matched |= 1ull << rule;
+    }
   }
-  return LIGHTWEIGHT_JSON_ERR_NONE;
+  const uint64_t terminal = matched & rules->terminal[depth];
+  if (0 != (terminal & rules->excludes)) {
+    return FILTER_SKIP;
+  }
+  if (0 != (terminal & rules->replaces)) {
+    // The first matching rule wins
+    *out_replacement =
+        rules->rules[count_trailing_zeros64(terminal & rules->replaces)]
+            .replacement;
+    return FILTER_REPLACE;
+  }
+  const bool included = level->included || 0 != (terminal & rules->includes);
+  // Include rules have nothing left to do in an included subtree
+  out_child->alive =
+      matched & ~terminal & (included ? ~rules->includes : UINT64_MAX);
+  out_child->depth = (uint8_t)(depth + 1);
+  out_child->included = included;
+  return filter_decide(rules, first, out_child, false);
 }
 
-lightweight_json_err_t
-lightweight_json_reader_array_next(lightweight_json_reader_ctx_t *ctx) {
-  if (NULL == ctx) {
-    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+// Add a value / member of the input as it is
+static void filter_copy(lightweight_json_writer_ctx_t *ctx, const char *key,
+                        size_t key_len, bool key_escaped, const char *value,
+                        size_t len) {
+  add_comma(ctx);
+  if (NULL != key) {
+    transcode_string(ctx, key, key_len, key_escaped);
+    write_bytes(ctx, ":", 1);
   }
+  write_bytes(ctx, value, len);
+  count_element(ctx);
+}
 
-  if (LIGHTWEIGHT_JSON_ARRAY != ctx->object_type[ctx->nesting]) {
-    return LIGHTWEIGHT_JSON_ERR_INVALID_STATE;
+// Begin the object / array at data[offset] and push its level
+static lightweight_json_err_t
+filter_open(lightweight_json_writer_ctx_t *ctx, const char *data,
+            size_t offset, const char *key, size_t key_len, bool key_escaped,
+            filter_level_t child, filter_level_t *stack, int *depth) {
+  if (*depth == LIGHTWEIGHT_JSON_FILTER_MAX_DEPTH) {
+    return LIGHTWEIGHT_JSON_ERR_MAX_NESTING_REACHED;
+  }
+  lightweight_json_value_t value;
+  value.type = data[offset] == '[' ? LIGHTWEIGHT_JSON_VALUE_ARRAY
+                                   : LIGHTWEIGHT_JSON_VALUE_OBJECT;
+  const lightweight_json_err_t err = lightweight_json_transcode_item(
+      ctx, key, key_len, key_escaped, &value, true);
+  if (LIGHTWEIGHT_JSON_ERR_NONE == err) {
+    child.array = data[offset] == '[';
+    child.first = true;
+    stack[(*depth)++] = child;
   }
+  return err;
+}
 
-  size_t offset = ctx->current_offset[ctx->nesting] +
-                  ctx->current_suboffset[ctx->nesting] + 1;
-  bool in_string = false;
-  int nesting = 0;
-  for (; offset < ctx->buffer_size; offset++) {
-    const char c = ctx->buffer[offset];
-    switch (c) {
-    case ',':
-      if (!in_string && nesting == 0) {
-        ctx->current_suboffset[ctx->nesting] =
-            offset - ctx->current_offset[ctx->nesting];
-        return LIGHTWEIGHT_JSON_ERR_NONE;
+// Copied members / elements next to each other are written as one span,
+// separators and whitespace included
+typedef struct {
+  size_t start;
+  size_t end;
+} filter_run_t;
+
+static void filter_flush_run(lightweight_json_writer_ctx_t *ctx,
+                             const char *data, filter_run_t *run) {
+  if (run->end > run->start) {
+    filter_copy(ctx, NULL, 0, false, &data[run->start], run->end - run->start);
+    run->start = run->end;
+  }
+}
+
+static lightweight_json_err_t
+filter_json(lightweight_json_writer_ctx_t *ctx, const char *const key,
+            const char *data, size_t size, const filter_rules_t *rules,
+            uint64_t all, bool *out_started) {
+  filter_level_t stack[LIGHTWEIGHT_JSON_FILTER_MAX_DEPTH];
+  int depth = 0;
+  size_t i = skip_whitespace(data, size, 0);
+  if (i >= size) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+  }
+
+  const filter_level_t root = {
+      .alive = all,
+      .included = 0 == rules->includes,
+  };
+  const size_t key_len = NULL != key ? strlen(key) : 0;
+  const filter_action_t action = filter_decide(rules, data[i], &root, true);
+  switch (action) {
+  case FILTER_DESCEND: {
+    const lightweight_json_err_t err =
+        filter_open(ctx, data, i, key, key_len, false, root, stack, &depth);
+    if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+      return err;
+    }
+    *out_started = true;
+    i++;
+    break;
+  }
+  case FILTER_SKIP:
+  default: {
+    // A scalar root, left out if there are include rules
+    const size_t end = skip_json_value(data, size, i);
+    if (ctx->nesting < 0) {
+      return LIGHTWEIGHT_JSON_ERR_INVALID_STATE;
+    }
+    if (end > size) {
+      return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+    }
+    if (FILTER_SKIP != action) {
+      filter_copy(ctx, key, key_len, false, &data[i], end - i);
+      *out_started = true;
+    }
+    i = end;
+    break;
+  }
+  }
+
+  filter_run_t run = {0, 0};
+  while (depth > 0) {
+    filter_level_t *level = &stack[depth - 1];
+    i = skip_whitespace(data, size, i);
+    if (i >= size) {
+      return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+    }
+    if (data[i] == (level->array ? ']' : '}')) {
+      filter_flush_run(ctx, data, &run);
+      const lightweight_json_err_t err = writer_end(ctx);
+      if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+        return err;
       }
-      break;
-    case '\"':
-      in_string = !in_string;
-      break;
-    case '\\':
-      offset++;
-      break;
-    case '{':
-    case '[':
-      if (!in_string) {
-        nesting++;
+      depth--;
+      i++;
+      continue;
+    }
+    if (!level->first) {
+      if (data[i] != ',') {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
       }
-      break;
-    case ']':
-    case '}':
-      if (!in_string && nesting > 0) {
-        nesting--;
-      } else if (!in_string) {
-        return LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
+      i = skip_whitespace(data, size, i + 1);
+      if (i >= size) {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
       }
-      break;
-    default:
+    }
+    level->first = false;
 
-      break;
+    const size_t start = i;
+    const char *item_key = NULL;
+    size_t item_key_len = 0;
+    // Array elements are on the array's path
+    filter_level_t child = *level;
+    const char *replacement = NULL;
+    filter_action_t action;
+    if (level->array) {
+      action = filter_decide(rules, data[i], &child, false);
+    } else {
+      if (data[i] != '"') {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+      }
+      const size_t key_end = scan_string(data, size, i + 1);
+      item_key = &data[i + 1];
+      item_key_len = key_end - i - 1;
+      i = skip_whitespace(data, size, key_end + 1);
+      if (i >= size || data[i] != ':') {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+      }
+      i = skip_whitespace(data, size, i + 1);
+      if (i >= size) {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+      }
+      action = filter_member(rules, level, item_key, item_key_len, data[i],
+                             &child, &replacement);
     }
-  }
 
-  return LIGHTWEIGHT_JSON_ERR_NONE;
+    if (FILTER_DESCEND == action) {
+      filter_flush_run(ctx, data, &run);
+      const lightweight_json_err_t err =
+          filter_open(ctx, data, i, item_key, item_key_len, true, child,
+                      stack, &depth);
+      if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+        return err;
+      }
+      i++;
+      continue;
+    }
+    const size_t end = skip_json_value(data, size, i);
+    if (end > size || end == i) {
+      return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+    }
+    if (FILTER_COPY == action) {
+      if (run.end == run.start) {
+        run.start = start;
+      }
+      run.end = end;
+    } else {
+      filter_flush_run(ctx, data, &run);
+      if (FILTER_REPLACE == action) {
+        filter_copy(ctx, item_key, item_key_len, true, replacement,
+                    strlen(replacement));
+      }
+    }
+    i = end;
+  }
+  // Only whitespace may follow the root value
+  return skip_whitespace(data, size, i) == size
+             ? LIGHTWEIGHT_JSON_ERR_NONE
+             : LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
 }
 
-lightweight_json_err_t
-lightweight_json_reader_get_bool(lightweight_json_reader_ctx_t *ctx,
-                                 const char *key, bool *out_value) {
-  if (NULL == ctx || NULL == out_value) {
+static lightweight_json_err_t
+writer_filter(lightweight_json_writer_ctx_t *ctx, const char *const key,
+              const char *data, size_t size,
+              const lightweight_json_filter_rule_t *rules, size_t rule_count) {
+  if (NULL == ctx || NULL == data || 0 == size ||
+      (NULL == rules && 0 != rule_count) ||
+      rule_count > LIGHTWEIGHT_JSON_FILTER_MAX_RULES) {
     return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
   }
+  if (LIGHTWEIGHT_JSON_FORMAT_JSON != ctx->format) {
+    // Spans are copied as they are
+    return LIGHTWEIGHT_JSON_ERR_NOT_SUPPORTED;
+  }
+  filter_rules_t compiled;
+  if (!filter_compile(rules, rule_count, &compiled)) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  const uint64_t all = LIGHTWEIGHT_JSON_FILTER_MAX_RULES == rule_count
+                           ? UINT64_MAX
+                           : (1ull << rule_count) - 1;
 
-  size_t offset = ctx->current_offset[ctx->nesting] +
-                  ctx->current_suboffset[ctx->nesting] + 1;
+  const int nesting = ctx->nesting;
+  bool started = false;
+  const lightweight_json_err_t err =
+      filter_json(ctx, key, data, size, &compiled, all, &started);
+  return writer_broke_off(ctx, nesting, err, started);
+}
 
-  if (NULL != key) {
-    offset = find_key(ctx, key);
-    if (0 == offset) {
-      return LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
-    }
+lightweight_json_err_t lightweight_json_writer_filter(
+    lightweight_json_writer_ctx_t *ctx, const char *const key,
+    const char *data, size_t size, const lightweight_json_filter_rule_t *rules,
+    size_t rule_count) {
+  STATS_CALL(ctx, LIGHTWEIGHT_JSON_API_OTHER,
+             writer_filter(ctx, key, data, size, rules, rule_count));
+}
 
-    // Skip key and the two "s and colon
-    offset += strlen(key) + 3;
+lightweight_json_err_t
+lightweight_json_reader_get_stats(const lightweight_json_reader_ctx_t *ctx,
+                                  lightweight_json_reader_stats_t *out_stats) {
+  if (NULL == ctx || NULL == out_stats) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
   }
+#ifdef LIGHTWEIGHT_JSON_ENABLE_STATS
+  *out_stats = ctx->stats;
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+#else
+  return LIGHTWEIGHT_JSON_ERR_NOT_SUPPORTED;
+#endif
+}
 
-  char temp[16] = {0};
-  bool found = false;
-  for (; offset < ctx->buffer_size && !found; offset++) {
-    const char c = ctx->buffer[offset];
+lightweight_json_err_t
+lightweight_json_reader_reset_stats(lightweight_json_reader_ctx_t *ctx) {
+  if (NULL == ctx) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+#ifdef LIGHTWEIGHT_JSON_ENABLE_STATS
+  memset(&ctx->stats, 0, sizeof(ctx->stats));
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+#else
+  return LIGHTWEIGHT_JSON_ERR_NOT_SUPPORTED;
+#endif
+}
 
-    switch (c) {
-    case 't':
-      // Copy "true"
-      memcpy(temp, &ctx->buffer[offset], 4);
-      found = true;
-      break;
-    case 'f':
-      // Copy "false"
-      memcpy(temp, &ctx->buffer[offset], 5);
-      found = true;
-      break;
-    default:
-      if (c != ' ' && c != '\r' && c != '\n' && c != '\t' && c != ':') {
-        return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
-      }
-      break;
-    }
+lightweight_json_err_t
+lightweight_json_reader_set_call_hook(lightweight_json_reader_ctx_t *ctx,
+                                      lightweight_json_call_hook_t hook,
+                                      void *userdata) {
+  if (NULL == ctx) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
   }
+#ifdef LIGHTWEIGHT_JSON_ENABLE_STATS
+  ctx->call_hook = hook;
+  ctx->call_hook_userdata = userdata;
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+#else
+  (void)hook;
+  (void)userdata;
+  return LIGHTWEIGHT_JSON_ERR_NOT_SUPPORTED;
+#endif
+}
 
-  if (0 == strcmp(temp, "true")) {
-    *out_value = true;
-  } else if (0 == strcmp(temp, "false")) {
-    *out_value = false;
-  } else {
-    return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
+lightweight_json_err_t
+lightweight_json_writer_get_stats(const lightweight_json_writer_ctx_t *ctx,
+                                  lightweight_json_writer_stats_t *out_stats) {
+  if (NULL == ctx || NULL == out_stats) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+#ifdef LIGHTWEIGHT_JSON_ENABLE_STATS
+  *out_stats = ctx->stats;
+  out_stats->bytes_written = ctx->stats.bytes_flushed + (uint64_t)ctx->offset;
+  out_stats->average_flush_size =
+      0 == ctx->stats.flush_calls
+          ? 0
+          : ctx->stats.bytes_flushed / ctx->stats.flush_calls;
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+#else
+  return LIGHTWEIGHT_JSON_ERR_NOT_SUPPORTED;
+#endif
+}
+
+lightweight_json_err_t
+lightweight_json_writer_reset_stats(lightweight_json_writer_ctx_t *ctx) {
+  if (NULL == ctx) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
   }
+#ifdef LIGHTWEIGHT_JSON_ENABLE_STATS
+  memset(&ctx->stats, 0, sizeof(ctx->stats));
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+#else
+  return LIGHTWEIGHT_JSON_ERR_NOT_SUPPORTED;
+#endif
+}
 
+lightweight_json_err_t
+lightweight_json_writer_set_call_hook(lightweight_json_writer_ctx_t *ctx,
+                                      lightweight_json_call_hook_t hook,
+                                      void *userdata) {
+  if (NULL == ctx) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+#ifdef LIGHTWEIGHT_JSON_ENABLE_STATS
+  ctx->call_hook = hook;
+  ctx->call_hook_userdata = userdata;
   return LIGHTWEIGHT_JSON_ERR_NONE;
+#else
+  (void)hook;
+  (void)userdata;
+  return LIGHTWEIGHT_JSON_ERR_NOT_SUPPORTED;
+#endif
 }
@@ -0,0 +1,987 @@
+#include "lightweight_json.h"
+#include "lightweight_json_ndjson.h"
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Benchmarks for the writer and the reader on generated corpora.
+// Throughput is reported as bytes_per_second (MB/s) and items_per_second
+// (documents, lookups or elements per second, see the individual benchmark).
+
+namespace {
+
+// --- Corpora ---
+// Every corpus is generated by a function emitting it through a writer, so the
+// same code drives the writer benchmarks and produces the reader input.
+
+constexpr int kDeepNesting = 64;
+
+struct Corpus {
+  const char *name;
+  void (*emit)(lightweight_json_writer_ctx_t *ctx);
+};
+
+// Simple deterministic generator so every run sees the same data
+uint64_t next_random(uint64_t &state) {
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return state;
+}
+
+void emit_api_response(lightweight_json_writer_ctx_t *ctx) {
+  static const char *const names[] = {"Alice", "Bob", "Carol", "Dave",
+                                      "Eve",   "Frank", "Grace", "Heidi"};
+  uint64_t state = 0x9E3779B97F4A7C15ull;
+  lightweight_json_writer_begin(ctx, NULL, LIGHTWEIGHT_JSON_OBJECT);
+  lightweight_json_writer_add_string(ctx, "status", "ok");
+  lightweight_json_writer_add_uint64(ctx, "page", 1);
+  lightweight_json_writer_add_uint64(ctx, "per_page", 200);
+  lightweight_json_writer_begin(ctx, "users", LIGHTWEIGHT_JSON_ARRAY);
+  for (int i = 0; i < 200; i++) {
+    lightweight_json_writer_begin(ctx, NULL, LIGHTWEIGHT_JSON_OBJECT);
+    lightweight_json_writer_add_uint64(ctx, "id", next_random(state) >> 20);
+    lightweight_json_writer_add_string(ctx, "name", names[i % 8]);
+    lightweight_json_writer_add_string(ctx, "email", "user@example.com");
+    lightweight_json_writer_add_bool(ctx, "active", i % 3 != 0);
+    lightweight_json_writer_add_double(
+        ctx, "score", (double)(next_random(state) % 100000) / 100.0);
+    lightweight_json_writer_add_int64(ctx, "delta",
+                                      (int64_t)(next_random(state) % 2000) -
+                                          1000);
+    lightweight_json_writer_begin(ctx, "tags", LIGHTWEIGHT_JSON_ARRAY);
+    lightweight_json_writer_add_string(ctx, NULL, "alpha");
+    lightweight_json_writer_add_string(ctx, NULL, "beta");
+    lightweight_json_writer_end(ctx);
+    lightweight_json_writer_end(ctx);
+  }
+  lightweight_json_writer_end(ctx);
+  lightweight_json_writer_add_string(ctx, "request_id",
+                                     "4f1c2a9e-77aa-4d2b-9a51-0c3c1b2f6e1d");
+  lightweight_json_writer_end(ctx);
+}
+
+void emit_numeric_array(lightweight_json_writer_ctx_t *ctx) {
+  uint64_t state = 0xD1B54A32D192ED03ull;
+  lightweight_json_writer_begin(ctx, NULL, LIGHTWEIGHT_JSON_ARRAY);
+  for (int i = 0; i < 10000; i++) {
+    lightweight_json_writer_add_double(
+        ctx, NULL, (double)(next_random(state) % 10000000) / 1000.0);
+  }
+  lightweight_json_writer_end(ctx);
+}
+
+// 50 documents nested kDeepNesting levels deep, back to back
+void emit_deep_nesting(lightweight_json_writer_ctx_t *ctx) {
+  for (int repeat = 0; repeat < 50; repeat++) {
+    lightweight_json_writer_begin(ctx, NULL, LIGHTWEIGHT_JSON_OBJECT);
+    for (int i = 1; i < kDeepNesting; i++) {
+      lightweight_json_writer_add_uint64(ctx, "depth", (uint64_t)i);
+      lightweight_json_writer_begin(ctx, "child", LIGHTWEIGHT_JSON_OBJECT);
+    }
+    lightweight_json_writer_add_string(ctx, "leaf", "bottom");
+    for (int i = 0; i < kDeepNesting; i++) {
+      lightweight_json_writer_end(ctx);
+    }
+  }
+}
+
+std::string make_long_string(size_t length) {
+  std::string value;
+  value.reserve(length);
+  for (size_t i = 0; i < length; i++) {
+    // Sprinkle in characters which have to be escaped
+    value.push_back(i % 97 == 0 ? '"' : (char)('a' + i % 26));
+  }
+  return value;
+}
+
+void emit_long_strings(lightweight_json_writer_ctx_t *ctx) {
+  static const std::string value = make_long_string(16 * 1024);
+  lightweight_json_writer_begin(ctx, NULL, LIGHTWEIGHT_JSON_OBJECT);
+  for (int i = 0; i < 16; i++) {
+    char key[16];
+    snprintf(key, sizeof(key), "text%d", i);
+    lightweight_json_writer_add_string(ctx, key, value.c_str());
+  }
+  lightweight_json_writer_end(ctx);
+}
+
+void emit_small_message(lightweight_json_writer_ctx_t *ctx) {
+  lightweight_json_writer_begin(ctx, NULL, LIGHTWEIGHT_JSON_OBJECT);
+  lightweight_json_writer_add_string(ctx, "topic", "sensors/42/temp");
+  lightweight_json_writer_add_uint64(ctx, "ts", 1700000000123ull);
+  lightweight_json_writer_add_double(ctx, "value", 21.5);
+  lightweight_json_writer_add_bool(ctx, "ok", true);
+  lightweight_json_writer_end(ctx);
+}
+
+// 1000 small documents back to back, like a message stream
+void emit_small_messages(lightweight_json_writer_ctx_t *ctx) {
+  for (int i = 0; i < 1000; i++) {
+    emit_small_message(ctx);
+  }
+}
+
+const Corpus kCorpora[] = {
+    {"api_response", emit_api_response},
+    {"numeric_array", emit_numeric_array},
+    {"deep_nesting", emit_deep_nesting},
+    {"long_strings", emit_long_strings},
+    {"small_messages", emit_small_messages},
+};
+
+struct Sink {
+  std::string *output;
+  size_t bytes;
+};
+
+void sink_cb(char *buffer, size_t amount, void *userdata) {
+  Sink *sink = static_cast<Sink *>(userdata);
+  sink->bytes += amount;
+  if (NULL != sink->output) {
+    sink->output->append(buffer, amount);
+  }
+}
+
+size_t run_writer(void (*emit)(lightweight_json_writer_ctx_t *), char *buffer,
+                  size_t buffer_size, std::string *output) {
+  lightweight_json_writer_level_t levels[kDeepNesting];
+  lightweight_json_writer_ctx_t ctx;
+  Sink sink = {output, 0};
+  lightweight_json_writer_init_with_stack(buffer, buffer_size, sink_cb, &sink,
+                                          levels, kDeepNesting, &ctx);
+  emit(&ctx);
+  lightweight_json_writer_flush(&ctx);
+  return sink.bytes;
+}
+
+std::string render(void (*emit)(lightweight_json_writer_ctx_t *)) {
+  std::vector<char> buffer(4096);
+  std::string output;
+  run_writer(emit, buffer.data(), buffer.size(), &output);
+  return output;
+}
+
+// --- Writer ---
+
+void BM_Writer(benchmark::State &state, void (*emit)(lightweight_json_writer_ctx_t *)) {
+  std::vector<char> buffer((size_t)state.range(0));
+  size_t bytes = 0;
+  for (auto _ : state) {
+    bytes += run_writer(emit, buffer.data(), buffer.size(), NULL);
+  }
+  state.SetBytesProcessed((int64_t)bytes);
+  state.SetItemsProcessed(state.iterations());
+}
+
+void register_writer_benchmarks() {
+  for (const Corpus &corpus : kCorpora) {
+    auto *bench = benchmark::RegisterBenchmark(
+        (std::string("BM_Writer/") + corpus.name).c_str(), BM_Writer,
+        corpus.emit);
+    // buffer_size sweep, 3 bytes is the smallest buffer the tests use
+    for (int64_t size : {3, 16, 64, 256, 1024, 4096, 16384, 65536}) {
+      bench->Arg(size);
+    }
+  }
+}
+
+// api_response into memory: dynamic mode vs. a flush callback appending to a
+// std::string
+void BM_WriterDynamic(benchmark::State &state) {
+  size_t bytes = 0;
+  for (auto _ : state) {
+    lightweight_json_writer_ctx_t ctx;
+    char *output = NULL;
+    size_t len = 0;
+    lightweight_json_writer_init_dynamic(4096, NULL, NULL, NULL,
+                                         LIGHTWEIGHT_JSON_MAX_NESTING_SIZE,
+                                         &ctx);
+    emit_api_response(&ctx);
+    lightweight_json_writer_take_buffer(&ctx, false, &output, &len);
+    benchmark::DoNotOptimize(output);
+    free(output);
+    bytes += len;
+  }
+  state.SetBytesProcessed((int64_t)bytes);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_WriterDynamic);
+
+void BM_WriterAppendCallback(benchmark::State &state) {
+  std::vector<char> buffer(4096);
+  size_t bytes = 0;
+  for (auto _ : state) {
+    std::string output;
+    bytes += run_writer(emit_api_response, buffer.data(), buffer.size(),
+                        &output);
+    benchmark::DoNotOptimize(output.data());
+  }
+  state.SetBytesProcessed((int64_t)bytes);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_WriterAppendCallback);
+
+// The same calls in every output format (0 JSON, 1 CBOR, 2 MessagePack), in
+// memory so MessagePack can patch its counts. bytes_per_second counts output
+// bytes, compare items_per_second across the formats.
+void BM_WriterFormat(benchmark::State &state,
+                     void (*emit)(lightweight_json_writer_ctx_t *)) {
+  const lightweight_json_format_e format =
+      (lightweight_json_format_e)state.range(0);
+  size_t bytes = 0;
+  for (auto _ : state) {
+    lightweight_json_writer_ctx_t ctx;
+    char *output = NULL;
+    size_t len = 0;
+    lightweight_json_writer_init_dynamic(65536, NULL, NULL, NULL,
+                                         LIGHTWEIGHT_JSON_MAX_NESTING_SIZE,
+                                         &ctx);
+    lightweight_json_writer_set_format(&ctx, format);
+    emit(&ctx);
+    lightweight_json_writer_take_buffer(&ctx, false, &output, &len);
+    benchmark::DoNotOptimize(output);
+    free(output);
+    bytes += len;
+  }
+  state.SetBytesProcessed((int64_t)bytes);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(BM_WriterFormat, api_response, emit_api_response)
+    ->DenseRange(0, 2);
+BENCHMARK_CAPTURE(BM_WriterFormat, numeric_array, emit_numeric_array)
+    ->DenseRange(0, 2);
+
+// small_messages through a template, compare with BM_Writer/small_messages/4096
+void BM_WriterTemplate(benchmark::State &state) {
+  char skeleton[128];
+  lightweight_json_template_slot_t slots[3];
+  lightweight_json_template_t tmpl;
+  lightweight_json_writer_ctx_t recorder;
+  lightweight_json_template_init(skeleton, sizeof(skeleton), slots, 3, NULL,
+                                 LIGHTWEIGHT_JSON_MAX_NESTING_SIZE, &tmpl,
+                                 &recorder);
+  lightweight_json_writer_begin(&recorder, NULL, LIGHTWEIGHT_JSON_OBJECT);
+  lightweight_json_writer_add_string(&recorder, "topic", "sensors/42/temp");
+  lightweight_json_template_add_slot(&recorder, "ts",
+                                     LIGHTWEIGHT_JSON_SLOT_UINT64, &tmpl);
+  lightweight_json_template_add_slot(&recorder, "value",
+                                     LIGHTWEIGHT_JSON_SLOT_DOUBLE, &tmpl);
+  lightweight_json_template_add_slot(&recorder, "ok",
+                                     LIGHTWEIGHT_JSON_SLOT_BOOL, &tmpl);
+  lightweight_json_writer_end(&recorder);
+  lightweight_json_template_finish(&tmpl, &recorder);
+
+  lightweight_json_slot_value_t values[3];
+  values[0].u64 = 1700000000123ull;
+  values[1].f64 = 21.5;
+  values[2].boolean = true;
+  std::vector<char> buffer(4096);
+  size_t bytes = 0;
+  for (auto _ : state) {
+    lightweight_json_writer_ctx_t ctx;
+    Sink sink = {NULL, 0};
+    lightweight_json_writer_init(buffer.data(), buffer.size(), sink_cb, &sink,
+                                 &ctx);
+    for (int i = 0; i < 1000; i++) {
+      lightweight_json_writer_add_template(&ctx, NULL, &tmpl, values);
+    }
+    lightweight_json_writer_flush(&ctx);
+    bytes += sink.bytes;
+  }
+  state.SetBytesProcessed((int64_t)bytes);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_WriterTemplate);
+
+// Size of api_response / numeric_array from a counting mode context (0) vs.
+// serializing it into a flushing 4 KiB buffer (1). bytes_per_second counts
+// output bytes.
+void BM_WriterCounting(benchmark::State &state,
+                       void (*emit)(lightweight_json_writer_ctx_t *)) {
+  std::vector<char> buffer(4096);
+  size_t bytes = 0;
+  for (auto _ : state) {
+    lightweight_json_writer_ctx_t ctx;
+    if (0 == state.range(0)) {
+      size_t size = 0;
+      lightweight_json_writer_init_counting(NULL,
+                                            LIGHTWEIGHT_JSON_MAX_NESTING_SIZE,
+                                            &ctx);
+      emit(&ctx);
+      lightweight_json_writer_get_counted_size(&ctx, &size);
+      bytes += size;
+    } else {
+      Sink sink = {NULL, 0};
+      lightweight_json_writer_init(buffer.data(), buffer.size(), sink_cb,
+                                   &sink, &ctx);
+      emit(&ctx);
+      lightweight_json_writer_flush(&ctx);
+      bytes += sink.bytes;
+    }
+  }
+  state.SetBytesProcessed((int64_t)bytes);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_CAPTURE(BM_WriterCounting, api_response, emit_api_response)
+    ->DenseRange(0, 1);
+BENCHMARK_CAPTURE(BM_WriterCounting, numeric_array, emit_numeric_array)
+    ->DenseRange(0, 1);
+
+// --- Reader ---
+
+void BM_ReaderKeyLookup(benchmark::State &state) {
+  const std::string json = render(emit_api_response);
+  // Early, late and missing keys of the top level object, the late ones have
+  // to skip over the whole "users" array
+  const char *const keys[] = {"status", "per_page", "request_id", "missing"};
+  lightweight_json_reader_ctx_t ctx;
+  lightweight_json_reader_init(json.data(), json.size(), &ctx);
+  size_t lookups = 0;
+  for (auto _ : state) {
+    for (const char *key : keys) {
+      benchmark::DoNotOptimize(lightweight_json_reader_key_exists(&ctx, key));
+      lookups++;
+    }
+  }
+  state.SetBytesProcessed((int64_t)(state.iterations() * json.size()));
+  state.SetItemsProcessed((int64_t)lookups);
+}
+BENCHMARK(BM_ReaderKeyLookup);
+
+void BM_ReaderArrayIteration(benchmark::State &state) {
+  const std::string json = render(emit_numeric_array);
+  size_t elements = 0;
+  for (auto _ : state) {
+    lightweight_json_reader_ctx_t ctx;
+    lightweight_json_reader_init(json.data(), json.size(), &ctx);
+    double sum = 0.0;
+    do {
+      double value = 0.0;
+      lightweight_json_reader_get_double(&ctx, NULL, &value);
+      sum += value;
+      elements++;
+    } while (LIGHTWEIGHT_JSON_ERR_NONE == lightweight_json_reader_array_next(&ctx));
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetBytesProcessed((int64_t)(state.iterations() * json.size()));
+  state.SetItemsProcessed((int64_t)elements);
+}
+BENCHMARK(BM_ReaderArrayIteration);
+
+// Reading scattered elements of the 10000 element numeric_array with
+// array_at: a table with an entry per element (0), with one per 16 elements
+// (1) and without a table (2)
+void BM_ReaderArrayAt(benchmark::State &state) {
+  const std::string json = render(emit_numeric_array);
+  std::vector<uint32_t> entries(0 == state.range(0) ? 10000 : 10000 / 16);
+  lightweight_json_reader_ctx_t ctx;
+  lightweight_json_reader_init(json.data(), json.size(), &ctx);
+  if (state.range(0) < 2) {
+    lightweight_json_reader_set_array_table(&ctx, entries.data(),
+                                            entries.size());
+  }
+  uint64_t random = 0x2545F4914F6CDD1Dull;
+  size_t lookups = 0;
+  for (auto _ : state) {
+    double value = 0.0;
+    lightweight_json_reader_array_at(&ctx, next_random(random) % 10000);
+    lightweight_json_reader_get_double(&ctx, NULL, &value);
+    benchmark::DoNotOptimize(value);
+    lookups++;
+  }
+  state.SetItemsProcessed((int64_t)lookups);
+}
+BENCHMARK(BM_ReaderArrayAt)->DenseRange(0, 2);
+
+void BM_ReaderObjectArray(benchmark::State &state) {
+  const std::string json = render(emit_api_response);
+  size_t elements = 0;
+  for (auto _ : state) {
+    lightweight_json_reader_ctx_t ctx;
+    lightweight_json_reader_init(json.data(), json.size(), &ctx);
+    lightweight_json_reader_enter(&ctx, "users");
+    uint64_t sum = 0;
+    do {
+      uint64_t id = 0;
+      lightweight_json_reader_enter(&ctx, NULL);
+      lightweight_json_reader_get_uint64(&ctx, "id", &id);
+      lightweight_json_reader_leave(&ctx);
+      sum += id;
+      elements++;
+    } while (LIGHTWEIGHT_JSON_ERR_NONE == lightweight_json_reader_array_next(&ctx));
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetBytesProcessed((int64_t)(state.iterations() * json.size()));
+  state.SetItemsProcessed((int64_t)elements);
+}
+BENCHMARK(BM_ReaderObjectArray);
+
+// BM_ReaderObjectArray on the same document encoded in every format (0 JSON,
+// 1 CBOR, 2 MessagePack)
+void BM_ReaderFormat(benchmark::State &state) {
+  const lightweight_json_format_e format =
+      (lightweight_json_format_e)state.range(0);
+  lightweight_json_writer_ctx_t writer;
+  char *encoded = NULL;
+  size_t len = 0;
+  lightweight_json_writer_init_dynamic(65536, NULL, NULL, NULL,
+                                       LIGHTWEIGHT_JSON_MAX_NESTING_SIZE,
+                                       &writer);
+  lightweight_json_writer_set_format(&writer, format);
+  emit_api_response(&writer);
+  lightweight_json_writer_take_buffer(&writer, false, &encoded, &len);
+
+  size_t elements = 0;
+  for (auto _ : state) {
+    lightweight_json_reader_ctx_t ctx;
+    lightweight_json_reader_init_format(encoded, len, format, NULL,
+                                        LIGHTWEIGHT_JSON_MAX_NESTING_SIZE,
+                                        &ctx);
+    lightweight_json_reader_enter(&ctx, "users");
+    uint64_t sum = 0;
+    do {
+      uint64_t id = 0;
+      lightweight_json_reader_enter(&ctx, NULL);
+      lightweight_json_reader_get_uint64(&ctx, "id", &id);
+      lightweight_json_reader_leave(&ctx);
+      sum += id;
+      elements++;
+    } while (LIGHTWEIGHT_JSON_ERR_NONE ==
+             lightweight_json_reader_array_next(&ctx));
+    benchmark::DoNotOptimize(sum);
+  }
+  free(encoded);
+  state.SetBytesProcessed((int64_t)(state.iterations() * len));
+  state.SetItemsProcessed((int64_t)elements);
+}
+BENCHMARK(BM_ReaderFormat)->DenseRange(0, 2);
+
+void BM_ReaderDeepNesting(benchmark::State &state) {
+  const std::string json = render(emit_deep_nesting);
+  lightweight_json_reader_level_t levels[kDeepNesting];
+  for (auto _ : state) {
+    lightweight_json_reader_ctx_t ctx;
+    lightweight_json_reader_init_with_stack(json.data(), json.size(), levels,
+                                            kDeepNesting, &ctx);
+    for (int i = 1; i < kDeepNesting; i++) {
+      lightweight_json_reader_enter(&ctx, "child");
+    }
+    char leaf[16];
+    benchmark::DoNotOptimize(
+        lightweight_json_reader_get_string(&ctx, "leaf", leaf, sizeof(leaf)));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ReaderDeepNesting);
+
+void BM_ReaderLongStrings(benchmark::State &state) {
+  const std::string json = render(emit_long_strings);
+  std::vector<char> value(32 * 1024);
+  for (auto _ : state) {
+    lightweight_json_reader_ctx_t ctx;
+    lightweight_json_reader_init(json.data(), json.size(), &ctx);
+    benchmark::DoNotOptimize(lightweight_json_reader_get_string(
+        &ctx, "text15", value.data(), value.size()));
+  }
+  state.SetBytesProcessed((int64_t)(state.iterations() * json.size()));
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ReaderLongStrings);
+
+void BM_ReaderSmallMessages(benchmark::State &state) {
+  const std::string json = render(emit_small_message);
+  for (auto _ : state) {
+    lightweight_json_reader_ctx_t ctx;
+    lightweight_json_reader_init(json.data(), json.size(), &ctx);
+    char topic[32];
+    uint64_t ts = 0;
+    double value = 0.0;
+    bool ok = false;
+    lightweight_json_reader_get_string(&ctx, "topic", topic, sizeof(topic));
+    lightweight_json_reader_get_uint64(&ctx, "ts", &ts);
+    lightweight_json_reader_get_double(&ctx, "value", &value);
+    lightweight_json_reader_get_bool(&ctx, "ok", &ok);
+    benchmark::DoNotOptimize(ts);
+    benchmark::DoNotOptimize(value);
+  }
+  state.SetBytesProcessed((int64_t)(state.iterations() * json.size()));
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ReaderSmallMessages);
+
+// Per-type getters on a small object, one lookup per iteration
+const char kGetterInput[] =
+    "{\"s\": \"hello world\", \"u\": 1234567890, \"i\": -1234567890, "
+    "\"d\": 3.14159265, \"b\": true}";
+
+void BM_ReaderGetString(benchmark::State &state) {
+  lightweight_json_reader_ctx_t ctx;
+  lightweight_json_reader_init(kGetterInput, sizeof(kGetterInput) - 1, &ctx);
+  char value[32];
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        lightweight_json_reader_get_string(&ctx, "s", value, sizeof(value)));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ReaderGetString);
+
+void BM_ReaderGetUint64(benchmark::State &state) {
+  lightweight_json_reader_ctx_t ctx;
+  lightweight_json_reader_init(kGetterInput, sizeof(kGetterInput) - 1, &ctx);
+  uint64_t value = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        lightweight_json_reader_get_uint64(&ctx, "u", &value));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ReaderGetUint64);
+
+void BM_ReaderGetInt64(benchmark::State &state) {
+  lightweight_json_reader_ctx_t ctx;
+  lightweight_json_reader_init(kGetterInput, sizeof(kGetterInput) - 1, &ctx);
+  int64_t value = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        lightweight_json_reader_get_int64(&ctx, "i", &value));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ReaderGetInt64);
+
+void BM_ReaderGetDouble(benchmark::State &state) {
+  lightweight_json_reader_ctx_t ctx;
+  lightweight_json_reader_init(kGetterInput, sizeof(kGetterInput) - 1, &ctx);
+  double value = 0.0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        lightweight_json_reader_get_double(&ctx, "d", &value));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ReaderGetDouble);
+
+void BM_ReaderGetBool(benchmark::State &state) {
+  lightweight_json_reader_ctx_t ctx;
+  lightweight_json_reader_init(kGetterInput, sizeof(kGetterInput) - 1, &ctx);
+  bool value = false;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        lightweight_json_reader_get_bool(&ctx, "b", &value));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ReaderGetBool);
+
+// --- Minifying ---
+
+// Indent a compact document by 4 spaces per level, like the usual pretty
+// printers do
+std::string pretty(const std::string &json) {
+  std::string out;
+  int depth = 0;
+  bool in_string = false;
+  for (size_t i = 0; i < json.size(); i++) {
+    const char c = json[i];
+    out += c;
+    if (in_string) {
+      if (c == '\\') {
+        out += json[++i];
+      } else if (c == '"') {
+        in_string = false;
+      }
+      continue;
+    }
+    switch (c) {
+    case '"':
+      in_string = true;
+      break;
+    case '{':
+    case '[':
+      depth++;
+      out += '\n';
+      out.append(4 * depth, ' ');
+      break;
+    case ',':
+      out += '\n';
+      out.append(4 * depth, ' ');
+      break;
+    case ':':
+      out += ' ';
+      break;
+    case '}':
+    case ']':
+      depth--;
+      out.back() = '\n';
+      out.append(4 * depth, ' ');
+      out += c;
+      break;
+    }
+  }
+  return out;
+}
+
+// Minifying the pretty printed api_response corpus into a second buffer
+void BM_Minify(benchmark::State &state) {
+  const std::string json = pretty(render(emit_api_response));
+  std::vector<char> out(json.size());
+  for (auto _ : state) {
+    size_t len = 0;
+    lightweight_json_minify(json.data(), json.size(), out.data(), out.size(),
+                            &len);
+    benchmark::DoNotOptimize(len);
+  }
+  state.SetBytesProcessed((int64_t)(state.iterations() * json.size()));
+}
+BENCHMARK(BM_Minify);
+
+// The late key lookups of BM_ReaderKeyLookup on the pretty printed (0) and
+// the minified (1) corpus
+void BM_ReaderKeyLookupPretty(benchmark::State &state) {
+  std::string json = pretty(render(emit_api_response));
+  const size_t pretty_size = json.size();
+  lightweight_json_reader_ctx_t ctx;
+  if (1 == state.range(0)) {
+    lightweight_json_reader_init_minify(&json[0], json.size(), NULL,
+                                        LIGHTWEIGHT_JSON_MAX_NESTING_SIZE, 0,
+                                        &ctx);
+  } else {
+    lightweight_json_reader_init(json.data(), json.size(), &ctx);
+  }
+  const char *const keys[] = {"request_id", "missing"};
+  size_t lookups = 0;
+  for (auto _ : state) {
+    for (const char *key : keys) {
+      benchmark::DoNotOptimize(lightweight_json_reader_key_exists(&ctx, key));
+      lookups++;
+    }
+  }
+  state.SetBytesProcessed((int64_t)(state.iterations() * pretty_size));
+  state.SetItemsProcessed((int64_t)lookups);
+}
+BENCHMARK(BM_ReaderKeyLookupPretty)->DenseRange(0, 1);
+
+// --- Segmented input ---
+
+// api_response received as 1460 byte (TCP MSS) segments, read in place with
+// the segment reader (0) or joined into one buffer first for the plain reader
+// (1). Both walk the whole "users" array for "status" and "request_id".
+void BM_SegmentReader(benchmark::State &state) {
+  const std::string json = render(emit_api_response);
+  std::vector<std::vector<char>> chunks;
+  std::vector<lightweight_json_segment_t> segments;
+  for (size_t offset = 0; offset < json.size(); offset += 1460) {
+    const size_t size = std::min<size_t>(1460, json.size() - offset);
+    chunks.emplace_back(json.data() + offset, json.data() + offset + size);
+  }
+  for (const std::vector<char> &chunk : chunks) {
+    segments.push_back({chunk.data(), chunk.size()});
+  }
+  std::vector<char> flat(json.size());
+  char status[8];
+  char request_id[64];
+  for (auto _ : state) {
+    if (0 == state.range(0)) {
+      lightweight_json_segment_reader_ctx_t ctx;
+      lightweight_json_segment_reader_init(segments.data(), segments.size(),
+                                           NULL, 4, &ctx);
+      lightweight_json_segment_reader_get_string(&ctx, "status", status,
+                                                 sizeof(status), NULL);
+      lightweight_json_segment_reader_get_string(
+          &ctx, "request_id", request_id, sizeof(request_id), NULL);
+    } else {
+      size_t offset = 0;
+      for (const lightweight_json_segment_t &segment : segments) {
+        memcpy(&flat[offset], segment.data, segment.size);
+        offset += segment.size;
+      }
+      lightweight_json_reader_ctx_t ctx;
+      lightweight_json_reader_init(flat.data(), offset, &ctx);
+      lightweight_json_reader_get_string(&ctx, "status", status,
+                                         sizeof(status));
+      lightweight_json_reader_get_string(&ctx, "request_id", request_id,
+                                         sizeof(request_id));
+    }
+    benchmark::DoNotOptimize(request_id);
+  }
+  state.SetBytesProcessed((int64_t)(state.iterations() * json.size()));
+}
+BENCHMARK(BM_SegmentReader)->DenseRange(0, 1);
+
+// --- Base64 ---
+
+// A 1 MiB blob added with add_base64 through a flushing 4 KiB buffer (0) and
+// decoded again with get_base64 (1), bytes are the blob's
+void BM_Base64(benchmark::State &state) {
+  std::vector<uint8_t> blob(1 << 20);
+  uint64_t random = 0x9E3779B97F4A7C15ull;
+  for (uint8_t &byte : blob) {
+    byte = (uint8_t)next_random(random);
+  }
+  lightweight_json_writer_ctx_t ctx;
+  char *json = NULL;
+  size_t len = 0;
+  lightweight_json_writer_init_dynamic(4096, NULL, NULL, NULL,
+                                       LIGHTWEIGHT_JSON_MAX_NESTING_SIZE, &ctx);
+  lightweight_json_writer_begin(&ctx, NULL, LIGHTWEIGHT_JSON_OBJECT);
+  lightweight_json_writer_add_base64(&ctx, "blob", blob.data(), blob.size());
+  lightweight_json_writer_end(&ctx);
+  lightweight_json_writer_take_buffer(&ctx, false, &json, &len);
+
+  std::vector<char> buffer(4096);
+  std::vector<uint8_t> decoded(blob.size());
+  for (auto _ : state) {
+    if (0 == state.range(0)) {
+      Sink sink = {NULL, 0};
+      lightweight_json_writer_init(buffer.data(), buffer.size(), sink_cb,
+                                   &sink, &ctx);
+      lightweight_json_writer_begin(&ctx, NULL, LIGHTWEIGHT_JSON_OBJECT);
+      lightweight_json_writer_add_base64(&ctx, "blob", blob.data(),
+                                         blob.size());
+      lightweight_json_writer_end(&ctx);
+      lightweight_json_writer_flush(&ctx);
+      benchmark::DoNotOptimize(sink.bytes);
+    } else {
+      lightweight_json_reader_ctx_t reader;
+      size_t decoded_len = 0;
+      lightweight_json_reader_init(json, len, &reader);
+      lightweight_json_reader_get_base64(&reader, "blob", decoded.data(),
+                                         decoded.size(), &decoded_len);
+      benchmark::DoNotOptimize(decoded_len);
+    }
+  }
+  free(json);
+  state.SetBytesProcessed((int64_t)(state.iterations() * blob.size()));
+}
+BENCHMARK(BM_Base64)->DenseRange(0, 1);
+
+// --- Batch parsing ---
+
+// 1000 small sensor messages, all four fields extracted with one
+// batch_parse call (0) or with a reader and four getters per message (1)
+void BM_BatchParse(benchmark::State &state) {
+  struct Reading {
+    uint64_t id;
+    double temp;
+    bool ok;
+    char unit[8];
+  };
+  std::vector<std::string> docs;
+  uint64_t random = 0x9E3779B97F4A7C15ull;
+  size_t bytes = 0;
+  for (int i = 0; i < 1000; i++) {
+    const uint64_t r = next_random(random);
+    docs.push_back("{\"id\":" + std::to_string(i) + ",\"temp\":" +
+                   std::to_string((double)(r % 4000) / 100.0) + ",\"ok\":" +
+                   ((r >> 20) & 1 ? "true" : "false") +
+                   ",\"unit\":\"C\",\"seq\":" + std::to_string(r >> 40) + "}");
+    bytes += docs.back().size();
+  }
+  std::vector<lightweight_json_batch_message_t> messages;
+  for (const std::string &doc : docs) {
+    messages.push_back({doc.data(), doc.size()});
+  }
+  const lightweight_json_batch_field_t fields[] = {
+      {"id", LIGHTWEIGHT_JSON_VALUE_UINT64, offsetof(Reading, id), 0},
+      {"temp", LIGHTWEIGHT_JSON_VALUE_DOUBLE, offsetof(Reading, temp), 0},
+      {"ok", LIGHTWEIGHT_JSON_VALUE_BOOL, offsetof(Reading, ok), 0},
+      {"unit", LIGHTWEIGHT_JSON_VALUE_STRING, offsetof(Reading, unit),
+       sizeof(Reading::unit)},
+  };
+  lightweight_json_batch_spec_t spec;
+  lightweight_json_batch_compile(fields, 4, &spec);
+  std::vector<Reading> out(docs.size());
+  std::vector<lightweight_json_batch_result_t> results(docs.size());
+
+  for (auto _ : state) {
+    if (0 == state.range(0)) {
+      lightweight_json_batch_parse(&spec, messages.data(), messages.size(),
+                                   out.data(), sizeof(Reading),
+                                   results.data());
+    } else {
+      for (size_t i = 0; i < messages.size(); i++) {
+        lightweight_json_reader_ctx_t ctx;
+        lightweight_json_reader_init(messages[i].data, messages[i].size, &ctx);
+        lightweight_json_reader_get_uint64(&ctx, "id", &out[i].id);
+        lightweight_json_reader_get_double(&ctx, "temp", &out[i].temp);
+        lightweight_json_reader_get_bool(&ctx, "ok", &out[i].ok);
+        lightweight_json_reader_get_string(&ctx, "unit", out[i].unit,
+                                           sizeof(out[i].unit));
+      }
+    }
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetBytesProcessed((int64_t)(state.iterations() * bytes));
+  state.SetItemsProcessed((int64_t)(state.iterations() * docs.size()));
+}
+BENCHMARK(BM_BatchParse)->DenseRange(0, 1);
+
+// --- Transcoding ---
+
+// The api_response corpus JSON to CBOR (0) and CBOR to JSON (1) through a
+// flushing 4 KiB buffer, bytes are those of the input
+void BM_Transcode(benchmark::State &state) {
+  const bool to_cbor = 0 == state.range(0);
+  lightweight_json_writer_ctx_t ctx;
+  char *encoded = NULL;
+  size_t len = 0;
+  lightweight_json_writer_init_dynamic(65536, NULL, NULL, NULL,
+                                       LIGHTWEIGHT_JSON_MAX_NESTING_SIZE, &ctx);
+  if (!to_cbor) {
+    lightweight_json_writer_set_format(&ctx, LIGHTWEIGHT_JSON_FORMAT_CBOR);
+  }
+  emit_api_response(&ctx);
+  lightweight_json_writer_take_buffer(&ctx, false, &encoded, &len);
+
+  std::vector<char> buffer(4096);
+  for (auto _ : state) {
+    Sink sink = {NULL, 0};
+    lightweight_json_writer_init(buffer.data(), buffer.size(), sink_cb, &sink,
+                                 &ctx);
+    if (to_cbor) {
+      lightweight_json_writer_set_format(&ctx, LIGHTWEIGHT_JSON_FORMAT_CBOR);
+    }
+    lightweight_json_writer_transcode(&ctx, NULL, encoded, len,
+                                      to_cbor ? LIGHTWEIGHT_JSON_FORMAT_JSON
+                                              : LIGHTWEIGHT_JSON_FORMAT_CBOR);
+    lightweight_json_writer_flush(&ctx);
+    benchmark::DoNotOptimize(sink.bytes);
+  }
+  free(encoded);
+  state.SetBytesProcessed((int64_t)(state.iterations() * len));
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Transcode)->DenseRange(0, 1);
+
+// --- Filtering ---
+
+// The api_response corpus through a flushing 4 KiB buffer: without rules (0),
+// redacting / dropping two fields of every user (1), dropping a top-level
+// field so the users array is copied as a whole (2) and, for comparison,
+// reparsing and rewriting everything with transcode (3)
+void BM_Filter(benchmark::State &state) {
+  static const lightweight_json_filter_rule_t per_user[] = {
+      {LIGHTWEIGHT_JSON_FILTER_REPLACE, "users.email", "\"***\""},
+      {LIGHTWEIGHT_JSON_FILTER_EXCLUDE, "users.delta", NULL},
+  };
+  static const lightweight_json_filter_rule_t top_level[] = {
+      {LIGHTWEIGHT_JSON_FILTER_EXCLUDE, "request_id", NULL},
+  };
+  const lightweight_json_filter_rule_t *rules = NULL;
+  size_t rule_count = 0;
+  if (1 == state.range(0)) {
+    rules = per_user;
+    rule_count = 2;
+  } else if (2 == state.range(0)) {
+    rules = top_level;
+    rule_count = 1;
+  }
+
+  lightweight_json_writer_ctx_t ctx;
+  char *json = NULL;
+  size_t len = 0;
+  lightweight_json_writer_init_dynamic(65536, NULL, NULL, NULL,
+                                       LIGHTWEIGHT_JSON_MAX_NESTING_SIZE, &ctx);
+  emit_api_response(&ctx);
+  lightweight_json_writer_take_buffer(&ctx, false, &json, &len);
+
+  std::vector<char> buffer(4096);
+  for (auto _ : state) {
+    Sink sink = {NULL, 0};
+    lightweight_json_writer_init(buffer.data(), buffer.size(), sink_cb, &sink,
+                                 &ctx);
+    if (3 == state.range(0)) {
+      lightweight_json_writer_transcode(&ctx, NULL, json, len,
+                                        LIGHTWEIGHT_JSON_FORMAT_JSON);
+    } else {
+      lightweight_json_writer_filter(&ctx, NULL, json, len, rules, rule_count);
+    }
+    lightweight_json_writer_flush(&ctx);
+    benchmark::DoNotOptimize(sink.bytes);
+  }
+  free(json);
+  state.SetBytesProcessed((int64_t)(state.iterations() * len));
+}
+BENCHMARK(BM_Filter)->DenseRange(0, 3);
+
+// --- NDJSON ring ---
+
+alignas(8) char ndjson_ring_buffer[1 << 20];
+lightweight_json_ndjson_ring_t ndjson_ring;
+std::atomic<bool> ndjson_running;
+std::thread ndjson_drain;
+Sink ndjson_sink;
+
+// One log record per iteration from 1 to 64 producer threads into a 1 MiB
+// ring, one thread drains it into a counting sink. Producers wait when the
+// ring is full, so this is the sustained rate.
+void BM_NdjsonRing(benchmark::State &state) {
+  if (0 == state.thread_index()) {
+    ndjson_sink = {NULL, 0};
+    lightweight_json_ndjson_ring_init(
+        ndjson_ring_buffer, sizeof(ndjson_ring_buffer),
+        LIGHTWEIGHT_JSON_NDJSON_BLOCK, [] { std::this_thread::yield(); },
+        sink_cb, &ndjson_sink, &ndjson_ring);
+    ndjson_running = true;
+    ndjson_drain = std::thread([] {
+      while (ndjson_running) {
+        size_t records = 0;
+        lightweight_json_ndjson_drain(&ndjson_ring, &records);
+        if (0 == records) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  char buffer[256];
+  lightweight_json_ndjson_record_t record;
+  lightweight_json_ndjson_record_init(&ndjson_ring, buffer, sizeof(buffer),
+                                      NULL, LIGHTWEIGHT_JSON_MAX_NESTING_SIZE,
+                                      &record);
+  uint64_t i = 0;
+  size_t bytes = 0;
+  for (auto _ : state) {
+    lightweight_json_writer_ctx_t *ctx = &record.writer;
+    lightweight_json_writer_begin(ctx, NULL, LIGHTWEIGHT_JSON_OBJECT);
+    lightweight_json_writer_add_uint64(ctx, "ts", 1700000000000ull + i++);
+    lightweight_json_writer_add_string(ctx, "level", "info");
+    lightweight_json_writer_add_int64(ctx, "thread", state.thread_index());
+    lightweight_json_writer_add_string(ctx, "msg", "request served");
+    lightweight_json_writer_add_uint64(ctx, "latency_us", i % 1000);
+    lightweight_json_writer_end(ctx);
+    bytes += (size_t)ctx->offset + 1;
+    lightweight_json_ndjson_commit(&record);
+  }
+
+  if (0 == state.thread_index()) {
+    ndjson_running = false;
+    ndjson_drain.join();
+    lightweight_json_ndjson_drain(&ndjson_ring, NULL);
+  }
+  state.SetBytesProcessed((int64_t)bytes);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_NdjsonRing)->ThreadRange(1, 64)->UseRealTime();
+
+} // namespace
+
+int main(int argc, char **argv) {
+  register_writer_benchmarks();
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,1081 @@
+#include "lightweight_json_internal.h"
+#include <math.h>
+#include <string.h>
+
+// CBOR and MessagePack behind the writer and reader APIs. The writer checks the
+// arguments and the state, counts the elements and handles the buffer, this
+// only produces the bytes. Numbers use the shortest binary width which holds
+// them, doubles are always written as 64 bit floats.
+
+// Longest header: initial byte + 64 bit argument
+#define HEAD_CHARS 9
+
+#define CBOR_UINT 0
+#define CBOR_NEGATIVE 1
+#define CBOR_BYTES 2
+#define CBOR_TEXT 3
+#define CBOR_ARRAY 4
+#define CBOR_MAP 5
+#define CBOR_INDEFINITE 31
+#define CBOR_FALSE 0xF4
+#define CBOR_TRUE 0xF5
+#define CBOR_NULL 0xF6
+#define CBOR_DOUBLE 0xFB
+#define CBOR_BREAK 0xFF
+
+#define MSGPACK_NULL 0xC0
+#define MSGPACK_BIN8 0xC4
+#define MSGPACK_FALSE 0xC2
+#define MSGPACK_TRUE 0xC3
+#define MSGPACK_DOUBLE 0xCB
+#define MSGPACK_UINT8 0xCC
+#define MSGPACK_INT8 0xD0
+#define MSGPACK_STR8 0xD9
+#define MSGPACK_ARRAY16 0xDC
+#define MSGPACK_MAP16 0xDE
+
+// Write the low `width` bytes of `value` big endian, returns `width`
+static size_t put_be(char *out, uint64_t value, size_t width) {
+  for (size_t i = 0; i < width; i++) {
+    out[i] = (char)(value >> (8 * (width - 1 - i)));
+  }
+  return width;
+}
+
+// Initial byte of the `major` type followed by `value` in 0, 1, 2, 4 or 8
+// bytes
+static size_t cbor_head(char *out, uint8_t major, uint64_t value) {
+  const uint8_t type = (uint8_t)(major << 5);
+  if (value < 24) {
+    out[0] = (char)(type | value);
+    return 1;
+  }
+  if (value <= UINT8_MAX) {
+    out[0] = (char)(type | 24);
+    return 1 + put_be(out + 1, value, 1);
+  }
+  if (value <= UINT16_MAX) {
+    out[0] = (char)(type | 25);
+    return 1 + put_be(out + 1, value, 2);
+  }
+  if (value <= UINT32_MAX) {
+    out[0] = (char)(type | 26);
+    return 1 + put_be(out + 1, value, 4);
+  }
+  out[0] = (char)(type | 27);
+  return 1 + put_be(out + 1, value, 8);
+}
+
+// `first` is the 8 bit form, the 16 / 32 / 64 bit forms follow it
+static size_t msgpack_sized(char *out, uint8_t first, uint64_t value) {
+  if (value <= UINT8_MAX) {
+    out[0] = (char)first;
+    return 1 + put_be(out + 1, value, 1);
+  }
+  if (value <= UINT16_MAX) {
+    out[0] = (char)(first + 1);
+    return 1 + put_be(out + 1, value, 2);
+  }
+  if (value <= UINT32_MAX) {
+    out[0] = (char)(first + 2);
+    return 1 + put_be(out + 1, value, 4);
+  }
+  out[0] = (char)(first + 3);
+  return 1 + put_be(out + 1, value, 8);
+}
+
+// Header of a map / array with `size` elements, `fix` is the fixmap /
+// fixarray prefix, `first` the 16 bit form and the 32 bit form follows it
+static size_t msgpack_container(char *out, uint8_t fix, uint8_t first,
+                                uint32_t size) {
+  if (size < 16) {
+    out[0] = (char)(fix | size);
+    return 1;
+  }
+  if (size <= UINT16_MAX) {
+    out[0] = (char)first;
+    return 1 + put_be(out + 1, size, 2);
+  }
+  out[0] = (char)(first + 1);
+  return 1 + put_be(out + 1, size, 4);
+}
+
+static inline bool is_cbor(const lightweight_json_writer_ctx_t *ctx) {
+  return LIGHTWEIGHT_JSON_FORMAT_CBOR == ctx->format;
+}
+
+void lightweight_json_binary_flushing(lightweight_json_writer_ctx_t *ctx) {
+  if (ctx->nesting < 0) {
+    return;
+  }
+  // Mark the headers still waiting for their count, innermost first. Once a
+  // level is marked the ones around it were open during that flush as well.
+  lightweight_json_writer_level_t *levels =
+      lightweight_json_writer_level(ctx) - 2 * ctx->nesting;
+  for (int i = ctx->nesting; i >= 0; i--) {
+    lightweight_json_writer_level_t *size = &levels[2 * i + 1];
+    if (LIGHTWEIGHT_JSON_LEVEL_FLUSHED == *size) {
+      break;
+    }
+    if (!(*size & LIGHTWEIGHT_JSON_LEVEL_SIZED_BIT)) {
+      *size = LIGHTWEIGHT_JSON_LEVEL_FLUSHED;
+    }
+  }
+}
+
+void lightweight_json_binary_begin(lightweight_json_writer_ctx_t *ctx,
+                                   const char *const key,
+                                   lightweight_json_type_e type, bool sized,
+                                   uint32_t size) {
+  const bool array = LIGHTWEIGHT_JSON_ARRAY == type;
+  char head[HEAD_CHARS];
+  size_t len;
+
+  lightweight_json_binary_key(ctx, key);
+  ctx->nesting++;
+  lightweight_json_writer_level_t *level = lightweight_json_writer_level(ctx);
+  level[0] = array ? LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT : 0;
+  if (sized) {
+    level[1] = LIGHTWEIGHT_JSON_LEVEL_SIZED_BIT | size;
+    len = is_cbor(ctx)
+              ? cbor_head(head, array ? CBOR_ARRAY : CBOR_MAP, size)
+              : msgpack_container(head, array ? 0x90 : 0x80,
+                                  array ? MSGPACK_ARRAY16 : MSGPACK_MAP16,
+                                  size);
+  } else if (is_cbor(ctx)) {
+    level[1] = 0;
+    head[0] = (char)(((array ? CBOR_ARRAY : CBOR_MAP) << 5) | CBOR_INDEFINITE);
+    len = 1;
+  } else {
+    // map32 / array32 with a count of 0, patched by end
+    level[1] = (uint32_t)ctx->offset;
+    head[0] = (char)((array ? MSGPACK_ARRAY16 : MSGPACK_MAP16) + 1);
+    len = 1 + put_be(head + 1, 0, 4);
+  }
+  // Pushed before writing, a flush in the middle of the header marks it
+  lightweight_json_write_bytes(ctx, head, len);
+}
+
+lightweight_json_err_t
+lightweight_json_binary_end(lightweight_json_writer_ctx_t *ctx) {
+  lightweight_json_writer_level_t *level = lightweight_json_writer_level(ctx);
+  const uint32_t count = level[0] & ~LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT;
+  lightweight_json_err_t err = LIGHTWEIGHT_JSON_ERR_NONE;
+
+  if (level[1] & LIGHTWEIGHT_JSON_LEVEL_SIZED_BIT) {
+    if ((level[1] & ~LIGHTWEIGHT_JSON_LEVEL_SIZED_BIT) != count) {
+      err = LIGHTWEIGHT_JSON_ERR_INVALID_STATE;
+    }
+  } else if (is_cbor(ctx)) {
+    const char brk = (char)CBOR_BREAK;
+    lightweight_json_write_bytes(ctx, &brk, 1);
+  } else if (LIGHTWEIGHT_JSON_LEVEL_FLUSHED == level[1]) {
+    // The count 0 already went out
+    err = LIGHTWEIGHT_JSON_ERR_BUFFER_TOO_SMALL;
+  } else if (!ctx->counting) {
+    // Patch the count, counting mode only needs the header's fixed size
+    put_be(&ctx->buffer[level[1] + 1], count, 4);
+  }
+  ctx->nesting--;
+
+  // The output is broken either way, keep the error around for flush
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err &&
+      LIGHTWEIGHT_JSON_ERR_NONE == ctx->error) {
+    ctx->error = err;
+  }
+  return err;
+}
+
+void lightweight_json_binary_key(lightweight_json_writer_ctx_t *ctx,
+                                 const char *const key) {
+  if (NULL != key) {
+    lightweight_json_binary_string(ctx, key, strlen(key));
+  }
+}
+
+void lightweight_json_binary_string_head(lightweight_json_writer_ctx_t *ctx,
+                                         size_t len) {
+  char head[HEAD_CHARS];
+  size_t head_len;
+  if (is_cbor(ctx)) {
+    head_len = cbor_head(head, CBOR_TEXT, len);
+  } else if (len < 32) {
+    head[0] = (char)(0xA0 | len);
+    head_len = 1;
+  } else {
+    // str8 / str16 / str32, there is no str64
+    head_len = msgpack_sized(head, MSGPACK_STR8, len);
+  }
+  lightweight_json_write_bytes(ctx, head, head_len);
+}
+
+void lightweight_json_binary_string(lightweight_json_writer_ctx_t *ctx,
+                                    const char *value, size_t len) {
+  lightweight_json_binary_string_head(ctx, len);
+  lightweight_json_write_bytes(ctx, value, len);
+}
+
+void lightweight_json_binary_bytes(lightweight_json_writer_ctx_t *ctx,
+                                   const uint8_t *data, size_t len) {
+  char head[HEAD_CHARS];
+  const size_t head_len = is_cbor(ctx) ? cbor_head(head, CBOR_BYTES, len)
+                                       : msgpack_sized(head, MSGPACK_BIN8, len);
+  lightweight_json_write_bytes(ctx, head, head_len);
+  lightweight_json_write_bytes(ctx, (const char *)data, len);
+}
+
+void lightweight_json_binary_double(lightweight_json_writer_ctx_t *ctx,
+                                    double value) {
+  char out[HEAD_CHARS];
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  out[0] = (char)(is_cbor(ctx) ? CBOR_DOUBLE : MSGPACK_DOUBLE);
+  put_be(out + 1, bits, 8);
+  lightweight_json_write_bytes(ctx, out, sizeof(out));
+}
+
+void lightweight_json_binary_uint64(lightweight_json_writer_ctx_t *ctx,
+                                    uint64_t value) {
+  char out[HEAD_CHARS];
+  size_t len;
+  if (is_cbor(ctx)) {
+    len = cbor_head(out, CBOR_UINT, value);
+  } else if (value < 0x80) {
+    // Positive fixint
+    out[0] = (char)value;
+    len = 1;
+  } else {
+    len = msgpack_sized(out, MSGPACK_UINT8, value);
+  }
+  lightweight_json_write_bytes(ctx, out, len);
+}
+
+void lightweight_json_binary_int64(lightweight_json_writer_ctx_t *ctx,
+                                   int64_t value) {
+  if (value >= 0) {
+    lightweight_json_binary_uint64(ctx, (uint64_t)value);
+    return;
+  }
+  char out[HEAD_CHARS];
+  size_t len;
+  if (is_cbor(ctx)) {
+    // -1 - value, can't overflow for negative values
+    len = cbor_head(out, CBOR_NEGATIVE, (uint64_t)(-1 - value));
+  } else if (value >= -32) {
+    // Negative fixint
+    out[0] = (char)value;
+    len = 1;
+  } else if (value >= INT8_MIN) {
+    out[0] = (char)MSGPACK_INT8;
+    len = 1 + put_be(out + 1, (uint64_t)value, 1);
+  } else if (value >= INT16_MIN) {
+    out[0] = (char)(MSGPACK_INT8 + 1);
+    len = 1 + put_be(out + 1, (uint64_t)value, 2);
+  } else if (value >= INT32_MIN) {
+    out[0] = (char)(MSGPACK_INT8 + 2);
+    len = 1 + put_be(out + 1, (uint64_t)value, 4);
+  } else {
+    out[0] = (char)(MSGPACK_INT8 + 3);
+    len = 1 + put_be(out + 1, (uint64_t)value, 8);
+  }
+  lightweight_json_write_bytes(ctx, out, len);
+}
+
+void lightweight_json_binary_bool(lightweight_json_writer_ctx_t *ctx,
+                                  bool value) {
+  char out;
+  if (is_cbor(ctx)) {
+    out = (char)(value ? CBOR_TRUE : CBOR_FALSE);
+  } else {
+    out = (char)(value ? MSGPACK_TRUE : MSGPACK_FALSE);
+  }
+  lightweight_json_write_bytes(ctx, &out, 1);
+}
+
+void lightweight_json_binary_null(lightweight_json_writer_ctx_t *ctx) {
+  const char out = (char)(is_cbor(ctx) ? CBOR_NULL : MSGPACK_NULL);
+  lightweight_json_write_bytes(ctx, &out, 1);
+}
+
+// --- Reader ---
+// Every head is bounds checked while decoding, so the buffer needs no
+// validation up front. Strings are skipped by their length, maps / arrays by
+// walking their elements.
+
+// Marks an indefinite length in a level's second entry
+#define LEVEL_INDEFINITE UINT32_MAX
+// Indefinite length CBOR maps / arrays a skip can be nested in
+#define SKIP_MAX_INDEFINITE 32
+
+// Decoded head of an item
+typedef struct {
+  // OBJECT / ARRAY for maps / arrays
+  lightweight_json_value_t value;
+  // Elements of an array / pairs of a map, UINT64_MAX if indefinite
+  uint64_t count;
+  // Offset right behind the head, for strings behind their data
+  size_t end;
+} item_t;
+
+static uint64_t get_be(const uint8_t *p, size_t width) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < width; i++) {
+    value = (value << 8) | p[i];
+  }
+  return value;
+}
+
+static double float_from_bits(uint32_t bits) {
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+static double double_from_bits(uint64_t bits) {
+  double value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+static double half_from_bits(uint16_t bits) {
+  const int exponent = (bits >> 10) & 0x1F;
+  const double mantissa = bits & 0x3FF;
+  double value;
+  if (0 == exponent) {
+    value = mantissa / (1 << 24);
+  } else if (31 == exponent) {
+    value = 0 == mantissa ? INFINITY : NAN;
+  } else {
+    value = (mantissa + 1024) * (double)(1ull << exponent) / (1 << 25);
+  }
+  return (bits & 0x8000) ? -value : value;
+}
+
+// Shared by both formats once the head is split up: a string of `len` bytes
+// at `offset`
+static lightweight_json_err_t string_item(size_t size, size_t offset,
+                                          const uint8_t *buffer, uint64_t len,
+                                          item_t *out) {
+  if (len > size - offset) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+  }
+  out->value.type = LIGHTWEIGHT_JSON_VALUE_STRING;
+  out->value.as.string.data = (const char *)&buffer[offset];
+  out->value.as.string.len = (size_t)len;
+  out->end = offset + (size_t)len;
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+// A map / array of `count` elements whose first element is at `offset`
+static lightweight_json_err_t container_item(size_t size, size_t offset,
+                                             bool array, uint64_t count,
+                                             item_t *out) {
+  // Every element takes at least one byte, this also keeps the counts small
+  // enough for the stack
+  if (UINT64_MAX != count && count > (size - offset) / (array ? 1 : 2)) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+  }
+  out->value.type =
+      array ? LIGHTWEIGHT_JSON_VALUE_ARRAY : LIGHTWEIGHT_JSON_VALUE_OBJECT;
+  out->count = count;
+  out->end = offset;
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+static lightweight_json_err_t cbor_decode(const uint8_t *buffer, size_t size,
+                                          size_t offset, item_t *out) {
+  for (;;) {
+    if (offset >= size) {
+      return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+    }
+    const uint8_t major = buffer[offset] >> 5;
+    const uint8_t info = buffer[offset] & 0x1F;
+    uint64_t arg = info;
+    size_t head = 1;
+    if (info >= 24 && info <= 27) {
+      const size_t width = (size_t)1 << (info - 24);
+      if (width >= size - offset) {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+      }
+      arg = get_be(&buffer[offset + 1], width);
+      head += width;
+    } else if (info >= 28 && info < CBOR_INDEFINITE) {
+      return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+    }
+    const bool indefinite = CBOR_INDEFINITE == info;
+    offset += head;
+
+    switch (major) {
+    case CBOR_UINT:
+    case CBOR_NEGATIVE:
+      if (indefinite) {
+        return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+      }
+      if (CBOR_UINT == major) {
+        out->value.type = LIGHTWEIGHT_JSON_VALUE_UINT64;
+        out->value.as.u64 = arg;
+      } else if (arg <= INT64_MAX) {
+        out->value.type = LIGHTWEIGHT_JSON_VALUE_INT64;
+        out->value.as.i64 = -1 - (int64_t)arg;
+      } else {
+        // Below INT64_MIN, like an out of range JSON integer
+        out->value.type = LIGHTWEIGHT_JSON_VALUE_DOUBLE;
+        out->value.as.f64 = -1.0 - (double)arg;
+      }
+      out->end = offset;
+      return LIGHTWEIGHT_JSON_ERR_NONE;
+    case CBOR_BYTES:
+    case CBOR_TEXT:
+      if (indefinite) {
+        // Chunked strings
+        return LIGHTWEIGHT_JSON_ERR_NOT_SUPPORTED;
+      }
+      return string_item(size, offset, buffer, arg, out);
+    case CBOR_ARRAY:
+    case CBOR_MAP:
+      return container_item(size, offset, CBOR_ARRAY == major,
+                            indefinite ? UINT64_MAX : arg, out);
+    case 6:
+      // Tags don't change how the tagged item is read, the value starts at
+      // the item's head
+      out->value.offset = offset;
+      continue;
+    default:
+      break;
+    }
+
+    out->end = offset;
+    switch (info) {
+    case 20:
+    case 21:
+      out->value.type = LIGHTWEIGHT_JSON_VALUE_BOOL;
+      out->value.as.boolean = 21 == info;
+      return LIGHTWEIGHT_JSON_ERR_NONE;
+    case 22:
+    case 23:
+      // null / undefined
+      out->value.type = LIGHTWEIGHT_JSON_VALUE_NULL;
+      return LIGHTWEIGHT_JSON_ERR_NONE;
+    case 25:
+      out->value.type = LIGHTWEIGHT_JSON_VALUE_DOUBLE;
+      out->value.as.f64 = half_from_bits((uint16_t)arg);
+      return LIGHTWEIGHT_JSON_ERR_NONE;
+    case 26:
+      out->value.type = LIGHTWEIGHT_JSON_VALUE_DOUBLE;
+      out->value.as.f64 = float_from_bits((uint32_t)arg);
+      return LIGHTWEIGHT_JSON_ERR_NONE;
+    case 27:
+      out->value.type = LIGHTWEIGHT_JSON_VALUE_DOUBLE;
+      out->value.as.f64 = double_from_bits(arg);
+      return LIGHTWEIGHT_JSON_ERR_NONE;
+    case CBOR_INDEFINITE:
+      // Break, the end of an indefinite map / array has no value at all
+      return LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
+    default:
+      return LIGHTWEIGHT_JSON_ERR_NOT_SUPPORTED;
+    }
+  }
+}
+
+static lightweight_json_err_t msgpack_decode(const uint8_t *buffer,
+                                             size_t size, size_t offset,
+                                             item_t *out) {
+  if (offset >= size) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+  }
+  const uint8_t type = buffer[offset++];
+  const size_t remaining = size - offset;
+  out->end = offset;
+
+  if (type < 0x80 || type >= 0xE0) {
+    // Positive / negative fixint
+    if (type < 0x80) {
+      out->value.type = LIGHTWEIGHT_JSON_VALUE_UINT64;
+      out->value.as.u64 = type;
+    } else {
+      out->value.type = LIGHTWEIGHT_JSON_VALUE_INT64;
+      out->value.as.i64 = (int8_t)type;
+    }
+    return LIGHTWEIGHT_JSON_ERR_NONE;
+  }
+  if (type < 0xA0) {
+    return container_item(size, offset, type >= 0x90, type & 0x0F, out);
+  }
+  if (type < 0xC0) {
+    return string_item(size, offset, buffer, type & 0x1F, out);
+  }
+
+  // Width of the length / value following the type byte
+  size_t width = 0;
+  switch (type) {
+  case MSGPACK_BIN8:
+  case MSGPACK_STR8:
+  case MSGPACK_UINT8:
+  case MSGPACK_INT8:
+    width = 1;
+    break;
+  case MSGPACK_BIN8 + 1:
+  case MSGPACK_STR8 + 1:
+  case MSGPACK_UINT8 + 1:
+  case MSGPACK_INT8 + 1:
+  case MSGPACK_ARRAY16:
+  case MSGPACK_MAP16:
+    width = 2;
+    break;
+  case MSGPACK_BIN8 + 2:
+  case MSGPACK_STR8 + 2:
+  case MSGPACK_UINT8 + 2:
+  case MSGPACK_INT8 + 2:
+  case MSGPACK_ARRAY16 + 1:
+  case MSGPACK_MAP16 + 1:
+  case 0xCA: // float32
+    width = 4;
+    break;
+  case MSGPACK_UINT8 + 3:
+  case MSGPACK_INT8 + 3:
+  case MSGPACK_DOUBLE:
+    width = 8;
+    break;
+  default:
+    break;
+  }
+  if (width > remaining) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+  }
+  const uint64_t arg = get_be(&buffer[offset], width);
+  offset += width;
+  out->end = offset;
+
+  switch (type) {
+  case MSGPACK_NULL:
+    out->value.type = LIGHTWEIGHT_JSON_VALUE_NULL;
+    return LIGHTWEIGHT_JSON_ERR_NONE;
+  case MSGPACK_FALSE:
+  case MSGPACK_TRUE:
+    out->value.type = LIGHTWEIGHT_JSON_VALUE_BOOL;
+    out->value.as.boolean = MSGPACK_TRUE == type;
+    return LIGHTWEIGHT_JSON_ERR_NONE;
+  case MSGPACK_BIN8:
+  case MSGPACK_BIN8 + 1:
+  case MSGPACK_BIN8 + 2:
+  case MSGPACK_STR8:
+  case MSGPACK_STR8 + 1:
+  case MSGPACK_STR8 + 2:
+    return string_item(size, offset, buffer, arg, out);
+  case 0xCA:
+    out->value.type = LIGHTWEIGHT_JSON_VALUE_DOUBLE;
+    out->value.as.f64 = float_from_bits((uint32_t)arg);
+    return LIGHTWEIGHT_JSON_ERR_NONE;
+  case MSGPACK_DOUBLE:
+    out->value.type = LIGHTWEIGHT_JSON_VALUE_DOUBLE;
+    out->value.as.f64 = double_from_bits(arg);
+    return LIGHTWEIGHT_JSON_ERR_NONE;
+  case MSGPACK_UINT8:
+  case MSGPACK_UINT8 + 1:
+  case MSGPACK_UINT8 + 2:
+  case MSGPACK_UINT8 + 3:
+    out->value.type = LIGHTWEIGHT_JSON_VALUE_UINT64;
+    out->value.as.u64 = arg;
+    return LIGHTWEIGHT_JSON_ERR_NONE;
+  case MSGPACK_INT8:
+  case MSGPACK_INT8 + 1:
+  case MSGPACK_INT8 + 2:
+  case MSGPACK_INT8 + 3: {
+    // Sign extend
+    const unsigned shift = (unsigned)(64 - 8 * width);
+    const int64_t value = (int64_t)(arg << shift) >> shift;
+    if (value >= 0) {
+      out->value.type = LIGHTWEIGHT_JSON_VALUE_UINT64;
+      out->value.as.u64 = (uint64_t)value;
+    } else {
+      out->value.type = LIGHTWEIGHT_JSON_VALUE_INT64;
+      out->value.as.i64 = value;
+    }
+    return LIGHTWEIGHT_JSON_ERR_NONE;
+  }
+  case MSGPACK_ARRAY16:
+  case MSGPACK_ARRAY16 + 1:
+    return container_item(size, offset, true, arg, out);
+  case MSGPACK_MAP16:
+  case MSGPACK_MAP16 + 1:
+    return container_item(size, offset, false, arg, out);
+  case 0xC1:
+    // Never used
+    return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+  default:
+    // Extension types
+    return LIGHTWEIGHT_JSON_ERR_NOT_SUPPORTED;
+  }
+}
+
+static lightweight_json_err_t decode_format(lightweight_json_format_e format,
+                                            const char *buffer, size_t size,
+                                            size_t offset, item_t *out) {
+  out->count = 0;
+  out->value.offset = offset;
+  return LIGHTWEIGHT_JSON_FORMAT_CBOR == format
+             ? cbor_decode((const uint8_t *)buffer, size, offset, out)
+             : msgpack_decode((const uint8_t *)buffer, size, offset, out);
+}
+
+static lightweight_json_err_t decode(const lightweight_json_reader_ctx_t *ctx,
+                                     size_t offset, item_t *out) {
+  return decode_format(ctx->format, ctx->buffer, ctx->buffer_size, offset,
+                       out);
+}
+
+static inline bool is_break(const lightweight_json_reader_ctx_t *ctx,
+                            size_t offset) {
+  return LIGHTWEIGHT_JSON_FORMAT_CBOR == ctx->format &&
+         offset < ctx->buffer_size &&
+         (uint8_t)ctx->buffer[offset] == CBOR_BREAK;
+}
+
+// Offset right behind the item at `offset`. Definite lengths just add up the
+// elements still to go, only indefinite maps / arrays need a stack entry.
+static lightweight_json_err_t skip(const lightweight_json_reader_ctx_t *ctx,
+                                   size_t offset, size_t *out_end) {
+  uint64_t stack[SKIP_MAX_INDEFINITE];
+  size_t depth = 0;
+  uint64_t pending = 1;
+  for (;;) {
+    if (0 == pending) {
+      if (0 == depth) {
+        *out_end = offset;
+        return LIGHTWEIGHT_JSON_ERR_NONE;
+      }
+      // Inside an indefinite map / array: its end or another element
+      if (is_break(ctx, offset)) {
+        offset++;
+        pending = stack[--depth];
+        continue;
+      }
+      pending = 1;
+    }
+    item_t item;
+    const lightweight_json_err_t err = decode(ctx, offset, &item);
+    if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+      // A break where an element is due is malformed as well
+      return LIGHTWEIGHT_JSON_ERR_NOT_FOUND == err
+                 ? LIGHTWEIGHT_JSON_ERR_INVALID_JSON
+                 : err;
+    }
+    offset = item.end;
+    pending--;
+    if (LIGHTWEIGHT_JSON_VALUE_OBJECT == item.value.type ||
+        LIGHTWEIGHT_JSON_VALUE_ARRAY == item.value.type) {
+      if (UINT64_MAX == item.count) {
+        if (SKIP_MAX_INDEFINITE == depth) {
+          return LIGHTWEIGHT_JSON_ERR_MAX_NESTING_REACHED;
+        }
+        stack[depth++] = pending;
+        pending = 0;
+      } else {
+        pending += LIGHTWEIGHT_JSON_VALUE_OBJECT == item.value.type
+                       ? 2 * item.count
+                       : item.count;
+      }
+    }
+  }
+}
+
+// Both stack entries of the current level
+static inline lightweight_json_reader_level_t *
+binary_level(lightweight_json_reader_ctx_t *ctx) {
+  return LIGHTWEIGHT_JSON_LEVELS(ctx) + 2 * ctx->nesting;
+}
+
+static inline size_t
+level_offset(const lightweight_json_reader_level_t *level) {
+  return level[0].offset & ~LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT;
+}
+
+static inline bool
+level_is_array(const lightweight_json_reader_level_t *level) {
+  return level[0].offset & LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT;
+}
+
+// Push the map / array `item` at `offset`
+static lightweight_json_err_t push(lightweight_json_reader_ctx_t *ctx,
+                                   size_t offset, const item_t *item) {
+  if (ctx->nesting == ctx->max_nesting - 1) {
+    return LIGHTWEIGHT_JSON_ERR_MAX_NESTING_REACHED;
+  }
+  ctx->nesting++;
+  lightweight_json_reader_level_t *level = binary_level(ctx);
+  level[0].offset = (uint32_t)offset;
+  if (LIGHTWEIGHT_JSON_VALUE_ARRAY == item->value.type) {
+    level[0].offset |= LIGHTWEIGHT_JSON_LEVEL_ARRAY_BIT;
+  }
+  level[0].suboffset = (uint32_t)(item->end - offset);
+  level[1].offset =
+      UINT64_MAX == item->count ? LEVEL_INDEFINITE : (uint32_t)item->count;
+  level[1].suboffset = 0;
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+lightweight_json_err_t
+lightweight_json_binary_reader_init(lightweight_json_reader_ctx_t *ctx) {
+  item_t root;
+  const lightweight_json_err_t err = decode(ctx, 0, &root);
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+    return LIGHTWEIGHT_JSON_ERR_NOT_FOUND == err
+               ? LIGHTWEIGHT_JSON_ERR_INVALID_JSON
+               : err;
+  }
+  if (LIGHTWEIGHT_JSON_VALUE_OBJECT != root.value.type &&
+      LIGHTWEIGHT_JSON_VALUE_ARRAY != root.value.type) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  // push() counts up from -1 to the root level
+  ctx->nesting = -1;
+  return push(ctx, 0, &root);
+}
+
+// Offset of the value of `key` in the current map, or of the current array
+// element if `key` is NULL
+static lightweight_json_err_t locate(lightweight_json_reader_ctx_t *ctx,
+                                     const char *key, size_t key_len,
+                                     size_t *out_offset) {
+  const lightweight_json_reader_level_t *level = binary_level(ctx);
+  const size_t start = level_offset(level);
+  if (NULL == key) {
+    if (!level_is_array(level) || 0 == level[1].offset) {
+      return LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
+    }
+    *out_offset = start + level[0].suboffset;
+    return LIGHTWEIGHT_JSON_ERR_NONE;
+  }
+  if (level_is_array(level)) {
+    return LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
+  }
+
+  const uint32_t count = level[1].offset;
+  size_t offset = start + level[0].suboffset;
+  for (uint32_t i = 0; LEVEL_INDEFINITE == count || i < count; i++) {
+    if (LEVEL_INDEFINITE == count && is_break(ctx, offset)) {
+      break;
+    }
+    item_t item;
+    lightweight_json_err_t err = decode(ctx, offset, &item);
+    if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+      return err;
+    }
+    if (LIGHTWEIGHT_JSON_VALUE_STRING == item.value.type) {
+      if (item.value.as.string.len == key_len &&
+          0 == memcmp(item.value.as.string.data, key, key_len)) {
+        *out_offset = item.end;
+        return LIGHTWEIGHT_JSON_ERR_NONE;
+      }
+      offset = item.end;
+    } else {
+      err = skip(ctx, offset, &offset);
+      if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+        return err;
+      }
+    }
+    err = skip(ctx, offset, &offset);
+    if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+      return err;
+    }
+  }
+  return LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
+}
+
+// Decode the value of `key` / the current array element
+static lightweight_json_err_t get_item(lightweight_json_reader_ctx_t *ctx,
+                                       const char *key, size_t key_len,
+                                       item_t *out) {
+  size_t offset = 0;
+  const lightweight_json_err_t err = locate(ctx, key, key_len, &offset);
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+    return err;
+  }
+  return decode(ctx, offset, out);
+}
+
+static inline size_t key_length(const char *key) {
+  return NULL != key ? strlen(key) : 0;
+}
+
+lightweight_json_err_t
+lightweight_json_binary_key_exists(lightweight_json_reader_ctx_t *ctx,
+                                   const char *key) {
+  size_t offset = 0;
+  return locate(ctx, key, key_length(key), &offset);
+}
+
+lightweight_json_err_t
+lightweight_json_binary_get_value(lightweight_json_reader_ctx_t *ctx,
+                                  const char *key, size_t key_len,
+                                  lightweight_json_value_t *out_value) {
+  item_t item;
+  const lightweight_json_err_t err = get_item(ctx, key, key_len, &item);
+  if (LIGHTWEIGHT_JSON_ERR_NONE == err) {
+    *out_value = item.value;
+  }
+  return err;
+}
+
+bool lightweight_json_binary_is_bytes(const lightweight_json_reader_ctx_t *ctx,
+                                      const lightweight_json_value_t *value) {
+  const uint8_t type = (uint8_t)ctx->buffer[value->offset];
+  if (LIGHTWEIGHT_JSON_FORMAT_CBOR == ctx->format) {
+    return CBOR_BYTES == type >> 5;
+  }
+  return type >= MSGPACK_BIN8 && type <= MSGPACK_BIN8 + 2;
+}
+
+lightweight_json_err_t lightweight_json_binary_get_string(
+    lightweight_json_reader_ctx_t *ctx, const char *key, char *buffer,
+    size_t buffer_len, size_t *out_len) {
+  item_t item;
+  const lightweight_json_err_t err =
+      get_item(ctx, key, key_length(key), &item);
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+    return err;
+  }
+  if (LIGHTWEIGHT_JSON_VALUE_STRING != item.value.type) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
+  }
+  const size_t len = item.value.as.string.len;
+  if (NULL != out_len) {
+    *out_len = len;
+  }
+  if (len >= buffer_len) {
+    return LIGHTWEIGHT_JSON_ERR_BUFFER_TOO_SMALL;
+  }
+  memcpy(buffer, item.value.as.string.data, len);
+  buffer[len] = '\0';
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+lightweight_json_err_t
+lightweight_json_binary_get_number(lightweight_json_reader_ctx_t *ctx,
+                                   const char *key,
+                                   lightweight_json_value_type_e type,
+                                   void *out_value) {
+  item_t item;
+  const lightweight_json_err_t err =
+      get_item(ctx, key, key_length(key), &item);
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+    return err;
+  }
+  const lightweight_json_value_t *value = &item.value;
+  switch (type) {
+  case LIGHTWEIGHT_JSON_VALUE_UINT64:
+    if (LIGHTWEIGHT_JSON_VALUE_UINT64 != value->type) {
+      return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
+    }
+    *(uint64_t *)out_value = value->as.u64;
+    return LIGHTWEIGHT_JSON_ERR_NONE;
+  case LIGHTWEIGHT_JSON_VALUE_INT64:
+    if (LIGHTWEIGHT_JSON_VALUE_INT64 == value->type) {
+      *(int64_t *)out_value = value->as.i64;
+    } else if (LIGHTWEIGHT_JSON_VALUE_UINT64 == value->type &&
+               value->as.u64 <= INT64_MAX) {
+      *(int64_t *)out_value = (int64_t)value->as.u64;
+    } else {
+      return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
+    }
+    return LIGHTWEIGHT_JSON_ERR_NONE;
+  case LIGHTWEIGHT_JSON_VALUE_DOUBLE:
+    if (LIGHTWEIGHT_JSON_VALUE_DOUBLE == value->type) {
+      *(double *)out_value = value->as.f64;
+    } else if (LIGHTWEIGHT_JSON_VALUE_UINT64 == value->type) {
+      *(double *)out_value = (double)value->as.u64;
+    } else if (LIGHTWEIGHT_JSON_VALUE_INT64 == value->type) {
+      *(double *)out_value = (double)value->as.i64;
+    } else {
+      return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
+    }
+    return LIGHTWEIGHT_JSON_ERR_NONE;
+  default:
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+}
+
+lightweight_json_err_t
+lightweight_json_binary_get_bool(lightweight_json_reader_ctx_t *ctx,
+                                 const char *key, bool *out_value) {
+  item_t item;
+  const lightweight_json_err_t err =
+      get_item(ctx, key, key_length(key), &item);
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+    return err;
+  }
+  if (LIGHTWEIGHT_JSON_VALUE_BOOL != item.value.type) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
+  }
+  *out_value = item.value.as.boolean;
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+static lightweight_json_err_t enter_item(lightweight_json_reader_ctx_t *ctx,
+                                         const item_t *item) {
+  if (LIGHTWEIGHT_JSON_VALUE_OBJECT != item->value.type &&
+      LIGHTWEIGHT_JSON_VALUE_ARRAY != item->value.type) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE;
+  }
+  return push(ctx, item->value.offset, item);
+}
+
+lightweight_json_err_t
+lightweight_json_binary_enter(lightweight_json_reader_ctx_t *ctx,
+                              const char *key) {
+  item_t item;
+  const lightweight_json_err_t err =
+      get_item(ctx, key, key_length(key), &item);
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+    return err;
+  }
+  return enter_item(ctx, &item);
+}
+
+lightweight_json_err_t
+lightweight_json_binary_enter_value(lightweight_json_reader_ctx_t *ctx,
+                                    const lightweight_json_value_t *value) {
+  item_t item;
+  const lightweight_json_err_t err = decode(ctx, value->offset, &item);
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err || item.value.type != value->type) {
+    // Not fetched from this reader's buffer
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  return enter_item(ctx, &item);
+}
+
+lightweight_json_err_t
+lightweight_json_binary_array_next(lightweight_json_reader_ctx_t *ctx) {
+  lightweight_json_reader_level_t *level = binary_level(ctx);
+  if (!level_is_array(level)) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_STATE;
+  }
+  const size_t start = level_offset(level);
+  const size_t offset = start + level[0].suboffset;
+  const bool indefinite = LEVEL_INDEFINITE == level[1].offset;
+  // The current element has to be followed by another one
+  if ((!indefinite && level[1].offset <= 1) ||
+      (indefinite && is_break(ctx, offset))) {
+    return LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
+  }
+  size_t next = 0;
+  const lightweight_json_err_t err = skip(ctx, offset, &next);
+  if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+    return err;
+  }
+  if (indefinite && (next >= ctx->buffer_size || is_break(ctx, next))) {
+    return LIGHTWEIGHT_JSON_ERR_NOT_FOUND;
+  }
+  level[0].suboffset = (uint32_t)(next - start);
+  if (!indefinite) {
+    level[1].offset--;
+  }
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+// --- Transcoding ---
+// One pass over the input, every item goes out as soon as it is decoded. Only
+// the open maps / arrays are tracked.
+
+// Deepest input followed, one entry of 8 bytes each
+#define TRANSCODE_MAX_DEPTH 128
+// Entry flags. Definite maps / arrays count down the items left (keys and
+// values for maps), indefinite ones count up the items seen.
+#define TRANSCODE_MAP (1ull << 62)
+#define TRANSCODE_INDEFINITE (1ull << 63)
+#define TRANSCODE_COUNT (TRANSCODE_MAP - 1)
+
+lightweight_json_err_t lightweight_json_binary_transcode(
+    lightweight_json_writer_ctx_t *ctx, const char *const key,
+    const char *data, size_t size, lightweight_json_format_e format,
+    bool *out_started) {
+  uint64_t stack[TRANSCODE_MAX_DEPTH];
+  size_t depth = 0;
+  size_t offset = 0;
+  const char *item_key = key;
+  size_t key_len = NULL != key ? strlen(key) : 0;
+
+  for (;;) {
+    uint64_t *level = depth > 0 ? &stack[depth - 1] : NULL;
+    if (NULL != level) {
+      bool done;
+      if (*level & TRANSCODE_INDEFINITE) {
+        done = LIGHTWEIGHT_JSON_FORMAT_CBOR == format && offset < size &&
+               (uint8_t)data[offset] == CBOR_BREAK;
+        if (done && (*level & TRANSCODE_MAP) && (*level & 1)) {
+          // Key without a value
+          return LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+        }
+        offset += done ? 1 : 0;
+      } else {
+        done = 0 == (*level & TRANSCODE_COUNT);
+      }
+      if (done) {
+        const lightweight_json_err_t err = lightweight_json_transcode_end(ctx);
+        if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+          return err;
+        }
+        if (0 == --depth) {
+          break;
+        }
+        continue;
+      }
+    }
+
+    item_t item;
+    lightweight_json_err_t err =
+        decode_format(format, data, size, offset, &item);
+    if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+      // A break where an item is due is malformed as well
+      return LIGHTWEIGHT_JSON_ERR_NOT_FOUND == err
+                 ? LIGHTWEIGHT_JSON_ERR_INVALID_JSON
+                 : err;
+    }
+    offset = item.end;
+    if (NULL != level) {
+      const bool map = *level & TRANSCODE_MAP;
+      const bool indefinite = *level & TRANSCODE_INDEFINITE;
+      // Keys come at even positions, counted from either end
+      const bool is_key = map && 0 == (*level & 1);
+      *level = indefinite ? *level + 1 : *level - 1;
+      if (is_key) {
+        if (LIGHTWEIGHT_JSON_VALUE_STRING != item.value.type) {
+          // JSON only has string keys
+          return LIGHTWEIGHT_JSON_ERR_NOT_SUPPORTED;
+        }
+        item_key = item.value.as.string.data;
+        key_len = item.value.as.string.len;
+        continue;
+      }
+      if (!map) {
+        item_key = NULL;
+      }
+    }
+
+    const bool array = LIGHTWEIGHT_JSON_VALUE_ARRAY == item.value.type;
+    const bool container =
+        array || LIGHTWEIGHT_JSON_VALUE_OBJECT == item.value.type;
+    if (container && TRANSCODE_MAX_DEPTH == depth) {
+      return LIGHTWEIGHT_JSON_ERR_MAX_NESTING_REACHED;
+    }
+    err = lightweight_json_transcode_item(ctx, item_key, key_len, false,
+                                          &item.value, false);
+    if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+      return err;
+    }
+    *out_started = true;
+    if (container) {
+      const uint64_t flag = array ? 0 : TRANSCODE_MAP;
+      if (UINT64_MAX == item.count) {
+        stack[depth++] = flag | TRANSCODE_INDEFINITE;
+      } else {
+        stack[depth++] = flag | (array ? item.count : 2 * item.count);
+      }
+    } else if (0 == depth) {
+      break;
+    }
+  }
+  // Nothing may follow the root
+  return offset == size ? LIGHTWEIGHT_JSON_ERR_NONE
+                        : LIGHTWEIGHT_JSON_ERR_INVALID_JSON;
+}
@@ -0,0 +1,222 @@
+#include "lightweight_json_compress.h"
+#include <limits.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef LIGHTWEIGHT_JSON_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef LIGHTWEIGHT_JSON_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+// Everything in the output block up to here has not been passed to the sink
+// yet. Kept next to the stream state so the public struct stays small.
+typedef struct {
+  size_t block_used;
+#ifdef LIGHTWEIGHT_JSON_HAVE_ZLIB
+  z_stream zlib;
+#endif
+#ifdef LIGHTWEIGHT_JSON_HAVE_ZSTD
+  ZSTD_CCtx *zstd;
+#endif
+} compress_state_t;
+
+static void emit_block(lightweight_json_compress_ctx_t *ctx, bool force) {
+  compress_state_t *state = (compress_state_t *)ctx->stream;
+  if (state->block_used == ctx->block_size ||
+      (force && state->block_used > 0)) {
+    ctx->sink(ctx->block, state->block_used, ctx->sink_userdata);
+    state->block_used = 0;
+  }
+}
+
+#ifdef LIGHTWEIGHT_JSON_HAVE_ZLIB
+static void zlib_run(lightweight_json_compress_ctx_t *ctx, const char *in,
+                     size_t len, int flush) {
+  compress_state_t *state = (compress_state_t *)ctx->stream;
+  z_stream *strm = &state->zlib;
+  int ret = Z_OK;
+
+  do {
+    // avail_in is only an uInt
+    const size_t chunk = len > UINT_MAX ? UINT_MAX : len;
+    strm->next_in = (Bytef *)in;
+    strm->avail_in = (uInt)chunk;
+    in += chunk;
+    len -= chunk;
+    const int mode = len > 0 ? Z_NO_FLUSH : flush;
+
+    do {
+      strm->next_out = (Bytef *)ctx->block + state->block_used;
+      strm->avail_out = (uInt)(ctx->block_size - state->block_used);
+      ret = deflate(strm, mode);
+      if (Z_STREAM_ERROR == ret) {
+        ctx->err = LIGHTWEIGHT_JSON_ERR_INVALID_STATE;
+        return;
+      }
+      state->block_used = ctx->block_size - strm->avail_out;
+      emit_block(ctx, false);
+    } while (strm->avail_in > 0 || (Z_FINISH == mode && Z_STREAM_END != ret));
+  } while (len > 0);
+}
+#endif
+
+#ifdef LIGHTWEIGHT_JSON_HAVE_ZSTD
+static void zstd_run(lightweight_json_compress_ctx_t *ctx, const char *in,
+                     size_t len, ZSTD_EndDirective directive) {
+  compress_state_t *state = (compress_state_t *)ctx->stream;
+  ZSTD_inBuffer input = {in, len, 0};
+  size_t remaining = 0;
+
+  do {
+    ZSTD_outBuffer output = {ctx->block, ctx->block_size, state->block_used};
+    remaining = ZSTD_compressStream2(state->zstd, &output, &input, directive);
+    if (ZSTD_isError(remaining)) {
+      ctx->err = LIGHTWEIGHT_JSON_ERR_INVALID_STATE;
+      return;
+    }
+    state->block_used = output.pos;
+    emit_block(ctx, false);
+  } while (input.pos < input.size ||
+           (ZSTD_e_end == directive && 0 != remaining));
+}
+#endif
+
+lightweight_json_err_t
+lightweight_json_compress_init(lightweight_json_compress_algo_e algo,
+                               int level, char *block, size_t block_size,
+                               flush_cb_t sink, void *sink_userdata,
+                               lightweight_json_compress_ctx_t *ctx) {
+  if (NULL == block || block_size < 64 || block_size > UINT_MAX ||
+      NULL == sink || NULL == ctx) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  memset(ctx, 0, sizeof(lightweight_json_compress_ctx_t));
+  ctx->algo = algo;
+  ctx->block = block;
+  ctx->block_size = block_size;
+  ctx->sink = sink;
+  ctx->sink_userdata = sink_userdata;
+  ctx->err = LIGHTWEIGHT_JSON_ERR_NONE;
+
+  switch (algo) {
+#ifdef LIGHTWEIGHT_JSON_HAVE_ZLIB
+  case LIGHTWEIGHT_JSON_COMPRESS_DEFLATE:
+  case LIGHTWEIGHT_JSON_COMPRESS_GZIP: {
+    compress_state_t *state =
+        (compress_state_t *)calloc(1, sizeof(compress_state_t));
+    if (NULL == state) {
+      return LIGHTWEIGHT_JSON_ERR_NO_MEM;
+    }
+    // +16 makes zlib write a gzip header and trailer
+    const int window_bits =
+        LIGHTWEIGHT_JSON_COMPRESS_GZIP == algo ? MAX_WBITS + 16 : MAX_WBITS;
+    if (Z_OK != deflateInit2(&state->zlib,
+                             level < 0 ? Z_DEFAULT_COMPRESSION : level,
+                             Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY)) {
+      free(state);
+      return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+    }
+    ctx->stream = state;
+    return LIGHTWEIGHT_JSON_ERR_NONE;
+  }
+#endif
+#ifdef LIGHTWEIGHT_JSON_HAVE_ZSTD
+  case LIGHTWEIGHT_JSON_COMPRESS_ZSTD: {
+    compress_state_t *state =
+        (compress_state_t *)calloc(1, sizeof(compress_state_t));
+    if (NULL == state) {
+      return LIGHTWEIGHT_JSON_ERR_NO_MEM;
+    }
+    state->zstd = ZSTD_createCCtx();
+    if (NULL == state->zstd) {
+      free(state);
+      return LIGHTWEIGHT_JSON_ERR_NO_MEM;
+    }
+    if (ZSTD_isError(ZSTD_CCtx_setParameter(
+            state->zstd, ZSTD_c_compressionLevel,
+            level < 0 ? ZSTD_CLEVEL_DEFAULT : level))) {
+      ZSTD_freeCCtx(state->zstd);
+      free(state);
+      return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+    }
+    ctx->stream = state;
+    return LIGHTWEIGHT_JSON_ERR_NONE;
+  }
+#endif
+  default:
+    return LIGHTWEIGHT_JSON_ERR_NOT_SUPPORTED;
+  }
+}
+
+void lightweight_json_compress_cb(char *buffer, size_t amount, void *userdata) {
+  lightweight_json_compress_ctx_t *ctx =
+      (lightweight_json_compress_ctx_t *)userdata;
+  if (NULL == ctx || NULL == ctx->stream || 0 == amount ||
+      LIGHTWEIGHT_JSON_ERR_NONE != ctx->err) {
+    return;
+  }
+
+  switch (ctx->algo) {
+#ifdef LIGHTWEIGHT_JSON_HAVE_ZLIB
+  case LIGHTWEIGHT_JSON_COMPRESS_DEFLATE:
+  case LIGHTWEIGHT_JSON_COMPRESS_GZIP:
+    zlib_run(ctx, buffer, amount, Z_NO_FLUSH);
+    break;
+#endif
+#ifdef LIGHTWEIGHT_JSON_HAVE_ZSTD
+  case LIGHTWEIGHT_JSON_COMPRESS_ZSTD:
+    zstd_run(ctx, buffer, amount, ZSTD_e_continue);
+    break;
+#endif
+  default:
+    break;
+  }
+}
+
+lightweight_json_err_t
+lightweight_json_compress_finish(lightweight_json_compress_ctx_t *ctx) {
+  if (NULL == ctx) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  if (NULL == ctx->stream) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_STATE;
+  }
+  compress_state_t *state = (compress_state_t *)ctx->stream;
+
+  switch (ctx->algo) {
+#ifdef LIGHTWEIGHT_JSON_HAVE_ZLIB
+  case LIGHTWEIGHT_JSON_COMPRESS_DEFLATE:
+  case LIGHTWEIGHT_JSON_COMPRESS_GZIP:
+    if (LIGHTWEIGHT_JSON_ERR_NONE == ctx->err) {
+      zlib_run(ctx, NULL, 0, Z_FINISH);
+    }
+    deflateEnd(&state->zlib);
+    break;
+#endif
+#ifdef LIGHTWEIGHT_JSON_HAVE_ZSTD
+  case LIGHTWEIGHT_JSON_COMPRESS_ZSTD:
+    if (LIGHTWEIGHT_JSON_ERR_NONE == ctx->err) {
+      zstd_run(ctx, NULL, 0, ZSTD_e_end);
+    }
+    ZSTD_freeCCtx(state->zstd);
+    break;
+#endif
+  default:
+    break;
+  }
+
+  if (LIGHTWEIGHT_JSON_ERR_NONE == ctx->err) {
+    emit_block(ctx, true);
+  }
+  free(state);
+  ctx->stream = NULL;
+  return ctx->err;
+}
+
+void lightweight_json_file_sink(char *buffer, size_t amount, void *userdata) {
+  if (NULL != userdata && amount > 0) {
+    fwrite(buffer, 1, amount, (FILE *)userdata);
+  }
+}
@@ -0,0 +1,126 @@
+#ifndef LIGHTWEIGHT_JSON_INTERNAL_H
+#define LIGHTWEIGHT_JSON_INTERNAL_H
+
+// Shared between the writer and its binary output formats, not part of the
+// public API
+
+#include "lightweight_json.h"
+
+// Second stack entry of a binary format level. With the bit set the low bits
+// are the size announced by begin_sized, otherwise they are the offset of the
+// MessagePack header to patch.
+#define LIGHTWEIGHT_JSON_LEVEL_SIZED_BIT 0x80000000u
+// The header got flushed before the size was known
+#define LIGHTWEIGHT_JSON_LEVEL_FLUSHED 0x7FFFFFFFu
+
+// The nesting stack of a context, the caller supplied one or the embedded one.
+// It is looked up on every access instead of storing a pointer to
+// `default_levels`, so contexts stay valid when they get copied.
+#if LIGHTWEIGHT_JSON_MAX_NESTING_SIZE > 0
+#define LIGHTWEIGHT_JSON_LEVELS(_ctx)                                          \
+  (NULL != (_ctx)->levels ? (_ctx)->levels : (_ctx)->default_levels)
+#else
+#define LIGHTWEIGHT_JSON_LEVELS(_ctx) ((_ctx)->levels)
+#endif
+
+// Copy `len` bytes into the buffer, flushing whenever it fills up
+void lightweight_json_write_bytes(lightweight_json_writer_ctx_t *ctx,
+                                  const char *data, size_t len);
+
+// First stack entry of the current level
+lightweight_json_writer_level_t *
+lightweight_json_writer_level(lightweight_json_writer_ctx_t *ctx);
+
+// Called before a binary format context flushes its buffer
+void lightweight_json_binary_flushing(lightweight_json_writer_ctx_t *ctx);
+
+// Write the key (if any) and the header, and push the level
+void lightweight_json_binary_begin(lightweight_json_writer_ctx_t *ctx,
+                                   const char *const key,
+                                   lightweight_json_type_e type, bool sized,
+                                   uint32_t size);
+
+// Terminate / patch the current level and pop it. The caller counts the
+// element in the parent.
+lightweight_json_err_t
+lightweight_json_binary_end(lightweight_json_writer_ctx_t *ctx);
+
+// Write the key of the next element, if any
+void lightweight_json_binary_key(lightweight_json_writer_ctx_t *ctx,
+                                 const char *const key);
+
+// Just the header of a string of `len` bytes, the caller writes the bytes
+void lightweight_json_binary_string_head(lightweight_json_writer_ctx_t *ctx,
+                                         size_t len);
+void lightweight_json_binary_string(lightweight_json_writer_ctx_t *ctx,
+                                    const char *value, size_t len);
+// A CBOR byte string / MessagePack bin
+void lightweight_json_binary_bytes(lightweight_json_writer_ctx_t *ctx,
+                                   const uint8_t *data, size_t len);
+void lightweight_json_binary_double(lightweight_json_writer_ctx_t *ctx,
+                                    double value);
+void lightweight_json_binary_uint64(lightweight_json_writer_ctx_t *ctx,
+                                    uint64_t value);
+void lightweight_json_binary_int64(lightweight_json_writer_ctx_t *ctx,
+                                   int64_t value);
+void lightweight_json_binary_bool(lightweight_json_writer_ctx_t *ctx,
+                                  bool value);
+void lightweight_json_binary_null(lightweight_json_writer_ctx_t *ctx);
+
+// Reader side. The reader checks the arguments and dispatches here for the
+// binary formats.
+
+// Enter the root map / array at offset 0
+lightweight_json_err_t
+lightweight_json_binary_reader_init(lightweight_json_reader_ctx_t *ctx);
+lightweight_json_err_t
+lightweight_json_binary_key_exists(lightweight_json_reader_ctx_t *ctx,
+                                   const char *key);
+lightweight_json_err_t
+lightweight_json_binary_get_value(lightweight_json_reader_ctx_t *ctx,
+                                  const char *key, size_t key_len,
+                                  lightweight_json_value_t *out_value);
+lightweight_json_err_t lightweight_json_binary_get_string(
+    lightweight_json_reader_ctx_t *ctx, const char *key, char *buffer,
+    size_t buffer_len, size_t *out_len);
+// Whether the string `value` is a byte string / bin rather than text
+bool lightweight_json_binary_is_bytes(const lightweight_json_reader_ctx_t *ctx,
+                                      const lightweight_json_value_t *value);
+// `type` is LIGHTWEIGHT_JSON_VALUE_UINT64, _INT64 or _DOUBLE
+lightweight_json_err_t
+lightweight_json_binary_get_number(lightweight_json_reader_ctx_t *ctx,
+                                   const char *key,
+                                   lightweight_json_value_type_e type,
+                                   void *out_value);
+lightweight_json_err_t
+lightweight_json_binary_get_bool(lightweight_json_reader_ctx_t *ctx,
+                                 const char *key, bool *out_value);
+lightweight_json_err_t
+lightweight_json_binary_enter(lightweight_json_reader_ctx_t *ctx,
+                              const char *key);
+lightweight_json_err_t
+lightweight_json_binary_enter_value(lightweight_json_reader_ctx_t *ctx,
+                                    const lightweight_json_value_t *value);
+lightweight_json_err_t
+lightweight_json_binary_array_next(lightweight_json_reader_ctx_t *ctx);
+
+// Transcoding, see lightweight_json_writer_transcode
+
+// Add one item of the document being converted: the comma, `key` (NULL inside
+// arrays) and `value`. Strings are JSON string content if `key_escaped` /
+// `escaped`, raw bytes otherwise. Maps / arrays only open a level,
+// lightweight_json_transcode_end closes it.
+lightweight_json_err_t lightweight_json_transcode_item(
+    lightweight_json_writer_ctx_t *ctx, const char *key, size_t key_len,
+    bool key_escaped, const lightweight_json_value_t *value, bool escaped);
+lightweight_json_err_t
+lightweight_json_transcode_end(lightweight_json_writer_ctx_t *ctx);
+
+// Walk the CBOR / MessagePack document in `data`. `out_started` is set once
+// the first item went out.
+lightweight_json_err_t lightweight_json_binary_transcode(
+    lightweight_json_writer_ctx_t *ctx, const char *const key,
+    const char *data, size_t size, lightweight_json_format_e format,
+    bool *out_started);
+
+#endif
@@ -0,0 +1,235 @@
+#include "lightweight_json_ndjson.h"
+#include <string.h>
+
+// Every line in the ring is a slot: an 8 byte header, then the line padded to
+// 8 bytes. The header is 0 until the producer published the slot, so the
+// drain stops at the first slot still being written. Drained slots are zeroed
+// again before the room is given back.
+#define SLOT_COMMITTED (1ull << 63)
+// Filler up to the end of the buffer, lines never wrap around
+#define SLOT_PADDING (1ull << 62)
+#define SLOT_LENGTH_MASK 0xFFFFFFFFull
+#define SLOT_HEADER_SIZE 8u
+
+#if defined(__GNUC__) || defined(__clang__)
+#define LIGHTWEIGHT_JSON_HAVE_ATOMICS
+#endif
+
+static void record_overflow(char *buffer, size_t amount, void *userdata) {
+  (void)buffer;
+  (void)amount;
+  // The record is incomplete now, commit drops it
+  ((lightweight_json_ndjson_record_t *)userdata)->overflow = true;
+}
+
+static void record_reset(lightweight_json_ndjson_record_t *record) {
+  record->overflow = false;
+  record->writer.offset = 0;
+  record->writer.nesting = -1;
+  record->writer.error = LIGHTWEIGHT_JSON_ERR_NONE;
+}
+
+lightweight_json_err_t lightweight_json_ndjson_ring_init(
+    char *buffer, size_t size, lightweight_json_ndjson_policy_e policy,
+    lightweight_json_wait_cb_t wait_cb, flush_cb_t sink, void *sink_userdata,
+    lightweight_json_ndjson_ring_t *ring) {
+#ifdef LIGHTWEIGHT_JSON_HAVE_ATOMICS
+  if (NULL == buffer || 0 != (uintptr_t)buffer % SLOT_HEADER_SIZE ||
+      size < 64 || 0 != (size & (size - 1)) || size > SLOT_LENGTH_MASK ||
+      (uint8_t)policy > (uint8_t)LIGHTWEIGHT_JSON_NDJSON_BLOCK ||
+      NULL == sink || NULL == ring) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  memset(ring, 0, sizeof(*ring));
+  memset(buffer, 0, size);
+  ring->buffer = buffer;
+  ring->size = size;
+  ring->policy = policy;
+  ring->wait_cb = wait_cb;
+  ring->sink = sink;
+  ring->sink_userdata = sink_userdata;
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+#else
+  (void)buffer;
+  (void)size;
+  (void)policy;
+  (void)wait_cb;
+  (void)sink;
+  (void)sink_userdata;
+  (void)ring;
+  return LIGHTWEIGHT_JSON_ERR_NOT_SUPPORTED;
+#endif
+}
+
+lightweight_json_err_t
+lightweight_json_ndjson_record_init(lightweight_json_ndjson_ring_t *ring,
+                                    char *buffer, size_t buffer_size,
+                                    lightweight_json_writer_level_t *levels,
+                                    size_t max_nesting,
+                                    lightweight_json_ndjson_record_t *record) {
+  if (NULL == ring || NULL == record) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+  record->ring = ring;
+  record->overflow = false;
+  return lightweight_json_writer_init_with_stack(
+      buffer, buffer_size, record_overflow, record, levels, max_nesting,
+      &record->writer);
+}
+
+#ifdef LIGHTWEIGHT_JSON_HAVE_ATOMICS
+static inline uint64_t *slot_header(lightweight_json_ndjson_ring_t *ring,
+                                    uint64_t pos) {
+  return (uint64_t *)(void *)&ring->buffer[pos & (ring->size - 1)];
+}
+
+static inline uint64_t slot_size(uint64_t len) {
+  return SLOT_HEADER_SIZE + ((len + SLOT_HEADER_SIZE - 1) &
+                             ~(uint64_t)(SLOT_HEADER_SIZE - 1));
+}
+
+// Reserve `size` bytes at the current write position. Fails if they would
+// run past the end of the buffer (`*out_wrap` is set then, with the position
+// in `*out_pos`) or if the ring is full.
+static bool ring_reserve(lightweight_json_ndjson_ring_t *ring, uint64_t size,
+                         uint64_t *out_pos, bool *out_wrap) {
+  uint64_t pos = __atomic_load_n(&ring->write_pos, __ATOMIC_RELAXED);
+  for (;;) {
+    const uint64_t offset = pos & (ring->size - 1);
+    if (offset + size > ring->size) {
+      *out_pos = pos;
+      *out_wrap = true;
+      return false;
+    }
+    // Pairs with the drain's release, the zeroed room is visible
+    const uint64_t read = __atomic_load_n(&ring->read_pos, __ATOMIC_ACQUIRE);
+    if (pos + size - read > ring->size) {
+      *out_wrap = false;
+      return false;
+    }
+    if (__atomic_compare_exchange_n(&ring->write_pos, &pos, pos + size, true,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+      *out_pos = pos;
+      return true;
+    }
+  }
+}
+
+// Fill the rest of the buffer from `pos` with padding, unless another
+// producer got there first
+static bool ring_pad(lightweight_json_ndjson_ring_t *ring, uint64_t pos) {
+  const uint64_t size = ring->size - (pos & (ring->size - 1));
+  const uint64_t read = __atomic_load_n(&ring->read_pos, __ATOMIC_ACQUIRE);
+  if (pos + size - read > ring->size) {
+    return false;
+  }
+  uint64_t expected = pos;
+  if (!__atomic_compare_exchange_n(&ring->write_pos, &expected, pos + size,
+                                   false, __ATOMIC_RELAXED,
+                                   __ATOMIC_RELAXED)) {
+    // Raced, retry the reservation
+    return true;
+  }
+  __atomic_store_n(slot_header(ring, pos), SLOT_COMMITTED | SLOT_PADDING | size,
+                   __ATOMIC_RELEASE);
+  return true;
+}
+#endif
+
+lightweight_json_err_t
+lightweight_json_ndjson_commit(lightweight_json_ndjson_record_t *record) {
+  if (NULL == record) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+#ifdef LIGHTWEIGHT_JSON_HAVE_ATOMICS
+  lightweight_json_ndjson_ring_t *ring = record->ring;
+  if (record->writer.nesting >= 0 || 0 == record->writer.offset) {
+    // The root wasn't ended yet / nothing was written
+    return LIGHTWEIGHT_JSON_ERR_INVALID_STATE;
+  }
+  // + newline
+  const uint64_t len = (uint64_t)record->writer.offset + 1;
+  const uint64_t size = slot_size(len);
+  if (record->overflow || size > ring->size) {
+    record_reset(record);
+    return LIGHTWEIGHT_JSON_ERR_BUFFER_TOO_SMALL;
+  }
+
+  uint64_t pos = 0;
+  bool wrap = false;
+  while (!ring_reserve(ring, size, &pos, &wrap)) {
+    if (wrap && ring_pad(ring, pos)) {
+      continue;
+    }
+    if (LIGHTWEIGHT_JSON_NDJSON_DROP == ring->policy) {
+      __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+      record_reset(record);
+      return LIGHTWEIGHT_JSON_ERR_NO_MEM;
+    }
+    if (NULL != ring->wait_cb) {
+      ring->wait_cb();
+    }
+  }
+
+  uint64_t *header = slot_header(ring, pos);
+  char *line = (char *)(header + 1);
+  memcpy(line, record->writer.buffer, (size_t)len - 1);
+  line[len - 1] = '\n';
+  // The drain sees the line once it sees the header
+  __atomic_store_n(header, SLOT_COMMITTED | len, __ATOMIC_RELEASE);
+  record_reset(record);
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+#else
+  return LIGHTWEIGHT_JSON_ERR_NOT_SUPPORTED;
+#endif
+}
+
+lightweight_json_err_t
+lightweight_json_ndjson_drain(lightweight_json_ndjson_ring_t *ring,
+                              size_t *out_records) {
+  if (NULL == ring) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+#ifdef LIGHTWEIGHT_JSON_HAVE_ATOMICS
+  // Only this thread writes read_pos
+  uint64_t pos = __atomic_load_n(&ring->read_pos, __ATOMIC_RELAXED);
+  size_t records = 0;
+  for (;;) {
+    uint64_t *header = slot_header(ring, pos);
+    const uint64_t value = __atomic_load_n(header, __ATOMIC_ACQUIRE);
+    if (0 == (value & SLOT_COMMITTED)) {
+      break;
+    }
+    uint64_t size = value & SLOT_LENGTH_MASK;
+    if (0 == (value & SLOT_PADDING)) {
+      ring->sink((char *)(header + 1), (size_t)size, ring->sink_userdata);
+      records++;
+      size = slot_size(size);
+    }
+    memset(header, 0, (size_t)size);
+    pos += size;
+    __atomic_store_n(&ring->read_pos, pos, __ATOMIC_RELEASE);
+  }
+  if (NULL != out_records) {
+    *out_records = records;
+  }
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+#else
+  (void)out_records;
+  return LIGHTWEIGHT_JSON_ERR_NOT_SUPPORTED;
+#endif
+}
+
+lightweight_json_err_t
+lightweight_json_ndjson_get_dropped(lightweight_json_ndjson_ring_t *ring,
+                                    uint64_t *out_dropped) {
+  if (NULL == ring || NULL == out_dropped) {
+    return LIGHTWEIGHT_JSON_ERR_INVALID_ARGS;
+  }
+#ifdef LIGHTWEIGHT_JSON_HAVE_ATOMICS
+  *out_dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+  return LIGHTWEIGHT_JSON_ERR_NONE;
+#else
+  return LIGHTWEIGHT_JSON_ERR_NOT_SUPPORTED;
+#endif
+}
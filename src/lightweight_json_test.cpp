@@ -1,5 +1,11 @@
 #include "lightweight_json.h"
+#include "lightweight_json.hpp"
+#include <cstddef>
 #include <cstdint>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
 #include <gtest/gtest.h>
 
 extern "C" {
@@ -189,3 +195,2299 @@ TEST(LightWeightJson, DeepNesting) {
   EXPECT_STREQ(output, "{\"obj\":{\"obj\":{\"obj\":{\"obj\":{\"obj\":{\"obj\":{"
                        "\"obj\":{\"obj\":{\"obj\":{}}}}}}}}}}");
 }
+
+TEST(LightWeightJson, CustomStackNesting) {
+  setup();
+  lightweight_json_writer_level_t levels[32];
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_ARGS,
+            lightweight_json_writer_init_with_stack(
+                buffer, sizeof(buffer), flush_cb, NULL, levels, 0, &ctx));
+  // The embedded stack has LIGHTWEIGHT_JSON_MAX_NESTING_SIZE entries
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_ARGS,
+            lightweight_json_writer_init_with_stack(
+                buffer, sizeof(buffer), flush_cb, NULL, NULL,
+                LIGHTWEIGHT_JSON_MAX_NESTING_SIZE + 1, &ctx));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_init_with_stack(buffer, sizeof(buffer),
+                                                    flush_cb, NULL, levels,
+                                                    32, &ctx));
+
+  for (int i = 0; i < 32; i++) {
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_writer_begin(&ctx, NULL, LIGHTWEIGHT_JSON_ARRAY));
+  }
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_MAX_NESTING_REACHED,
+            lightweight_json_writer_begin(&ctx, NULL, LIGHTWEIGHT_JSON_ARRAY));
+  for (int i = 0; i < 32; i++) {
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, lightweight_json_writer_end(&ctx));
+  }
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_STATE,
+            lightweight_json_writer_end(&ctx));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, lightweight_json_writer_flush(&ctx));
+  EXPECT_EQ(64, output_offset);
+  EXPECT_EQ('[', output[31]);
+  EXPECT_EQ(']', output[32]);
+}
+
+TEST(LightWeightJson, ReaderCustomStackNesting) {
+  // 11 levels, one more than the default stack holds
+  const char *input = "{\"a\":{\"a\":{\"a\":{\"a\":{\"a\":{\"a\":{\"a\":{\"a\":"
+                      "{\"a\":{\"a\":{\"v\":42}}}}}}}}}}}";
+  lightweight_json_reader_ctx_t reader;
+  lightweight_json_reader_level_t levels[11];
+  uint64_t value = 0;
+
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_init(input, strlen(input), &reader));
+  for (int i = 0; i < LIGHTWEIGHT_JSON_MAX_NESTING_SIZE - 1; i++) {
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_enter(&reader, "a"));
+  }
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_MAX_NESTING_REACHED,
+            lightweight_json_reader_enter(&reader, "a"));
+
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_init_with_stack(input, strlen(input),
+                                                    levels, 11, &reader));
+  for (int i = 0; i < 10; i++) {
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_enter(&reader, "a"));
+  }
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_get_uint64(&reader, "v", &value));
+  EXPECT_EQ(42, value);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, lightweight_json_reader_leave(&reader));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_key_exists(&reader, "a"));
+}
+
+static std::string compressed;
+static void memory_sink(char *buffer, size_t amount, void *userdata) {
+  compressed.append(buffer, amount);
+}
+
+#ifdef LIGHTWEIGHT_JSON_HAVE_ZLIB
+#include "lightweight_json_compress.h"
+#include <zlib.h>
+
+TEST(LightWeightJson, CompressGzip) {
+  setup();
+  compressed.clear();
+  char block[64];
+  lightweight_json_compress_ctx_t compress;
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_compress_init(LIGHTWEIGHT_JSON_COMPRESS_GZIP, 9,
+                                           block, sizeof(block), memory_sink,
+                                           NULL, &compress));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_init(buffer, sizeof(buffer),
+                                         lightweight_json_compress_cb,
+                                         &compress, &ctx));
+
+  std::string expected = "[";
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_begin(&ctx, NULL, LIGHTWEIGHT_JSON_ARRAY));
+  for (int i = 0; i < 500; i++) {
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_writer_add_string(&ctx, NULL, "compress me"));
+    expected += i > 0 ? ",\"compress me\"" : "\"compress me\"";
+  }
+  expected += "]";
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, lightweight_json_writer_end(&ctx));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, lightweight_json_writer_flush(&ctx));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_compress_finish(&compress));
+  EXPECT_LT(compressed.size(), expected.size() / 10);
+
+  std::string inflated(expected.size() + 16, '\0');
+  z_stream strm;
+  memset(&strm, 0, sizeof(strm));
+  ASSERT_EQ(Z_OK, inflateInit2(&strm, MAX_WBITS + 16));
+  strm.next_in = (Bytef *)&compressed[0];
+  strm.avail_in = (uInt)compressed.size();
+  strm.next_out = (Bytef *)&inflated[0];
+  strm.avail_out = (uInt)inflated.size();
+  EXPECT_EQ(Z_STREAM_END, inflate(&strm, Z_FINISH));
+  inflated.resize(strm.total_out);
+  inflateEnd(&strm);
+  EXPECT_EQ(expected, inflated);
+}
+
+TEST(LightWeightJson, CompressFileSink) {
+  setup();
+  char block[64];
+  lightweight_json_compress_ctx_t compress;
+  FILE *file = tmpfile();
+  ASSERT_NE(nullptr, file);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_compress_init(LIGHTWEIGHT_JSON_COMPRESS_DEFLATE,
+                                           -1, block, sizeof(block),
+                                           lightweight_json_file_sink, file,
+                                           &compress));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_init(buffer, sizeof(buffer),
+                                         lightweight_json_compress_cb,
+                                         &compress, &ctx));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_begin(&ctx, NULL, LIGHTWEIGHT_JSON_OBJECT));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_add_uint64(&ctx, "answer", 42));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, lightweight_json_writer_end(&ctx));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, lightweight_json_writer_flush(&ctx));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_compress_finish(&compress));
+
+  char file_data[128];
+  rewind(file);
+  const size_t file_size = fread(file_data, 1, sizeof(file_data), file);
+  fclose(file);
+
+  char inflated[64] = {0};
+  uLongf inflated_size = sizeof(inflated) - 1;
+  EXPECT_EQ(Z_OK, uncompress((Bytef *)inflated, &inflated_size,
+                             (const Bytef *)file_data, file_size));
+  EXPECT_STREQ("{\"answer\":42}", inflated);
+}
+#endif
+
+#ifdef LIGHTWEIGHT_JSON_ENABLE_STATS
+static int hook_enters = 0;
+static int hook_leaves = 0;
+static void call_hook(lightweight_json_api_e api, bool enter, void *userdata) {
+  if (enter) {
+    hook_enters++;
+  } else {
+    hook_leaves++;
+  }
+}
+
+TEST(LightWeightJson, WriterStats) {
+  setup();
+  lightweight_json_writer_stats_t stats;
+  EXPECT_EQ(
+      LIGHTWEIGHT_JSON_ERR_NONE,
+      lightweight_json_writer_init(buffer, sizeof(buffer), flush_cb, NULL, &ctx));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_set_call_hook(&ctx, call_hook, NULL));
+  hook_enters = hook_leaves = 0;
+
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_begin(&ctx, NULL, LIGHTWEIGHT_JSON_OBJECT));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_add_string(&ctx, "s", "a\"b"));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, lightweight_json_writer_end(&ctx));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_get_stats(&ctx, &stats));
+  EXPECT_EQ(strlen("{\"s\":\"a\\\"b\"}"), stats.bytes_written);
+  EXPECT_EQ(4, stats.flush_calls);
+  EXPECT_EQ(3, stats.average_flush_size);
+  EXPECT_EQ(1, stats.escapes);
+  EXPECT_EQ(1, stats.calls[LIGHTWEIGHT_JSON_API_WRITER_ADD_STRING]);
+  EXPECT_EQ(3, hook_enters);
+  EXPECT_EQ(3, hook_leaves);
+
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, lightweight_json_writer_reset_stats(&ctx));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_get_stats(&ctx, &stats));
+  EXPECT_EQ(0, stats.flush_calls);
+}
+
+TEST(LightWeightJson, ReaderStats) {
+  const char *input = "{\"a\": [1, [2, 3], {\"x\": 4}], \"b\": {\"c\": 5}}";
+  lightweight_json_reader_ctx_t reader;
+  lightweight_json_reader_stats_t stats;
+  uint64_t value = 0;
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_init(input, strlen(input), &reader));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_key_exists(&reader, "b"));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, lightweight_json_reader_enter(&reader, "b"));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_get_uint64(&reader, "c", &value));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_get_stats(&reader, &stats));
+  EXPECT_EQ(3, stats.lookups);
+  // "a"'s array, skipped by key_exists and enter
+  EXPECT_EQ(2, stats.subtrees_skipped);
+  EXPECT_EQ(1, stats.max_depth);
+  EXPECT_EQ(1, stats.calls[LIGHTWEIGHT_JSON_API_READER_KEY_EXISTS]);
+  EXPECT_GT(stats.bytes_scanned[LIGHTWEIGHT_JSON_API_READER_KEY_EXISTS],
+            stats.bytes_scanned[LIGHTWEIGHT_JSON_API_READER_GET_UINT64]);
+}
+#else
+TEST(LightWeightJson, StatsDisabled) {
+  setup();
+  lightweight_json_writer_stats_t stats;
+  EXPECT_EQ(
+      LIGHTWEIGHT_JSON_ERR_NONE,
+      lightweight_json_writer_init(buffer, sizeof(buffer), flush_cb, NULL, &ctx));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NOT_SUPPORTED,
+            lightweight_json_writer_get_stats(&ctx, &stats));
+}
+#endif
+
+TEST(LightWeightJson, Validate) {
+  const char *valid[] = {
+      "{}",
+      " [ ] ",
+      "{\"a\":[1,-2.5,3e10,4E-2,0.5e+1],\"b\":{\"c\":null},\"d\":true}",
+      "[\"\\u00e4\\n\\\"\", \"\xc3\xa4\xe2\x82\xac\xf0\x9f\x98\x80\", false]",
+      "\"just a string\"",
+      "42",
+  };
+  const char *invalid[] = {
+      "",
+      "{",
+      "{\"a\":1,}",
+      "[1 2]",
+      "{\"a\" 1}",
+      "{} x",
+      "[01]",
+      "[1.]",
+      "[-]",
+      "[tru]",
+      "[\"\\x\"]",
+      "[\"\\u12g4\"]",
+      "[\"tab\there\"]",
+      "[\"\xc3\"]",
+      "[\"\xc0\xaf\"]",
+      "[\"\xed\xa0\x80\"]",
+      "{'a':1}",
+  };
+
+  for (const char *input : valid) {
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_validate(input, strlen(input)))
+        << input;
+  }
+  for (const char *input : invalid) {
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_JSON,
+              lightweight_json_validate(input, strlen(input)))
+        << input;
+  }
+
+  std::string deep(LIGHTWEIGHT_JSON_VALIDATE_MAX_DEPTH + 1, '[');
+  deep += std::string(LIGHTWEIGHT_JSON_VALIDATE_MAX_DEPTH + 1, ']');
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_MAX_NESTING_REACHED,
+            lightweight_json_validate(deep.c_str(), deep.size()));
+}
+
+TEST(LightWeightJson, ValidatedReader) {
+  const char *input = "{\n"
+                      "  \"name\" : \"va\\\"lue\",\n"
+                      "  \"skip\" : {\"name\": \"nested\", \"x\": [1, {}]},\n"
+                      "  \"count\" : 12345678901234567890,\n"
+                      "  \"neg\" : -42,\n"
+                      "  \"pi\" : 3.25e2,\n"
+                      "  \"ok\" : true,\n"
+                      "  \"items\" : [ 1 , [2, 3] , \"x,]\" , {\"v\": 4} ]\n"
+                      "}";
+  lightweight_json_reader_ctx_t reader;
+  char buffer[32];
+  uint64_t u = 0;
+  int64_t i = 0;
+  double d = 0;
+  bool b = false;
+
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_JSON,
+            lightweight_json_reader_init_ex(
+                "{\"a\":1,}", 8, NULL, LIGHTWEIGHT_JSON_MAX_NESTING_SIZE,
+                LIGHTWEIGHT_JSON_READER_FLAG_VALIDATE, &reader));
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_init_ex(
+                input, strlen(input), NULL, LIGHTWEIGHT_JSON_MAX_NESTING_SIZE,
+                LIGHTWEIGHT_JSON_READER_FLAG_VALIDATE, &reader));
+
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_get_string(&reader, "name", buffer,
+                                               sizeof(buffer)));
+  EXPECT_STREQ("va\"lue", buffer);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_get_uint64(&reader, "count", &u));
+  EXPECT_EQ(12345678901234567890ull, u);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_get_int64(&reader, "neg", &i));
+  EXPECT_EQ(-42, i);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_get_double(&reader, "pi", &d));
+  EXPECT_DOUBLE_EQ(325.0, d);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_get_bool(&reader, "ok", &b));
+  EXPECT_TRUE(b);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE,
+            lightweight_json_reader_get_bool(&reader, "name", &b));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NOT_FOUND,
+            lightweight_json_reader_key_exists(&reader, "x"));
+
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_enter(&reader, "items"));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_get_uint64(&reader, NULL, &u));
+  EXPECT_EQ(1, u);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_array_next(&reader));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_enter(&reader, NULL));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_array_next(&reader));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_get_uint64(&reader, NULL, &u));
+  EXPECT_EQ(3, u);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NOT_FOUND,
+            lightweight_json_reader_array_next(&reader));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, lightweight_json_reader_leave(&reader));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_array_next(&reader));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_get_string(&reader, NULL, buffer,
+                                               sizeof(buffer)));
+  EXPECT_STREQ("x,]", buffer);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_array_next(&reader));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_enter(&reader, NULL));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_get_uint64(&reader, "v", &u));
+  EXPECT_EQ(4, u);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, lightweight_json_reader_leave(&reader));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NOT_FOUND,
+            lightweight_json_reader_array_next(&reader));
+}
+
+TEST(LightWeightJson, ReaderExponent) {
+  const char *input = "{\"a\": 1.5e3, \"b\": -2E-2}";
+  lightweight_json_reader_ctx_t reader;
+  double d = 0;
+
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_init(input, strlen(input), &reader));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_get_double(&reader, "a", &d));
+  EXPECT_DOUBLE_EQ(1500.0, d);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_get_double(&reader, "b", &d));
+  EXPECT_DOUBLE_EQ(-0.02, d);
+}
+
+TEST(LightWeightJson, ReaderUnescape) {
+  const char *input =
+      "{\"plain\": \"a long run without any escapes in it at all\","
+      " \"esc\": \"q\\\"b\\\\s\\/n\\nt\\tr\\rb\\bf\\f\","
+      " \"uni\": \"\\u00e9\\u20ac\\ud83d\\ude00\\ud800x\"}";
+  const char *bad = "{\"bad\": \"\\q\"}";
+  lightweight_json_reader_ctx_t reader;
+  char buffer[64];
+  char small[4];
+  size_t len = 0;
+
+  for (uint32_t flags : {0u, (uint32_t)LIGHTWEIGHT_JSON_READER_FLAG_VALIDATE}) {
+    ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_init_ex(input, strlen(input), NULL,
+                                              LIGHTWEIGHT_JSON_MAX_NESTING_SIZE,
+                                              flags, &reader));
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_get_string(&reader, "plain", buffer,
+                                                 sizeof(buffer)));
+    EXPECT_STREQ("a long run without any escapes in it at all", buffer);
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_get_string(&reader, "esc", buffer,
+                                                 sizeof(buffer)));
+    EXPECT_STREQ("q\"b\\s/n\nt\tr\rb\bf\f", buffer);
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_get_string_len(&reader, "uni", buffer,
+                                                     sizeof(buffer), &len));
+    EXPECT_STREQ("\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80\xef\xbf\xbdx", buffer);
+    EXPECT_EQ(13, len);
+
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_BUFFER_TOO_SMALL,
+              lightweight_json_reader_get_string_len(&reader, "uni", small,
+                                                     sizeof(small), &len));
+    EXPECT_EQ(13, len);
+    EXPECT_STREQ("", small);
+  }
+
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_init(bad, strlen(bad), &reader));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_JSON,
+            lightweight_json_reader_get_string(&reader, "bad", buffer,
+                                               sizeof(buffer)));
+}
+
+TEST(LightWeightJson, SharedDocument) {
+  const char *input = "{\"skip\": {\"a\": [1, [2, {\"b\": \"}]\"}]]},"
+                      " \"list\": [{\"id\": 1}, {\"id\": 2}, {\"id\": 3}],"
+                      " \"name\": \"config\"}";
+  lightweight_json_index_entry_t index[9];
+  lightweight_json_document_t doc;
+  lightweight_json_reader_ctx_t cursor;
+  char name[16];
+  uint64_t id = 0;
+
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_BUFFER_TOO_SMALL,
+            lightweight_json_document_init(input, strlen(input), index, 8,
+                                           &doc));
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_document_init(input, strlen(input), index, 9,
+                                           &doc));
+  EXPECT_EQ(9, doc.index_size);
+  EXPECT_EQ(0, doc.index[0].open);
+  EXPECT_EQ(strlen(input) - 1, doc.index[0].close);
+
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_init_document(
+                &doc, NULL, LIGHTWEIGHT_JSON_MAX_NESTING_SIZE, &cursor));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_get_string(&cursor, "name", name,
+                                               sizeof(name)));
+  EXPECT_STREQ("config", name);
+
+  // Copies are independent cursors
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_enter(&cursor, "list"));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_array_next(&cursor));
+  lightweight_json_reader_ctx_t saved = cursor;
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_array_next(&cursor));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_enter(&cursor, NULL));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_get_uint64(&cursor, "id", &id));
+  EXPECT_EQ(3, id);
+  cursor = saved;
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_enter(&cursor, NULL));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_get_uint64(&cursor, "id", &id));
+  EXPECT_EQ(2, id);
+
+  std::vector<std::thread> threads;
+  std::vector<uint64_t> sums(4, 0);
+  for (size_t t = 0; t < sums.size(); t++) {
+    threads.emplace_back([&doc, &sums, t] {
+      for (int round = 0; round < 100; round++) {
+        lightweight_json_reader_ctx_t reader;
+        uint64_t value = 0;
+        lightweight_json_reader_init_document(
+            &doc, NULL, LIGHTWEIGHT_JSON_MAX_NESTING_SIZE, &reader);
+        lightweight_json_reader_enter(&reader, "list");
+        do {
+          lightweight_json_reader_enter(&reader, NULL);
+          lightweight_json_reader_get_uint64(&reader, "id", &value);
+          lightweight_json_reader_leave(&reader);
+          sums[t] += value;
+        } while (LIGHTWEIGHT_JSON_ERR_NONE ==
+                 lightweight_json_reader_array_next(&reader));
+      }
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  for (uint64_t sum : sums) {
+    EXPECT_EQ(600, sum);
+  }
+}
+
+TEST(LightWeightJson, Fragments) {
+  char out[256] = {0};
+  char parent_buffer[16];
+  char fragment_buffers[3][64];
+  lightweight_json_writer_ctx_t parent;
+  lightweight_json_writer_ctx_t writers[3];
+  lightweight_json_fragment_t fragments[3];
+  std::string result;
+  auto append = [](char *buffer, size_t size, void *userdata) {
+    static_cast<std::string *>(userdata)->append(buffer, size);
+  };
+
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_init(parent_buffer, sizeof(parent_buffer),
+                                         append, &result, &parent));
+  lightweight_json_writer_begin(&parent, NULL, LIGHTWEIGHT_JSON_OBJECT);
+  lightweight_json_writer_add_uint64(&parent, "first", 1);
+  lightweight_json_writer_begin(&parent, "sections", LIGHTWEIGHT_JSON_ARRAY);
+  for (int i = 0; i < 3; i++) {
+    ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_fragment_init(
+                  &parent, fragment_buffers[i], sizeof(fragment_buffers[i]),
+                  NULL, LIGHTWEIGHT_JSON_MAX_NESTING_SIZE, &fragments[i],
+                  &writers[i]));
+  }
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 3; i++) {
+    threads.emplace_back([&writers, &fragments, i] {
+      lightweight_json_writer_ctx_t *w = &writers[i];
+      // The middle fragment stays empty
+      for (int j = 0; i != 1 && j < 2; j++) {
+        lightweight_json_writer_begin(w, NULL, LIGHTWEIGHT_JSON_OBJECT);
+        lightweight_json_writer_add_int64(w, "id", i * 10 + j);
+        lightweight_json_writer_end(w);
+      }
+      EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_STATE,
+                lightweight_json_writer_end(w));
+      EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+                lightweight_json_fragment_finish(&fragments[i], w));
+    });
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  for (int i = 0; i < 3; i++) {
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_writer_splice(&parent, &fragments[i]));
+  }
+  lightweight_json_writer_begin(&parent, NULL, LIGHTWEIGHT_JSON_OBJECT);
+  lightweight_json_writer_end(&parent);
+  lightweight_json_writer_end(&parent);
+  lightweight_json_writer_end(&parent);
+  lightweight_json_writer_flush(&parent);
+  EXPECT_EQ("{\"first\":1,\"sections\":[{\"id\":0},{\"id\":1},{\"id\":20},"
+            "{\"id\":21},{}]}",
+            result);
+
+  // Overflowing fragment
+  lightweight_json_writer_begin(&parent, NULL, LIGHTWEIGHT_JSON_OBJECT);
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_fragment_init(&parent, out, 8, NULL,
+                                           LIGHTWEIGHT_JSON_MAX_NESTING_SIZE,
+                                           &fragments[0], &writers[0]));
+  lightweight_json_writer_add_string(&writers[0], "key", "too long");
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_BUFFER_TOO_SMALL,
+            lightweight_json_fragment_finish(&fragments[0], &writers[0]));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_STATE,
+            lightweight_json_writer_splice(&parent, &fragments[0]));
+
+  // A fragment nests as deep as its own stack allows
+  lightweight_json_writer_level_t levels[64];
+  result.clear();
+  lightweight_json_writer_init(parent_buffer, sizeof(parent_buffer), append,
+                               &result, &parent);
+  lightweight_json_writer_begin(&parent, NULL, LIGHTWEIGHT_JSON_ARRAY);
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_fragment_init(&parent, out, sizeof(out), levels,
+                                           64, &fragments[0], &writers[0]));
+  for (int i = 0; i < 63; i++) {
+    ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_writer_begin(&writers[0], NULL,
+                                            LIGHTWEIGHT_JSON_ARRAY));
+  }
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_MAX_NESTING_REACHED,
+            lightweight_json_writer_begin(&writers[0], NULL,
+                                          LIGHTWEIGHT_JSON_ARRAY));
+  for (int i = 0; i < 63; i++) {
+    lightweight_json_writer_end(&writers[0]);
+  }
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_fragment_finish(&fragments[0], &writers[0]));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_splice(&parent, &fragments[0]));
+
+  // A single entry only holds the parent's level, and no binary level
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_fragment_init(&parent, out, sizeof(out), levels,
+                                           1, &fragments[0], &writers[0]));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_MAX_NESTING_REACHED,
+            lightweight_json_writer_begin(&writers[0], NULL,
+                                          LIGHTWEIGHT_JSON_OBJECT));
+  lightweight_json_writer_end(&parent);
+  lightweight_json_writer_flush(&parent);
+  EXPECT_EQ(std::string(64, '[') + std::string(64, ']'), result);
+  char cbor[16];
+  lightweight_json_writer_init(cbor, sizeof(cbor), append, &result, &parent);
+  lightweight_json_writer_set_format(&parent, LIGHTWEIGHT_JSON_FORMAT_CBOR);
+  lightweight_json_writer_begin(&parent, NULL, LIGHTWEIGHT_JSON_ARRAY);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_ARGS,
+            lightweight_json_fragment_init(&parent, out, sizeof(out), levels,
+                                           1, &fragments[0], &writers[0]));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_fragment_init(&parent, out, sizeof(out), levels,
+                                           2, &fragments[0], &writers[0]));
+}
+
+TEST(LightWeightJson, AddRawAndCache) {
+  char writer_buffer[8];
+  char cache_buffer[64];
+  char small_buffer[8];
+  lightweight_json_writer_ctx_t writer;
+  lightweight_json_cache_entry_t entry;
+  lightweight_json_cache_entry_t small;
+  std::string result;
+  struct Device {
+    const char *name;
+    int serializations;
+  } device = {"sensor", 0};
+  auto append = [](char *buffer, size_t size, void *userdata) {
+    static_cast<std::string *>(userdata)->append(buffer, size);
+  };
+  auto serialize = [](lightweight_json_writer_ctx_t *ctx,
+                      void *userdata) -> lightweight_json_err_t {
+    Device *device = static_cast<Device *>(userdata);
+    device->serializations++;
+    lightweight_json_writer_begin(ctx, NULL, LIGHTWEIGHT_JSON_OBJECT);
+    lightweight_json_writer_add_string(ctx, "name", device->name);
+    lightweight_json_writer_end(ctx);
+    return LIGHTWEIGHT_JSON_ERR_NONE;
+  };
+
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_cache_init(cache_buffer, sizeof(cache_buffer),
+                                        NULL, LIGHTWEIGHT_JSON_MAX_NESTING_SIZE,
+                                        &entry));
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_cache_init(small_buffer, sizeof(small_buffer),
+                                        NULL, LIGHTWEIGHT_JSON_MAX_NESTING_SIZE,
+                                        &small));
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_init(writer_buffer, sizeof(writer_buffer),
+                                         append, &result, &writer));
+  lightweight_json_writer_begin(&writer, NULL, LIGHTWEIGHT_JSON_ARRAY);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_add_raw(&writer, NULL, "[1,2]", 5));
+  for (uint64_t version : {1, 1, 2}) {
+    if (2 == version) {
+      device.name = "actuator";
+    }
+    lightweight_json_writer_begin(&writer, NULL, LIGHTWEIGHT_JSON_OBJECT);
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_writer_add_cached(&writer, "device", &entry,
+                                                 version, serialize, &device));
+    lightweight_json_writer_add_uint64(&writer, "v", version);
+    lightweight_json_writer_end(&writer);
+  }
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_BUFFER_TOO_SMALL,
+            lightweight_json_writer_add_cached(&writer, NULL, &small, 1,
+                                               serialize, &device));
+  lightweight_json_writer_end(&writer);
+  lightweight_json_writer_flush(&writer);
+
+  EXPECT_EQ(3, device.serializations);
+  EXPECT_EQ("[[1,2],{\"device\":{\"name\":\"sensor\"},\"v\":1},"
+            "{\"device\":{\"name\":\"sensor\"},\"v\":1},"
+            "{\"device\":{\"name\":\"actuator\"},\"v\":2}]",
+            result);
+
+  // A value deeper than the embedded stack, through the entry's own stack
+  auto deep = [](lightweight_json_writer_ctx_t *ctx,
+                 void *userdata) -> lightweight_json_err_t {
+    (void)userdata;
+    for (int i = 0; i < 30; i++) {
+      lightweight_json_err_t err =
+          lightweight_json_writer_begin(ctx, NULL, LIGHTWEIGHT_JSON_ARRAY);
+      if (LIGHTWEIGHT_JSON_ERR_NONE != err) {
+        return err;
+      }
+    }
+    for (int i = 0; i < 30; i++) {
+      lightweight_json_writer_end(ctx);
+    }
+    return LIGHTWEIGHT_JSON_ERR_NONE;
+  };
+  lightweight_json_writer_level_t levels[31];
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_cache_init(cache_buffer, sizeof(cache_buffer),
+                                        levels, 31, &entry));
+  result.clear();
+  lightweight_json_writer_init(writer_buffer, sizeof(writer_buffer), append,
+                               &result, &writer);
+  lightweight_json_writer_begin(&writer, NULL, LIGHTWEIGHT_JSON_ARRAY);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_add_cached(&writer, NULL, &entry, 1, deep,
+                                               NULL));
+  lightweight_json_writer_end(&writer);
+  lightweight_json_writer_flush(&writer);
+  EXPECT_EQ(std::string(31, '[') + std::string(31, ']'), result);
+  lightweight_json_cache_init(cache_buffer, sizeof(cache_buffer), levels, 30,
+                              &entry);
+  lightweight_json_writer_begin(&writer, NULL, LIGHTWEIGHT_JSON_ARRAY);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_MAX_NESTING_REACHED,
+            lightweight_json_writer_add_cached(&writer, NULL, &entry, 1, deep,
+                                               NULL));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_ARGS,
+            lightweight_json_cache_init(cache_buffer, sizeof(cache_buffer),
+                                        NULL,
+                                        LIGHTWEIGHT_JSON_MAX_NESTING_SIZE + 1,
+                                        &entry));
+}
+
+TEST(LightWeightJson, Template) {
+  char skeleton[128];
+  char writer_buffer[16];
+  lightweight_json_template_slot_t slots[5];
+  lightweight_json_template_t tmpl;
+  lightweight_json_writer_ctx_t recorder;
+  lightweight_json_writer_ctx_t writer;
+  std::string result;
+  auto append = [](char *buffer, size_t size, void *userdata) {
+    static_cast<std::string *>(userdata)->append(buffer, size);
+  };
+
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_template_init(
+                skeleton, sizeof(skeleton), slots, 5, NULL,
+                LIGHTWEIGHT_JSON_MAX_NESTING_SIZE, &tmpl, &recorder));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_STATE,
+            lightweight_json_template_add_slot(
+                &recorder, NULL, LIGHTWEIGHT_JSON_SLOT_UINT64, &tmpl));
+  lightweight_json_writer_begin(&recorder, NULL, LIGHTWEIGHT_JSON_OBJECT);
+  lightweight_json_writer_add_string(&recorder, "type", "telemetry");
+  lightweight_json_template_add_slot(&recorder, "seq",
+                                     LIGHTWEIGHT_JSON_SLOT_UINT64, &tmpl);
+  lightweight_json_template_add_slot(&recorder, "temp",
+                                     LIGHTWEIGHT_JSON_SLOT_DOUBLE, &tmpl);
+  lightweight_json_writer_begin(&recorder, "status", LIGHTWEIGHT_JSON_ARRAY);
+  lightweight_json_template_add_slot(&recorder, NULL,
+                                     LIGHTWEIGHT_JSON_SLOT_BOOL, &tmpl);
+  lightweight_json_template_add_slot(&recorder, NULL,
+                                     LIGHTWEIGHT_JSON_SLOT_INT64, &tmpl);
+  lightweight_json_writer_end(&recorder);
+  lightweight_json_template_add_slot(&recorder, "tag",
+                                     LIGHTWEIGHT_JSON_SLOT_STRING, &tmpl);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_BUFFER_TOO_SMALL,
+            lightweight_json_template_add_slot(
+                &recorder, "x", LIGHTWEIGHT_JSON_SLOT_BOOL, &tmpl));
+  lightweight_json_writer_end(&recorder);
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_template_finish(&tmpl, &recorder));
+
+  lightweight_json_slot_value_t values[5];
+  values[0].u64 = std::numeric_limits<uint64_t>::max();
+  values[1].f64 = 21.5;
+  values[2].boolean = true;
+  values[3].i64 = std::numeric_limits<int64_t>::min();
+  values[4].string = "a\"b";
+
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_init(writer_buffer, sizeof(writer_buffer),
+                                         append, &result, &writer));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_add_template(&writer, NULL, &tmpl, values));
+  lightweight_json_writer_flush(&writer);
+  EXPECT_EQ("{\"type\":\"telemetry\",\"seq\":18446744073709551615,"
+            "\"temp\":21.50000000,\"status\":[true,-9223372036854775808],"
+            "\"tag\":\"a\\\"b\"}",
+            result);
+
+  // As values of an array
+  result.clear();
+  values[0].u64 = 0;
+  values[3].i64 = -7;
+  lightweight_json_writer_begin(&writer, NULL, LIGHTWEIGHT_JSON_ARRAY);
+  lightweight_json_writer_add_template(&writer, NULL, &tmpl, values);
+  values[0].u64 = 1;
+  values[2].boolean = false;
+  lightweight_json_writer_add_template(&writer, NULL, &tmpl, values);
+  lightweight_json_writer_end(&writer);
+  lightweight_json_writer_flush(&writer);
+  EXPECT_EQ("[{\"type\":\"telemetry\",\"seq\":0,\"temp\":21.50000000,"
+            "\"status\":[true,-7],\"tag\":\"a\\\"b\"},"
+            "{\"type\":\"telemetry\",\"seq\":1,\"temp\":21.50000000,"
+            "\"status\":[false,-7],\"tag\":\"a\\\"b\"}]",
+            result);
+
+  // Deeper than the embedded stack, recorded with a caller supplied one
+  lightweight_json_writer_level_t levels[21];
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_template_init(skeleton, sizeof(skeleton), slots,
+                                           5, levels, 21, &tmpl, &recorder));
+  for (int i = 0; i < 20; i++) {
+    ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_writer_begin(&recorder, NULL,
+                                            LIGHTWEIGHT_JSON_ARRAY));
+  }
+  lightweight_json_template_add_slot(&recorder, NULL,
+                                     LIGHTWEIGHT_JSON_SLOT_UINT64, &tmpl);
+  for (int i = 0; i < 20; i++) {
+    lightweight_json_writer_end(&recorder);
+  }
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_template_finish(&tmpl, &recorder));
+  result.clear();
+  lightweight_json_writer_add_template(&writer, NULL, &tmpl, values);
+  lightweight_json_writer_flush(&writer);
+  EXPECT_EQ(std::string(20, '[') + "1" + std::string(20, ']'), result);
+  // No room for the recorded object / array
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_ARGS,
+            lightweight_json_template_init(skeleton, sizeof(skeleton), slots,
+                                           5, levels, 1, &tmpl, &recorder));
+}
+
+TEST(LightWeightJson, DynamicWriter) {
+  lightweight_json_writer_ctx_t writer;
+  char fixed_buffer[32];
+  std::string expected;
+  char *result = NULL;
+  size_t len = 0;
+  auto append = [](char *buffer, size_t size, void *userdata) {
+    static_cast<std::string *>(userdata)->append(buffer, size);
+  };
+  auto emit = [](lightweight_json_writer_ctx_t *ctx) {
+    lightweight_json_writer_begin(ctx, NULL, LIGHTWEIGHT_JSON_ARRAY);
+    for (int i = 0; i < 500; i++) {
+      lightweight_json_writer_begin(ctx, NULL, LIGHTWEIGHT_JSON_OBJECT);
+      lightweight_json_writer_add_int64(ctx, "i", i);
+      lightweight_json_writer_add_string(ctx, "s", "some text");
+      lightweight_json_writer_end(ctx);
+    }
+    lightweight_json_writer_end(ctx);
+  };
+
+  lightweight_json_writer_init(fixed_buffer, sizeof(fixed_buffer), append,
+                               &expected, &writer);
+  emit(&writer);
+  lightweight_json_writer_flush(&writer);
+
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_init_dynamic(
+                2, NULL, NULL, NULL, LIGHTWEIGHT_JSON_MAX_NESTING_SIZE,
+                &writer));
+  emit(&writer);
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_take_buffer(&writer, true, &result, &len));
+  EXPECT_EQ(expected.size(), len);
+  EXPECT_STREQ(expected.c_str(), result);
+  free(result);
+
+  // Caller supplied stack, deeper than the embedded one
+  lightweight_json_writer_level_t levels[LIGHTWEIGHT_JSON_MAX_NESTING_SIZE * 2];
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_init_dynamic(2, NULL, NULL, levels,
+                                                 sizeof(levels) /
+                                                     sizeof(levels[0]),
+                                                 &writer));
+  for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+    ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_writer_begin(&writer, NULL,
+                                            LIGHTWEIGHT_JSON_ARRAY));
+  }
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_MAX_NESTING_REACHED,
+            lightweight_json_writer_begin(&writer, NULL,
+                                          LIGHTWEIGHT_JSON_ARRAY));
+  for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); i++) {
+    lightweight_json_writer_end(&writer);
+  }
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_take_buffer(&writer, false, &result, &len));
+  EXPECT_EQ(2 * sizeof(levels) / sizeof(levels[0]), len);
+  free(result);
+
+  // Bump allocator over a fixed arena which runs out
+  struct Arena {
+    char memory[4096];
+    size_t used;
+  } arena = {{0}, 0};
+  auto arena_realloc = [](void *ptr, size_t old_size, size_t new_size,
+                          void *userdata) -> void * {
+    Arena *arena = static_cast<Arena *>(userdata);
+    if (0 == new_size || arena->used + new_size > sizeof(arena->memory)) {
+      return NULL;
+    }
+    void *block = &arena->memory[arena->used];
+    arena->used += new_size;
+    if (NULL != ptr) {
+      memcpy(block, ptr, old_size < new_size ? old_size : new_size);
+    }
+    return block;
+  };
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_init_dynamic(
+                64, arena_realloc, &arena, NULL,
+                LIGHTWEIGHT_JSON_MAX_NESTING_SIZE, &writer));
+  lightweight_json_writer_begin(&writer, NULL, LIGHTWEIGHT_JSON_OBJECT);
+  lightweight_json_writer_add_string(&writer, "k", "v");
+  lightweight_json_writer_end(&writer);
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_take_buffer(&writer, false, &result, &len));
+  EXPECT_STREQ("{\"k\":\"v\"}", result);
+
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_init_dynamic(
+                64, arena_realloc, &arena, NULL,
+                LIGHTWEIGHT_JSON_MAX_NESTING_SIZE, &writer));
+  emit(&writer);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NO_MEM, lightweight_json_writer_flush(&writer));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NO_MEM,
+            lightweight_json_writer_take_buffer(&writer, false, &result, &len));
+}
+
+TEST(LightWeightJson, ReaderGetValue) {
+  const char *input = "{\"n\": null, \"t\": true, \"f\": false, \"u\": 42,"
+                      " \"i\": -9223372036854775808, \"d\": 2.5e-1,"
+                      " \"big\": 18446744073709551616, \"s\": \"a\\\\nb\","
+                      " \"o\": {\"x\": 1}, \"a\": [ 7 ]}";
+  lightweight_json_reader_ctx_t reader;
+  lightweight_json_value_t value;
+  lightweight_json_value_type_e type;
+  char buffer[8];
+  uint64_t u = 0;
+
+  for (uint32_t flags : {0u, (uint32_t)LIGHTWEIGHT_JSON_READER_FLAG_VALIDATE}) {
+    ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_init_ex(input, strlen(input), NULL,
+                                              LIGHTWEIGHT_JSON_MAX_NESTING_SIZE,
+                                              flags, &reader));
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_get_value(&reader, "n", &value));
+    EXPECT_EQ(LIGHTWEIGHT_JSON_VALUE_NULL, value.type);
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_get_value(&reader, "t", &value));
+    EXPECT_EQ(LIGHTWEIGHT_JSON_VALUE_BOOL, value.type);
+    EXPECT_TRUE(value.as.boolean);
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_get_value(&reader, "f", &value));
+    EXPECT_FALSE(value.as.boolean);
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_get_value(&reader, "u", &value));
+    EXPECT_EQ(LIGHTWEIGHT_JSON_VALUE_UINT64, value.type);
+    EXPECT_EQ(42, value.as.u64);
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_get_value(&reader, "i", &value));
+    EXPECT_EQ(LIGHTWEIGHT_JSON_VALUE_INT64, value.type);
+    EXPECT_EQ(std::numeric_limits<int64_t>::min(), value.as.i64);
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_get_value(&reader, "d", &value));
+    EXPECT_EQ(LIGHTWEIGHT_JSON_VALUE_DOUBLE, value.type);
+    EXPECT_DOUBLE_EQ(0.25, value.as.f64);
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_get_value(&reader, "big", &value));
+    EXPECT_EQ(LIGHTWEIGHT_JSON_VALUE_DOUBLE, value.type);
+    EXPECT_DOUBLE_EQ(18446744073709551616.0, value.as.f64);
+
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_get_value(&reader, "s", &value));
+    EXPECT_EQ(LIGHTWEIGHT_JSON_VALUE_STRING, value.type);
+    EXPECT_EQ("a\\\\nb", std::string(value.as.string.data,
+                                      value.as.string.len));
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_unescape(value.as.string.data,
+                                        value.as.string.len, buffer,
+                                        sizeof(buffer), NULL));
+    EXPECT_STREQ("a\\nb", buffer);
+
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_get_type(&reader, "a", &type));
+    EXPECT_EQ(LIGHTWEIGHT_JSON_VALUE_ARRAY, type);
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NOT_FOUND,
+              lightweight_json_reader_get_type(&reader, "missing", &type));
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_get_value(&reader, "o", &value));
+    EXPECT_EQ(LIGHTWEIGHT_JSON_VALUE_OBJECT, value.type);
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_enter_value(&reader, &value));
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_get_uint64(&reader, "x", &u));
+    EXPECT_EQ(1, u);
+    lightweight_json_reader_leave(&reader);
+
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_enter(&reader, "a"));
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_get_value(&reader, NULL, &value));
+    EXPECT_EQ(7, value.as.u64);
+  }
+}
+
+TEST(LightWeightJson, BinaryFormats) {
+  lightweight_json_writer_ctx_t writer;
+  char buffer[64];
+  std::string output;
+  auto append = [](char *buffer, size_t size, void *userdata) {
+    static_cast<std::string *>(userdata)->append(buffer, size);
+  };
+  auto emit = [](lightweight_json_writer_ctx_t *ctx, bool sized) {
+    if (sized) {
+      lightweight_json_writer_begin_sized(ctx, NULL, LIGHTWEIGHT_JSON_OBJECT,
+                                          7);
+    } else {
+      lightweight_json_writer_begin(ctx, NULL, LIGHTWEIGHT_JSON_OBJECT);
+    }
+    lightweight_json_writer_add_uint64(ctx, "a", 1);
+    lightweight_json_writer_add_int64(ctx, "b", -2);
+    lightweight_json_writer_add_string(ctx, "c", "hi");
+    lightweight_json_writer_add_bool(ctx, "d", true);
+    lightweight_json_writer_add_null(ctx, "e");
+    if (sized) {
+      lightweight_json_writer_begin_sized(ctx, "f", LIGHTWEIGHT_JSON_ARRAY, 1);
+    } else {
+      lightweight_json_writer_begin(ctx, "f", LIGHTWEIGHT_JSON_ARRAY);
+    }
+    lightweight_json_writer_add_double(ctx, NULL, 1.5);
+    lightweight_json_writer_end(ctx);
+    lightweight_json_writer_add_uint64(ctx, "g", 300);
+    return lightweight_json_writer_end(ctx);
+  };
+  const std::string double_bits("\x3f\xf8\x00\x00\x00\x00\x00\x00", 8);
+
+  // Same call sequence as JSON
+  lightweight_json_writer_init(buffer, sizeof(buffer), append, &output,
+                               &writer);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, emit(&writer, false));
+  lightweight_json_writer_flush(&writer);
+  EXPECT_EQ("{\"a\":1,\"b\":-2,\"c\":\"hi\",\"d\":true,\"e\":null,\"f\":[1."
+            "50000000],\"g\":300}",
+            output);
+
+  const std::string cbor = std::string("\xbf\x61\x61\x01\x61\x62\x21\x61\x63"
+                                       "\x62hi\x61\x64\xf5\x61\x65\xf6\x61\x66"
+                                       "\x9f\xfb") +
+                           double_bits + "\xff\x61\x67\x19\x01\x2c\xff";
+  // Streams through a buffer of any size
+  for (size_t size : {sizeof(buffer), (size_t)4}) {
+    output.clear();
+    lightweight_json_writer_init(buffer, size, append, &output, &writer);
+    ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_writer_set_format(&writer,
+                                                 LIGHTWEIGHT_JSON_FORMAT_CBOR));
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, emit(&writer, false));
+    lightweight_json_writer_flush(&writer);
+    EXPECT_EQ(cbor, output);
+  }
+
+  // The map32 / array32 counts get patched while in the buffer
+  output.clear();
+  lightweight_json_writer_init(buffer, sizeof(buffer), append, &output,
+                               &writer);
+  lightweight_json_writer_set_format(&writer, LIGHTWEIGHT_JSON_FORMAT_MSGPACK);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, emit(&writer, false));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, lightweight_json_writer_flush(&writer));
+  EXPECT_EQ(std::string("\xdf\x00\x00\x00\x07\xa1\x61\x01\xa1\x62\xfe\xa1\x63"
+                        "\xa2hi\xa1\x64\xc3\xa1\x65\xc0\xa1\x66\xdd\x00\x00\x00"
+                        "\x01\xcb",
+                        30) +
+                double_bits + "\xa1\x67\xcd\x01\x2c",
+            output);
+
+  // Flushed before the count was known
+  output.clear();
+  lightweight_json_writer_init(buffer, 4, append, &output, &writer);
+  lightweight_json_writer_set_format(&writer, LIGHTWEIGHT_JSON_FORMAT_MSGPACK);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_BUFFER_TOO_SMALL, emit(&writer, false));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_BUFFER_TOO_SMALL,
+            lightweight_json_writer_flush(&writer));
+
+  // Known sizes stream through any buffer and use the short headers
+  output.clear();
+  lightweight_json_writer_init(buffer, 4, append, &output, &writer);
+  lightweight_json_writer_set_format(&writer, LIGHTWEIGHT_JSON_FORMAT_MSGPACK);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, emit(&writer, true));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, lightweight_json_writer_flush(&writer));
+  EXPECT_EQ(std::string("\x87\xa1\x61\x01\xa1\x62\xfe\xa1\x63\xa2hi\xa1\x64\xc3"
+                        "\xa1\x65\xc0\xa1\x66\x91\xcb") +
+                double_bits + "\xa1\x67\xcd\x01\x2c",
+            output);
+
+  // Wide integers
+  output.clear();
+  lightweight_json_writer_init(buffer, sizeof(buffer), append, &output,
+                               &writer);
+  lightweight_json_writer_set_format(&writer, LIGHTWEIGHT_JSON_FORMAT_MSGPACK);
+  lightweight_json_writer_begin_sized(&writer, NULL, LIGHTWEIGHT_JSON_ARRAY, 3);
+  lightweight_json_writer_add_int64(&writer, NULL, INT64_MIN);
+  lightweight_json_writer_add_int64(&writer, NULL, -200);
+  lightweight_json_writer_add_uint64(&writer, NULL, UINT64_MAX);
+  // Announced 3, wrote 4
+  lightweight_json_writer_add_bool(&writer, NULL, false);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_STATE,
+            lightweight_json_writer_end(&writer));
+  lightweight_json_writer_flush(&writer);
+  EXPECT_EQ(std::string("\x93\xd3\x80\x00\x00\x00\x00\x00\x00\x00\xd1\xff\x38"
+                        "\xcf\xff\xff\xff\xff\xff\xff\xff\xff\xc2",
+                        23),
+            output);
+
+  // Too late to switch
+  lightweight_json_writer_init(buffer, sizeof(buffer), append, &output,
+                               &writer);
+  lightweight_json_writer_begin(&writer, NULL, LIGHTWEIGHT_JSON_OBJECT);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_STATE,
+            lightweight_json_writer_set_format(&writer,
+                                               LIGHTWEIGHT_JSON_FORMAT_CBOR));
+}
+
+TEST(LightWeightJson, BinaryReader) {
+  auto emit = [](lightweight_json_writer_ctx_t *ctx) {
+    lightweight_json_writer_begin(ctx, NULL, LIGHTWEIGHT_JSON_OBJECT);
+    lightweight_json_writer_begin(ctx, "skipped", LIGHTWEIGHT_JSON_ARRAY);
+    lightweight_json_writer_begin(ctx, NULL, LIGHTWEIGHT_JSON_OBJECT);
+    lightweight_json_writer_add_string(ctx, "name", "deep");
+    lightweight_json_writer_end(ctx);
+    lightweight_json_writer_end(ctx);
+    lightweight_json_writer_add_string(ctx, "name", "binary \"quoted\"");
+    lightweight_json_writer_add_uint64(ctx, "big", UINT64_MAX);
+    lightweight_json_writer_add_int64(ctx, "neg", -100000);
+    lightweight_json_writer_add_double(ctx, "pi", 3.14159);
+    lightweight_json_writer_add_bool(ctx, "flag", true);
+    lightweight_json_writer_add_null(ctx, "nothing");
+    lightweight_json_writer_begin(ctx, "list", LIGHTWEIGHT_JSON_ARRAY);
+    for (int i = 0; i < 3; i++) {
+      lightweight_json_writer_begin(ctx, NULL, LIGHTWEIGHT_JSON_OBJECT);
+      lightweight_json_writer_add_int64(ctx, "i", i);
+      lightweight_json_writer_end(ctx);
+    }
+    lightweight_json_writer_end(ctx);
+    lightweight_json_writer_begin(ctx, "empty", LIGHTWEIGHT_JSON_ARRAY);
+    lightweight_json_writer_end(ctx);
+    lightweight_json_writer_end(ctx);
+  };
+
+  for (lightweight_json_format_e format :
+       {LIGHTWEIGHT_JSON_FORMAT_CBOR, LIGHTWEIGHT_JSON_FORMAT_MSGPACK}) {
+    lightweight_json_writer_ctx_t writer;
+    char *encoded = NULL;
+    size_t len = 0;
+    lightweight_json_writer_init_dynamic(16, NULL, NULL, NULL,
+                                         LIGHTWEIGHT_JSON_MAX_NESTING_SIZE,
+                                         &writer);
+    lightweight_json_writer_set_format(&writer, format);
+    emit(&writer);
+    ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, lightweight_json_writer_take_buffer(
+                                             &writer, false, &encoded, &len));
+
+    lightweight_json_reader_ctx_t reader;
+    ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_init_format(
+                  encoded, len, format, NULL, LIGHTWEIGHT_JSON_MAX_NESTING_SIZE,
+                  &reader));
+    char text[32];
+    uint64_t u64 = 0;
+    int64_t i64 = 0;
+    double f64 = 0;
+    bool flag = false;
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_get_string(&reader, "name", text,
+                                                 sizeof(text)));
+    EXPECT_STREQ("binary \"quoted\"", text);
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_BUFFER_TOO_SMALL,
+              lightweight_json_reader_get_string(&reader, "name", text, 4));
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_get_uint64(&reader, "big", &u64));
+    EXPECT_EQ(UINT64_MAX, u64);
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_get_int64(&reader, "neg", &i64));
+    EXPECT_EQ(-100000, i64);
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE,
+              lightweight_json_reader_get_uint64(&reader, "neg", &u64));
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_get_double(&reader, "pi", &f64));
+    EXPECT_EQ(3.14159, f64);
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_get_bool(&reader, "flag", &flag));
+    EXPECT_TRUE(flag);
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE,
+              lightweight_json_reader_get_bool(&reader, "nothing", &flag));
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_key_exists(&reader, "nothing"));
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NOT_FOUND,
+              lightweight_json_reader_key_exists(&reader, "missing"));
+
+    // Arrays
+    ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_enter(&reader, "list"));
+    for (int i = 0; i < 3; i++) {
+      ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+                lightweight_json_reader_enter(&reader, NULL));
+      EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+                lightweight_json_reader_get_int64(&reader, "i", &i64));
+      EXPECT_EQ(i, i64);
+      lightweight_json_reader_leave(&reader);
+      EXPECT_EQ(i < 2 ? LIGHTWEIGHT_JSON_ERR_NONE
+                      : LIGHTWEIGHT_JSON_ERR_NOT_FOUND,
+                lightweight_json_reader_array_next(&reader));
+    }
+    lightweight_json_reader_leave(&reader);
+    ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_enter(&reader, "empty"));
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NOT_FOUND,
+              lightweight_json_reader_get_int64(&reader, NULL, &i64));
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NOT_FOUND,
+              lightweight_json_reader_array_next(&reader));
+    lightweight_json_reader_leave(&reader);
+
+    // Values of unknown type
+    lightweight_json_value_t value;
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_get_value(&reader, "nothing", &value));
+    EXPECT_EQ(LIGHTWEIGHT_JSON_VALUE_NULL, value.type);
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_get_value(&reader, "skipped", &value));
+    ASSERT_EQ(LIGHTWEIGHT_JSON_VALUE_ARRAY, value.type);
+    ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_enter_value(&reader, &value));
+    ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_enter(&reader, NULL));
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_get_string(&reader, "name", text,
+                                                 sizeof(text)));
+    EXPECT_STREQ("deep", text);
+
+    // Truncated input is caught while decoding
+    lightweight_json_reader_init_format(encoded, len / 2, format, NULL,
+                                        LIGHTWEIGHT_JSON_MAX_NESTING_SIZE,
+                                        &reader);
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_JSON,
+              lightweight_json_reader_get_bool(&reader, "flag", &flag));
+    free(encoded);
+  }
+
+  // Encodings the writer doesn't produce: a definite map, a tag, a half float
+  // and a byte string
+  const char cbor[] = "\xa3\x61\x74\xc1\x1a\x65\x53\xf1\x00\x61\x68\xf9\x3e\x00"
+                      "\x61\x62\x42\x01\x02";
+  lightweight_json_reader_ctx_t reader;
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_init_format(
+                cbor, sizeof(cbor) - 1, LIGHTWEIGHT_JSON_FORMAT_CBOR, NULL,
+                LIGHTWEIGHT_JSON_MAX_NESTING_SIZE, &reader));
+  uint64_t u64 = 0;
+  double f64 = 0;
+  char text[8];
+  size_t len = 0;
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_get_uint64(&reader, "t", &u64));
+  EXPECT_EQ(1700000000u, u64);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_get_double(&reader, "h", &f64));
+  EXPECT_EQ(1.5, f64);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_get_string_len(&reader, "b", text,
+                                                   sizeof(text), &len));
+  EXPECT_EQ(2u, len);
+
+  // Nested MessagePack ints and a bin8
+  const char msgpack[] = "\x83\xa1\x61\xd1\xff\x38\xa1\x62\xcd\x01\x2c\xa1\x63"
+                         "\xc4\x01\x7a";
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_init_format(
+                msgpack, sizeof(msgpack) - 1, LIGHTWEIGHT_JSON_FORMAT_MSGPACK,
+                NULL, LIGHTWEIGHT_JSON_MAX_NESTING_SIZE, &reader));
+  int64_t i64 = 0;
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_get_int64(&reader, "a", &i64));
+  EXPECT_EQ(-200, i64);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_get_int64(&reader, "b", &i64));
+  EXPECT_EQ(300, i64);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_get_string(&reader, "c", text,
+                                               sizeof(text)));
+  EXPECT_STREQ("z", text);
+
+  // The root has to be a map / array
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_ARGS,
+            lightweight_json_reader_init_format(
+                "\x01", 1, LIGHTWEIGHT_JSON_FORMAT_CBOR, NULL,
+                LIGHTWEIGHT_JSON_MAX_NESTING_SIZE, &reader));
+}
+
+TEST(LightWeightJson, Transcode) {
+  const char json[] = " {\"a\": [1, -2, 2.5, true, null], "
+                      "\"s\": \"x\\ny\\u00e9\", \"e\": {}} ";
+  const char cbor[] = "\xbf\x61\x61\x9f\x01\x21\xfb\x40\x04\x00\x00\x00\x00"
+                      "\x00\x00\xf5\xf6\xff\x61\x73\x65x\ny\xc3\xa9\x61\x65"
+                      "\xbf\xff\xff";
+
+  // JSON to CBOR through a buffer much smaller than the document
+  char small[8];
+  lightweight_json_writer_ctx_t writer;
+  compressed.clear();
+  lightweight_json_writer_init(small, sizeof(small), memory_sink, NULL,
+                               &writer);
+  lightweight_json_writer_set_format(&writer, LIGHTWEIGHT_JSON_FORMAT_CBOR);
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_transcode(&writer, NULL, json,
+                                              sizeof(json) - 1,
+                                              LIGHTWEIGHT_JSON_FORMAT_JSON));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, lightweight_json_writer_flush(&writer));
+  EXPECT_EQ(std::string(cbor, sizeof(cbor) - 1), compressed);
+
+  // And back, as the value of a key
+  char *out = NULL;
+  size_t len = 0;
+  lightweight_json_writer_init_dynamic(16, NULL, NULL, NULL,
+                                       LIGHTWEIGHT_JSON_MAX_NESTING_SIZE,
+                                       &writer);
+  lightweight_json_writer_begin(&writer, NULL, LIGHTWEIGHT_JSON_OBJECT);
+  lightweight_json_writer_add_uint64(&writer, "before", 1);
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_transcode(&writer, "doc", cbor,
+                                              sizeof(cbor) - 1,
+                                              LIGHTWEIGHT_JSON_FORMAT_CBOR));
+  lightweight_json_writer_add_double(&writer, "after", 1);
+  lightweight_json_writer_end(&writer);
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_take_buffer(&writer, true, &out, &len));
+  EXPECT_STREQ("{\"before\":1,\"doc\":{\"a\":[1,-2,2.5,true,null],"
+               "\"s\":\"x\\ny\xc3\xa9\",\"e\":{}},\"after\":1.00000000}",
+               out);
+  free(out);
+
+  // MessagePack round trip, scalars and full precision doubles
+  const char values[] = "[0.1, -0.05, 123.45, 1e300, 0.3333333333333333, "
+                        "-9223372036854775808, \"\\\"\", [[]]]";
+  lightweight_json_writer_init_dynamic(16, NULL, NULL, NULL,
+                                       LIGHTWEIGHT_JSON_MAX_NESTING_SIZE,
+                                       &writer);
+  lightweight_json_writer_set_format(&writer, LIGHTWEIGHT_JSON_FORMAT_MSGPACK);
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_transcode(&writer, NULL, values,
+                                              sizeof(values) - 1,
+                                              LIGHTWEIGHT_JSON_FORMAT_JSON));
+  char *msgpack = NULL;
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_take_buffer(&writer, false, &msgpack,
+                                                &len));
+  lightweight_json_writer_init_dynamic(16, NULL, NULL, NULL,
+                                       LIGHTWEIGHT_JSON_MAX_NESTING_SIZE,
+                                       &writer);
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_transcode(&writer, NULL, msgpack, len,
+                                              LIGHTWEIGHT_JSON_FORMAT_MSGPACK));
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_take_buffer(&writer, true, &out, &len));
+  EXPECT_STREQ("[0.1,-0.05,123.45,1e+300,0.33333333333333331,"
+               "-9223372036854775808,\"\\\"\",[[]]]",
+               out);
+  free(out);
+  free(msgpack);
+
+  // Broken input after the output started, the error sticks
+  compressed.clear();
+  lightweight_json_writer_init(small, sizeof(small), memory_sink, NULL,
+                               &writer);
+  lightweight_json_writer_begin(&writer, NULL, LIGHTWEIGHT_JSON_ARRAY);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_JSON,
+            lightweight_json_writer_transcode(&writer, NULL, "{\"a\":[1,}", 9,
+                                              LIGHTWEIGHT_JSON_FORMAT_JSON));
+  EXPECT_EQ(0, writer.nesting);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_JSON,
+            lightweight_json_writer_flush(&writer));
+
+  // Broken before anything went out, the context is fine
+  lightweight_json_writer_init(small, sizeof(small), memory_sink, NULL,
+                               &writer);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_STATE,
+            lightweight_json_writer_transcode(&writer, NULL, "1", 1,
+                                              LIGHTWEIGHT_JSON_FORMAT_JSON));
+  lightweight_json_writer_begin(&writer, NULL, LIGHTWEIGHT_JSON_ARRAY);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_JSON,
+            lightweight_json_writer_transcode(&writer, NULL, "1 2", 3,
+                                              LIGHTWEIGHT_JSON_FORMAT_JSON));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NOT_SUPPORTED,
+            lightweight_json_writer_transcode(&writer, NULL, "\xa1\x01\x02",
+                                              3, LIGHTWEIGHT_JSON_FORMAT_CBOR));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_JSON,
+            lightweight_json_writer_transcode(&writer, NULL, "\x82\x01", 2,
+                                              LIGHTWEIGHT_JSON_FORMAT_CBOR));
+}
+
+TEST(LightWeightJson, CppWrapper) {
+  using namespace lightweight_json::literals;
+
+  constexpr lightweight_json::key id = "id"_key;
+  static_assert(2 == id.size(), "key length is computed at compile time");
+
+  lightweight_json::writer writer(16);
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, writer.init_error());
+  {
+    auto root = writer.object();
+    ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, root.error());
+    writer.add(id, 42);
+    writer.add("neg", -7);
+    writer.add("pi", 3.25);
+    writer.add("ok", true);
+    writer.add("name", std::string("a\"b"));
+    // Keys don't have to be null terminated
+    writer.add(std::string_view("nullable", 4), "x");
+    writer.add_null("none");
+    auto list = writer.array("list");
+    writer.add(1u);
+    writer.add("two");
+  }
+  auto out = writer.take();
+  ASSERT_TRUE(out);
+  const std::string json(out->view());
+  EXPECT_EQ("{\"id\":42,\"neg\":-7,\"pi\":3.25,\"ok\":true,\"name\":\"a\\\"b\","
+            "\"null\":\"x\",\"none\":null,\"list\":[1,\"two\"]}",
+            json);
+
+  lightweight_json::reader reader(json);
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, reader.init_error());
+  EXPECT_EQ(42, reader.get<int>(id).value());
+  EXPECT_EQ(42u, *reader.get<uint8_t>("id"));
+  EXPECT_EQ(-7, *reader.get<int64_t>("neg"));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE,
+            reader.get<unsigned>("neg").error());
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE,
+            reader.get<int>("pi").error());
+  EXPECT_DOUBLE_EQ(3.25, *reader.get<double>("pi"));
+  EXPECT_DOUBLE_EQ(42.0, *reader.get<double>("id"));
+  EXPECT_TRUE(*reader.get<bool>("ok"));
+  EXPECT_EQ("a\\\"b", *reader.get<std::string_view>("name"));
+  EXPECT_EQ("a\"b", *reader.get<std::string>("name"));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NOT_FOUND, reader.get<int>("nope").error());
+  EXPECT_EQ(5, reader.get<int>("nope").value_or(5));
+  EXPECT_TRUE(reader.contains("none"));
+  EXPECT_FALSE(reader.contains("nope"));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_VALUE_NULL,
+            reader.get<lightweight_json_value_t>("none")->type);
+
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, reader.enter("list"));
+  EXPECT_EQ(1, *reader.get<int>());
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, reader.next());
+  EXPECT_EQ("two", *reader.get<std::string>());
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, reader.leave());
+
+  // Moving hands the buffer over, only one of them frees it
+  lightweight_json::writer cbor(16, LIGHTWEIGHT_JSON_FORMAT_CBOR);
+  {
+    auto root = cbor.array();
+    cbor.add(std::string("binary"));
+    cbor.add(-1.5f);
+  }
+  lightweight_json::writer moved(std::move(cbor));
+  auto encoded = moved.take();
+  ASSERT_TRUE(encoded);
+  lightweight_json::reader binary(encoded->view(),
+                                  LIGHTWEIGHT_JSON_FORMAT_CBOR);
+  EXPECT_EQ("binary", *binary.get<std::string>());
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, binary.next());
+  EXPECT_FLOAT_EQ(-1.5f, *binary.get<float>());
+
+  lightweight_json::reader broken(std::string_view("{\"a\":", 5),
+                                  LIGHTWEIGHT_JSON_FORMAT_JSON,
+                                  LIGHTWEIGHT_JSON_READER_FLAG_VALIDATE);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_JSON, broken.init_error());
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_JSON, broken.get<int>("a").error());
+
+  // A writer nobody took the buffer from frees it
+  lightweight_json::writer dropped(16);
+  dropped.object().error();
+}
+
+#ifdef LIGHTWEIGHT_JSON_HAVE_COROUTINES
+TEST(LightWeightJson, CppGenerator) {
+  const char json[] =
+      "{\"nums\":[1,2,3,4,5],\"empty\":[],\"mixed\":[1,\"x\",3],"
+      "\"objs\":[{\"id\":1},{\"id\":2}],\"after\":true}";
+  lightweight_json::reader reader(json);
+
+  // Every element exactly once, the last one isn't read again
+  std::vector<int> nums;
+  for (auto num : reader.items<int>("nums")) {
+    ASSERT_TRUE(num);
+    nums.push_back(*num);
+  }
+  EXPECT_EQ((std::vector<int>{1, 2, 3, 4, 5}), nums);
+  // Back in the root object
+  EXPECT_TRUE(*reader.get<bool>("after"));
+
+  int count = 0;
+  for (auto item : reader.items<int>("empty")) {
+    (void)item;
+    count++;
+  }
+  EXPECT_EQ(0, count);
+
+  // The error is yielded once and ends the sequence
+  std::vector<lightweight_json_err_t> errors;
+  for (auto item : reader.items<int>("mixed")) {
+    errors.push_back(item.error());
+  }
+  EXPECT_EQ((std::vector<lightweight_json_err_t>{
+                LIGHTWEIGHT_JSON_ERR_NONE,
+                LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE}),
+            errors);
+  for (auto item : reader.items<int>("missing")) {
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NOT_FOUND, item.error());
+  }
+
+  // Breaking out early still leaves the array
+  for (auto num : reader.items<int>("nums")) {
+    if (2 == *num) {
+      break;
+    }
+  }
+  EXPECT_TRUE(*reader.get<bool>("after"));
+
+  std::vector<int> ids;
+  for (auto &element : reader.elements("objs")) {
+    ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, element.enter());
+    ids.push_back(*element.get<int>("id"));
+    element.leave();
+  }
+  EXPECT_EQ((std::vector<int>{1, 2}), ids);
+  EXPECT_TRUE(*reader.get<bool>("after"));
+}
+#endif
+
+#include "lightweight_json_ndjson.h"
+#include <atomic>
+
+static void collect_line(char *buffer, size_t amount, void *userdata) {
+  static_cast<std::vector<std::string> *>(userdata)->emplace_back(buffer,
+                                                                  amount);
+}
+
+TEST(LightWeightJson, NdjsonRing) {
+  // Small enough to wrap around and fill up many times
+  alignas(8) static char ring_buffer[256];
+  std::vector<std::string> lines;
+  lightweight_json_ndjson_ring_t ring;
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_ndjson_ring_init(
+                ring_buffer, sizeof(ring_buffer), LIGHTWEIGHT_JSON_NDJSON_BLOCK,
+                [] { std::this_thread::yield(); }, collect_line, &lines,
+                &ring));
+
+  const int producers = 4;
+  const int records = 2000;
+  std::atomic<int> running{producers};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < producers; t++) {
+    threads.emplace_back([&ring, &running, t] {
+      char record_buffer[64];
+      lightweight_json_ndjson_record_t record;
+      lightweight_json_ndjson_record_init(&ring, record_buffer,
+                                          sizeof(record_buffer), NULL,
+                                          LIGHTWEIGHT_JSON_MAX_NESTING_SIZE,
+                                          &record);
+      for (int i = 0; i < records; i++) {
+        lightweight_json_writer_begin(&record.writer, NULL,
+                                      LIGHTWEIGHT_JSON_OBJECT);
+        lightweight_json_writer_add_int64(&record.writer, "t", t);
+        lightweight_json_writer_add_int64(&record.writer, "i", i);
+        // Varying lengths
+        lightweight_json_writer_add_string(&record.writer, "pad",
+                                           &"xxxxxxxxxxxx"[i % 13]);
+        lightweight_json_writer_end(&record.writer);
+        EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+                  lightweight_json_ndjson_commit(&record));
+      }
+      running--;
+    });
+  }
+  // The drain thread
+  while (running > 0) {
+    lightweight_json_ndjson_drain(&ring, NULL);
+  }
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  lightweight_json_ndjson_drain(&ring, NULL);
+
+  // Every record arrives as one whole line, in order per producer
+  ASSERT_EQ((size_t)(producers * records), lines.size());
+  std::vector<int64_t> next(producers, 0);
+  for (const std::string &line : lines) {
+    ASSERT_EQ('\n', line.back());
+    lightweight_json_reader_ctx_t reader;
+    ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_init_ex(
+                  line.data(), line.size(), NULL, 1,
+                  LIGHTWEIGHT_JSON_READER_FLAG_VALIDATE, &reader));
+    int64_t t = 0;
+    int64_t i = 0;
+    ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_get_int64(&reader, "t", &t));
+    ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_get_int64(&reader, "i", &i));
+    EXPECT_EQ(next[t]++, i);
+  }
+  uint64_t dropped = 1;
+  lightweight_json_ndjson_get_dropped(&ring, &dropped);
+  EXPECT_EQ(0u, dropped);
+}
+
+TEST(LightWeightJson, NdjsonDrop) {
+  alignas(8) static char ring_buffer[64];
+  std::vector<std::string> lines;
+  lightweight_json_ndjson_ring_t ring;
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_ARGS,
+            lightweight_json_ndjson_ring_init(
+                ring_buffer, 48, LIGHTWEIGHT_JSON_NDJSON_DROP, NULL,
+                collect_line, &lines, &ring));
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_ndjson_ring_init(
+                ring_buffer, sizeof(ring_buffer), LIGHTWEIGHT_JSON_NDJSON_DROP,
+                NULL, collect_line, &lines, &ring));
+
+  char record_buffer[128];
+  lightweight_json_ndjson_record_t record;
+  lightweight_json_ndjson_record_init(&ring, record_buffer,
+                                      sizeof(record_buffer), NULL,
+                                      LIGHTWEIGHT_JSON_MAX_NESTING_SIZE,
+                                      &record);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_STATE,
+            lightweight_json_ndjson_commit(&record));
+
+  // 8 byte header + 8 byte line "[12345]\n" per slot, 4 of them fit
+  for (int i = 0; i < 6; i++) {
+    lightweight_json_writer_begin(&record.writer, NULL, LIGHTWEIGHT_JSON_ARRAY);
+    lightweight_json_writer_add_int64(&record.writer, NULL, 12340 + i);
+    lightweight_json_writer_end(&record.writer);
+    EXPECT_EQ(i < 4 ? LIGHTWEIGHT_JSON_ERR_NONE : LIGHTWEIGHT_JSON_ERR_NO_MEM,
+              lightweight_json_ndjson_commit(&record));
+  }
+  uint64_t dropped = 0;
+  lightweight_json_ndjson_get_dropped(&ring, &dropped);
+  EXPECT_EQ(2u, dropped);
+  size_t drained = 0;
+  lightweight_json_ndjson_drain(&ring, &drained);
+  EXPECT_EQ(4u, drained);
+  EXPECT_EQ("[12343]\n", lines.back());
+
+  // Larger than the ring
+  lightweight_json_writer_begin(&record.writer, NULL, LIGHTWEIGHT_JSON_ARRAY);
+  lightweight_json_writer_add_string(
+      &record.writer, NULL,
+      "this one never fits into the ring, not even when it's empty");
+  lightweight_json_writer_end(&record.writer);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_BUFFER_TOO_SMALL,
+            lightweight_json_ndjson_commit(&record));
+
+  // Larger than the record buffer
+  char tiny[8];
+  lightweight_json_ndjson_record_init(&ring, tiny, sizeof(tiny), NULL,
+                                      LIGHTWEIGHT_JSON_MAX_NESTING_SIZE,
+                                      &record);
+  lightweight_json_writer_begin(&record.writer, NULL, LIGHTWEIGHT_JSON_ARRAY);
+  lightweight_json_writer_add_string(&record.writer, NULL, "too long");
+  lightweight_json_writer_end(&record.writer);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_BUFFER_TOO_SMALL,
+            lightweight_json_ndjson_commit(&record));
+
+  // The writer got reset, the next record works
+  lightweight_json_writer_begin(&record.writer, NULL, LIGHTWEIGHT_JSON_ARRAY);
+  lightweight_json_writer_end(&record.writer);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, lightweight_json_ndjson_commit(&record));
+  lightweight_json_ndjson_drain(&ring, &drained);
+  EXPECT_EQ(1u, drained);
+  EXPECT_EQ("[]\n", lines.back());
+}
+
+static std::string filtered(const char *json,
+                            const lightweight_json_filter_rule_t *rules,
+                            size_t rule_count,
+                            lightweight_json_err_t expected_err =
+                                LIGHTWEIGHT_JSON_ERR_NONE) {
+  char small[16];
+  compressed.clear();
+  lightweight_json_writer_ctx_t writer;
+  lightweight_json_writer_init(small, sizeof(small), memory_sink, NULL,
+                               &writer);
+  EXPECT_EQ(expected_err,
+            lightweight_json_writer_filter(&writer, NULL, json, strlen(json),
+                                           rules, rule_count));
+  lightweight_json_writer_flush(&writer);
+  return compressed;
+}
+
+TEST(LightWeightJson, Filter) {
+  const char *json =
+      "{\"user\": {\"name\": \"a\\\"b\", \"password\": \"hunter2\", "
+      "\"roles\": [\"x\", \"y\"]}, \"items\": [{\"id\": 1, \"token\": \"t1\"}, "
+      "{\"id\": 2.50, \"token\": \"t2\"}, 7], \"meta\": {\"n\": 1e3}}";
+
+  // No rules, the document is copied as it is
+  EXPECT_EQ(json, filtered(json, NULL, 0));
+
+  const lightweight_json_filter_rule_t redact[] = {
+      {LIGHTWEIGHT_JSON_FILTER_EXCLUDE, "user.password", NULL},
+      {LIGHTWEIGHT_JSON_FILTER_REPLACE, "items.token", "\"***\""},
+      {LIGHTWEIGHT_JSON_FILTER_EXCLUDE, "meta", NULL},
+  };
+  // Untouched members keep their spacing
+  EXPECT_EQ("{\"user\":{\"name\": \"a\\\"b\",\"roles\": [\"x\", \"y\"]},"
+            "\"items\":[{\"id\": 1,\"token\":\"***\"},{\"id\": 2.50,"
+            "\"token\":\"***\"},7]}",
+            filtered(json, redact, 3));
+
+  // Only what is on an include path, "*" matches any key
+  const lightweight_json_filter_rule_t project[] = {
+      {LIGHTWEIGHT_JSON_FILTER_INCLUDE, "user.*", NULL},
+      {LIGHTWEIGHT_JSON_FILTER_INCLUDE, "items.id", NULL},
+      {LIGHTWEIGHT_JSON_FILTER_EXCLUDE, "user.password", NULL},
+  };
+  EXPECT_EQ("{\"user\":{\"name\": \"a\\\"b\",\"roles\": [\"x\", \"y\"]},"
+            "\"items\":[{\"id\": 1},{\"id\": 2.50}]}",
+            filtered(json, project, 3));
+
+  // Inside of another value, objects rules could still match are rewritten
+  char small[16];
+  compressed.clear();
+  lightweight_json_writer_ctx_t writer;
+  lightweight_json_writer_init(small, sizeof(small), memory_sink, NULL,
+                               &writer);
+  lightweight_json_writer_begin(&writer, NULL, LIGHTWEIGHT_JSON_OBJECT);
+  lightweight_json_writer_add_bool(&writer, "ok", true);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_filter(&writer, "body", "[1, {\"a\": 2}]",
+                                           13, redact, 3));
+  lightweight_json_writer_end(&writer);
+  lightweight_json_writer_flush(&writer);
+  EXPECT_EQ("{\"ok\":true,\"body\":[1,{\"a\": 2}]}", compressed);
+
+  // A scalar no include rule reaches is left out
+  compressed.clear();
+  lightweight_json_writer_init(small, sizeof(small), memory_sink, NULL,
+                               &writer);
+  lightweight_json_writer_begin(&writer, NULL, LIGHTWEIGHT_JSON_ARRAY);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_filter(&writer, NULL, "7", 1, project, 3));
+  lightweight_json_writer_add_bool(&writer, NULL, true);
+  lightweight_json_writer_end(&writer);
+  lightweight_json_writer_flush(&writer);
+  EXPECT_EQ("[true]", compressed);
+
+  // Broken input, the error sticks once output started
+  filtered("{\"user\": {\"password\": 1", redact, 3,
+           LIGHTWEIGHT_JSON_ERR_INVALID_JSON);
+  filtered("{\"a\": 1} x", NULL, 0, LIGHTWEIGHT_JSON_ERR_INVALID_JSON);
+  filtered("1", NULL, 0, LIGHTWEIGHT_JSON_ERR_INVALID_STATE);
+  const lightweight_json_filter_rule_t broken[] = {
+      {LIGHTWEIGHT_JSON_FILTER_REPLACE, "a", NULL}};
+  filtered(json, broken, 1, LIGHTWEIGHT_JSON_ERR_INVALID_ARGS);
+}
+
+TEST(LightWeightJson, Minify) {
+  // Long enough for the vectorized path, with strings in between blocks
+  const std::string pretty =
+      "{\n"
+      "    \"name\": \"a b\\\"  c\\\\\",\n"
+      "    \"list\": [\n"
+      "        1,\t2,\r\n"
+      "        \"                 spaces kept                 \"\n"
+      "    ],\n"
+      "    \"nested\": {\n"
+      "                                        \"k\" : null\n"
+      "    }\n"
+      "}\n";
+  const std::string expected = "{\"name\":\"a b\\\"  c\\\\\",\"list\":[1,2,"
+                               "\"                 spaces kept           "
+                               "      \"],\"nested\":{\"k\":null}}";
+
+  std::vector<char> out(pretty.size());
+  size_t len = 0;
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_minify(pretty.data(), pretty.size(), out.data(),
+                                    out.size(), &len));
+  EXPECT_EQ(expected, std::string(out.data(), len));
+
+  // In place, then read
+  std::vector<char> buffer(pretty.begin(), pretty.end());
+  lightweight_json_reader_ctx_t reader;
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_init_minify(
+                buffer.data(), buffer.size(), NULL,
+                LIGHTWEIGHT_JSON_MAX_NESTING_SIZE,
+                LIGHTWEIGHT_JSON_READER_FLAG_VALIDATE, &reader));
+  EXPECT_EQ(expected.size(), reader.buffer_size);
+  EXPECT_EQ(expected, std::string(buffer.data(), expected.size()));
+  char name[16];
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_get_string(&reader, "name", name,
+                                               sizeof(name)));
+  EXPECT_STREQ("a b\"  c\\", name);
+
+  // Unterminated string, output too small
+  const char *broken = "{\"a\": \"b\\\"}";
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_JSON,
+            lightweight_json_minify(broken, strlen(broken), out.data(),
+                                    out.size(), &len));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_ARGS,
+            lightweight_json_minify(pretty.data(), pretty.size(), out.data(),
+                                    10, &len));
+}
+
+TEST(LightWeightJson, ReaderArrayAt) {
+  std::string json = "{\"empty\": [ ], \"items\": [";
+  for (int i = 0; i < 100; i++) {
+    json += (0 == i ? "" : ", ") + std::string("{\"id\": ") +
+            std::to_string(i) + ", \"tags\": [\"a\", [1, 2]]}";
+  }
+  json += "]}";
+
+  // Full table, a table too small for every element, no table; both reader
+  // modes
+  uint32_t entries[128];
+  const size_t capacities[] = {128, 7, 0};
+  for (uint32_t flags : {0u, (unsigned)LIGHTWEIGHT_JSON_READER_FLAG_VALIDATE}) {
+    for (size_t capacity : capacities) {
+      lightweight_json_reader_ctx_t ctx;
+      ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+                lightweight_json_reader_init_ex(
+                    json.data(), json.size(), NULL,
+                    LIGHTWEIGHT_JSON_MAX_NESTING_SIZE, flags, &ctx));
+      ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+                lightweight_json_reader_set_array_table(
+                    &ctx, 0 == capacity ? NULL : entries, capacity));
+      size_t length = 0;
+      EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_STATE,
+                lightweight_json_reader_array_length(&ctx, &length));
+
+      ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+                lightweight_json_reader_enter(&ctx, "empty"));
+      EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+                lightweight_json_reader_array_length(&ctx, &length));
+      EXPECT_EQ(0u, length);
+      EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NOT_FOUND,
+                lightweight_json_reader_array_at(&ctx, 0));
+      lightweight_json_reader_leave(&ctx);
+
+      ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+                lightweight_json_reader_enter(&ctx, "items"));
+      EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+                lightweight_json_reader_array_length(&ctx, &length));
+      EXPECT_EQ(100u, length);
+      // Scattered, backwards, and through nested arrays in between, which
+      // keeps the table of "items"
+      for (size_t index : {99, 0, 57, 13, 14, 98, 1}) {
+        ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+                  lightweight_json_reader_array_at(&ctx, index));
+        ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+                  lightweight_json_reader_enter(&ctx, NULL));
+        uint64_t id = 0;
+        EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+                  lightweight_json_reader_get_uint64(&ctx, "id", &id));
+        EXPECT_EQ(index, id);
+        ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+                  lightweight_json_reader_enter(&ctx, "tags"));
+        EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+                  lightweight_json_reader_array_length(&ctx, &length));
+        EXPECT_EQ(2u, length);
+        EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+                  lightweight_json_reader_array_at(&ctx, 1));
+        // Past the end, stays at element 1
+        EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NOT_FOUND,
+                  lightweight_json_reader_array_at(&ctx, 2));
+        ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+                  lightweight_json_reader_enter(&ctx, NULL));
+        uint64_t first = 0;
+        EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+                  lightweight_json_reader_get_uint64(&ctx, NULL, &first));
+        EXPECT_EQ(1u, first);
+        lightweight_json_reader_leave(&ctx);
+        lightweight_json_reader_leave(&ctx);
+        lightweight_json_reader_leave(&ctx);
+      }
+      EXPECT_EQ(100u, ctx.array_table.length);
+      EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NOT_FOUND,
+                lightweight_json_reader_array_at(&ctx, 100));
+      // array_next continues from the element
+      ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+                lightweight_json_reader_array_at(&ctx, 98));
+      EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+                lightweight_json_reader_array_next(&ctx));
+      EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NOT_FOUND,
+                lightweight_json_reader_array_next(&ctx));
+    }
+  }
+
+  // A truncated array
+  const char *broken = "[1, 2";
+  lightweight_json_reader_ctx_t ctx;
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_init(broken, strlen(broken), &ctx));
+  size_t length = 0;
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_JSON,
+            lightweight_json_reader_array_length(&ctx, &length));
+}
+
+TEST(LightWeightJson, Base64) {
+  std::vector<uint8_t> blob(1000);
+  for (size_t i = 0; i < blob.size(); i++) {
+    blob[i] = (uint8_t)(i * 7 + (i >> 3));
+  }
+
+  // Through a small flushing buffer, every length modulo 3
+  char small[16];
+  lightweight_json_writer_ctx_t writer;
+  compressed.clear();
+  lightweight_json_writer_init(small, sizeof(small), memory_sink, NULL,
+                               &writer);
+  lightweight_json_writer_begin(&writer, NULL, LIGHTWEIGHT_JSON_OBJECT);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_writer_add_base64(
+                &writer, "a", (const uint8_t *)"Man", 3));
+  lightweight_json_writer_add_base64(&writer, "b", (const uint8_t *)"Ma", 2);
+  lightweight_json_writer_add_base64(&writer, "c", (const uint8_t *)"M", 1);
+  lightweight_json_writer_add_base64(&writer, "d", NULL, 0);
+  lightweight_json_writer_add_base64(&writer, "blob", blob.data(),
+                                     blob.size());
+  lightweight_json_writer_end(&writer);
+  lightweight_json_writer_flush(&writer);
+  EXPECT_EQ(0u, compressed.find("{\"a\":\"TWFu\",\"b\":\"TWE=\",\"c\":\"TQ==\","
+                                "\"d\":\"\",\"blob\":\""));
+
+  lightweight_json_reader_ctx_t reader;
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_init(compressed.data(), compressed.size(),
+                                         &reader));
+  std::vector<uint8_t> decoded(blob.size());
+  size_t len = 0;
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_get_base64(&reader, "blob", decoded.data(),
+                                               decoded.size(), &len));
+  EXPECT_EQ(blob, decoded);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_BUFFER_TOO_SMALL,
+            lightweight_json_reader_get_base64(&reader, "blob", decoded.data(),
+                                               10, &len));
+  EXPECT_EQ(blob.size(), len);
+  uint8_t bytes[4];
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_get_base64(&reader, "b", bytes,
+                                               sizeof(bytes), &len));
+  EXPECT_EQ("Ma", std::string((char *)bytes, len));
+
+  // Unpadded, with escaped slashes, and broken
+  const char *json = "[\"TWE\", \"\\/\\/8\", \"TQ=\", \"T!==\", 1]";
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_init(json, strlen(json), &reader));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_get_base64(&reader, NULL, bytes,
+                                               sizeof(bytes), &len));
+  EXPECT_EQ("Ma", std::string((char *)bytes, len));
+  lightweight_json_reader_array_next(&reader);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_get_base64(&reader, NULL, bytes,
+                                               sizeof(bytes), &len));
+  EXPECT_EQ("\xff\xff", std::string((char *)bytes, len));
+  for (int i = 0; i < 3; i++) {
+    lightweight_json_reader_array_next(&reader);
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE,
+              lightweight_json_reader_get_base64(&reader, NULL, bytes,
+                                                 sizeof(bytes), &len));
+  }
+
+  // CBOR carries the bytes as they are
+  char cbor[64];
+  lightweight_json_writer_init(cbor, sizeof(cbor), memory_sink, NULL,
+                               &writer);
+  lightweight_json_writer_set_format(&writer, LIGHTWEIGHT_JSON_FORMAT_CBOR);
+  lightweight_json_writer_begin(&writer, NULL, LIGHTWEIGHT_JSON_OBJECT);
+  lightweight_json_writer_add_base64(&writer, "a", (const uint8_t *)"\x00\x01",
+                                     2);
+  lightweight_json_writer_end(&writer);
+  EXPECT_EQ(std::string("\xbf\x61\x61\x42\x00\x01\xff", 7),
+            std::string(writer.buffer, (size_t)writer.offset));
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_init_format(
+                writer.buffer, (size_t)writer.offset,
+                LIGHTWEIGHT_JSON_FORMAT_CBOR, NULL,
+                LIGHTWEIGHT_JSON_MAX_NESTING_SIZE, &reader));
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_get_base64(&reader, "a", bytes,
+                                               sizeof(bytes), &len));
+  EXPECT_EQ(std::string("\x00\x01", 2), std::string((char *)bytes, len));
+
+  // Tagged byte strings, {"a": 2(h'0001'), "b": 24(2(h'07'))}
+  const char tagged[] = "\xa2\x61\x61\xc2\x42\x00\x01\x61\x62\xd8\x18\xc2\x41"
+                        "\x07";
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_init_format(
+                tagged, sizeof(tagged) - 1, LIGHTWEIGHT_JSON_FORMAT_CBOR, NULL,
+                LIGHTWEIGHT_JSON_MAX_NESTING_SIZE, &reader));
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_get_base64(&reader, "a", bytes,
+                                               sizeof(bytes), &len));
+  EXPECT_EQ(std::string("\x00\x01", 2), std::string((char *)bytes, len));
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_reader_get_base64(&reader, "b", bytes,
+                                               sizeof(bytes), &len));
+  EXPECT_EQ("\x07", std::string((char *)bytes, len));
+}
+
+TEST(LightWeightJson, BatchParse) {
+  struct Message {
+    uint64_t id;
+    int64_t delta;
+    double temp;
+    bool ok;
+    char name[8];
+  };
+  const lightweight_json_batch_field_t fields[] = {
+      {"id", LIGHTWEIGHT_JSON_VALUE_UINT64, offsetof(Message, id), 0},
+      {"delta", LIGHTWEIGHT_JSON_VALUE_INT64, offsetof(Message, delta), 0},
+      {"temp", LIGHTWEIGHT_JSON_VALUE_DOUBLE, offsetof(Message, temp), 0},
+      {"ok", LIGHTWEIGHT_JSON_VALUE_BOOL, offsetof(Message, ok), 0},
+      {"name", LIGHTWEIGHT_JSON_VALUE_STRING, offsetof(Message, name),
+       sizeof(Message::name)},
+  };
+  lightweight_json_batch_spec_t spec;
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_batch_compile(fields, 5, &spec));
+
+  const char *const docs[] = {
+      // Everything, in another order, with members the spec skips
+      "{\"skip\": [1, {\"id\": 9}], \"name\": \"a\\tb\", \"ok\": true, "
+      "\"temp\": 21, \"delta\": -5, \"id\": 7}",
+      // Missing and mistyped fields, the first occurrence wins
+      "{\"id\": -1, \"delta\": 3, \"delta\": 4, \"ok\": null, "
+      "\"name\": \"too long!\", \"temp\": 1.5}",
+      // Malformed after the first field
+      "{\"id\": 1, \"delta\" 2}",
+      // Not an object
+      "[1]",
+      "{}",
+  };
+  std::vector<lightweight_json_batch_message_t> messages;
+  for (const char *doc : docs) {
+    messages.push_back({doc, strlen(doc)});
+  }
+  Message out[5] = {};
+  lightweight_json_batch_result_t results[5];
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_batch_parse(&spec, messages.data(), 5, out,
+                                         sizeof(Message), results));
+
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, results[0].err);
+  EXPECT_EQ(0x1Fu, results[0].found);
+  EXPECT_EQ(7u, out[0].id);
+  EXPECT_EQ(-5, out[0].delta);
+  EXPECT_EQ(21.0, out[0].temp);
+  EXPECT_TRUE(out[0].ok);
+  EXPECT_STREQ("a\tb", out[0].name);
+
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, results[1].err);
+  EXPECT_EQ(0x6u, results[1].found);
+  EXPECT_EQ(0u, out[1].id);
+  EXPECT_EQ(3, out[1].delta);
+  EXPECT_EQ(1.5, out[1].temp);
+  EXPECT_FALSE(out[1].ok);
+
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_JSON, results[2].err);
+  EXPECT_EQ(0x1u, results[2].found);
+  EXPECT_EQ(1u, out[2].id);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_JSON, results[3].err);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, results[4].err);
+  EXPECT_EQ(0u, results[4].found);
+
+  // Duplicate keys, unsupported types, strings without room
+  const lightweight_json_batch_field_t duplicate[] = {
+      {"id", LIGHTWEIGHT_JSON_VALUE_UINT64, 0, 0},
+      {"id", LIGHTWEIGHT_JSON_VALUE_INT64, 0, 0},
+  };
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_ARGS,
+            lightweight_json_batch_compile(duplicate, 2, &spec));
+  const lightweight_json_batch_field_t object = {
+      "o", LIGHTWEIGHT_JSON_VALUE_OBJECT, 0, 0};
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_ARGS,
+            lightweight_json_batch_compile(&object, 1, &spec));
+  const lightweight_json_batch_field_t empty = {
+      "s", LIGHTWEIGHT_JSON_VALUE_STRING, 0, 0};
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_ARGS,
+            lightweight_json_batch_compile(&empty, 1, &spec));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_ARGS,
+            lightweight_json_batch_compile(fields, 0, &spec));
+}
+
+TEST(LightWeightJson, SegmentReader) {
+  const std::string json =
+      "{\"name\": \"a\\\"b\\u00e9\\ud83d\\ude00c\", \"skip\": {\"id\": [1, "
+      "\"}\"]}, \"id\": -1234567, \"temp\": 2.5e1, \"ok\": false, "
+      "\"list\": [{\"v\": 1}, \"x\", [2], 18446744073709551615]}";
+  // Split at every position, plus an empty segment in between
+  for (size_t split = 0; split <= json.size(); split++) {
+    const lightweight_json_segment_t segments[] = {
+        {json.data(), split},
+        {NULL, 0},
+        {json.data() + split, json.size() - split},
+    };
+    lightweight_json_segment_reader_ctx_t ctx;
+    ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_segment_reader_init(segments, 3, NULL, 4,
+                                                   &ctx));
+    char name[16];
+    size_t len = 0;
+    ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_segment_reader_get_string(
+                  &ctx, "name", name, sizeof(name), &len))
+        << split;
+    EXPECT_EQ(std::string("a\"b\xc3\xa9\xf0\x9f\x98\x80" "c"),
+              std::string(name, len))
+        << split;
+    int64_t id = 0;
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_segment_reader_get_int64(&ctx, "id", &id));
+    EXPECT_EQ(-1234567, id) << split;
+    double temp = 0.0;
+    lightweight_json_segment_reader_get_double(&ctx, "temp", &temp);
+    EXPECT_EQ(25.0, temp) << split;
+    bool ok = true;
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_segment_reader_get_bool(&ctx, "ok", &ok));
+    EXPECT_FALSE(ok);
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NOT_FOUND,
+              lightweight_json_segment_reader_key_exists(&ctx, "v"));
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_DATATYPE,
+              lightweight_json_segment_reader_get_string(
+                  &ctx, "ok", name, sizeof(name), NULL));
+
+    ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_segment_reader_enter(&ctx, "list"));
+    uint64_t v = 0;
+    ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_segment_reader_enter(&ctx, NULL));
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_segment_reader_get_uint64(&ctx, "v", &v));
+    EXPECT_EQ(1u, v) << split;
+    lightweight_json_segment_reader_leave(&ctx);
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_segment_reader_array_next(&ctx));
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_segment_reader_get_string(&ctx, NULL, name,
+                                                         sizeof(name), NULL));
+    EXPECT_STREQ("x", name);
+    lightweight_json_segment_reader_array_next(&ctx);
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_segment_reader_array_next(&ctx));
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_segment_reader_get_uint64(&ctx, NULL, &v));
+    EXPECT_EQ(UINT64_MAX, v) << split;
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NOT_FOUND,
+              lightweight_json_segment_reader_array_next(&ctx));
+  }
+
+  // One byte per segment
+  std::vector<lightweight_json_segment_t> bytes;
+  for (const char &c : json) {
+    bytes.push_back({&c, 1});
+  }
+  lightweight_json_segment_reader_ctx_t ctx;
+  ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_segment_reader_init(bytes.data(), bytes.size(),
+                                                 NULL, 4, &ctx));
+  char name[16];
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_BUFFER_TOO_SMALL,
+            lightweight_json_segment_reader_get_string(&ctx, "name", name, 8,
+                                                       NULL));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+            lightweight_json_segment_reader_get_string(&ctx, "name", name,
+                                                       sizeof(name), NULL));
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NOT_FOUND,
+            lightweight_json_segment_reader_key_exists(&ctx, "missing"));
+
+  // Errors match the plain reader's
+  for (const char *doc : {"{}", "[]", "{\"a\": ", "{\"a\": .5}", "[\"s\"]"}) {
+    std::string copy = doc;
+    const lightweight_json_segment_t segment = {doc, copy.size()};
+    lightweight_json_reader_ctx_t plain;
+    ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_reader_init(&copy[0], copy.size(), &plain));
+    ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_segment_reader_init(&segment, 1, NULL, 4,
+                                                   &ctx));
+    const char *key = '{' == doc[0] && '}' != doc[1] ? "a" : NULL;
+    uint64_t v = 0;
+    EXPECT_EQ(lightweight_json_reader_get_uint64(&plain, key, &v),
+              lightweight_json_segment_reader_get_uint64(&ctx, key, &v))
+        << doc;
+    EXPECT_EQ(lightweight_json_reader_get_string(&plain, key, name,
+                                                 sizeof(name)),
+              lightweight_json_segment_reader_get_string(&ctx, key, name,
+                                                         sizeof(name), NULL))
+        << doc;
+    bool ok = false;
+    EXPECT_EQ(lightweight_json_reader_get_bool(&plain, key, &ok),
+              lightweight_json_segment_reader_get_bool(&ctx, key, &ok))
+        << doc;
+    EXPECT_EQ(lightweight_json_reader_enter(&plain, key),
+              lightweight_json_segment_reader_enter(&ctx, key))
+        << doc;
+  }
+
+  const lightweight_json_segment_t empty = {NULL, 0};
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_ARGS,
+            lightweight_json_segment_reader_init(&empty, 1, NULL, 4, &ctx));
+}
+
+TEST(LightWeightJson, CountingWriter) {
+  auto append = [](char *buffer, size_t size, void *userdata) {
+    static_cast<std::string *>(userdata)->append(buffer, size);
+  };
+  auto emit = [](lightweight_json_writer_ctx_t *ctx) {
+    static const double doubles[] = {
+        0.0,
+        -0.0,
+        1.5,
+        -2.25,
+        9.999999996,
+        0.99999999,
+        0.999999995,
+        -0.000000001,
+        1e14,
+        -123456789.125,
+        1e20,
+        -1e300,
+        std::numeric_limits<double>::infinity(),
+        std::numeric_limits<double>::quiet_NaN(),
+        0.1,
+    };
+    lightweight_json_writer_begin(ctx, NULL, LIGHTWEIGHT_JSON_OBJECT);
+    lightweight_json_writer_add_string(ctx, "text", "a \"quoted\"\n\\ line\r");
+    lightweight_json_writer_add_uint64(ctx, "max", UINT64_MAX);
+    lightweight_json_writer_add_int64(ctx, "min", INT64_MIN);
+    lightweight_json_writer_add_uint64(ctx, "zero", 0);
+    lightweight_json_writer_add_bool(ctx, "yes", true);
+    lightweight_json_writer_add_null(ctx, "none");
+    lightweight_json_writer_add_raw(ctx, "raw", "[1,2]", 5);
+    lightweight_json_writer_begin(ctx, "doubles", LIGHTWEIGHT_JSON_ARRAY);
+    for (double value : doubles) {
+      lightweight_json_writer_add_double(ctx, NULL, value);
+    }
+    for (int64_t i = -1000; i <= 1000; i += 7) {
+      lightweight_json_writer_add_int64(ctx, NULL, i * i * i);
+    }
+    lightweight_json_writer_end(ctx);
+    for (size_t len = 0; len < 6; len++) {
+      lightweight_json_writer_add_base64(ctx, "b", (const uint8_t *)"bytes!",
+                                         len);
+    }
+    lightweight_json_writer_end(ctx);
+  };
+
+  const lightweight_json_format_e formats[] = {LIGHTWEIGHT_JSON_FORMAT_JSON,
+                                               LIGHTWEIGHT_JSON_FORMAT_CBOR,
+                                               LIGHTWEIGHT_JSON_FORMAT_MSGPACK};
+  for (lightweight_json_format_e format : formats) {
+    std::string expected;
+    char buffer[256];
+    lightweight_json_writer_ctx_t writer;
+    lightweight_json_writer_init(buffer, sizeof(buffer), append, &expected,
+                                 &writer);
+    lightweight_json_writer_set_format(&writer, format);
+    emit(&writer);
+    lightweight_json_writer_flush(&writer);
+
+    ASSERT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_writer_init_counting(NULL, 4, &writer));
+    lightweight_json_writer_set_format(&writer, format);
+    emit(&writer);
+    // Flushing does nothing
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE, lightweight_json_writer_flush(&writer));
+    size_t size = 0;
+    EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_NONE,
+              lightweight_json_writer_get_counted_size(&writer, &size));
+    EXPECT_EQ(expected.size(), size) << format;
+  }
+
+  lightweight_json_writer_ctx_t writer;
+  size_t size = 0;
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_ARGS,
+            lightweight_json_writer_init_counting(
+                NULL, LIGHTWEIGHT_JSON_MAX_NESTING_SIZE + 1, &writer));
+  lightweight_json_writer_init_counting(NULL, 1, &writer);
+  lightweight_json_writer_begin(&writer, NULL, LIGHTWEIGHT_JSON_ARRAY);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_MAX_NESTING_REACHED,
+            lightweight_json_writer_begin(&writer, NULL,
+                                          LIGHTWEIGHT_JSON_ARRAY));
+  // Only once nothing was counted yet
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_STATE,
+            lightweight_json_writer_set_format(&writer,
+                                               LIGHTWEIGHT_JSON_FORMAT_CBOR));
+  char buffer[8];
+  lightweight_json_writer_init(buffer, sizeof(buffer), append, NULL, &writer);
+  EXPECT_EQ(LIGHTWEIGHT_JSON_ERR_INVALID_ARGS,
+            lightweight_json_writer_get_counted_size(&writer, &size));
+}